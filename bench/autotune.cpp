@@ -0,0 +1,533 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Driver pipeline and helpers shared with ml_compiler
+#include "driver/ModuleIO.h"
+#include "driver/OptimizationPipeline.h"
+#include "driver/SampleStats.h"
+#include "driver/TuningDatabase.h"
+
+// Kernel execution through the JIT
+#include "jit/JITKernel.h"
+#include "jit/KernelBuffers.h"
+#include "jit/KernelSpec.h"
+#include "jit/KernelTimer.h"
+
+// Parallel loop runtime the parallel tuning parameter calls into
+#include "runtime/ParallelRuntime.h"
+
+static llvm::cl::OptionCategory TuneCategory("autotune options");
+
+static llvm::cl::opt<std::string> InputFile(
+    llvm::cl::Positional, llvm::cl::desc("<ir-file>"), llvm::cl::Required,
+    llvm::cl::cat(TuneCategory));
+
+static llvm::cl::list<std::string> Specs(
+    "spec",
+    llvm::cl::desc("Kernel to tune and the shape of its arguments, e.g. "
+                   "matmul_2x2:A=4,B=4,C=4 (repeatable)"),
+    llvm::cl::value_desc("kernel:arg=value,..."), llvm::cl::OneOrMore,
+    llvm::cl::cat(TuneCategory));
+
+static llvm::cl::list<std::string> Params(
+    "param",
+    llvm::cl::desc("Values of a tuning parameter to search, e.g. "
+                   "unroll=default,2,4,8 (repeatable; default: every "
+                   "parameter)"),
+    llvm::cl::value_desc("name=value,..."), llvm::cl::cat(TuneCategory));
+
+static llvm::cl::opt<unsigned> Budget(
+    "budget", llvm::cl::desc("Configurations to evaluate per kernel"),
+    llvm::cl::init(32), llvm::cl::cat(TuneCategory));
+
+static llvm::cl::opt<unsigned> InitialSamples(
+    "initial",
+    llvm::cl::desc("Random configurations to evaluate before the search "
+                   "follows the model (default: half the budget)"),
+    llvm::cl::init(0), llvm::cl::cat(TuneCategory));
+
+static llvm::cl::opt<unsigned> Jobs(
+    "jobs", llvm::cl::desc("Configurations compiled in parallel (default: "
+                           "one per core)"),
+    llvm::cl::init(0), llvm::cl::cat(TuneCategory));
+
+static llvm::cl::opt<unsigned> Seed(
+    "seed", llvm::cl::desc("Seed of the random sampling"), llvm::cl::init(1),
+    llvm::cl::cat(TuneCategory));
+
+static llvm::cl::opt<std::string> DatabaseFile(
+    "db",
+    llvm::cl::desc("Tuning database to store the best configuration of every "
+                   "kernel in, for ml_compiler --tuning-db"),
+    llvm::cl::value_desc("filename"), llvm::cl::cat(TuneCategory));
+
+static llvm::cl::opt<unsigned> Repetitions(
+    "repetitions", llvm::cl::desc("Timed samples per configuration"),
+    llvm::cl::init(5), llvm::cl::cat(TuneCategory));
+
+static llvm::cl::opt<double> MinSampleTime(
+    "min-sample-ms",
+    llvm::cl::desc("Repeat the kernel until one sample takes this long"),
+    llvm::cl::init(20.0), llvm::cl::cat(TuneCategory));
+
+static llvm::cl::opt<double> RelTolerance(
+    "rtol", llvm::cl::desc("Relative tolerance of the output check"),
+    llvm::cl::init(1e-4), llvm::cl::cat(TuneCategory));
+
+static llvm::cl::opt<double> AbsTolerance(
+    "atol", llvm::cl::desc("Absolute tolerance of the output check"),
+    llvm::cl::init(1e-6), llvm::cl::cat(TuneCategory));
+
+static llvm::cl::opt<unsigned> ShowTop(
+    "show", llvm::cl::desc("Configurations listed per kernel"),
+    llvm::cl::init(10), llvm::cl::cat(TuneCategory));
+
+// A parameter and the values the search tries; "default" leaves it unset
+struct SearchParam {
+    std::string Name;
+    std::vector<std::string> Values;
+};
+
+// A point of the search space, as one value index per parameter
+using Choice = std::vector<unsigned>;
+
+struct Candidate {
+    mlcompileropt::TuningConfig Config;
+
+    // Point of the search space, empty for configurations from elsewhere
+    Choice Point;
+
+    // Median time per call in microseconds; infinite if the configuration
+    // failed to compile or computed a different result
+    double Time = std::numeric_limits<double>::infinity();
+    std::string Failure;
+};
+
+static void reportError(llvm::Error E) {
+    llvm::logAllUnhandledErrors(std::move(E), llvm::errs(), "error: ");
+}
+
+static std::vector<SearchParam> getDefaultSpace() {
+    return {{"interchange", {"default", "always", "never"}},
+            {"unroll", {"default", "1", "2", "4", "8"}},
+            {"vectorize-width", {"default", "1", "4", "8"}},
+            {"merge-width", {"default", "128"}},
+            {"tile", {"default", "1", "16", "32", "64"}},
+            {"prefetch", {"default", "4", "16", "64"}}};
+}
+
+static llvm::Expected<mlcompileropt::TuningConfig>
+getConfig(const std::vector<SearchParam> &Space, const Choice &Point) {
+    mlcompileropt::TuningConfig Config;
+    for (size_t P = 0; P < Space.size(); ++P) {
+        const std::string &Value = Space[P].Values[Point[P]];
+        if (Value == "default")
+            continue;
+        if (llvm::Error E = Config.set(Space[P].Name, Value))
+            return std::move(E);
+    }
+    return Config;
+}
+
+// Attaches Config to the kernel of Input, optimizes the module with O3
+// and the memory coalescing pass, unless Optimize is false, and compiles
+// it for the host
+static llvm::Expected<std::unique_ptr<mlcompileropt::JITKernel>>
+compileVariant(const llvm::MemoryBuffer &Input, llvm::StringRef Kernel,
+               const mlcompileropt::TuningConfig &Config, bool Optimize) {
+    return mlcompileropt::compileKernelModule(
+        Input.getMemBufferRef(), Kernel, [&](llvm::Module &Module) {
+            Config.attachTo(*Module.getFunction(Kernel));
+            if (Optimize) {
+                mlcompileropt::OptimizationPipeline Pipeline(/*UseCustomPasses=*/true);
+                Pipeline.run(Module);
+            }
+        });
+}
+
+// Median time per call of Kernel in microseconds, measured like
+// bench_runtime measures it
+static double medianTime(const mlcompileropt::JITKernel &Kernel,
+                         mlcompileropt::KernelBuffers &Buffers) {
+    mlcompileropt::KernelTimingOptions Options;
+    Options.Repetitions = Repetitions;
+    Options.MinSampleTime = MinSampleTime;
+    mlcompileropt::KernelTiming Timing = mlcompileropt::timeKernel(Kernel, Buffers, Options);
+    return mlcompileropt::summarizeSamples(Timing.Samples).Median;
+}
+
+// Compiles the candidates on --jobs threads, then checks and times them
+// one at a time so that the measurements do not compete for the cores
+static void evaluate(std::vector<Candidate *> &Batch, const llvm::MemoryBuffer &Input,
+                     llvm::StringRef Kernel, mlcompileropt::KernelBuffers &Buffers,
+                     const mlcompileropt::KernelBuffers &Reference, unsigned NumThreads) {
+    std::vector<std::unique_ptr<mlcompileropt::JITKernel>> Compiled(Batch.size());
+    std::atomic<unsigned> Next(0);
+    auto Worker = [&] {
+        for (unsigned I = Next++; I < Batch.size(); I = Next++) {
+            auto KernelOrErr = compileVariant(Input, Kernel, Batch[I]->Config,
+                                              /*Optimize=*/true);
+            if (KernelOrErr)
+                Compiled[I] = std::move(*KernelOrErr);
+            else
+                Batch[I]->Failure = llvm::toString(KernelOrErr.takeError());
+        }
+    };
+    std::vector<std::thread> Threads;
+    for (unsigned T = 1; T < std::min<size_t>(NumThreads, Batch.size()); ++T)
+        Threads.emplace_back(Worker);
+    Worker();
+    for (std::thread &T : Threads)
+        T.join();
+
+    for (size_t I = 0; I < Batch.size(); ++I) {
+        if (!Compiled[I])
+            continue;
+        mlcompileropt::KernelBuffers Run = Buffers.clone();
+        Compiled[I]->run(Run.getArgumentArray(), 1);
+        Batch[I]->Failure = Run.compare(Reference, RelTolerance, AbsTolerance);
+        if (Batch[I]->Failure.empty())
+            Batch[I]->Time = medianTime(*Compiled[I], Run);
+    }
+}
+
+// Predicts log time as the mean over the evaluated points plus one effect
+// per parameter value: the mean deviation of the points that use it.
+// Values not seen yet get the best effect of their parameter, so that the
+// search tries them.
+class AdditiveModel {
+public:
+    AdditiveModel(const std::vector<SearchParam> &Space,
+                  const std::vector<Candidate> &Evaluated) {
+        double Sum = 0.0;
+        unsigned N = 0;
+        for (const Candidate &C : Evaluated)
+            if (!C.Point.empty() && std::isfinite(C.Time)) {
+                Sum += std::log(C.Time);
+                ++N;
+            }
+        Mean = N ? Sum / N : 0.0;
+
+        Effects.resize(Space.size());
+        for (size_t P = 0; P < Space.size(); ++P) {
+            std::vector<double> EffectSum(Space[P].Values.size(), 0.0);
+            std::vector<unsigned> Count(Space[P].Values.size(), 0);
+            for (const Candidate &C : Evaluated) {
+                if (C.Point.empty())
+                    continue;
+                // Failed configurations count as much slower than any other
+                double Y = std::isfinite(C.Time) ? std::log(C.Time) : Mean + 10.0;
+                EffectSum[C.Point[P]] += Y - Mean;
+                ++Count[C.Point[P]];
+            }
+            double Best = 0.0;
+            for (size_t V = 0; V < Count.size(); ++V)
+                if (Count[V])
+                    Best = std::min(Best, EffectSum[V] / Count[V]);
+            for (size_t V = 0; V < Count.size(); ++V)
+                Effects[P].push_back(Count[V] ? EffectSum[V] / Count[V] : Best);
+        }
+    }
+
+    double predict(const Choice &Point) const {
+        double Y = Mean;
+        for (size_t P = 0; P < Point.size(); ++P)
+            Y += Effects[P][Point[P]];
+        return Y;
+    }
+
+private:
+    double Mean;
+    std::vector<std::vector<double>> Effects;
+};
+
+// Tunes one kernel and returns the evaluated candidates, best first
+static bool tuneKernel(const llvm::MemoryBuffer &Input, const mlcompileropt::KernelSpec &Spec,
+                       const std::vector<SearchParam> &Space,
+                       const mlcompileropt::TuningDatabase &DB,
+                       std::string &Signature, std::vector<Candidate> &Evaluated) {
+    // The signature and the argument layout come from the unoptimized kernel
+    llvm::LLVMContext Context;
+    llvm::SMDiagnostic Err;
+    std::unique_ptr<llvm::Module> Module =
+        mlcompileropt::parseModule(Input.getMemBufferRef(), Context, Err);
+    if (!Module) {
+        Err.print("autotune", llvm::errs());
+        return false;
+    }
+    llvm::Function *F = Module->getFunction(Spec.Function);
+    if (!F || F->isDeclaration()) {
+        llvm::errs() << "error: " << InputFile << " does not define @" << Spec.Function << "\n";
+        return false;
+    }
+    Signature = mlcompileropt::getKernelSignature(*F);
+    auto BuffersOrErr = mlcompileropt::KernelBuffers::create(*F, Spec);
+    if (!BuffersOrErr) {
+        reportError(BuffersOrErr.takeError());
+        return false;
+    }
+    mlcompileropt::KernelBuffers &Buffers = *BuffersOrErr;
+
+    // Every configuration must compute what the unoptimized kernel computes
+    auto OriginalOrErr = compileVariant(Input, Spec.Function, mlcompileropt::TuningConfig(),
+                                        /*Optimize=*/false);
+    if (!OriginalOrErr) {
+        reportError(OriginalOrErr.takeError());
+        return false;
+    }
+    mlcompileropt::KernelBuffers Reference = Buffers.clone();
+    (*OriginalOrErr)->run(Reference.getArgumentArray(), 1);
+
+    uint64_t SpaceSize = 1;
+    for (const SearchParam &P : Space)
+        SpaceSize = std::min<uint64_t>(SpaceSize * P.Values.size(), uint64_t(1) << 32);
+
+    std::map<std::string, size_t> Seen;
+    std::vector<Candidate> Pending;
+    auto Propose = [&](Candidate C) {
+        if (Seen.emplace(C.Config.toString(), Evaluated.size() + Pending.size()).second)
+            Pending.push_back(std::move(C));
+    };
+    auto ProposePoint = [&](const Choice &Point) {
+        auto ConfigOrErr = getConfig(Space, Point);
+        if (!ConfigOrErr) {
+            llvm::consumeError(ConfigOrErr.takeError());
+            return;
+        }
+        Candidate C;
+        C.Config = *ConfigOrErr;
+        C.Point = Point;
+        Propose(std::move(C));
+    };
+    unsigned NumThreads = Jobs ? Jobs : std::max(1u, std::thread::hardware_concurrency());
+    auto Flush = [&] {
+        std::vector<Candidate *> Batch;
+        for (Candidate &C : Pending)
+            Batch.push_back(&C);
+        evaluate(Batch, Input, Spec.Function, Buffers, Reference, NumThreads);
+        for (Candidate &C : Pending)
+            Evaluated.push_back(std::move(C));
+        Pending.clear();
+    };
+
+    // The default configuration is the baseline, and the stored one must
+    // be beaten to be replaced
+    ProposePoint(Choice(Space.size(), 0));
+    if (const mlcompileropt::TuningDatabase::Entry *E = DB.lookup(Signature)) {
+        Candidate C;
+        C.Config = E->Config;
+        Propose(std::move(C));
+    }
+
+    // Random sampling, deterministic for a given --seed
+    std::mt19937_64 Random(Seed);
+    auto RandomPoint = [&] {
+        Choice Point;
+        for (const SearchParam &P : Space)
+            Point.push_back(std::uniform_int_distribution<unsigned>(
+                0, P.Values.size() - 1)(Random));
+        return Point;
+    };
+    unsigned Initial = InitialSamples ? unsigned(InitialSamples) : std::max(1u, Budget / 2);
+    Initial = std::min<uint64_t>({Initial, Budget, SpaceSize});
+    for (unsigned Attempts = 0; Pending.size() + Evaluated.size() < Initial &&
+                                Attempts < 64 * Budget; ++Attempts) {
+        ProposePoint(RandomPoint());
+        if (Pending.size() >= NumThreads)
+            Flush();
+    }
+    Flush();
+
+    // Model-guided rounds: evaluate the unevaluated points the model
+    // predicts to be fastest, one batch per round
+    const uint64_t MaxEnumerated = 4096;
+    while (Evaluated.size() < Budget && Seen.size() < SpaceSize + 1) {
+        AdditiveModel Model(Space, Evaluated);
+        std::vector<std::pair<double, Choice>> Ranked;
+        auto Consider = [&](const Choice &Point) {
+            auto ConfigOrErr = getConfig(Space, Point);
+            if (!ConfigOrErr) {
+                llvm::consumeError(ConfigOrErr.takeError());
+                return;
+            }
+            if (!Seen.count(ConfigOrErr->toString()))
+                Ranked.push_back({Model.predict(Point), Point});
+        };
+        if (SpaceSize <= MaxEnumerated) {
+            for (uint64_t Index = 0; Index < SpaceSize; ++Index) {
+                Choice Point;
+                uint64_t Rest = Index;
+                for (const SearchParam &P : Space) {
+                    Point.push_back(Rest % P.Values.size());
+                    Rest /= P.Values.size();
+                }
+                Consider(Point);
+            }
+        } else {
+            for (uint64_t I = 0; I < MaxEnumerated; ++I)
+                Consider(RandomPoint());
+        }
+        if (Ranked.empty())
+            break;
+        std::stable_sort(Ranked.begin(), Ranked.end(),
+                         [](const std::pair<double, Choice> &A,
+                            const std::pair<double, Choice> &B) { return A.first < B.first; });
+        size_t Round = std::min<size_t>({Ranked.size(), size_t(NumThreads),
+                                         size_t(Budget - Evaluated.size())});
+        for (size_t I = 0; I < Round; ++I)
+            ProposePoint(Ranked[I].second);
+        Flush();
+    }
+
+    std::stable_sort(Evaluated.begin(), Evaluated.end(),
+                     [](const Candidate &A, const Candidate &B) { return A.Time < B.Time; });
+    return true;
+}
+
+static bool parseSpace(std::vector<SearchParam> &Space) {
+    if (Params.empty()) {
+        Space = getDefaultSpace();
+        return true;
+    }
+    for (const std::string &Text : Params) {
+        std::pair<llvm::StringRef, llvm::StringRef> NameValues = llvm::StringRef(Text).split('=');
+        SearchParam P;
+        P.Name = NameValues.first.str();
+        llvm::SmallVector<llvm::StringRef, 8> Values;
+        NameValues.second.split(Values, ',', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+        for (llvm::StringRef V : Values) {
+            mlcompileropt::TuningConfig Check;
+            if (V != "default")
+                if (llvm::Error E = Check.set(P.Name, V)) {
+                    reportError(std::move(E));
+                    return false;
+                }
+            P.Values.push_back(V.str());
+        }
+        if (P.Values.empty()) {
+            llvm::errs() << "error: --param " << Text << " has no values\n";
+            return false;
+        }
+        Space.push_back(std::move(P));
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::HideUnrelatedOptions(TuneCategory);
+    llvm::cl::ParseCommandLineOptions(argc, argv,
+                                      "ML Compiler Optimization Framework - Autotuner\n");
+    if (Repetitions == 0 || Budget == 0) {
+        llvm::errs() << "--repetitions and --budget must be at least 1\n";
+        return 1;
+    }
+
+    std::vector<SearchParam> Space;
+    if (!parseSpace(Space))
+        return 1;
+
+    std::vector<mlcompileropt::KernelSpec> KernelSpecs;
+    for (const std::string &Text : Specs) {
+        auto SpecOrErr = mlcompileropt::parseKernelSpec(Text);
+        if (!SpecOrErr) {
+            reportError(SpecOrErr.takeError());
+            return 1;
+        }
+        KernelSpecs.push_back(std::move(*SpecOrErr));
+    }
+
+    mlcompileropt::TuningDatabase DB;
+    if (!DatabaseFile.empty()) {
+        auto DBOrErr = mlcompileropt::TuningDatabase::load(DatabaseFile);
+        if (!DBOrErr) {
+            reportError(DBOrErr.takeError());
+            return 1;
+        }
+        DB = std::move(*DBOrErr);
+    }
+
+    auto BufferOrErr = llvm::MemoryBuffer::getFile(InputFile);
+    if (!BufferOrErr) {
+        llvm::errs() << "Error loading file: " << InputFile << ": "
+                     << BufferOrErr.getError().message() << "\n";
+        return 1;
+    }
+
+    std::cout << "ML Compiler Optimization Framework - Autotuner\n";
+    std::cout << "==============================================\n";
+    std::cout << "Up to " << Budget << " configurations per kernel, "
+              << Repetitions << " timed samples of at least " << MinSampleTime << " ms each\n";
+    std::cout << "Parallel loop threads: " << __ml_get_num_threads() << "\n";
+
+    bool Failed = false;
+    for (const mlcompileropt::KernelSpec &Spec : KernelSpecs) {
+        std::string Signature;
+        std::vector<Candidate> Evaluated;
+        if (!tuneKernel(**BufferOrErr, Spec, Space, DB, Signature, Evaluated)) {
+            Failed = true;
+            continue;
+        }
+
+        double DefaultTime = 0.0;
+        for (const Candidate &C : Evaluated)
+            if (C.Config.isDefault())
+                DefaultTime = C.Time;
+
+        std::cout << "\n" << Signature << ": " << Evaluated.size() << " configurations\n";
+        std::cout << std::right << std::setw(14) << "time (us)"
+                  << std::setw(10) << "speedup" << "  config\n";
+        std::cout << std::string(80, '-') << "\n";
+        for (size_t I = 0; I < Evaluated.size() && I < ShowTop; ++I) {
+            const Candidate &C = Evaluated[I];
+            if (!std::isfinite(C.Time))
+                break;
+            std::cout << std::fixed << std::setprecision(4) << std::setw(14) << C.Time
+                      << std::setprecision(2) << std::setw(9) << DefaultTime / C.Time << "x"
+                      << "  " << C.Config.toString() << "\n";
+        }
+        for (const Candidate &C : Evaluated)
+            if (!C.Failure.empty())
+                std::cout << "  failed: " << C.Config.toString() << ": " << C.Failure << "\n";
+
+        const Candidate &Best = Evaluated.front();
+        if (!std::isfinite(Best.Time)) {
+            llvm::errs() << "error: no configuration of @" << Spec.Function << " works\n";
+            Failed = true;
+            continue;
+        }
+        mlcompileropt::TuningDatabase::Entry E;
+        E.Config = Best.Config;
+        E.Time = Best.Time;
+        DB.insert(Signature, E);
+    }
+
+    if (!DatabaseFile.empty()) {
+        if (llvm::Error E = DB.save(DatabaseFile)) {
+            reportError(std::move(E));
+            return 1;
+        }
+        std::cout << "\nWrote " << DB.size() << " entries to " << DatabaseFile << "\n";
+    }
+    return Failed ? 1 : 0;
+}
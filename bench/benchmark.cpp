@@ -5,131 +5,656 @@
 #include <string>
 #include <memory>
 #include <iomanip>
+#include <sstream>
 
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
-#include "llvm/IRReader/IRReader.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_ostream.h"
-#include "llvm/Support/FileSystem.h"
-#include "llvm/Passes/PassBuilder.h"
-#include "llvm/Analysis/LoopAnalysisManager.h"
-#include "llvm/Analysis/CGSCCPassManager.h"
-#include "llvm/Passes/OptimizationLevel.h"
 
-// Include our custom passes
+// Driver pipeline and helpers shared with ml_compiler
+#include "driver/CodeGenerator.h"
+#include "driver/ModuleIO.h"
+#include "driver/OptimizationPipeline.h"
+#include "driver/PassProfiler.h"
+#include "driver/SampleStats.h"
+#include "passes/LoopFusion.h"
+#include "passes/LoopParallelization.h"
+#include "passes/LoopTiling.h"
 #include "passes/MemoryCoalescing.h"
+#include "passes/ReductionVectorization.h"
+#include "passes/SoftwarePrefetch.h"
+
+#ifndef ML_COMPILER_VERSION
+#define ML_COMPILER_VERSION "unknown"
+#endif
+
+static llvm::cl::OptionCategory BenchCategory("bench_optimizer options");
+
+static llvm::cl::list<std::string> InputFiles(
+    llvm::cl::Positional, llvm::cl::desc("<ir-file> [<ir-file> ...]"),
+    llvm::cl::OneOrMore, llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> Warmup(
+    "warmup", llvm::cl::desc("Untimed runs per file and configuration"),
+    llvm::cl::init(2), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> Repetitions(
+    "repetitions", llvm::cl::desc("Timed runs per file and configuration"),
+    llvm::cl::init(10), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<mlcompileropt::OutputFormat> Emit(
+    "emit", llvm::cl::desc("Format produced by the emit phase"),
+    llvm::cl::values(
+        clEnumValN(mlcompileropt::OutputFormat::Text, "ll", "Textual IR"),
+        clEnumValN(mlcompileropt::OutputFormat::Bitcode, "bc", "Bitcode"),
+        clEnumValN(mlcompileropt::OutputFormat::Assembly, "asm",
+                   "Native assembly"),
+        clEnumValN(mlcompileropt::OutputFormat::Object, "obj",
+                   "Native object file")),
+    llvm::cl::init(mlcompileropt::OutputFormat::Bitcode),
+    llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> CodeGenPartitions(
+    "codegen-partitions",
+    llvm::cl::desc("With --emit=obj or asm, generate code for N partitions "
+                   "concurrently"),
+    llvm::cl::value_desc("N"), llvm::cl::init(1),
+    llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<std::string> JSONFile(
+    "json", llvm::cl::desc("Write the results as JSON to this file"),
+    llvm::cl::value_desc("filename"), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<std::string> CSVFile(
+    "csv", llvm::cl::desc("Write the results as CSV to this file"),
+    llvm::cl::value_desc("filename"), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<std::string> OutputDir(
+    "output-dir",
+    llvm::cl::desc("Save the optimized IR of each file as <name>.opt.ll here"),
+    llvm::cl::value_desc("directory"), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<std::string> TraceFile(
+    "trace",
+    llvm::cl::desc("Write a Chrome trace of an extra, untimed run of every "
+                   "file and configuration"),
+    llvm::cl::value_desc("filename"), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::list<std::string> Placements(
+    "placements",
+    llvm::cl::desc("Extension points to run the memory coalescing pass at, "
+                   "one coalescing and one custom configuration each "
+                   "(default: vectorizer-start)"),
+    llvm::cl::value_desc("ep,..."), llvm::cl::CommaSeparated,
+    llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<bool> CompareNoPreserve(
+    "no-preserve-config",
+    llvm::cl::desc("Also time every placement with the memory coalescing pass "
+                   "invalidating all analyses of the functions it changes"),
+    llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<std::string> Passes(
+    "passes",
+    llvm::cl::desc("Time this textual pass pipeline alone instead of the O3 "
+                   "configurations, e.g. 'function(memory-coalescing)'"),
+    llvm::cl::value_desc("pipeline"), llvm::cl::cat(BenchCategory));
 
 // Simple timer class for benchmarking
 class Timer {
 public:
     Timer() : start(std::chrono::high_resolution_clock::now()) {}
-    
+
     double elapsed() const {
         auto now = std::chrono::high_resolution_clock::now();
         return std::chrono::duration<double, std::milli>(now - start).count();
     }
-    
+
 private:
     std::chrono::time_point<std::chrono::high_resolution_clock> start;
 };
 
-// Benchmarking function for optimization passes
-double runOptimizer(const std::string &InputFile, bool useCustomPasses = true) {
-    // Create context and parse the module
-    llvm::LLVMContext Context;
-    llvm::SMDiagnostic Err;
-    
-    // Load the IR file
-    std::unique_ptr<llvm::Module> Module = llvm::parseIRFile(InputFile, Err, Context);
-    if (!Module) {
-        llvm::errs() << "Error loading file: " << InputFile << "\n";
-        Err.print("benchmark", llvm::errs());
-        return -1.0;
-    }
-    
-    // Setup the pass manager infrastructure
-    llvm::LoopAnalysisManager LAM;
-    llvm::FunctionAnalysisManager FAM;
-    llvm::CGSCCAnalysisManager CGAM;
-    llvm::ModuleAnalysisManager MAM;
-    
-    llvm::PassBuilder PB;
-    PB.registerModuleAnalyses(MAM);
-    PB.registerCGSCCAnalyses(CGAM);
-    PB.registerFunctionAnalyses(FAM);
-    PB.registerLoopAnalyses(LAM);
-    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
-    
-    // Create the standard optimization pipeline
-    llvm::ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(
-        llvm::OptimizationLevel::O3);
-    
-    // Start the timer
-    Timer timer;
-    
-    // Apply our custom passes if requested
-    if (useCustomPasses) {
-        // Apply memory coalescing to each function
-        for (auto &F : *Module) {
-            if (!F.isDeclaration()) {
-                mlcompileropt::MemoryCoalescingPass MemCoalesce;
-                MemCoalesce.run(F, FAM);
+// Phases of one compilation, in execution order
+enum Phase { Parse, Setup, Optimize, EmitOutput, NumPhases };
+static const char *const PhaseNames[NumPhases] = {"parse", "setup", "optimize", "emit"};
+
+// Custom passes the optimize phase is split into; the rest of its time is
+// reported as "o3"
+enum CustomPass {
+    Coalescing,
+    Fusion,
+    Parallelize,
+    Tiling,
+    ReductionVectorize,
+    Prefetch,
+    NumCustomPasses
+};
+static const char *const CustomPassNames[NumCustomPasses] = {
+    "memory-coalescing", "loop-fusion",         "loop-parallelize",
+    "loop-tiling",       "reduction-vectorize", "software-prefetch"};
+
+// Name the pass instrumentation reports for pass P
+static llvm::StringRef getInstrumentedName(CustomPass P) {
+    switch (P) {
+    case Coalescing: return mlcompileropt::MemoryCoalescingPass::name();
+    case Fusion: return mlcompileropt::LoopFusionPass::name();
+    case Parallelize: return mlcompileropt::LoopParallelizePass::name();
+    case Tiling: return mlcompileropt::LoopTilingPass::name();
+    case ReductionVectorize: return mlcompileropt::ReductionVectorizePass::name();
+    case Prefetch: return mlcompileropt::SoftwarePrefetchPass::name();
+    case NumCustomPasses: break;
+    }
+    llvm_unreachable("unknown custom pass");
+}
+
+// A configuration is the O3 pipeline with the memory coalescing pass at
+// one extension point, or without it for the baseline. Unless
+// CoalescingOnly, the other custom passes are added as well, as far as
+// their options select them. A PassPipeline replaces the O3 pipeline.
+// Without PreserveAnalyses the pass invalidates every analysis of a
+// function it changes, as if it tracked no analyses.
+struct BenchConfig {
+    std::string Name;
+    mlcompileropt::CoalescingExtensionPoint EP = mlcompileropt::CoalescingExtensionPoint::None;
+    std::string PassPipeline;
+    bool PreserveAnalyses = true;
+    bool CoalescingOnly = false;
+
+    bool isBaseline() const { return EP == mlcompileropt::CoalescingExtensionPoint::None; }
+};
+
+// Returns a configuration with all custom passes that preserves analyses;
+// callers set the remaining fields by name
+static BenchConfig makeConfig(std::string Name, mlcompileropt::CoalescingExtensionPoint EP,
+                              std::string PassPipeline = "") {
+    BenchConfig Config;
+    Config.Name = std::move(Name);
+    Config.EP = EP;
+    Config.PassPipeline = std::move(PassPipeline);
+    return Config;
+}
+
+// Sets the pass's hidden -memory-coalescing-preserve-analyses option
+static void setPreserveAnalyses(bool Preserve) {
+    auto &Options = llvm::cl::getRegisteredOptions();
+    auto It = Options.find("memory-coalescing-preserve-analyses");
+    if (It != Options.end())
+        static_cast<llvm::cl::opt<bool> *>(It->second)->setValue(Preserve);
+}
+
+// Peak resident set size tracking. On Linux the high-water mark can be
+// reset between runs through /proc/self/clear_refs; elsewhere the peak
+// of the whole process is reported.
+static bool resetPeakRSS() {
+    std::ofstream ClearRefs("/proc/self/clear_refs");
+    return ClearRefs && (ClearRefs << "5").flush().good();
+}
+
+static uint64_t getPeakRSSKB() {
+    std::ifstream Status("/proc/self/status");
+    std::string Line;
+    while (std::getline(Status, Line)) {
+        if (llvm::StringRef(Line).startswith("VmHWM:")) {
+            uint64_t KB = 0;
+            llvm::StringRef(Line).drop_front(6).trim().split(' ').first.getAsInteger(10, KB);
+            return KB;
+        }
+    }
+    return 0;
+}
+
+struct RunResult {
+    double PhaseTimes[NumPhases] = {};
+    double PassTimes[NumCustomPasses] = {};
+    double PassSelfTimes[NumCustomPasses] = {};
+    double O3Time = 0.0;
+    double TotalTime = 0.0;
+    uint64_t PeakRSSKB = 0;
+    std::string OptimizedIR;
+};
+
+// Compiles Input once, timing each phase, and the custom passes with the
+// pass instrumentation. Every run gets a fresh context, so runs do not
+// share types or constants.
+static bool runOptimizer(const llvm::MemoryBuffer &Input, const BenchConfig &Config,
+                         RunResult &Result, bool KeepIR = false,
+                         mlcompileropt::PassProfiler *Profiler = nullptr) {
+    mlcompileropt::PassProfiler RunProfiler("run");
+    if (!Profiler)
+        Profiler = &RunProfiler;
+    resetPeakRSS();
+    Timer Total;
+    {
+        llvm::LLVMContext Context;
+        llvm::SMDiagnostic Err;
+
+        Timer ParseTimer;
+        std::unique_ptr<llvm::Module> Module =
+            mlcompileropt::parseModule(Input.getMemBufferRef(), Context, Err);
+        Result.PhaseTimes[Parse] = ParseTimer.elapsed();
+        if (!Module) {
+            Err.print("benchmark", llvm::errs());
+            return false;
+        }
+
+        // Pipeline construction is part of what every ml_compiler run pays
+        Timer SetupTimer;
+        setPreserveAnalyses(Config.PreserveAnalyses);
+        mlcompileropt::OptimizationPipeline Pipeline(Config.EP, Profiler,
+                                                     Config.CoalescingOnly);
+        if (!Config.PassPipeline.empty()) {
+            if (llvm::Error E = Pipeline.setPipeline(Config.PassPipeline)) {
+                llvm::errs() << "benchmark: " << llvm::toString(std::move(E)) << "\n";
+                return false;
             }
         }
+        Result.PhaseTimes[Setup] = SetupTimer.elapsed();
+
+        // The custom passes run inside the pipeline; the instrumentation
+        // gives their share
+        Timer OptimizeTimer;
+        Pipeline.run(*Module);
+        Result.PhaseTimes[Optimize] = OptimizeTimer.elapsed();
+        llvm::StringMap<double> PassTimes = Profiler->getPassTimes();
+        llvm::StringMap<double> PassSelfTimes = Profiler->getPassSelfTimes();
+        Result.O3Time = Result.PhaseTimes[Optimize];
+        for (unsigned P = 0; P < NumCustomPasses; ++P) {
+            Result.PassTimes[P] = PassTimes.lookup(getInstrumentedName(CustomPass(P)));
+            Result.PassSelfTimes[P] = PassSelfTimes.lookup(getInstrumentedName(CustomPass(P)));
+            Result.O3Time -= Result.PassTimes[P];
+        }
+
+        Timer EmitTimer;
+        if (mlcompileropt::isNativeFormat(Emit)) {
+            std::vector<llvm::SmallString<0>> Outputs(std::max(1u, unsigned(CodeGenPartitions)));
+            std::vector<std::unique_ptr<llvm::raw_svector_ostream>> Streams;
+            std::vector<llvm::raw_pwrite_stream *> StreamPtrs;
+            for (llvm::SmallString<0> &Output : Outputs) {
+                Streams.push_back(std::make_unique<llvm::raw_svector_ostream>(Output));
+                StreamPtrs.push_back(Streams.back().get());
+            }
+            mlcompileropt::CodeGenOptions Opts;
+            Opts.Format = Emit;
+            if (llvm::Error E = mlcompileropt::emitNativeCode(*Module, StreamPtrs, Opts)) {
+                llvm::errs() << "benchmark: " << llvm::toString(std::move(E)) << "\n";
+                return false;
+            }
+        } else {
+            std::string Output;
+            llvm::raw_string_ostream OS(Output);
+            mlcompileropt::writeModule(*Module, OS, Emit);
+            OS.flush();
+        }
+        Result.PhaseTimes[EmitOutput] = EmitTimer.elapsed();
+
+        if (KeepIR) {
+            llvm::raw_string_ostream IROS(Result.OptimizedIR);
+            Module->print(IROS, nullptr);
+        }
     }
-    
-    // Run the standard optimization pipeline
-    MPM.run(*Module, MAM);
-    
-    // Return the elapsed time
-    return timer.elapsed();
+    Result.TotalTime = Total.elapsed();
+    Result.PeakRSSKB = getPeakRSSKB();
+    return true;
+}
+
+// Aggregated results of one file under one configuration
+struct BenchResult {
+    std::string File;
+    std::string Config;
+    std::vector<double> Samples[NumPhases];
+    std::vector<double> PassSamples[NumCustomPasses];
+    std::vector<double> PassSelfSamples[NumCustomPasses];
+    std::vector<double> O3Samples;
+    std::vector<double> TotalSamples;
+    std::vector<double> PeakRSSKB;
+    bool PassRan[NumCustomPasses] = {};
+
+    mlcompileropt::SampleSummary phase(unsigned P) const {
+        return mlcompileropt::summarizeSamples(Samples[P]);
+    }
+    mlcompileropt::SampleSummary pass(unsigned P) const {
+        return mlcompileropt::summarizeSamples(PassSamples[P]);
+    }
+    mlcompileropt::SampleSummary passSelf(unsigned P) const {
+        return mlcompileropt::summarizeSamples(PassSelfSamples[P]);
+    }
+    mlcompileropt::SampleSummary o3() const {
+        return mlcompileropt::summarizeSamples(O3Samples);
+    }
+    mlcompileropt::SampleSummary total() const {
+        return mlcompileropt::summarizeSamples(TotalSamples);
+    }
+};
+
+// Prints the difference of R's median total time from Ref's. Differences
+// smaller than the spread of either configuration are reported as noise.
+static void printComparison(const BenchResult &R, const BenchResult &Ref) {
+    mlcompileropt::SampleSummary C = R.total();
+    mlcompileropt::SampleSummary B = Ref.total();
+    double Delta = C.Median - B.Median;
+    bool Significant = C.Min > B.P95 || B.Min > C.P95;
+    std::cout << std::left << std::setw(24) << "" << R.Config << " vs " << Ref.Config << ": "
+              << std::showpos << std::fixed << std::setprecision(2) << Delta << " ms ("
+              << (B.Median > 0 ? 100.0 * Delta / B.Median : 0.0) << "%)" << std::noshowpos
+              << (Significant ? "" : ", within noise") << "\n";
+}
+
+static bool benchmarkFile(const std::string &InputFile, const llvm::MemoryBuffer &Input,
+                          const BenchConfig &Config, BenchResult &Result,
+                          mlcompileropt::PassProfiler *Profiler) {
+    Result.File = InputFile;
+    Result.Config = Config.Name;
+
+    for (unsigned I = 0; I < Warmup + Repetitions; ++I) {
+        RunResult Run;
+        if (!runOptimizer(Input, Config, Run))
+            return false;
+        if (I < Warmup)
+            continue;
+
+        for (unsigned P = 0; P < NumPhases; ++P)
+            Result.Samples[P].push_back(Run.PhaseTimes[P]);
+        for (unsigned P = 0; P < NumCustomPasses; ++P) {
+            Result.PassSamples[P].push_back(Run.PassTimes[P]);
+            Result.PassSelfSamples[P].push_back(Run.PassSelfTimes[P]);
+            Result.PassRan[P] |= Run.PassTimes[P] > 0;
+        }
+        Result.O3Samples.push_back(Run.O3Time);
+        Result.TotalSamples.push_back(Run.TotalTime);
+        Result.PeakRSSKB.push_back(Run.PeakRSSKB);
+    }
+
+    // Profile and save the optimized output from an extra, untimed run, so
+    // that neither affects the timings
+    bool KeepIR = !Config.isBaseline() && !Config.CoalescingOnly && !OutputDir.empty();
+    if (!KeepIR && !Profiler)
+        return true;
+    RunResult Run;
+    if (!runOptimizer(Input, Config, Run, KeepIR, Profiler))
+        return false;
+    if (KeepIR) {
+        // One file per placement when several are compared
+        std::string Suffix = Placements.size() > 1
+            ? "." + mlcompileropt::getExtensionPointName(Config.EP).str() + ".opt.ll"
+            : ".opt.ll";
+        llvm::SmallString<128> OutputFile(OutputDir);
+        llvm::sys::path::append(OutputFile, llvm::sys::path::stem(InputFile) + Suffix);
+        std::error_code EC;
+        llvm::raw_fd_ostream OS(OutputFile, EC, llvm::sys::fs::OF_Text);
+        if (EC)
+            llvm::errs() << "Error writing " << OutputFile << ": " << EC.message() << "\n";
+        else
+            OS << Run.OptimizedIR;
+    }
+    return true;
+}
+
+static llvm::json::Object toJSON(const mlcompileropt::SampleSummary &S) {
+    return llvm::json::Object{{"min", S.Min},       {"median", S.Median},
+                              {"p95", S.P95},       {"max", S.Max},
+                              {"mean", S.Mean},     {"stddev", S.StdDev}};
+}
+
+static void writeJSON(llvm::raw_ostream &OS, const std::vector<BenchResult> &Results) {
+    llvm::json::OStream J(OS, /*IndentSize=*/2);
+    J.object([&] {
+        J.attribute("tool", "bench_optimizer");
+        J.attribute("version", ML_COMPILER_VERSION);
+        J.attribute("llvm_version", LLVM_VERSION_STRING);
+        J.attribute("warmup", int64_t(Warmup));
+        J.attribute("repetitions", int64_t(Repetitions));
+        J.attribute("time_unit", "ms");
+        J.attributeArray("results", [&] {
+            for (const BenchResult &R : Results) {
+                J.object([&] {
+                    J.attribute("file", R.File);
+                    J.attribute("config", R.Config);
+                    J.attributeObject("phases", [&] {
+                        for (unsigned P = 0; P < NumPhases; ++P)
+                            J.attribute(PhaseNames[P], toJSON(R.phase(P)));
+                        J.attribute("total", toJSON(R.total()));
+                    });
+                    J.attributeObject("passes", [&] {
+                        for (unsigned P = 0; P < NumCustomPasses; ++P)
+                            if (R.PassRan[P])
+                                J.attribute(CustomPassNames[P], toJSON(R.pass(P)));
+                        J.attribute("o3", toJSON(R.o3()));
+                    });
+                    J.attributeObject("pass_self", [&] {
+                        for (unsigned P = 0; P < NumCustomPasses; ++P)
+                            if (R.PassRan[P])
+                                J.attribute(CustomPassNames[P], toJSON(R.passSelf(P)));
+                    });
+                    mlcompileropt::SampleSummary RSS = mlcompileropt::summarizeSamples(R.PeakRSSKB);
+                    J.attributeObject("peak_rss_kb", [&] {
+                        J.attribute("min", int64_t(RSS.Min));
+                        J.attribute("median", int64_t(RSS.Median));
+                        J.attribute("max", int64_t(RSS.Max));
+                    });
+                    J.attributeArray("total_samples", [&] {
+                        for (double T : R.TotalSamples)
+                            J.value(T);
+                    });
+                });
+            }
+        });
+    });
+    OS << "\n";
+}
+
+static void writeCSV(llvm::raw_ostream &OS, const std::vector<BenchResult> &Results) {
+    OS << "file,config,phase,min_ms,median_ms,p95_ms,max_ms,mean_ms,stddev_ms,peak_rss_kb\n";
+    for (const BenchResult &R : Results) {
+        uint64_t PeakRSS = mlcompileropt::summarizeSamples(R.PeakRSSKB).Max;
+        auto Row = [&](llvm::StringRef Phase, const mlcompileropt::SampleSummary &S) {
+            OS << R.File << "," << R.Config << "," << Phase
+               << llvm::format(",%.4f,%.4f,%.4f,%.4f,%.4f,%.4f", S.Min, S.Median,
+                               S.P95, S.Max, S.Mean, S.StdDev)
+               << "," << PeakRSS << "\n";
+        };
+        for (unsigned P = 0; P < NumPhases; ++P)
+            Row(PhaseNames[P], R.phase(P));
+        for (unsigned P = 0; P < NumCustomPasses; ++P)
+            if (R.PassRan[P])
+                Row(std::string("pass:") + CustomPassNames[P], R.pass(P));
+        Row("pass:o3", R.o3());
+        for (unsigned P = 0; P < NumCustomPasses; ++P)
+            if (R.PassRan[P])
+                Row(std::string("self:") + CustomPassNames[P], R.passSelf(P));
+        Row("total", R.total());
+    }
+}
+
+static bool writeReport(const std::string &Filename,
+                        void (*Writer)(llvm::raw_ostream &, const std::vector<BenchResult> &),
+                        const std::vector<BenchResult> &Results) {
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(Filename, EC, llvm::sys::fs::OF_Text);
+    if (EC) {
+        llvm::errs() << "Error writing " << Filename << ": " << EC.message() << "\n";
+        return false;
+    }
+    Writer(OS, Results);
+    return true;
 }
 
 int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <ir-file> [<ir-file> ...]\n";
+    llvm::InitLLVM X(argc, argv);
+
+    // --time-passes is LLVM's own option, the others select the custom
+    // passes of the custom configurations
+    auto &Options = llvm::cl::getRegisteredOptions();
+    for (const char *Name : {"time-passes", "loop-fusion-mode", "loop-parallelize",
+                             "loop-tiling", "reduction-vectorize", "software-prefetch"}) {
+        if (Options.count(Name)) {
+            Options[Name]->addCategory(BenchCategory);
+            Options[Name]->setHiddenFlag(llvm::cl::NotHidden);
+        }
+    }
+    llvm::cl::HideUnrelatedOptions(BenchCategory);
+    llvm::cl::ParseCommandLineOptions(argc, argv,
+                                      "ML Compiler Optimization Framework - Benchmark\n");
+    if (Repetitions == 0) {
+        llvm::errs() << "--repetitions must be at least 1\n";
         return 1;
     }
-    
+
+    // The baseline, then the memory coalescing pass alone and with the
+    // other custom passes at each requested placement, or only the
+    // --passes pipeline
+    if (Placements.empty())
+        Placements.push_back("vectorizer-start");
+    std::vector<BenchConfig> Configs = {
+        makeConfig("baseline", mlcompileropt::CoalescingExtensionPoint::None)};
+    if (!Passes.empty()) {
+        Configs = {makeConfig("passes", mlcompileropt::CoalescingExtensionPoint::VectorizerStart,
+                              Passes)};
+        Placements.clear();
+    }
+    for (const std::string &Placement : Placements) {
+        llvm::Optional<mlcompileropt::CoalescingExtensionPoint> EP =
+            mlcompileropt::parseExtensionPoint(Placement);
+        if (!EP || *EP == mlcompileropt::CoalescingExtensionPoint::None) {
+            llvm::errs() << "Unknown placement '" << Placement << "'\n";
+            return 1;
+        }
+        BenchConfig Coalescing = makeConfig("coalescing@" + Placement, *EP);
+        Coalescing.CoalescingOnly = true;
+        Configs.push_back(Coalescing);
+        if (CompareNoPreserve) {
+            BenchConfig NoPreserve = makeConfig("no-preserve@" + Placement, *EP);
+            NoPreserve.CoalescingOnly = true;
+            NoPreserve.PreserveAnalyses = false;
+            Configs.push_back(NoPreserve);
+        }
+        Configs.push_back(makeConfig("custom@" + Placement, *EP));
+    }
+
     std::cout << "ML Compiler Optimization Framework - Benchmark\n";
-    std::cout << "=============================================\n\n";
-    
-    // Print header
-    std::cout << std::left << std::setw(30) << "File"
-              << std::right << std::setw(15) << "Standard (ms)"
-              << std::right << std::setw(15) << "Custom (ms)"
-              << std::right << std::setw(15) << "Speedup (%)"
+    std::cout << "=============================================\n";
+    std::cout << Warmup << " warm-up runs, " << Repetitions << " timed runs per configuration";
+    if (!resetPeakRSS())
+        std::cout << " (peak RSS is the process peak)";
+    std::cout << "\n\n";
+
+    // Print header; times are medians, p95 in parentheses
+    std::cout << std::left << std::setw(24) << "File"
+              << std::setw(30) << "Config";
+    for (unsigned P = 0; P < NumPhases; ++P)
+        std::cout << std::right << std::setw(14) << (std::string(PhaseNames[P]) + " (ms)");
+    std::cout << std::right << std::setw(22) << "total (ms, p95)"
+              << std::right << std::setw(10) << "stddev"
+              << std::right << std::setw(14) << "peak RSS (KB)"
               << "\n";
-    std::cout << std::string(75, '-') << "\n";
-    
+    std::cout << std::string(156, '-') << "\n";
+
+    std::vector<BenchResult> Results;
+    std::vector<std::unique_ptr<mlcompileropt::PassProfiler>> Profilers;
+    bool Profile = llvm::TimePassesIsEnabled || !TraceFile.empty();
+    bool Failed = false;
+
     // Process each input file
-    for (int i = 1; i < argc; ++i) {
-        std::string InputFile = argv[i];
-        
-        // Run with standard passes only
-        double standardTime = runOptimizer(InputFile, false);
-        
-        // Run with our custom passes
-        double customTime = runOptimizer(InputFile, true);
-        
-        // Calculate speedup
-        double speedup = 0.0;
-        if (standardTime > 0 && customTime > 0) {
-            speedup = ((standardTime - customTime) / standardTime) * 100.0;
-        }
-        
+    for (const std::string &InputFile : InputFiles) {
+        // Read the file once so that disk I/O is not part of the parse phase
+        auto BufferOrErr = llvm::MemoryBuffer::getFile(InputFile);
+        if (!BufferOrErr) {
+            llvm::errs() << "Error loading file: " << InputFile << ": "
+                         << BufferOrErr.getError().message() << "\n";
+            Failed = true;
+            continue;
+        }
+
+        std::vector<std::unique_ptr<mlcompileropt::PassProfiler>> FileProfilers;
+        std::vector<BenchResult> FileResults(Configs.size());
+        bool FileFailed = false;
+        for (unsigned C = 0; C < Configs.size() && !FileFailed; ++C) {
+            if (Profile)
+                FileProfilers.push_back(std::make_unique<mlcompileropt::PassProfiler>(
+                    llvm::sys::path::filename(InputFile).str() + " (" + Configs[C].Name + ")"));
+            FileFailed = !benchmarkFile(InputFile, **BufferOrErr, Configs[C], FileResults[C],
+                                        Profile ? FileProfilers.back().get() : nullptr);
+        }
+        if (FileFailed) {
+            Failed = true;
+            continue;
+        }
+
         // Print results
-        std::cout << std::left << std::setw(30) << InputFile
-                  << std::right << std::setw(15) << std::fixed << std::setprecision(2) << standardTime
-                  << std::right << std::setw(15) << std::fixed << std::setprecision(2) << customTime
-                  << std::right << std::setw(15) << std::fixed << std::setprecision(2) << speedup
-                  << "\n";
-        
-        // Save the optimized output (optional)
-        std::string OutputFile = InputFile + ".opt.ll";
-        // Code to save optimized IR would go here
-    }
-    
-    return 0;
-} 
\ No newline at end of file
+        for (const BenchResult &R : FileResults) {
+            mlcompileropt::SampleSummary Total = R.total();
+            std::ostringstream TotalStr;
+            TotalStr << std::fixed << std::setprecision(2) << Total.Median << " (" << Total.P95 << ")";
+
+            std::cout << std::left << std::setw(24) << llvm::sys::path::filename(InputFile).str()
+                      << std::setw(30) << R.Config;
+            for (unsigned P = 0; P < NumPhases; ++P)
+                std::cout << std::right << std::setw(14) << std::fixed << std::setprecision(2)
+                          << R.phase(P).Median;
+            std::cout << std::right << std::setw(22) << TotalStr.str()
+                      << std::right << std::setw(10) << std::fixed << std::setprecision(2) << Total.StdDev
+                      << std::right << std::setw(14)
+                      << uint64_t(mlcompileropt::summarizeSamples(R.PeakRSSKB).Max)
+                      << "\n";
+
+            // The optimize phase by pass, from the pass instrumentation
+            std::cout << std::left << std::setw(24) << "" << "optimize:" << std::fixed
+                      << std::setprecision(2);
+            for (unsigned P = 0; P < NumCustomPasses; ++P)
+                if (R.PassRan[P])
+                    std::cout << " " << CustomPassNames[P] << " " << R.pass(P).Median << ",";
+            std::cout << " o3 " << R.o3().Median << "\n";
+        }
+
+        // Compile-time cost of the custom passes at each placement, and
+        // what preserving analyses saves over each no-preserve run that
+        // follows the coalescing-only one
+        for (unsigned I = 1; I < FileResults.size(); ++I) {
+            if (Configs[I].PreserveAnalyses)
+                printComparison(FileResults[I], FileResults.front());
+            else
+                printComparison(FileResults[I - 1], FileResults[I]);
+        }
+
+        for (BenchResult &R : FileResults)
+            Results.push_back(std::move(R));
+        for (auto &Profiler : FileProfilers)
+            Profilers.push_back(std::move(Profiler));
+    }
+
+    if (llvm::TimePassesIsEnabled) {
+        std::cout.flush();
+        for (const auto &Profiler : Profilers) {
+            llvm::outs() << "\n";
+            Profiler->printReport(llvm::outs());
+        }
+        llvm::outs().flush();
+    }
+    if (!TraceFile.empty()) {
+        std::vector<const mlcompileropt::PassProfiler *> Traced;
+        for (const auto &Profiler : Profilers)
+            Traced.push_back(Profiler.get());
+        if (llvm::Error E = mlcompileropt::writeChromeTrace(TraceFile, Traced)) {
+            llvm::errs() << llvm::toString(std::move(E)) << "\n";
+            return 1;
+        }
+    }
+
+    if (!JSONFile.empty() && !writeReport(JSONFile, writeJSON, Results))
+        return 1;
+    if (!CSVFile.empty() && !writeReport(CSVFile, writeCSV, Results))
+        return 1;
+
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,225 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Driver pipeline and helpers shared with ml_compiler
+#include "driver/ModuleIO.h"
+#include "driver/OptimizationPipeline.h"
+#include "driver/SampleStats.h"
+
+// Kernel execution through the JIT
+#include "jit/JITKernel.h"
+#include "jit/KernelBuffers.h"
+#include "jit/KernelSpec.h"
+#include "jit/KernelTimer.h"
+
+// Interchange decisions and the training log
+#include "passes/InterchangeAdvisor.h"
+
+static llvm::cl::OptionCategory CollectCategory("collect_training_data options");
+
+static llvm::cl::list<std::string> InputFiles(
+    llvm::cl::Positional, llvm::cl::desc("<ir-file> [<ir-file> ...]"),
+    llvm::cl::OneOrMore, llvm::cl::cat(CollectCategory));
+
+static llvm::cl::list<std::string> Specs(
+    "spec",
+    llvm::cl::desc("Kernel to run and the shape of its arguments, e.g. "
+                   "matmul_2x2:A=4,B=4,C=4 (repeatable)"),
+    llvm::cl::value_desc("kernel:arg=value,..."), llvm::cl::OneOrMore,
+    llvm::cl::cat(CollectCategory));
+
+static llvm::cl::opt<std::string> OutputFile(
+    "o", llvm::cl::desc("Training log to write (default: stdout)"),
+    llvm::cl::value_desc("filename"), llvm::cl::init("-"),
+    llvm::cl::cat(CollectCategory));
+
+static llvm::cl::opt<unsigned> Repetitions(
+    "repetitions", llvm::cl::desc("Timed samples per kernel and decision"),
+    llvm::cl::init(10), llvm::cl::cat(CollectCategory));
+
+static llvm::cl::opt<double> MinSampleTime(
+    "min-sample-ms",
+    llvm::cl::desc("Repeat the kernel until one sample takes this long"),
+    llvm::cl::init(20.0), llvm::cl::cat(CollectCategory));
+
+static void reportError(llvm::Error E) {
+    llvm::logAllUnhandledErrors(std::move(E), llvm::errs(), "error: ");
+}
+
+// Optimizes Input with O3 and the memory coalescing pass, taking every
+// interchange decision from Advisor, and compiles Kernel for the host
+static llvm::Expected<std::unique_ptr<mlcompileropt::JITKernel>>
+compileKernel(const llvm::MemoryBuffer &Input, llvm::StringRef Kernel,
+              mlcompileropt::InterchangeAdvisorKind Advisor) {
+    return mlcompileropt::compileKernelModule(
+        Input.getMemBufferRef(), Kernel, [&](llvm::Module &Module) {
+            mlcompileropt::setSelectedInterchangeAdvisor(Advisor);
+            mlcompileropt::OptimizationPipeline Pipeline(/*UseCustomPasses=*/true);
+            Pipeline.run(Module);
+        });
+}
+
+// Median time per call of Kernel in microseconds, measured like
+// bench_runtime measures it
+static double medianTime(const mlcompileropt::JITKernel &Kernel,
+                         mlcompileropt::KernelBuffers &Buffers) {
+    mlcompileropt::KernelTimingOptions Options;
+    Options.Repetitions = Repetitions;
+    Options.MinSampleTime = MinSampleTime;
+    mlcompileropt::KernelTiming Timing =
+        mlcompileropt::timeKernel(Kernel, Buffers, Options);
+    return mlcompileropt::summarizeSamples(Timing.Samples).Median;
+}
+
+// Compiles the kernel without interchanges and with every legal one, and
+// writes the candidates the pass interchanged with the measured speedup.
+// Candidates that were not interchanged did not change the kernel and are
+// left out.
+static bool collectKernel(const llvm::MemoryBuffer &Input,
+                          const mlcompileropt::KernelSpec &Spec,
+                          llvm::raw_ostream &OS, unsigned &NumRecords) {
+    using mlcompileropt::InterchangeAdvisorKind;
+
+    // The argument layout comes from the unoptimized signature
+    llvm::LLVMContext Context;
+    llvm::SMDiagnostic Err;
+    std::unique_ptr<llvm::Module> Module =
+        mlcompileropt::parseModule(Input.getMemBufferRef(), Context, Err);
+    if (!Module) {
+        Err.print("collect_training_data", llvm::errs());
+        return false;
+    }
+    auto BuffersOrErr = mlcompileropt::KernelBuffers::create(
+        *Module->getFunction(Spec.Function), Spec);
+    if (!BuffersOrErr) {
+        reportError(BuffersOrErr.takeError());
+        return false;
+    }
+    mlcompileropt::KernelBuffers &Buffers = *BuffersOrErr;
+
+    auto KeptOrErr = compileKernel(Input, Spec.Function, InterchangeAdvisorKind::Never);
+    if (!KeptOrErr) {
+        reportError(KeptOrErr.takeError());
+        return false;
+    }
+
+    mlcompileropt::InterchangeTrainingLog Log;
+    mlcompileropt::setInterchangeTrainingLog(&Log);
+    auto InterchangedOrErr =
+        compileKernel(Input, Spec.Function, InterchangeAdvisorKind::Always);
+    mlcompileropt::setInterchangeTrainingLog(nullptr);
+    if (!InterchangedOrErr) {
+        reportError(InterchangedOrErr.takeError());
+        return false;
+    }
+
+    std::vector<mlcompileropt::InterchangeRecord> Records = Log.takeRecords();
+    bool AnyApplied = false;
+    for (const mlcompileropt::InterchangeRecord &R : Records)
+        if (R.Applied && R.Function == Spec.Function)
+            AnyApplied = true;
+    if (!AnyApplied) {
+        std::cerr << Spec.Function << ": no interchange applied\n";
+        return true;
+    }
+
+    double KeptTime = medianTime(**KeptOrErr, Buffers);
+    double InterchangedTime = medianTime(**InterchangedOrErr, Buffers);
+    double Speedup = InterchangedTime > 0 ? KeptTime / InterchangedTime : 0.0;
+    std::cerr << Spec.Function << ": " << KeptTime << " us without, "
+              << InterchangedTime << " us with interchange (" << Speedup << "x)\n";
+
+    for (const mlcompileropt::InterchangeRecord &R : Records) {
+        if (!R.Applied || R.Function != Spec.Function)
+            continue;
+        mlcompileropt::InterchangeTrainingLog::writeRecord(OS, R, Speedup);
+        ++NumRecords;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::HideUnrelatedOptions(CollectCategory);
+    llvm::cl::ParseCommandLineOptions(
+        argc, argv, "ML Compiler Optimization Framework - Interchange Training Data\n");
+    if (Repetitions == 0) {
+        llvm::errs() << "--repetitions must be at least 1\n";
+        return 1;
+    }
+
+    std::vector<mlcompileropt::KernelSpec> KernelSpecs;
+    for (const std::string &Text : Specs) {
+        auto SpecOrErr = mlcompileropt::parseKernelSpec(Text);
+        if (!SpecOrErr) {
+            reportError(SpecOrErr.takeError());
+            return 1;
+        }
+        KernelSpecs.push_back(std::move(*SpecOrErr));
+    }
+
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(OutputFile, EC, llvm::sys::fs::OF_Text);
+    if (EC) {
+        llvm::errs() << "Error writing " << OutputFile << ": " << EC.message() << "\n";
+        return 1;
+    }
+    mlcompileropt::InterchangeTrainingLog::writeHeader(OS);
+
+    std::vector<bool> SpecUsed(KernelSpecs.size());
+    unsigned NumRecords = 0;
+    bool Failed = false;
+
+    for (const std::string &InputFile : InputFiles) {
+        auto BufferOrErr = llvm::MemoryBuffer::getFile(InputFile);
+        if (!BufferOrErr) {
+            llvm::errs() << "Error loading file: " << InputFile << ": "
+                         << BufferOrErr.getError().message() << "\n";
+            Failed = true;
+            continue;
+        }
+
+        // Run every spec whose kernel the file defines
+        llvm::LLVMContext Context;
+        llvm::SMDiagnostic Err;
+        std::unique_ptr<llvm::Module> Module =
+            mlcompileropt::parseModule((*BufferOrErr)->getMemBufferRef(), Context, Err);
+        if (!Module) {
+            Err.print("collect_training_data", llvm::errs());
+            Failed = true;
+            continue;
+        }
+
+        for (size_t S = 0; S < KernelSpecs.size(); ++S) {
+            llvm::Function *F = Module->getFunction(KernelSpecs[S].Function);
+            if (!F || F->isDeclaration())
+                continue;
+            SpecUsed[S] = true;
+            if (!collectKernel(**BufferOrErr, KernelSpecs[S], OS, NumRecords))
+                Failed = true;
+        }
+    }
+
+    for (size_t S = 0; S < KernelSpecs.size(); ++S) {
+        if (!SpecUsed[S]) {
+            llvm::errs() << "error: no input defines @" << KernelSpecs[S].Function << "\n";
+            Failed = true;
+        }
+    }
+
+    std::cerr << NumRecords << " training records\n";
+    return Failed ? 1 : 0;
+}
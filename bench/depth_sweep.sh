@@ -0,0 +1,80 @@
+#!/usr/bin/env bash
+# Loop-depth sweep: generates modules whose nests get deeper with
+# gen_kernels --depth and times the memory coalescing pass alone on each
+# with bench_optimizer --passes. The pass instrumentation splits the
+# pass time into the pass's self time and the analyses it requests, such
+# as the access pattern analysis: the pass visits every loop once, so its
+# self time per 1000 instructions does not grow as the nests deepen.
+#
+# Usage: depth_sweep.sh [options] [-- bench_optimizer options]
+#   -b DIR   build directory (default: build)
+#   -o DIR   directory for the modules and reports (default: depth)
+#   -d LIST  loop depths (default: "6 8 12 16 24 32")
+#   -k KIND  kernel kind (default: conv2d-nchw)
+#   -n N     kernels per module (default: 200)
+#   -r N     timed repetitions per module (default: 5)
+#
+# Writes depth-<depth>.ll and the report depth-<depth>.csv per point, and
+# summary.csv with the instruction count, the median analysis and pass
+# self times and the times per 1000 instructions of every point.
+
+set -euo pipefail
+
+BUILD_DIR=build
+OUT_DIR=depth
+DEPTHS="6 8 12 16 24 32"
+KIND=conv2d-nchw
+KERNELS=200
+PASS_PIPELINE="function(memory-coalescing)"
+REPETITIONS=5
+
+while getopts "b:o:d:k:n:r:h" Opt; do
+  case "$Opt" in
+    b) BUILD_DIR="$OPTARG" ;;
+    o) OUT_DIR="$OPTARG" ;;
+    d) DEPTHS="$OPTARG" ;;
+    k) KIND="$OPTARG" ;;
+    n) KERNELS="$OPTARG" ;;
+    r) REPETITIONS="$OPTARG" ;;
+    *) sed -n '2,20p' "$0" | sed 's/^# \{0,1\}//'; exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+GEN="$BUILD_DIR/bench/gen_kernels"
+BENCH="$BUILD_DIR/bench/bench_optimizer"
+for Tool in "$GEN" "$BENCH"; do
+  if [ ! -x "$Tool" ]; then
+    echo "error: $Tool not found; build the project first or pass -b" >&2
+    exit 1
+  fi
+done
+mkdir -p "$OUT_DIR"
+
+SUMMARY="$OUT_DIR/summary.csv"
+echo "kind,depth,instructions,analysis_ms,pass_ms,analysis_ms_per_1000,pass_ms_per_1000" > "$SUMMARY"
+
+# Median time of row $2 in the bench_optimizer CSV report $1
+median_ms() {
+  awk -F, -v Row="$2" '$3 == Row { print $5 }' "$1"
+}
+
+for Depth in $DEPTHS; do
+  Name="$OUT_DIR/depth-$Depth"
+  "$GEN" --kinds="$KIND" --kernels="$KERNELS" --depth="$Depth" -o "$Name.ll"
+  # Instructions are the indented lines of function bodies
+  Instructions=$(grep -c '^  [^ ;]' "$Name.ll" || true)
+  echo "== $KIND, depth $Depth, $Instructions instructions"
+  "$BENCH" "$Name.ll" --passes="$PASS_PIPELINE" --warmup=1 \
+    --repetitions="$REPETITIONS" --csv="$Name.csv" "$@"
+  # Every run's pass time includes its self time, and so do the medians
+  awk -v Kind="$KIND" -v Depth="$Depth" -v Insts="$Instructions" \
+    -v Pass="$(median_ms "$Name.csv" pass:memory-coalescing)" \
+    -v Self="$(median_ms "$Name.csv" self:memory-coalescing)" \
+    'BEGIN { Analysis = Pass - Self
+             printf "%s,%s,%s,%.4f,%.4f,%.4f,%.4f\n", Kind, Depth, Insts, Analysis, Self,
+                    1000 * Analysis / Insts, 1000 * Self / Insts }' >> "$SUMMARY"
+done
+
+echo
+column -s, -t "$SUMMARY" 2>/dev/null || cat "$SUMMARY"
@@ -0,0 +1,159 @@
+#include <string>
+#include <memory>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Module output shared with ml_compiler
+#include "driver/ModuleIO.h"
+
+// Synthetic kernels
+#include "kernelgen/KernelGenerator.h"
+
+static llvm::cl::OptionCategory GenCategory("gen_kernels options");
+
+static llvm::cl::list<std::string> Kinds(
+    "kinds",
+    llvm::cl::desc("Kernels to generate, in round-robin order: matmul, "
+                   "batched-matmul, conv2d-nchw, conv2d-nhwc, depthwise-conv, "
+                   "elementwise, column-walk, transpose-add, transpose, "
+                   "column-add (default: matmul)"),
+    llvm::cl::value_desc("kind,..."), llvm::cl::CommaSeparated,
+    llvm::cl::cat(GenCategory));
+
+static llvm::cl::opt<unsigned> NumKernels(
+    "kernels", llvm::cl::desc("Number of kernels in the module"),
+    llvm::cl::init(1), llvm::cl::cat(GenCategory));
+
+static llvm::cl::opt<unsigned> MatM(
+    "m", llvm::cl::desc("Rows of C and A in matmul kernels, and of the "
+                        "outputs of the column and transpose kinds"),
+    llvm::cl::init(32), llvm::cl::cat(GenCategory));
+static llvm::cl::opt<unsigned> MatN(
+    "n", llvm::cl::desc("Columns of C and B in matmul kernels, and of the "
+                        "outputs of the column and transpose kinds"),
+    llvm::cl::init(32), llvm::cl::cat(GenCategory));
+static llvm::cl::opt<unsigned> MatK(
+    "k", llvm::cl::desc("Reduction size of matmul kernels"),
+    llvm::cl::init(32), llvm::cl::cat(GenCategory));
+
+static llvm::cl::opt<unsigned> Channels(
+    "channels", llvm::cl::desc("Input channels of convolutions"),
+    llvm::cl::init(8), llvm::cl::cat(GenCategory));
+static llvm::cl::opt<unsigned> Height(
+    "height", llvm::cl::desc("Input height of convolutions"),
+    llvm::cl::init(16), llvm::cl::cat(GenCategory));
+static llvm::cl::opt<unsigned> Width(
+    "width", llvm::cl::desc("Input width of convolutions"),
+    llvm::cl::init(16), llvm::cl::cat(GenCategory));
+static llvm::cl::opt<unsigned> Filters(
+    "filters", llvm::cl::desc("Output channels of convolutions"),
+    llvm::cl::init(8), llvm::cl::cat(GenCategory));
+static llvm::cl::opt<unsigned> KernelSize(
+    "kernel-size", llvm::cl::desc("Window size of convolutions"),
+    llvm::cl::init(3), llvm::cl::cat(GenCategory));
+
+static llvm::cl::opt<unsigned> Length(
+    "length", llvm::cl::desc("Buffer length of elementwise chains"),
+    llvm::cl::init(1024), llvm::cl::cat(GenCategory));
+static llvm::cl::opt<unsigned> ChainLength(
+    "chain-length", llvm::cl::desc("Operations per elementwise chain"),
+    llvm::cl::init(4), llvm::cl::cat(GenCategory));
+
+static llvm::cl::opt<unsigned> Batch(
+    "batch", llvm::cl::desc("Trip count of every batch loop"),
+    llvm::cl::init(4), llvm::cl::cat(GenCategory));
+
+static llvm::cl::opt<unsigned> LoopDepth(
+    "depth",
+    llvm::cl::desc("Depth of every loop nest; deeper than the kernel's own "
+                   "loops adds batch loops (default: the kernel's depth)"),
+    llvm::cl::init(0), llvm::cl::cat(GenCategory));
+
+static llvm::cl::opt<unsigned> Unroll(
+    "unroll", llvm::cl::desc("Unroll factor of the innermost loop"),
+    llvm::cl::init(1), llvm::cl::cat(GenCategory));
+
+static llvm::cl::opt<std::string> OutputFilename(
+    "o", llvm::cl::desc("Output file (default: stdout)"),
+    llvm::cl::value_desc("filename"), llvm::cl::init("-"),
+    llvm::cl::cat(GenCategory));
+
+static llvm::cl::opt<mlcompileropt::OutputFormat> Emit(
+    "emit", llvm::cl::desc("Output format (default: bc for .bc outputs, ll otherwise)"),
+    llvm::cl::values(
+        clEnumValN(mlcompileropt::OutputFormat::Text, "ll", "Textual IR"),
+        clEnumValN(mlcompileropt::OutputFormat::Bitcode, "bc", "Bitcode")),
+    llvm::cl::cat(GenCategory));
+
+int main(int argc, char** argv) {
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::HideUnrelatedOptions(GenCategory);
+    llvm::cl::ParseCommandLineOptions(argc, argv,
+                                      "ML Compiler Optimization Framework - Kernel Generator\n");
+
+    mlcompileropt::KernelGeneratorOptions Opts;
+    if (!Kinds.empty()) {
+        Opts.Kinds.clear();
+        for (const std::string &Name : Kinds) {
+            llvm::Optional<mlcompileropt::KernelKind> Kind = mlcompileropt::parseKernelKind(Name);
+            if (!Kind) {
+                llvm::errs() << "Unknown kernel kind '" << Name << "'\n";
+                return 1;
+            }
+            Opts.Kinds.push_back(*Kind);
+        }
+    }
+    Opts.NumKernels = NumKernels;
+    Opts.M = MatM;
+    Opts.N = MatN;
+    Opts.K = MatK;
+    Opts.Channels = Channels;
+    Opts.Height = Height;
+    Opts.Width = Width;
+    Opts.Filters = Filters;
+    Opts.KernelSize = KernelSize;
+    Opts.Length = Length;
+    Opts.ChainLength = ChainLength;
+    Opts.Batch = Batch;
+    Opts.LoopDepth = LoopDepth;
+    Opts.Unroll = Unroll;
+
+    llvm::LLVMContext Context;
+    auto ModuleOrErr = mlcompileropt::generateKernelModule(Context, Opts);
+    if (!ModuleOrErr) {
+        llvm::errs() << "Error: " << llvm::toString(ModuleOrErr.takeError()) << "\n";
+        return 1;
+    }
+    std::unique_ptr<llvm::Module> Module = std::move(*ModuleOrErr);
+    if (llvm::verifyModule(*Module, &llvm::errs())) {
+        llvm::errs() << "Error: generated module is broken\n";
+        return 1;
+    }
+
+    mlcompileropt::OutputFormat Format = Emit;
+    if (!Emit.getNumOccurrences())
+        Format = llvm::StringRef(OutputFilename).endswith(".bc")
+                     ? mlcompileropt::OutputFormat::Bitcode
+                     : mlcompileropt::OutputFormat::Text;
+
+    std::error_code EC;
+    llvm::ToolOutputFile Out(OutputFilename, EC,
+                             Format == mlcompileropt::OutputFormat::Text
+                                 ? llvm::sys::fs::OF_Text
+                                 : llvm::sys::fs::OF_None);
+    if (EC) {
+        llvm::errs() << "Error opening '" << OutputFilename << "': " << EC.message() << "\n";
+        return 1;
+    }
+    mlcompileropt::writeModule(*Module, Out.os(), Format);
+    Out.keep();
+    return 0;
+}
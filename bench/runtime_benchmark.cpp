@@ -0,0 +1,436 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <iomanip>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Driver pipeline and helpers shared with ml_compiler
+#include "driver/ModuleIO.h"
+#include "driver/OptimizationPipeline.h"
+#include "driver/SampleStats.h"
+
+// Kernel execution through the JIT
+#include "jit/JITKernel.h"
+#include "jit/KernelBuffers.h"
+#include "jit/KernelSpec.h"
+#include "jit/KernelTimer.h"
+
+// Per-kernel parameters of the custom passes
+#include "passes/TuningConfig.h"
+
+// Thread pool that runs parallelized loops
+#include "runtime/ParallelRuntime.h"
+
+#ifndef ML_COMPILER_VERSION
+#define ML_COMPILER_VERSION "unknown"
+#endif
+
+static llvm::cl::OptionCategory BenchCategory("bench_runtime options");
+
+static llvm::cl::list<std::string> InputFiles(
+    llvm::cl::Positional, llvm::cl::desc("<ir-file> [<ir-file> ...]"),
+    llvm::cl::OneOrMore, llvm::cl::cat(BenchCategory));
+
+static llvm::cl::list<std::string> Specs(
+    "spec",
+    llvm::cl::desc("Kernel to run and the shape of its arguments, e.g. "
+                   "matmul_2x2:A=4,B=4,C=4 (repeatable)"),
+    llvm::cl::value_desc("kernel:arg=value,..."), llvm::cl::OneOrMore,
+    llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> Warmup(
+    "warmup", llvm::cl::desc("Untimed samples per kernel and configuration"),
+    llvm::cl::init(1), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<unsigned> Repetitions(
+    "repetitions", llvm::cl::desc("Timed samples per kernel and configuration"),
+    llvm::cl::init(10), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<double> MinSampleTime(
+    "min-sample-ms",
+    llvm::cl::desc("Repeat the kernel until one sample takes this long"),
+    llvm::cl::init(20.0), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<double> RelTolerance(
+    "rtol", llvm::cl::desc("Relative tolerance of the output check"),
+    llvm::cl::init(1e-4), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<double> AbsTolerance(
+    "atol", llvm::cl::desc("Absolute tolerance of the output check"),
+    llvm::cl::init(1e-6), llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<bool> ComparePrefetch(
+    "prefetch-config",
+    llvm::cl::desc("Also time the custom configuration with software "
+                   "prefetches"),
+    llvm::cl::cat(BenchCategory));
+
+static llvm::cl::list<unsigned> ThreadCounts(
+    "threads",
+    llvm::cl::desc("Also time the custom configuration with its outermost "
+                   "loops parallelized, on each of these numbers of threads "
+                   "(e.g. 1,2,4,8)"),
+    llvm::cl::CommaSeparated, llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<mlcompileropt::ParallelSchedule> Schedule(
+    "parallel-schedule",
+    llvm::cl::desc("Schedule of the parallelized loops with --threads"),
+    llvm::cl::init(mlcompileropt::ParallelSchedule::Static),
+    llvm::cl::values(clEnumValN(mlcompileropt::ParallelSchedule::Static, "static",
+                                "one block of iterations per thread"),
+                     clEnumValN(mlcompileropt::ParallelSchedule::Dynamic, "dynamic",
+                                "chunks balanced by work stealing")),
+    llvm::cl::cat(BenchCategory));
+
+static llvm::cl::opt<std::string> JSONFile(
+    "json", llvm::cl::desc("Write the results as JSON to this file"),
+    llvm::cl::value_desc("filename"), llvm::cl::cat(BenchCategory));
+
+// Compiled variants of each kernel, in the order they are run. The
+// unoptimized module is the reference for the output check and the
+// speedups. Prefetch is only run with --prefetch-config, and Parallel
+// once per thread count of --threads.
+enum Config { Original, Baseline, Custom, Prefetch, Parallel, NumConfigs };
+static const char *const ConfigNames[NumConfigs] = {"original", "baseline", "custom",
+                                                    "prefetch", "parallel"};
+
+// Results of one kernel under one configuration
+struct KernelResult {
+    std::string File;
+    std::string Kernel;
+    std::string Config;
+    unsigned Threads = 0;  // parallel configuration only
+    uint64_t Iterations = 0;
+    uint64_t Flops = 0;
+    uint64_t Bytes = 0;
+    std::vector<double> Samples;  // microseconds per call
+    std::string Mismatch;
+
+    mlcompileropt::SampleSummary time() const {
+        return mlcompileropt::summarizeSamples(Samples);
+    }
+    double gflops() const {
+        double T = time().Median;
+        return T > 0 ? Flops / T * 1e-3 : 0.0;
+    }
+    double gbytes() const {
+        double T = time().Median;
+        return T > 0 ? Bytes / T * 1e-3 : 0.0;
+    }
+};
+
+// Sets the prefetch pass's -software-prefetch option
+static void setSoftwarePrefetch(bool Enable) {
+    auto &Options = llvm::cl::getRegisteredOptions();
+    auto It = Options.find("software-prefetch");
+    if (It != Options.end())
+        static_cast<llvm::cl::opt<bool> *>(It->second)->setValue(Enable);
+}
+
+static void reportError(llvm::Error E) {
+    llvm::logAllUnhandledErrors(std::move(E), llvm::errs(), "error: ");
+}
+
+// Applies the optimization configuration to the kernel's module. Prefetch
+// adds the software prefetch pass with -software-prefetch and Parallel
+// sets the kernel's parallel schedule, on top of any tuning configuration
+// it carries.
+static void optimizeKernelModule(llvm::Module &Module, llvm::StringRef Kernel, Config C) {
+    if (C == Original)
+        return;
+    if (C == Parallel) {
+        llvm::Function &F = *Module.getFunction(Kernel);
+        mlcompileropt::TuningConfig Tuning =
+            mlcompileropt::TuningConfig::get(F).getValueOr(mlcompileropt::TuningConfig());
+        Tuning.Parallel = Schedule.getValue();
+        Tuning.attachTo(F);
+    }
+
+    // The pipeline reads -software-prefetch when it is built
+    setSoftwarePrefetch(C == Prefetch);
+    mlcompileropt::OptimizationPipeline Pipeline(/*UseCustomPasses=*/C != Baseline);
+    setSoftwarePrefetch(false);
+    Pipeline.run(Module);
+}
+
+static bool benchmarkKernel(const std::string &InputFile, const llvm::MemoryBuffer &Input,
+                            const mlcompileropt::KernelSpec &Spec,
+                            std::vector<KernelResult> &Results) {
+    // The argument layout comes from the unoptimized signature
+    auto FlopContext = std::make_unique<llvm::LLVMContext>();
+    llvm::SMDiagnostic Err;
+    std::unique_ptr<llvm::Module> FlopModule =
+        mlcompileropt::parseModule(Input.getMemBufferRef(), *FlopContext, Err);
+    if (!FlopModule) {
+        Err.print("bench_runtime", llvm::errs());
+        return false;
+    }
+    llvm::Function *F = FlopModule->getFunction(Spec.Function);
+    if (!F || F->isDeclaration()) {
+        llvm::errs() << "error: " << InputFile << " does not define @" << Spec.Function << "\n";
+        return false;
+    }
+    auto BuffersOrErr = mlcompileropt::KernelBuffers::create(*F, Spec);
+    if (!BuffersOrErr) {
+        reportError(BuffersOrErr.takeError());
+        return false;
+    }
+    mlcompileropt::KernelBuffers &Buffers = *BuffersOrErr;
+
+    // Work per call: measured FLOPs, and every argument buffer moved once
+    uint64_t Flops = 0;
+    if (Spec.Flops) {
+        Flops = *Spec.Flops;
+    } else {
+        auto FlopsOrErr = mlcompileropt::countFlops(std::move(FlopModule), std::move(FlopContext),
+                                                    Spec.Function, Buffers);
+        if (!FlopsOrErr) {
+            reportError(FlopsOrErr.takeError());
+            return false;
+        }
+        Flops = *FlopsOrErr;
+    }
+    uint64_t Bytes = Spec.Bytes ? *Spec.Bytes : Buffers.getTotalBytes();
+
+    mlcompileropt::KernelBuffers Reference = Buffers.clone();
+    for (unsigned C = 0; C < NumConfigs; ++C) {
+        if ((C == Prefetch && !ComparePrefetch) || (C == Parallel && ThreadCounts.empty()))
+            continue;
+
+        auto KernelOrErr = mlcompileropt::compileKernelModule(
+            Input.getMemBufferRef(), Spec.Function,
+            [&](llvm::Module &Module) { optimizeKernelModule(Module, Spec.Function, Config(C)); });
+        if (!KernelOrErr) {
+            reportError(KernelOrErr.takeError());
+            return false;
+        }
+        const mlcompileropt::JITKernel &Kernel = **KernelOrErr;
+
+        // The parallel kernel is compiled once and run on every number of
+        // threads; the other configurations run once
+        std::vector<unsigned> Threads{0};
+        if (C == Parallel)
+            Threads.assign(ThreadCounts.begin(), ThreadCounts.end());
+        for (unsigned NumThreads : Threads) {
+            KernelResult Result;
+            Result.File = InputFile;
+            Result.Kernel = Spec.Function;
+            Result.Config = ConfigNames[C];
+            Result.Flops = Flops;
+            Result.Bytes = Bytes;
+            if (C == Parallel) {
+                __ml_set_num_threads(NumThreads);
+                Result.Threads = __ml_get_num_threads();
+                Result.Config += "@" + std::to_string(Result.Threads);
+            }
+
+            // One call from the initial inputs is checked against the
+            // unoptimized kernel
+            mlcompileropt::KernelBuffers Run = Buffers.clone();
+            Kernel.run(Run.getArgumentArray(), 1);
+            if (C == Original)
+                Reference = Run.clone();
+            Result.Mismatch = Run.compare(Reference, RelTolerance, AbsTolerance);
+
+            mlcompileropt::KernelTimingOptions Options;
+            Options.Warmup = Warmup;
+            Options.Repetitions = Repetitions;
+            Options.MinSampleTime = MinSampleTime;
+            mlcompileropt::KernelTiming Timing = mlcompileropt::timeKernel(Kernel, Run, Options);
+            Result.Iterations = Timing.Iterations;
+            Result.Samples = std::move(Timing.Samples);
+            Results.push_back(std::move(Result));
+        }
+    }
+    return true;
+}
+
+static void writeJSON(llvm::raw_ostream &OS, const std::vector<KernelResult> &Results) {
+    llvm::json::OStream J(OS, /*IndentSize=*/2);
+    J.object([&] {
+        J.attribute("tool", "bench_runtime");
+        J.attribute("version", ML_COMPILER_VERSION);
+        J.attribute("llvm_version", LLVM_VERSION_STRING);
+        J.attribute("repetitions", int64_t(Repetitions));
+        J.attribute("time_unit", "us");
+        J.attributeArray("results", [&] {
+            for (const KernelResult &R : Results) {
+                mlcompileropt::SampleSummary T = R.time();
+                J.object([&] {
+                    J.attribute("file", R.File);
+                    J.attribute("kernel", R.Kernel);
+                    J.attribute("config", R.Config);
+                    if (R.Threads)
+                        J.attribute("threads", int64_t(R.Threads));
+                    J.attribute("iterations_per_sample", int64_t(R.Iterations));
+                    J.attribute("flops_per_call", int64_t(R.Flops));
+                    J.attribute("bytes_per_call", int64_t(R.Bytes));
+                    J.attributeObject("time", [&] {
+                        J.attribute("min", T.Min);
+                        J.attribute("median", T.Median);
+                        J.attribute("p95", T.P95);
+                        J.attribute("max", T.Max);
+                        J.attribute("mean", T.Mean);
+                        J.attribute("stddev", T.StdDev);
+                    });
+                    J.attribute("gflops", R.gflops());
+                    J.attribute("gbytes_per_s", R.gbytes());
+                    J.attribute("output_matches", R.Mismatch.empty());
+                });
+            }
+        });
+    });
+    OS << "\n";
+}
+
+int main(int argc, char** argv) {
+    llvm::InitLLVM X(argc, argv);
+    llvm::cl::HideUnrelatedOptions(BenchCategory);
+    llvm::cl::ParseCommandLineOptions(argc, argv,
+                                      "ML Compiler Optimization Framework - Runtime Benchmark\n");
+    if (Repetitions == 0) {
+        llvm::errs() << "--repetitions must be at least 1\n";
+        return 1;
+    }
+
+    std::vector<mlcompileropt::KernelSpec> KernelSpecs;
+    for (const std::string &Text : Specs) {
+        auto SpecOrErr = mlcompileropt::parseKernelSpec(Text);
+        if (!SpecOrErr) {
+            reportError(SpecOrErr.takeError());
+            return 1;
+        }
+        KernelSpecs.push_back(std::move(*SpecOrErr));
+    }
+
+    std::cout << "ML Compiler Optimization Framework - Runtime Benchmark\n";
+    std::cout << "=====================================================\n";
+    std::cout << Warmup << " warm-up and " << Repetitions
+              << " timed samples of at least " << MinSampleTime << " ms per configuration\n\n";
+
+    std::cout << std::left << std::setw(24) << "File"
+              << std::setw(20) << "Kernel"
+              << std::setw(12) << "Config"
+              << std::right << std::setw(14) << "time (us)"
+              << std::right << std::setw(12) << "p95 (us)"
+              << std::right << std::setw(10) << "GFLOP/s"
+              << std::right << std::setw(10) << "GB/s"
+              << std::right << std::setw(10) << "speedup"
+              << "  output\n";
+    std::cout << std::string(124, '-') << "\n";
+
+    std::vector<KernelResult> Results;
+    std::vector<bool> SpecUsed(KernelSpecs.size());
+    bool Failed = false;
+
+    for (const std::string &InputFile : InputFiles) {
+        auto BufferOrErr = llvm::MemoryBuffer::getFile(InputFile);
+        if (!BufferOrErr) {
+            llvm::errs() << "Error loading file: " << InputFile << ": "
+                         << BufferOrErr.getError().message() << "\n";
+            Failed = true;
+            continue;
+        }
+
+        // Run every spec whose kernel the file defines
+        llvm::LLVMContext Context;
+        llvm::SMDiagnostic Err;
+        std::unique_ptr<llvm::Module> Module =
+            mlcompileropt::parseModule((*BufferOrErr)->getMemBufferRef(), Context, Err);
+        if (!Module) {
+            Err.print("bench_runtime", llvm::errs());
+            Failed = true;
+            continue;
+        }
+
+        for (size_t S = 0; S < KernelSpecs.size(); ++S) {
+            const mlcompileropt::KernelSpec &Spec = KernelSpecs[S];
+            llvm::Function *F = Module->getFunction(Spec.Function);
+            if (!F || F->isDeclaration())
+                continue;
+            SpecUsed[S] = true;
+
+            size_t First = Results.size();
+            if (!benchmarkKernel(InputFile, **BufferOrErr, Spec, Results)) {
+                Failed = true;
+                continue;
+            }
+
+            double OriginalTime = Results[First].time().Median;
+            for (size_t I = First; I < Results.size(); ++I) {
+                const KernelResult &R = Results[I];
+                mlcompileropt::SampleSummary T = R.time();
+                std::cout << std::left << std::setw(24) << llvm::sys::path::filename(InputFile).str()
+                          << std::setw(20) << R.Kernel
+                          << std::setw(12) << R.Config
+                          << std::fixed << std::setprecision(4)
+                          << std::right << std::setw(14) << T.Median
+                          << std::right << std::setw(12) << T.P95
+                          << std::setprecision(2)
+                          << std::right << std::setw(10) << R.gflops()
+                          << std::right << std::setw(10) << R.gbytes()
+                          << std::right << std::setw(9) << (T.Median > 0 ? OriginalTime / T.Median : 0.0) << "x"
+                          << "  " << (R.Mismatch.empty() ? "ok" : "MISMATCH: " + R.Mismatch)
+                          << "\n";
+                if (!R.Mismatch.empty())
+                    Failed = true;
+            }
+            std::cout << std::left << std::setw(24) << "" << Results[First].Flops
+                      << " FLOPs and " << Results[First].Bytes << " bytes per call\n";
+
+            // Speedup of every thread count over the first one
+            const KernelResult *FirstParallel = nullptr;
+            for (size_t I = First; I < Results.size(); ++I) {
+                const KernelResult &R = Results[I];
+                if (!R.Threads)
+                    continue;
+                if (!FirstParallel) {
+                    FirstParallel = &R;
+                    std::cout << std::left << std::setw(24) << "" << "scaling ("
+                              << mlcompileropt::getParallelScheduleName(Schedule).str()
+                              << ", vs " << R.Threads << " thread" << (R.Threads > 1 ? "s" : "")
+                              << "):";
+                }
+                double T = R.time().Median;
+                std::cout << " " << R.Threads << "T "
+                          << std::setprecision(2)
+                          << (T > 0 ? FirstParallel->time().Median / T : 0.0) << "x";
+            }
+            if (FirstParallel)
+                std::cout << "\n";
+        }
+    }
+
+    for (size_t S = 0; S < KernelSpecs.size(); ++S) {
+        if (!SpecUsed[S]) {
+            llvm::errs() << "error: no input defines @" << KernelSpecs[S].Function << "\n";
+            Failed = true;
+        }
+    }
+
+    if (!JSONFile.empty()) {
+        std::error_code EC;
+        llvm::raw_fd_ostream OS(JSONFile, EC, llvm::sys::fs::OF_Text);
+        if (EC) {
+            llvm::errs() << "Error writing " << JSONFile << ": " << EC.message() << "\n";
+            return 1;
+        }
+        writeJSON(OS, Results);
+    }
+
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+#!/usr/bin/env bash
+# Compile-time scaling sweep: generates modules of 10 to 10,000 synthetic
+# kernels with gen_kernels and runs bench_optimizer on each of them.
+#
+# Usage: scaling_sweep.sh [options] [-- bench_optimizer options]
+#   -b DIR   build directory (default: build)
+#   -o DIR   directory for the modules and reports (default: scaling)
+#   -n LIST  kernels per module (default: "10 100 1000 10000")
+#   -k LIST  kernel kinds, one series each; "mixed" cycles through all
+#            kinds (default: "matmul conv2d-nchw conv2d-nhwc depthwise-conv
+#            elementwise mixed")
+#   -g ARGS  extra gen_kernels options, e.g. "--unroll=4 --depth=5"
+#   -r N     timed repetitions per module (default: 3)
+#
+# Writes <kind>-<count>.{ll,json,csv} per point and summary.csv with the
+# median total time and peak RSS of every point and configuration.
+
+set -euo pipefail
+
+BUILD_DIR=build
+OUT_DIR=scaling
+COUNTS="10 100 1000 10000"
+KINDS="matmul conv2d-nchw conv2d-nhwc depthwise-conv elementwise mixed"
+GEN_ARGS=""
+REPETITIONS=3
+
+while getopts "b:o:n:k:g:r:h" Opt; do
+  case "$Opt" in
+    b) BUILD_DIR="$OPTARG" ;;
+    o) OUT_DIR="$OPTARG" ;;
+    n) COUNTS="$OPTARG" ;;
+    k) KINDS="$OPTARG" ;;
+    g) GEN_ARGS="$OPTARG" ;;
+    r) REPETITIONS="$OPTARG" ;;
+    *) sed -n '2,17p' "$0" | sed 's/^# \{0,1\}//'; exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+GEN="$BUILD_DIR/bench/gen_kernels"
+BENCH="$BUILD_DIR/bench/bench_optimizer"
+for Tool in "$GEN" "$BENCH"; do
+  if [ ! -x "$Tool" ]; then
+    echo "error: $Tool not found; build the project first or pass -b" >&2
+    exit 1
+  fi
+done
+mkdir -p "$OUT_DIR"
+
+SUMMARY="$OUT_DIR/summary.csv"
+echo "kind,kernels,config,total_median_ms,ms_per_kernel,peak_rss_kb" > "$SUMMARY"
+
+for Kind in $KINDS; do
+  if [ "$Kind" = mixed ]; then
+    KindArg="matmul,batched-matmul,conv2d-nchw,conv2d-nhwc,depthwise-conv,elementwise"
+  else
+    KindArg="$Kind"
+  fi
+  for Count in $COUNTS; do
+    Name="$OUT_DIR/$Kind-$Count"
+    # shellcheck disable=SC2086
+    "$GEN" --kinds="$KindArg" --kernels="$Count" $GEN_ARGS -o "$Name.ll"
+    echo "== $Kind, $Count kernels"
+    "$BENCH" "$Name.ll" --warmup=0 --repetitions="$REPETITIONS" \
+      --json="$Name.json" --csv="$Name.csv" "$@"
+    awk -F, -v Kind="$Kind" -v Count="$Count" \
+      '$3 == "total" { printf "%s,%s,%s,%.4f,%.6f,%s\n", Kind, Count, $2, $5, $5 / Count, $10 }' \
+      "$Name.csv" >> "$SUMMARY"
+  done
+done
+
+echo
+column -s, -t "$SUMMARY" 2>/dev/null || cat "$SUMMARY"
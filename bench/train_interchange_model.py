@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+"""Trains the loop interchange decision tree and writes it as a C++ header.
+
+Reads training logs written by collect_training_data, labels every record
+as worth interchanging when its measured speedup reaches --min-speedup, fits
+a CART decision tree on the features and writes src/passes/InterchangeModel.h.
+Training is deterministic: the same logs always give the same header.
+
+Before training on every record, the tree is cross-validated: the kernels
+are dealt into --folds folds, and each fold is predicted by a tree trained
+on the others. The accuracy on the held-out folds is reported next to the
+accuracy of the cost model heuristic on the same records.
+
+    train_interchange_model.py -o src/passes/InterchangeModel.h log1.csv ...
+"""
+
+import argparse
+import sys
+
+LOG_VERSION = "# memory-coalescing interchange training log v2"
+NAME_COLUMNS = 3  # function, loop, outer_loop
+RESULT_COLUMNS = 2  # heuristic, speedup
+
+
+def read_logs(paths):
+    """Returns the feature names and one (kernel, values, heuristic, speedup)
+    row per record, where kernel identifies the log and function."""
+    names = None
+    rows = []
+    for path in paths:
+        with open(path) as f:
+            lines = [l.rstrip("\n") for l in f if l.strip()]
+        if not lines or lines[0] != LOG_VERSION:
+            sys.exit(f"{path}: not a training log")
+        header = lines[1].split(",")
+        features = header[NAME_COLUMNS:-RESULT_COLUMNS]
+        if names is None:
+            names = features
+        elif names != features:
+            sys.exit(f"{path}: features differ from the other logs")
+        # Unrolled outer loops give one kernel several copies of a nest,
+        # with the same features and the same timing; keep one of each
+        seen = set()
+        for line in lines[2:]:
+            fields = line.split(",")
+            key = (fields[0],) + tuple(fields[NAME_COLUMNS:])
+            if key in seen:
+                continue
+            seen.add(key)
+            values = [float(v) for v in fields[NAME_COLUMNS:-RESULT_COLUMNS]]
+            rows.append(((path, fields[0]), values, fields[-2] == "1",
+                         float(fields[-1])))
+    return names, rows
+
+
+def gini(labels):
+    if not labels:
+        return 0.0
+    p = sum(labels) / len(labels)
+    return 2.0 * p * (1.0 - p)
+
+
+def majority(labels):
+    # Ties keep the loop order
+    return 2 * sum(labels) > len(labels)
+
+
+def best_split(samples, num_features, min_leaf):
+    labels = [l for _, l in samples]
+    best = None
+    best_impurity = gini(labels) * len(samples)
+    for feature in range(num_features):
+        ordered = sorted(samples, key=lambda s: s[0][feature])
+        for i in range(min_leaf, len(ordered) - min_leaf + 1):
+            lo, hi = ordered[i - 1][0][feature], ordered[i][0][feature]
+            if lo == hi:
+                continue
+            left = [l for _, l in ordered[:i]]
+            right = [l for _, l in ordered[i:]]
+            impurity = gini(left) * len(left) + gini(right) * len(right)
+            if impurity < best_impurity - 1e-12:
+                best_impurity = impurity
+                best = (feature, (lo + hi) / 2.0)
+    return best
+
+
+def build(samples, num_features, depth, max_depth, min_leaf, nodes):
+    """Appends the subtree for samples to nodes in preorder."""
+    index = len(nodes)
+    labels = [l for _, l in samples]
+    nodes.append(None)
+    split = None
+    if depth < max_depth and 0 < sum(labels) < len(labels):
+        split = best_split(samples, num_features, min_leaf)
+    if split is None:
+        nodes[index] = (-1, 0.0, 0, 0, majority(labels))
+        return index
+    feature, threshold = split
+    left = [s for s in samples if s[0][feature] <= threshold]
+    right = [s for s in samples if s[0][feature] > threshold]
+    true_child = build(left, num_features, depth + 1, max_depth, min_leaf, nodes)
+    false_child = build(right, num_features, depth + 1, max_depth, min_leaf, nodes)
+    # A split whose leaves all decide the same way changes no decision
+    if (nodes[true_child][0] < 0 and nodes[false_child][0] < 0 and
+            nodes[true_child][4] == nodes[false_child][4]):
+        decision = nodes[true_child][4]
+        del nodes[index + 1:]
+        nodes[index] = (-1, 0.0, 0, 0, decision)
+        return index
+    nodes[index] = (feature, threshold, true_child, false_child, majority(labels))
+    return index
+
+
+def predict(nodes, values):
+    node = nodes[0]
+    while node[0] >= 0:
+        node = nodes[node[2] if values[node[0]] <= node[1] else node[3]]
+    return node[4]
+
+
+def cross_validate(rows, num_features, folds, args):
+    """Returns how many held-out records the tree and the heuristic got
+    right. Records of one kernel share a timing, so they share a fold."""
+    kernels = sorted({kernel for kernel, _, _, _ in rows})
+    fold_of = {kernel: i % folds for i, kernel in enumerate(kernels)}
+    model_correct = heuristic_correct = 0
+    for fold in range(folds):
+        train = [(v, s >= args.min_speedup) for k, v, _, s in rows
+                 if fold_of[k] != fold]
+        nodes = []
+        build(train, num_features, 0, args.max_depth, args.min_leaf, nodes)
+        for kernel, values, heuristic, speedup in rows:
+            if fold_of[kernel] != fold:
+                continue
+            label = speedup >= args.min_speedup
+            model_correct += predict(nodes, values) == label
+            heuristic_correct += heuristic == label
+    return model_correct, heuristic_correct
+
+
+def format_float(value):
+    text = repr(float(value))
+    if text in ("inf", "-inf", "nan"):
+        sys.exit("features must be finite")
+    return text + "f"
+
+
+def write_header(out, names, nodes, num_records, min_speedup, accuracy):
+    out.write(f"""//===- InterchangeModel.h - Embedded Loop Interchange Model ---------===//
+//
+// Generated by bench/train_interchange_model.py from {num_records} training
+// records with --min-speedup={min_speedup}. Do not edit; rerun the script.
+//{accuracy}
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_PASSES_INTERCHANGE_MODEL_H
+#define MLCOMPILEROPT_PASSES_INTERCHANGE_MODEL_H
+
+namespace mlcompileropt {{
+namespace interchange_model {{
+
+// Records the tree was trained on
+constexpr unsigned NumTrainingRecords = {num_records};
+
+// Features the tree was trained on, in LoopFeature order
+constexpr const char *FeatureNames[] = {{
+""")
+    for name in names:
+        out.write(f'    "{name}",\n')
+    out.write("""};
+
+// An inner node continues at TrueChild if Values[Feature] <= Threshold and
+// at FalseChild otherwise. Leaves have Feature -1 and decide Interchange.
+struct Node {
+  int Feature;
+  float Threshold;
+  int TrueChild;
+  int FalseChild;
+  bool Interchange;
+};
+
+constexpr Node Nodes[] = {
+""")
+    for feature, threshold, true_child, false_child, decision in nodes:
+        out.write(f"    {{{feature}, {format_float(threshold)}, {true_child}, "
+                  f"{false_child}, {'true' if decision else 'false'}}},\n")
+    out.write("""};
+
+} // namespace interchange_model
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_PASSES_INTERCHANGE_MODEL_H
+""")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("logs", nargs="*", help="training logs")
+    parser.add_argument("-o", "--output", default="-", help="header to write")
+    parser.add_argument("--min-speedup", type=float, default=1.05,
+                        help="speedup from which an interchange is worth it")
+    parser.add_argument("--max-depth", type=int, default=4)
+    parser.add_argument("--min-leaf", type=int, default=2,
+                        help="fewest records in a leaf")
+    parser.add_argument("--folds", type=int, default=5,
+                        help="cross-validation folds; 0 skips it")
+    parser.add_argument("--features", default=None,
+                        help="comma-separated feature names; only needed "
+                             "without logs")
+    args = parser.parse_args()
+
+    if args.logs:
+        names, rows = read_logs(args.logs)
+    elif args.features:
+        names, rows = args.features.split(","), []
+    else:
+        parser.error("give training logs, or --features for an empty model")
+
+    samples = [(values, speedup >= args.min_speedup)
+               for _, values, _, speedup in rows]
+    nodes = []
+    build(samples, len(names), 0, args.max_depth, args.min_leaf, nodes)
+
+    accuracy = ""
+    if samples:
+        correct = sum(predict(nodes, v) == l for v, l in samples)
+        positive = sum(l for _, l in samples)
+        print(f"{len(samples)} records, {positive} worth interchanging; "
+              f"{len(nodes)} nodes, training accuracy "
+              f"{100.0 * correct / len(samples):.1f}%", file=sys.stderr)
+    if samples and args.folds > 1:
+        model, heuristic = cross_validate(rows, len(names), args.folds, args)
+        model = 100.0 * model / len(samples)
+        heuristic = 100.0 * heuristic / len(samples)
+        print(f"{args.folds}-fold held-out accuracy {model:.1f}%, cost model "
+              f"heuristic {heuristic:.1f}%", file=sys.stderr)
+        accuracy = (f" Held-out accuracy in {args.folds}-fold cross-validation:"
+                    f"\n// {model:.1f}%, against {heuristic:.1f}% for the cost "
+                    f"model heuristic.\n//")
+
+    header_args = (names, nodes, len(samples), args.min_speedup, accuracy)
+    if args.output == "-":
+        write_header(sys.stdout, *header_args)
+    else:
+        with open(args.output, "w") as out:
+            write_header(out, *header_args)
+
+
+if __name__ == "__main__":
+    main()
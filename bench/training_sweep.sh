@@ -0,0 +1,109 @@
+#!/usr/bin/env bash
+# Interchange training sweep: generates one module with a kernel of every
+# interchange kind (column-walk, transpose-add, transpose, column-add) per
+# matrix shape and nest depth with gen_kernels, times each kernel with and
+# without its interchanges with collect_training_data, adds the column
+# walks of tests/test_files/strided_access.ll and trains the decision tree
+# on all of the logs. The other kinds have no interchange candidates.
+#
+# Usage: training_sweep.sh [options]
+#   -b DIR   build directory (default: build)
+#   -o DIR   directory for the modules and training logs (default: training)
+#   -s LIST  M x N shapes (default: every pair of 32 48 64 96 128 256 384
+#            512 1024 2048 with at most 2^20 elements)
+#   -d LIST  nest depths; each level above 2 adds a batch loop of 4
+#            iterations, which O3 unrolls (default: "2 3")
+#   -e N     largest buffer in elements; bigger shape and depth pairs are
+#            skipped (default: 4194304)
+#   -r N     timed samples per kernel and decision (default: 5)
+#
+# Writes <shape>-d<depth>.{ll,csv} per point, strided_access.csv and the
+# trained header InterchangeModel.h; copy it to src/passes to compile it
+# in. The default sweep takes about ten minutes.
+
+set -euo pipefail
+
+SRC_DIR="$(cd "$(dirname "$0")/.." && pwd)"
+BUILD_DIR=build
+OUT_DIR=training
+SIZES="32 48 64 96 128 256 384 512 1024 2048"
+SHAPES=""
+for M in $SIZES; do
+  for N in $SIZES; do
+    if [ $((M * N)) -le 1048576 ]; then
+      SHAPES="$SHAPES ${M}x${N}"
+    fi
+  done
+done
+DEPTHS="2 3"
+MAX_ELEMENTS=4194304
+REPETITIONS=5
+KINDS="column-walk transpose-add transpose column-add"
+BATCH=4
+
+while getopts "b:o:s:d:e:r:h" Opt; do
+  case "$Opt" in
+    b) BUILD_DIR="$OPTARG" ;;
+    o) OUT_DIR="$OPTARG" ;;
+    s) SHAPES="$OPTARG" ;;
+    d) DEPTHS="$OPTARG" ;;
+    e) MAX_ELEMENTS="$OPTARG" ;;
+    r) REPETITIONS="$OPTARG" ;;
+    *) sed -n '2,22p' "$0" | sed 's/^# \{0,1\}//'; exit 1 ;;
+  esac
+done
+
+GEN="$BUILD_DIR/bench/gen_kernels"
+COLLECT="$BUILD_DIR/bench/collect_training_data"
+for Tool in "$GEN" "$COLLECT"; do
+  if [ ! -x "$Tool" ]; then
+    echo "error: $Tool not found; build the project first or pass -b" >&2
+    exit 1
+  fi
+done
+mkdir -p "$OUT_DIR"
+
+for Shape in $SHAPES; do
+  M="${Shape%x*}"
+  N="${Shape#*x}"
+  for Depth in $DEPTHS; do
+    # Every buffer holds one M x N matrix per batch iteration
+    Size=$((M * N))
+    for ((Level = 2; Level < Depth; ++Level)); do
+      Size=$((Size * BATCH))
+    done
+    if [ "$Size" -gt "$MAX_ELEMENTS" ]; then
+      continue
+    fi
+    Name="$OUT_DIR/$Shape-d$Depth"
+    "$GEN" --kinds="$(echo $KINDS | tr ' ' ,)" --kernels=4 -m "$M" -n "$N" \
+      --depth="$Depth" --batch="$BATCH" -o "$Name.ll"
+
+    Specs=()
+    Index=0
+    for Kind in $KINDS; do
+      Kernel="${Kind//-/_}_$Index"
+      case "$Kind" in
+        transpose-add|column-add)
+          Specs+=("--spec=$Kernel:X=$Size,Y=$Size,out=$Size") ;;
+        column-walk|transpose)
+          Specs+=("--spec=$Kernel:input=$Size,output=$Size") ;;
+      esac
+      Index=$((Index + 1))
+    done
+
+    echo "== $Shape depth $Depth"
+    "$COLLECT" "$Name.ll" "${Specs[@]}" --repetitions="$REPETITIONS" \
+      --min-sample-ms=10 -o "$Name.csv"
+  done
+done
+
+echo "== strided_access.ll"
+"$COLLECT" "$SRC_DIR/tests/test_files/strided_access.ll" \
+  --spec=column_walk:src=4096,dst=4096 \
+  --spec=column_walk_batched:src=262144,dst=262144 \
+  --repetitions="$REPETITIONS" --min-sample-ms=10 \
+  -o "$OUT_DIR/strided_access.csv"
+
+"$SRC_DIR/bench/train_interchange_model.py" -o "$OUT_DIR/InterchangeModel.h" \
+  "$OUT_DIR"/*.csv
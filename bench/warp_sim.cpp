@@ -0,0 +1,240 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <iomanip>
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Driver pipeline and helpers shared with ml_compiler
+#include "driver/ModuleIO.h"
+#include "driver/OptimizationPipeline.h"
+
+// Warp memory transaction model
+#include "passes/WarpTransactions.h"
+
+#ifndef ML_COMPILER_VERSION
+#define ML_COMPILER_VERSION "unknown"
+#endif
+
+static llvm::cl::OptionCategory WarpCategory("warp_sim options");
+
+static llvm::cl::list<std::string> InputFiles(
+    llvm::cl::Positional, llvm::cl::desc("<ir-file> [<ir-file> ...]"),
+    llvm::cl::OneOrMore, llvm::cl::cat(WarpCategory));
+
+static llvm::cl::opt<std::string> PrePasses(
+    "pre-passes",
+    llvm::cl::desc("Pipeline that brings the input into the form the memory "
+                   "coalescing pass sees at its default placement"),
+    llvm::cl::init("function(sroa,early-cse,instcombine,simplifycfg,"
+                   "loop-simplify,lcssa,loop-mssa(loop-rotate,licm),loop(indvars))"),
+    llvm::cl::cat(WarpCategory));
+
+static llvm::cl::opt<bool> PrintAccesses(
+    "print-accesses",
+    llvm::cl::desc("Print the simulated requests of every load and store"),
+    llvm::cl::cat(WarpCategory));
+
+static llvm::cl::opt<std::string> JSONFile(
+    "json", llvm::cl::desc("Write the results as JSON to this file"),
+    llvm::cl::value_desc("filename"), llvm::cl::cat(WarpCategory));
+
+// Simulated transactions of one function before and after the memory
+// coalescing pass
+struct FunctionResult {
+    std::string File;
+    std::string Function;
+    mlcompileropt::WarpTransactionStats Before;
+    mlcompileropt::WarpTransactionStats After;
+};
+
+// Runs Pipeline on M and records the transactions of every function with
+// memory accesses in loops
+static bool simulate(mlcompileropt::OptimizationPipeline &Pipeline, llvm::StringRef Passes,
+                     llvm::Module &M, llvm::StringRef Label,
+                     std::vector<mlcompileropt::WarpTransactionStats> &Stats) {
+    if (llvm::Error E = Pipeline.setPipeline(Passes)) {
+        llvm::errs() << "Invalid pipeline '" << Passes << "': "
+                     << llvm::toString(std::move(E)) << "\n";
+        return false;
+    }
+    Pipeline.run(M);
+
+    llvm::FunctionAnalysisManager &FAM = Pipeline.getFunctionAnalysisManager();
+    for (llvm::Function &F : M) {
+        if (F.isDeclaration())
+            continue;
+        const auto &Info = FAM.getResult<mlcompileropt::WarpTransactionAnalysis>(F);
+        Stats.push_back(Info.getTotal());
+        if (PrintAccesses && Info.getTotal().Requests) {
+            std::string Text;
+            llvm::raw_string_ostream OS(Text);
+            OS << "@" << F.getName() << " " << Label << ":\n";
+            Info.print(OS);
+            std::cout << OS.str();
+        }
+    }
+    FAM.clear();
+    return true;
+}
+
+static void printStats(const mlcompileropt::WarpTransactionStats &S) {
+    std::cout << std::right << std::setw(10) << S.Requests;
+    for (unsigned Size = 0; Size < mlcompileropt::NumWarpSegmentSizes; ++Size)
+        std::cout << std::setw(8) << std::fixed << std::setprecision(2)
+                  << S.getTransactionsPerRequest(Size);
+    for (unsigned Size = 0; Size < mlcompileropt::NumWarpSegmentSizes; ++Size)
+        std::cout << std::setw(7) << std::fixed << std::setprecision(0)
+                  << 100.0 * S.getEfficiency(Size) << "%";
+}
+
+// Relative change of the transactions at the smallest segment size
+static double getTransactionChange(const FunctionResult &R) {
+    if (!R.Before.Transactions[0])
+        return 0.0;
+    return double(R.After.Transactions[0]) / R.Before.Transactions[0] - 1.0;
+}
+
+static llvm::json::Object toJSON(const mlcompileropt::WarpTransactionStats &S) {
+    llvm::json::Object Result{{"requests", int64_t(S.Requests)},
+                              {"requested_bytes", int64_t(S.RequestedBytes)}};
+    for (unsigned Size = 0; Size < mlcompileropt::NumWarpSegmentSizes; ++Size) {
+        std::string Suffix = std::to_string(mlcompileropt::WarpSegmentSizes[Size]) + "B";
+        Result["transactions_" + Suffix] = int64_t(S.Transactions[Size]);
+        Result["transactions_per_request_" + Suffix] = S.getTransactionsPerRequest(Size);
+        Result["efficiency_" + Suffix] = S.getEfficiency(Size);
+    }
+    return Result;
+}
+
+static void writeJSON(llvm::raw_ostream &OS, const std::vector<FunctionResult> &Results) {
+    llvm::json::OStream J(OS, /*IndentSize=*/2);
+    J.object([&] {
+        J.attribute("tool", "warp_sim");
+        J.attribute("version", ML_COMPILER_VERSION);
+        J.attribute("llvm_version", LLVM_VERSION_STRING);
+        J.attributeArray("results", [&] {
+            for (const FunctionResult &R : Results) {
+                J.object([&] {
+                    J.attribute("file", R.File);
+                    J.attribute("function", R.Function);
+                    J.attribute("before", toJSON(R.Before));
+                    J.attribute("after", toJSON(R.After));
+                    J.attribute("transaction_change", getTransactionChange(R));
+                });
+            }
+        });
+    });
+    OS << "\n";
+}
+
+int main(int argc, char** argv) {
+    llvm::InitLLVM X(argc, argv);
+    // Parameters of the model, defined with the analysis
+    auto &Options = llvm::cl::getRegisteredOptions();
+    for (const char *Name : {"warp-thread-loop", "warp-size", "warp-count"}) {
+        if (Options.count(Name)) {
+            Options[Name]->addCategory(WarpCategory);
+            Options[Name]->setHiddenFlag(llvm::cl::NotHidden);
+        }
+    }
+    llvm::cl::HideUnrelatedOptions(WarpCategory);
+    llvm::cl::ParseCommandLineOptions(argc, argv,
+                                      "ML Compiler Optimization Framework - Warp Transaction Simulator\n");
+
+    std::cout << "ML Compiler Optimization Framework - Warp Transaction Simulator\n";
+    std::cout << "==============================================================\n";
+    std::cout << "Transactions per warp request and efficiency for 32/64/128-byte segments, "
+                 "before and after the memory coalescing pass\n\n";
+
+    std::cout << std::left << std::setw(24) << "File"
+              << std::setw(28) << "Function"
+              << std::setw(8) << "Config"
+              << std::right << std::setw(10) << "requests"
+              << std::setw(8) << "tx/32B" << std::setw(8) << "tx/64B"
+              << std::setw(8) << "tx/128B"
+              << std::setw(8) << "eff32" << std::setw(8) << "eff64"
+              << std::setw(8) << "eff128" << "\n";
+    std::cout << std::string(118, '-') << "\n";
+
+    // Pipelines without the custom passes at any extension point; the
+    // memory coalescing pass only runs where the pipeline names it
+    mlcompileropt::OptimizationPipeline Pipeline(mlcompileropt::CoalescingExtensionPoint::None);
+    std::vector<FunctionResult> Results;
+    bool Failed = false;
+
+    for (const std::string &InputFile : InputFiles) {
+        llvm::LLVMContext Context;
+        llvm::SMDiagnostic Err;
+        std::unique_ptr<llvm::Module> M = mlcompileropt::loadModule(InputFile, Context, Err);
+        if (!M) {
+            Err.print("warp_sim", llvm::errs());
+            Failed = true;
+            continue;
+        }
+
+        std::vector<mlcompileropt::WarpTransactionStats> Before, After;
+        if (!simulate(Pipeline, PrePasses, *M, "before", Before) ||
+            !simulate(Pipeline, "function(memory-coalescing)", *M, "after", After))
+            return 1;
+
+        std::string File = llvm::sys::path::filename(InputFile).str();
+        unsigned Index = 0;
+        for (llvm::Function &F : *M) {
+            if (F.isDeclaration())
+                continue;
+            FunctionResult R{File, F.getName().str(), Before[Index], After[Index]};
+            ++Index;
+            if (!R.Before.Requests && !R.After.Requests)
+                continue;
+
+            std::cout << std::left << std::setw(24) << R.File
+                      << std::setw(28) << R.Function << std::setw(8) << "before";
+            printStats(R.Before);
+            std::cout << "\n" << std::left << std::setw(24) << "" << std::setw(28) << ""
+                      << std::setw(8) << "after";
+            printStats(R.After);
+            std::cout << "\n" << std::left << std::setw(60) << ""
+                      << "transactions (32B): " << std::showpos << std::fixed
+                      << std::setprecision(1) << 100.0 * getTransactionChange(R)
+                      << std::noshowpos << "%\n";
+            Results.push_back(std::move(R));
+        }
+    }
+
+    // Totals over all functions, each access weighted equally
+    mlcompileropt::WarpTransactionStats TotalBefore, TotalAfter;
+    for (const FunctionResult &R : Results) {
+        TotalBefore += R.Before;
+        TotalAfter += R.After;
+    }
+    std::cout << std::string(118, '-') << "\n";
+    std::cout << std::left << std::setw(52) << "total" << std::setw(8) << "before";
+    printStats(TotalBefore);
+    std::cout << "\n" << std::left << std::setw(52) << "" << std::setw(8) << "after";
+    printStats(TotalAfter);
+    std::cout << "\n";
+
+    if (!JSONFile.empty()) {
+        std::error_code EC;
+        llvm::raw_fd_ostream OS(JSONFile, EC, llvm::sys::fs::OF_Text);
+        if (EC) {
+            llvm::errs() << "Error writing " << JSONFile << ": " << EC.message() << "\n";
+            return 1;
+        }
+        writeJSON(OS, Results);
+    }
+
+    return Failed ? 1 : 0;
+}
@@ -6,8 +6,8 @@ target triple = "x86_64-unknown-linux-gnu"
 
 ; Constant pool for floating point values
 @fpZero = private unnamed_addr constant float 0.0
-@fpOneDecimal = private unnamed_addr constant float 0.1
-@fpTwoDecimal = private unnamed_addr constant float 0.2
+@fpOneDecimal = private unnamed_addr constant float 0x3FB99999A0000000
+@fpTwoDecimal = private unnamed_addr constant float 0x3FC99999A0000000
 
 ; Function to perform 2D convolution
 ; Input: 5x5 matrix (float*)
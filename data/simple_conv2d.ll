@@ -103,23 +103,23 @@ entry:
   ; Initialize kernel with value 0.1 for all elements except center (0.2)
   ; Manually initialize all kernel elements
   %kernel_ptr_0 = getelementptr [9 x float], [9 x float]* %kernel, i32 0, i32 0
-  store float 0.1, float* %kernel_ptr_0, align 4
+  store float 0x3FB99999A0000000, float* %kernel_ptr_0, align 4
   %kernel_ptr_1 = getelementptr [9 x float], [9 x float]* %kernel, i32 0, i32 1
-  store float 0.1, float* %kernel_ptr_1, align 4
+  store float 0x3FB99999A0000000, float* %kernel_ptr_1, align 4
   %kernel_ptr_2 = getelementptr [9 x float], [9 x float]* %kernel, i32 0, i32 2
-  store float 0.1, float* %kernel_ptr_2, align 4
+  store float 0x3FB99999A0000000, float* %kernel_ptr_2, align 4
   %kernel_ptr_3 = getelementptr [9 x float], [9 x float]* %kernel, i32 0, i32 3
-  store float 0.1, float* %kernel_ptr_3, align 4
+  store float 0x3FB99999A0000000, float* %kernel_ptr_3, align 4
   %kernel_ptr_4 = getelementptr [9 x float], [9 x float]* %kernel, i32 0, i32 4
-  store float 0.2, float* %kernel_ptr_4, align 4  ; Center has higher weight
+  store float 0x3FC99999A0000000, float* %kernel_ptr_4, align 4  ; Center has higher weight
   %kernel_ptr_5 = getelementptr [9 x float], [9 x float]* %kernel, i32 0, i32 5
-  store float 0.1, float* %kernel_ptr_5, align 4
+  store float 0x3FB99999A0000000, float* %kernel_ptr_5, align 4
   %kernel_ptr_6 = getelementptr [9 x float], [9 x float]* %kernel, i32 0, i32 6
-  store float 0.1, float* %kernel_ptr_6, align 4
+  store float 0x3FB99999A0000000, float* %kernel_ptr_6, align 4
   %kernel_ptr_7 = getelementptr [9 x float], [9 x float]* %kernel, i32 0, i32 7
-  store float 0.1, float* %kernel_ptr_7, align 4
+  store float 0x3FB99999A0000000, float* %kernel_ptr_7, align 4
   %kernel_ptr_8 = getelementptr [9 x float], [9 x float]* %kernel, i32 0, i32 8
-  store float 0.1, float* %kernel_ptr_8, align 4
+  store float 0x3FB99999A0000000, float* %kernel_ptr_8, align 4
   
   ; Initialize input matrix with ramp values (0 to 24)
   %input_ptr_0 = getelementptr [25 x float], [25 x float]* %input, i32 0, i32 0
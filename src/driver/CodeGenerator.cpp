@@ -0,0 +1,212 @@
+//===- CodeGenerator.cpp - Native Code Emission ---------------------===//
+//
+// Implementation of object and assembly emission. Partitions travel to
+// the code generation threads as bitcode, like in the parallel optimizer,
+// and every thread creates its own TargetMachine since they are not
+// thread-safe.
+//
+//===----------------------------------------------------------------===//
+
+#include "driver/CodeGenerator.h"
+
+#include "driver/TargetMachineCache.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define DEBUG_TYPE "code-generator"
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double millisecondsSince(Clock::time_point Start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - Start)
+      .count();
+}
+
+Expected<std::unique_ptr<TargetMachine>>
+createTargetMachine(const TargetMachineCache &TMs, StringRef Triple,
+                    const CodeGenOptions &Opts) {
+  return TMs.createTargetMachine(Triple, Opts.RelocModel, Opts.OptLevel);
+}
+
+// Runs the code generator of TM on M and writes the result to OS
+Error emitModule(Module &M, TargetMachine &TM, raw_pwrite_stream &OS,
+                 const CodeGenOptions &Opts) {
+  legacy::PassManager PM;
+  PM.add(new TargetLibraryInfoWrapperPass(
+      TargetLibraryInfoImpl(Triple(M.getTargetTriple()))));
+  CodeGenFileType FileType = Opts.Format == OutputFormat::Assembly
+                                 ? CGFT_AssemblyFile
+                                 : CGFT_ObjectFile;
+  if (TM.addPassesToEmitFile(PM, OS, /*DwoOut=*/nullptr, FileType))
+    return createStringError(inconvertibleErrorCode(),
+                             "target '%s' cannot emit this file type",
+                             M.getTargetTriple().c_str());
+  PM.run(M);
+  return Error::success();
+}
+
+} // end anonymous namespace
+
+Error emitNativeCode(Module &M, ArrayRef<raw_pwrite_stream *> Outputs,
+                     const CodeGenOptions &Opts, CodeGenStats *Stats) {
+  assert((Opts.Format == OutputFormat::Object ||
+          Opts.Format == OutputFormat::Assembly) &&
+         "not a native output format");
+  assert(!Outputs.empty() && "no outputs");
+  CodeGenStats LocalStats;
+  if (!Stats)
+    Stats = &LocalStats;
+
+  // Modules without a triple are compiled for the host, like llc does
+  if (M.getTargetTriple().empty())
+    M.setTargetTriple(sys::getDefaultTargetTriple());
+  TargetMachineCache TMs;
+  auto TMOrErr = createTargetMachine(TMs, M.getTargetTriple(), Opts);
+  if (!TMOrErr)
+    return TMOrErr.takeError();
+  M.setDataLayout((*TMOrErr)->createDataLayout());
+
+  Stats->NumPartitions = Outputs.size();
+  if (Outputs.size() == 1) {
+    auto Start = Clock::now();
+    Error E = emitModule(M, **TMOrErr, *Outputs[0], Opts);
+    Stats->CodeGenTime = millisecondsSince(Start);
+    return E;
+  }
+
+  // 1. Split the module. Locals stay with their users, so no symbol has
+  // to be renamed and the objects link like the serial one.
+  auto Start = Clock::now();
+
+  std::vector<SmallVector<char, 0>> Partitions;
+  SplitModule(
+      M, Outputs.size(),
+      [&](std::unique_ptr<Module> Part) {
+        Partitions.emplace_back();
+        raw_svector_ostream OS(Partitions.back());
+        WriteBitcodeToFile(*Part, OS);
+      },
+      /*PreserveLocals=*/true);
+
+  Stats->SplitTime = millisecondsSince(Start);
+  LLVM_DEBUG(dbgs() << "Split " << M.getName() << " into "
+                    << Partitions.size() << " partitions\n");
+
+  // 2. Compile every partition in a private context.
+  Start = Clock::now();
+
+  std::vector<std::string> Errors(Partitions.size());
+  auto CompilePartition = [&](unsigned I) {
+    LLVMContext Context;
+    MemoryBufferRef Buffer(
+        StringRef(Partitions[I].data(), Partitions[I].size()), "partition");
+    auto PartOrErr = parseBitcodeFile(Buffer, Context);
+    if (!PartOrErr) {
+      Errors[I] = toString(PartOrErr.takeError());
+      return;
+    }
+    auto PartTMOrErr =
+        createTargetMachine(TMs, (*PartOrErr)->getTargetTriple(), Opts);
+    if (!PartTMOrErr) {
+      Errors[I] = toString(PartTMOrErr.takeError());
+      return;
+    }
+    if (Error E = emitModule(**PartOrErr, **PartTMOrErr, *Outputs[I], Opts))
+      Errors[I] = toString(std::move(E));
+  };
+
+  std::atomic<unsigned> NextPartition(0);
+  auto Worker = [&] {
+    for (unsigned I = NextPartition++; I < Partitions.size();
+         I = NextPartition++)
+      CompilePartition(I);
+  };
+
+  unsigned NumThreads = Opts.Jobs ? Opts.Jobs : Partitions.size();
+  NumThreads = std::max(1u, std::min<unsigned>(NumThreads, Partitions.size()));
+  std::vector<std::thread> Threads;
+  for (unsigned T = 1; T < NumThreads; ++T)
+    Threads.emplace_back(Worker);
+  Worker();
+  for (std::thread &T : Threads)
+    T.join();
+
+  Stats->CodeGenTime = millisecondsSince(Start);
+  for (unsigned I = 0, E = Errors.size(); I != E; ++I)
+    if (!Errors[I].empty())
+      return createStringError(inconvertibleErrorCode(),
+                               "partition %u: %s", I, Errors[I].c_str());
+  return Error::success();
+}
+
+std::string getPartitionFilename(StringRef Filename, unsigned I) {
+  if (I == 0)
+    return Filename.str();
+  StringRef Extension = sys::path::extension(Filename);
+  return (Filename.drop_back(Extension.size()) + "." + Twine(I) + Extension)
+      .str();
+}
+
+Expected<std::unique_ptr<PartitionOutputFiles>>
+PartitionOutputFiles::open(StringRef Filename, unsigned NumPartitions,
+                           OutputFormat Format) {
+  std::unique_ptr<PartitionOutputFiles> Outputs(new PartitionOutputFiles());
+  for (unsigned I = 0; I < NumPartitions; ++I) {
+    std::string PartitionFilename = getPartitionFilename(Filename, I);
+    std::error_code EC;
+    Outputs->Files.push_back(std::make_unique<ToolOutputFile>(
+        PartitionFilename, EC,
+        Format == OutputFormat::Assembly ? sys::fs::OF_Text : sys::fs::OF_None));
+    if (EC)
+      return createStringError(EC, "Error opening '%s': %s",
+                               PartitionFilename.c_str(),
+                               EC.message().c_str());
+    raw_fd_ostream &File = Outputs->Files.back()->os();
+    if (File.supportsSeeking()) {
+      Outputs->Streams.push_back(&File);
+    } else {
+      Outputs->Buffers.push_back(std::make_unique<buffer_ostream>(File));
+      Outputs->Streams.push_back(Outputs->Buffers.back().get());
+    }
+  }
+  return std::move(Outputs);
+}
+
+PartitionOutputFiles::~PartitionOutputFiles() = default;
+
+void PartitionOutputFiles::keep() {
+  Buffers.clear();
+  Streams.clear();
+  for (auto &File : Files)
+    File->keep();
+}
+
+} // namespace mlcompileropt
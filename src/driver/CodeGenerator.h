@@ -0,0 +1,106 @@
+//===- CodeGenerator.h - Native Code Emission -----------------------===//
+//
+// This file declares how the driver emits object files and assembly for
+// an optimized module. The TargetMachine is created from the module's
+// triple, or the host's if it has none, with the CPU and features of
+// -target-cpu and -target-features.
+//
+// Code generation can be split like optimization in the parallel driver
+// mode: the module is split into one partition per output, and worker
+// threads compile the partitions in private LLVMContexts. Objects cannot
+// be merged without a linker, so every partition is written to its own
+// output, and linking all of them gives the same program as the serial
+// object.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_DRIVER_CODE_GENERATOR_H
+#define MLCOMPILEROPT_DRIVER_CODE_GENERATOR_H
+
+#include "driver/ModuleIO.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Support/Error.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Module;
+class ToolOutputFile;
+class buffer_ostream;
+class raw_pwrite_stream;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+struct CodeGenOptions {
+  // Object or Assembly
+  OutputFormat Format = OutputFormat::Object;
+
+  // Number of worker threads for partitioned code generation; 0 uses one
+  // thread per partition
+  unsigned Jobs = 0;
+
+  llvm::CodeGenOpt::Level OptLevel = llvm::CodeGenOpt::Aggressive;
+
+  // Position independent by default, so objects link into executables
+  // and shared libraries alike
+  llvm::Reloc::Model RelocModel = llvm::Reloc::PIC_;
+};
+
+// Wall-clock time of each phase, in milliseconds.
+struct CodeGenStats {
+  unsigned NumPartitions = 0;
+  double SplitTime = 0.0;
+  double CodeGenTime = 0.0;
+
+  double getTotalTime() const { return SplitTime + CodeGenTime; }
+};
+
+// Compiles M to Outputs.size() partitions, the I-th written to Outputs[I].
+// Object writers seek back to patch headers, so pipes such as stdout have
+// to be wrapped in a buffer_ostream. M is given the triple and data layout
+// of the target and otherwise left unchanged.
+llvm::Error emitNativeCode(llvm::Module &M,
+                           llvm::ArrayRef<llvm::raw_pwrite_stream *> Outputs,
+                           const CodeGenOptions &Opts,
+                           CodeGenStats *Stats = nullptr);
+
+// Name of the output file of partition I: Filename itself for partition 0,
+// and e.g. "out.2.o" for partition 2 of "out.o".
+std::string getPartitionFilename(llvm::StringRef Filename, unsigned I);
+
+// Output files of the partitions of Filename, named by getPartitionFilename,
+// or stdout for "-". Outputs that cannot seek, such as pipes, are written
+// through one buffer each until keep(). The files are removed unless
+// keep() is called.
+class PartitionOutputFiles {
+public:
+  static llvm::Expected<std::unique_ptr<PartitionOutputFiles>>
+  open(llvm::StringRef Filename, unsigned NumPartitions, OutputFormat Format);
+
+  ~PartitionOutputFiles();
+
+  // Streams to pass to emitNativeCode
+  llvm::ArrayRef<llvm::raw_pwrite_stream *> getStreams() const {
+    return Streams;
+  }
+
+  // Flushes the buffers into their outputs and keeps the files
+  void keep();
+
+private:
+  PartitionOutputFiles() = default;
+
+  std::vector<std::unique_ptr<llvm::ToolOutputFile>> Files;
+  // Destroyed before Files, which they write to
+  std::vector<std::unique_ptr<llvm::buffer_ostream>> Buffers;
+  std::vector<llvm::raw_pwrite_stream *> Streams;
+};
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_DRIVER_CODE_GENERATOR_H
@@ -0,0 +1,208 @@
+//===- CompileServer.cpp - Persistent Compile Server ----------------===//
+//
+// Implementation of the compile server. The calling thread reads and
+// queues requests; the workers optimize them and write the responses.
+//
+//===----------------------------------------------------------------===//
+
+#include "driver/CompileServer.h"
+
+#include "driver/ModuleCache.h"
+#include "driver/ModuleIO.h"
+#include "driver/OptimizationPipeline.h"
+#include "driver/SampleStats.h"
+#include "driver/TuningDatabase.h"
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+double millisecondsBetween(std::chrono::steady_clock::time_point Start,
+                           std::chrono::steady_clock::time_point End) {
+  return std::chrono::duration<double, std::milli>(End - Start).count();
+}
+
+void printSummary(raw_ostream &OS, StringRef Name,
+                  const std::vector<double> &Samples) {
+  SampleSummary S = summarizeSamples(Samples);
+  OS << format("  %-8s min %8.3f  p50 %8.3f  p95 %8.3f  p99 %8.3f  "
+               "max %8.3f  mean %8.3f ms\n",
+               Name.str().c_str(), S.Min, S.Median, S.P95, S.P99, S.Max,
+               S.Mean);
+}
+
+} // end anonymous namespace
+
+CompileServer::CompileServer(const CompileServerOptions &Opts) : Opts(Opts) {
+  for (unsigned I = 0, E = std::max(1u, Opts.Workers); I != E; ++I)
+    Workers.emplace_back([this] {
+      // Built once per worker and reused for every request
+      OptimizationPipeline Pipeline(this->Opts.UseCustomPasses);
+      if (!this->Opts.PassPipeline.empty())
+        cantFail(Pipeline.setPipeline(this->Opts.PassPipeline));
+      workerLoop(Pipeline);
+    });
+}
+
+CompileServer::~CompileServer() {
+  {
+    std::lock_guard<std::mutex> Lock(QueueMutex);
+    Closed = true;
+  }
+  QueueCV.notify_all();
+  for (std::thread &T : Workers)
+    T.join();
+}
+
+bool CompileServer::serve(std::istream &IS, raw_ostream &OS) {
+  {
+    std::lock_guard<std::mutex> Lock(OutputMutex);
+    Out = &OS;
+  }
+
+  bool WellFormed = true;
+  while (true) {
+    Job J;
+    Expected<bool> ReadOrErr = readServerRequest(IS, J.Request);
+    J.Arrival = Clock::now();
+    if (!ReadOrErr) {
+      // Framing is lost, so nothing after this point can be trusted.
+      respond("-", /*Success=*/false, toString(ReadOrErr.takeError()));
+      WellFormed = false;
+      break;
+    }
+    if (!*ReadOrErr)
+      break;
+
+    if (J.Request.Command == ServerRequest::Stats) {
+      std::string Stats;
+      raw_string_ostream StatsOS(Stats);
+      printStats(StatsOS);
+      respond(J.Request.Id, /*Success=*/true, StatsOS.str());
+      continue;
+    }
+
+    {
+      std::lock_guard<std::mutex> Lock(QueueMutex);
+      Queue.push_back(std::move(J));
+    }
+    QueueCV.notify_one();
+  }
+
+  // Wait for the outstanding requests before returning.
+  std::unique_lock<std::mutex> Lock(QueueMutex);
+  IdleCV.wait(Lock, [this] { return Queue.empty() && NumBusy == 0; });
+  return WellFormed;
+}
+
+void CompileServer::workerLoop(OptimizationPipeline &Pipeline) {
+  while (true) {
+    Job J;
+    {
+      std::unique_lock<std::mutex> Lock(QueueMutex);
+      QueueCV.wait(Lock, [this] { return Closed || !Queue.empty(); });
+      if (Queue.empty())
+        return;
+      J = std::move(Queue.front());
+      Queue.pop_front();
+      ++NumBusy;
+    }
+
+    handle(J, Pipeline);
+
+    {
+      std::lock_guard<std::mutex> Lock(QueueMutex);
+      --NumBusy;
+    }
+    IdleCV.notify_all();
+  }
+}
+
+void CompileServer::handle(Job &J, OptimizationPipeline &Pipeline) {
+  auto Start = Clock::now();
+  OutputFormat Format =
+      J.Request.EmitBitcode ? OutputFormat::Bitcode : OutputFormat::Text;
+
+  std::string Key;
+  std::unique_ptr<MemoryBuffer> Cached;
+  if (Opts.Cache) {
+    Key = Opts.Cache->getKey(J.Request.Payload);
+    Cached = Opts.Cache->lookup(Key);
+  }
+
+  std::string Result;
+  bool Success = false;
+  if (Cached && Format == OutputFormat::Bitcode) {
+    Result = Cached->getBuffer().str();
+    Success = true;
+  } else {
+    // A fresh context per request keeps workers independent and stops
+    // types and constants from accumulating across modules.
+    LLVMContext Context;
+    SMDiagnostic Err;
+    MemoryBufferRef Buffer(Cached ? Cached->getBuffer()
+                                  : StringRef(J.Request.Payload),
+                           J.Request.Id);
+    std::unique_ptr<Module> M = parseModule(Buffer, Context, Err);
+
+    raw_string_ostream OS(Result);
+    if (!M) {
+      Err.print(nullptr, OS, /*ShowColors=*/false);
+    } else {
+      if (!Cached) {
+        if (Opts.Tuning)
+          Opts.Tuning->apply(*M);
+        Pipeline.run(*M);
+        if (Opts.Cache) {
+          std::string Bitcode;
+          raw_string_ostream BitcodeOS(Bitcode);
+          writeModule(*M, BitcodeOS, OutputFormat::Bitcode);
+          // A failed insert only costs a later miss.
+          if (Error E = Opts.Cache->insert(Key, BitcodeOS.str()))
+            consumeError(std::move(E));
+        }
+      }
+      writeModule(*M, OS, Format);
+      Success = true;
+    }
+    OS.flush();
+  }
+
+  respond(J.Request.Id, Success, Result);
+
+  auto End = Clock::now();
+  std::lock_guard<std::mutex> Lock(StatsMutex);
+  Latencies.push_back(millisecondsBetween(J.Arrival, End));
+  ServiceTimes.push_back(millisecondsBetween(Start, End));
+  if (!Success)
+    ++NumFailed;
+}
+
+void CompileServer::respond(StringRef Id, bool Success, StringRef Payload) {
+  std::lock_guard<std::mutex> Lock(OutputMutex);
+  writeServerResponse(*Out, Id, Success, Payload);
+}
+
+void CompileServer::printStats(raw_ostream &OS) const {
+  std::lock_guard<std::mutex> Lock(StatsMutex);
+  OS << "requests: " << Latencies.size() << " (" << NumFailed
+     << " failed), workers: " << Workers.size() << "\n";
+  if (Opts.Cache)
+    OS << "cache: " << Opts.Cache->getNumHits() << " hits, "
+       << Opts.Cache->getNumMisses() << " misses\n";
+  printSummary(OS, "latency", Latencies);
+  printSummary(OS, "service", ServiceTimes);
+}
+
+} // namespace mlcompileropt
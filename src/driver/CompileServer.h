@@ -0,0 +1,109 @@
+//===- CompileServer.h - Persistent Compile Server ------------------===//
+//
+// This file declares the long-running server mode of ml_compiler. A pool
+// of worker threads each builds the optimization pipeline once and then
+// optimizes every request it receives with it, so the cost of setting up
+// the PassBuilder, the analysis managers and the O3 pipeline is paid once
+// per worker instead of once per module. Requests use the framing from
+// ServerProtocol.h.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_DRIVER_COMPILE_SERVER_H
+#define MLCOMPILEROPT_DRIVER_COMPILE_SERVER_H
+
+#include "driver/ServerProtocol.h"
+
+#include "llvm/ADT/StringRef.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+class ModuleCache;
+class TuningDatabase;
+class OptimizationPipeline;
+
+struct CompileServerOptions {
+  // Number of requests optimized concurrently
+  unsigned Workers = 1;
+
+  // Add the memory coalescing pass to the O3 pipeline
+  bool UseCustomPasses = true;
+
+  // Pipeline run instead of O3, in the syntax of opt -passes, if not empty.
+  // It must parse; see OptimizationPipeline::setPipeline.
+  std::string PassPipeline;
+
+  // Optional cache of optimized modules shared by all workers
+  ModuleCache *Cache = nullptr;
+
+  // Optional autotuned configurations, applied to every request's module
+  const TuningDatabase *Tuning = nullptr;
+};
+
+class CompileServer {
+public:
+  explicit CompileServer(const CompileServerOptions &Opts);
+  ~CompileServer();
+
+  // Serves requests from IS until the end of the input, writing responses
+  // to OS, and returns once every request has been answered. Returns false
+  // if the input was malformed.
+  bool serve(std::istream &IS, llvm::raw_ostream &OS);
+
+  // Prints request counts and latency percentiles. Latency is measured
+  // from the arrival of a request to its response; service time excludes
+  // the time spent waiting for a worker.
+  void printStats(llvm::raw_ostream &OS) const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Job {
+    ServerRequest Request;
+    Clock::time_point Arrival;
+  };
+
+  void workerLoop(OptimizationPipeline &Pipeline);
+  void handle(Job &J, OptimizationPipeline &Pipeline);
+  void respond(llvm::StringRef Id, bool Success, llvm::StringRef Payload);
+
+  CompileServerOptions Opts;
+  std::vector<std::thread> Workers;
+
+  // Pending requests
+  std::mutex QueueMutex;
+  std::condition_variable QueueCV;
+  std::deque<Job> Queue;
+  bool Closed = false;
+
+  // Signalled when the queue is empty and no worker is busy
+  std::condition_variable IdleCV;
+  unsigned NumBusy = 0;
+
+  // Response stream of the current serve() call
+  std::mutex OutputMutex;
+  llvm::raw_ostream *Out = nullptr;
+
+  // Per-request timings in milliseconds
+  mutable std::mutex StatsMutex;
+  std::vector<double> Latencies;
+  std::vector<double> ServiceTimes;
+  unsigned NumFailed = 0;
+};
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_DRIVER_COMPILE_SERVER_H
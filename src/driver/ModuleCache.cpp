@@ -0,0 +1,154 @@
+//===- ModuleCache.cpp - On-Disk Cache of Optimized Modules ---------===//
+//
+// Implementation of the optimized module cache.
+//
+//===----------------------------------------------------------------===//
+
+#include "driver/ModuleCache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+
+#define DEBUG_TYPE "module-cache"
+
+#ifndef ML_COMPILER_VERSION
+#define ML_COMPILER_VERSION "unknown"
+#endif
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+// Removes the temporary files of inserts that did not finish, e.g. because
+// the process was killed before the rename. pruneCache only looks at
+// llvmcache- entries, so nothing else would ever remove them. A file is
+// stale once it has not been written to for an hour, far longer than an
+// insert takes.
+void removeStaleTempFiles(StringRef Directory) {
+  auto Deadline = std::chrono::system_clock::now() - std::chrono::hours(1);
+  std::error_code EC;
+  for (sys::fs::directory_iterator File(Directory, EC), End; File != End && !EC;
+       File.increment(EC)) {
+    if (!sys::path::filename(File->path()).startswith("tmp-"))
+      continue;
+    ErrorOr<sys::fs::basic_file_status> Status = File->status();
+    if (Status && Status->getLastModificationTime() < Deadline) {
+      LLVM_DEBUG(dbgs() << "Removing stale " << File->path() << "\n");
+      sys::fs::remove(File->path());
+    }
+  }
+}
+
+} // end anonymous namespace
+
+ModuleCache::ModuleCache(StringRef Directory, StringRef Config,
+                         CachePruningPolicy Policy)
+    : Directory(Directory.str()), Config(Config.str()), Policy(Policy) {}
+
+Error ModuleCache::initialize() {
+  if (std::error_code EC = sys::fs::create_directories(Directory))
+    return createStringError(EC, "cannot create cache directory '%s': %s",
+                             Directory.c_str(), EC.message().c_str());
+  return Error::success();
+}
+
+std::string ModuleCache::getKey(StringRef Input) const {
+  // The fields are separated by a null byte so that no two different
+  // combinations hash the same text.
+  SHA256 Hasher;
+  Hasher.update("ml_compiler " ML_COMPILER_VERSION ", LLVM " LLVM_VERSION_STRING);
+  Hasher.update(StringRef("\0", 1));
+  Hasher.update(Config);
+  Hasher.update(StringRef("\0", 1));
+  Hasher.update(Input);
+  return toHex(Hasher.final(), /*LowerCase=*/true);
+}
+
+std::string ModuleCache::getEntryPath(StringRef Key) const {
+  SmallString<128> Path(Directory);
+  sys::path::append(Path, "llvmcache-" + Key);
+  return std::string(Path);
+}
+
+std::unique_ptr<MemoryBuffer> ModuleCache::lookup(StringRef Key) {
+  std::string Path = getEntryPath(Key);
+  int FD;
+  if (sys::fs::openFileForRead(Path, FD)) {
+    ++NumMisses;
+    LLVM_DEBUG(dbgs() << "Cache miss: " << Key << "\n");
+    return nullptr;
+  }
+
+  // Pruning evicts by access time, which many file systems do not update
+  // on reads.
+  sys::fs::setLastAccessAndModificationTime(
+      FD, std::chrono::time_point_cast<std::chrono::nanoseconds>(
+              std::chrono::system_clock::now()));
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufferOrErr =
+      MemoryBuffer::getOpenFile(sys::fs::convertFDToNativeFile(FD), Path,
+                                /*FileSize=*/-1,
+                                /*RequiresNullTerminator=*/false);
+  sys::Process::SafelyCloseFileDescriptor(FD);
+  if (!BufferOrErr) {
+    ++NumMisses;
+    return nullptr;
+  }
+
+  ++NumHits;
+  LLVM_DEBUG(dbgs() << "Cache hit: " << Key << "\n");
+  return std::move(*BufferOrErr);
+}
+
+Error ModuleCache::insert(StringRef Key, StringRef Bitcode) {
+  // Temporary files do not carry the llvmcache- prefix, so pruning never
+  // removes an entry that is still being written. Abandoned ones are
+  // removed by removeStaleTempFiles.
+  SmallString<128> TempModel(Directory);
+  sys::path::append(TempModel, "tmp-" + Key + "-%%%%%%");
+
+  int FD;
+  SmallString<128> TempPath;
+  if (std::error_code EC = sys::fs::createUniqueFile(TempModel, FD, TempPath))
+    return createStringError(EC, "cannot create cache file in '%s': %s",
+                             Directory.c_str(), EC.message().c_str());
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Bitcode;
+    OS.close();
+    if (OS.has_error()) {
+      std::error_code EC = OS.error();
+      OS.clear_error();
+      sys::fs::remove(TempPath);
+      return createStringError(EC, "cannot write cache file '%s': %s",
+                               TempPath.c_str(), EC.message().c_str());
+    }
+  }
+
+  // Concurrent writers of the same key produce identical contents, so it
+  // does not matter which rename wins.
+  std::string Path = getEntryPath(Key);
+  if (std::error_code EC = sys::fs::rename(TempPath, Path)) {
+    sys::fs::remove(TempPath);
+    return createStringError(EC, "cannot rename cache file to '%s': %s",
+                             Path.c_str(), EC.message().c_str());
+  }
+
+  removeStaleTempFiles(Directory);
+  pruneCache(Directory, Policy);
+  return Error::success();
+}
+
+} // namespace mlcompileropt
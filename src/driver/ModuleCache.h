@@ -0,0 +1,67 @@
+//===- ModuleCache.h - On-Disk Cache of Optimized Modules -----------===//
+//
+// This file declares a content-addressed cache of optimized modules. An
+// entry maps the hash of an input module, the pipeline configuration and
+// the tool version to the optimized bitcode. Entries are files named
+// llvmcache-<key> so that the cache directory can be pruned with LLVM's
+// CachePruning, which evicts the least recently used entries first.
+//
+// Several processes may share a cache directory: entries are written to
+// a temporary file and renamed into place, so readers never see a
+// partially written entry.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_DRIVER_MODULE_CACHE_H
+#define MLCOMPILEROPT_DRIVER_MODULE_CACHE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/Error.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace llvm {
+class MemoryBuffer;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+class ModuleCache {
+public:
+  // Config describes everything besides the input that determines the
+  // output, e.g. the pipeline and the values of pass options.
+  ModuleCache(llvm::StringRef Directory, llvm::StringRef Config,
+              llvm::CachePruningPolicy Policy);
+
+  // Creates the cache directory if it does not exist yet.
+  llvm::Error initialize();
+
+  // Returns the key of Input under this cache's configuration.
+  std::string getKey(llvm::StringRef Input) const;
+
+  // Returns the cached optimized bitcode for Key, or null on a miss. A hit
+  // marks the entry as recently used.
+  std::unique_ptr<llvm::MemoryBuffer> lookup(llvm::StringRef Key);
+
+  // Stores Bitcode under Key and prunes the cache according to the policy.
+  llvm::Error insert(llvm::StringRef Key, llvm::StringRef Bitcode);
+
+  unsigned getNumHits() const { return NumHits; }
+  unsigned getNumMisses() const { return NumMisses; }
+
+private:
+  std::string getEntryPath(llvm::StringRef Key) const;
+
+  std::string Directory;
+  std::string Config;
+  llvm::CachePruningPolicy Policy;
+  std::atomic<unsigned> NumHits{0};
+  std::atomic<unsigned> NumMisses{0};
+};
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_DRIVER_MODULE_CACHE_H
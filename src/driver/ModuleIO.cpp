@@ -0,0 +1,69 @@
+//===- ModuleIO.cpp - Module Loading and Writing --------------------===//
+//
+// Implementation of module loading and writing for the driver.
+//
+//===----------------------------------------------------------------===//
+
+#include "driver/ModuleIO.h"
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+std::unique_ptr<MemoryBuffer> openInputFile(StringRef Filename,
+                                            SMDiagnostic &Err) {
+  // Without the null terminator requirement large files are mapped
+  // rather than read; small files and stdin are still read.
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufferOrErr =
+      MemoryBuffer::getFileOrSTDIN(Filename, /*IsText=*/false,
+                                   /*RequiresNullTerminator=*/false);
+  if (std::error_code EC = BufferOrErr.getError()) {
+    Err = SMDiagnostic(Filename, SourceMgr::DK_Error,
+                       "Could not open input file: " + EC.message());
+    return nullptr;
+  }
+  return std::move(*BufferOrErr);
+}
+
+std::unique_ptr<Module> parseModule(MemoryBufferRef Buffer,
+                                    LLVMContext &Context, SMDiagnostic &Err) {
+  // The bitcode reader only reads from the buffer, which can be dropped
+  // once the module is materialized.
+  const auto *Start =
+      reinterpret_cast<const unsigned char *>(Buffer.getBufferStart());
+  const auto *End =
+      reinterpret_cast<const unsigned char *>(Buffer.getBufferEnd());
+  if (isBitcode(Start, End))
+    return parseIR(Buffer, Err, Context);
+
+  // The assembly lexer relies on a terminating null character.
+  std::unique_ptr<MemoryBuffer> Text = MemoryBuffer::getMemBufferCopy(
+      Buffer.getBuffer(), Buffer.getBufferIdentifier());
+  return parseIR(Text->getMemBufferRef(), Err, Context);
+}
+
+std::unique_ptr<Module> loadModule(StringRef Filename, LLVMContext &Context,
+                                   SMDiagnostic &Err) {
+  std::unique_ptr<MemoryBuffer> Buffer = openInputFile(Filename, Err);
+  if (!Buffer)
+    return nullptr;
+  return parseModule(Buffer->getMemBufferRef(), Context, Err);
+}
+
+void writeModule(const Module &M, raw_ostream &OS, OutputFormat Format) {
+  assert(!isNativeFormat(Format) && "native code needs the code generator");
+  if (Format == OutputFormat::Bitcode)
+    WriteBitcodeToFile(M, OS);
+  else
+    M.print(OS, nullptr);
+}
+
+} // namespace mlcompileropt
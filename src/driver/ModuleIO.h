@@ -0,0 +1,58 @@
+//===- ModuleIO.h - Module Loading and Writing ----------------------===//
+//
+// This file declares how the driver reads and writes modules. Bitcode is
+// parsed directly out of a memory-mapped input file without copying it,
+// and modules can be written either as bitcode or as textual IR. Object
+// files and assembly are emitted by the code generator instead.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_DRIVER_MODULE_IO_H
+#define MLCOMPILEROPT_DRIVER_MODULE_IO_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <memory>
+
+namespace llvm {
+class LLVMContext;
+class MemoryBuffer;
+class MemoryBufferRef;
+class Module;
+class SMDiagnostic;
+class raw_ostream;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+enum class OutputFormat { Text, Bitcode, Assembly, Object };
+
+// True for the formats of the code generator, see CodeGenerator.h
+inline bool isNativeFormat(OutputFormat Format) {
+  return Format == OutputFormat::Assembly || Format == OutputFormat::Object;
+}
+
+// Maps Filename, or reads stdin if it is "-". The buffer is not null
+// terminated. Returns null and fills in Err on failure.
+std::unique_ptr<llvm::MemoryBuffer> openInputFile(llvm::StringRef Filename,
+                                                  llvm::SMDiagnostic &Err);
+
+// Parses a bitcode or textual IR module out of Buffer, which does not need
+// to be null terminated. Returns null and fills in Err on failure.
+std::unique_ptr<llvm::Module> parseModule(llvm::MemoryBufferRef Buffer,
+                                          llvm::LLVMContext &Context,
+                                          llvm::SMDiagnostic &Err);
+
+// Loads a bitcode or textual IR module from Filename, or from stdin if it
+// is "-". Returns null and fills in Err on failure.
+std::unique_ptr<llvm::Module> loadModule(llvm::StringRef Filename,
+                                         llvm::LLVMContext &Context,
+                                         llvm::SMDiagnostic &Err);
+
+// Writes M to OS as bitcode or textual IR.
+void writeModule(const llvm::Module &M, llvm::raw_ostream &OS,
+                 OutputFormat Format);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_DRIVER_MODULE_IO_H
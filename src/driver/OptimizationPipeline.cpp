@@ -0,0 +1,90 @@
+//===- OptimizationPipeline.cpp - ml_compiler Optimization Pipeline -===//
+//
+// Implementation of the pipeline shared by the serial and parallel
+// drivers.
+//
+//===----------------------------------------------------------------===//
+
+#include "driver/OptimizationPipeline.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/OptimizationLevel.h"
+
+#include "driver/PassProfiler.h"
+#include "passes/LoopFusion.h"
+#include "passes/LoopParallelization.h"
+#include "passes/LoopTiling.h"
+#include "passes/ReductionVectorization.h"
+#include "passes/SoftwarePrefetch.h"
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+OptimizationPipeline::OptimizationPipeline(bool UseCustomPasses,
+                                           PassProfiler *Profiler)
+    : OptimizationPipeline(UseCustomPasses ? getSelectedExtensionPoint()
+                                           : CoalescingExtensionPoint::None,
+                           Profiler) {}
+
+OptimizationPipeline::OptimizationPipeline(CoalescingExtensionPoint EP,
+                                           PassProfiler *Profiler,
+                                           bool CoalescingOnly)
+    : PB(/*TM=*/nullptr, PipelineTuningOptions(), /*PGOOpt=*/None, &PIC) {
+  if (Profiler)
+    Profiler->registerCallbacks(PIC);
+
+  // Registered first, so the analysis registration callback below fills
+  // FAM and the extension point callback is part of every default pipeline
+  // built afterwards. The pass then shares the analyses of the pipeline.
+  registerMemoryCoalescingPass(PB, EP);
+  bool AddOthers = EP != CoalescingExtensionPoint::None && !CoalescingOnly;
+  registerLoopFusionPass(PB, AddOthers && getSelectedLoopFusionMode() !=
+                                              LoopFusionMode::None);
+  // Between fusion and tiling at the pipeline start. Both decide per
+  // function, since tuning parameters can select them.
+  registerLoopParallelizePass(PB, AddOthers);
+  registerLoopTilingPass(PB, AddOthers);
+  registerReductionVectorizePass(PB,
+                                 AddOthers && isReductionVectorizationEnabled());
+  registerSoftwarePrefetchPass(PB, AddOthers);
+
+  // Takes precedence over the target-independent TargetIRAnalysis that
+  // registerFunctionAnalyses would add.
+  FAM.registerPass([this] { return Targets.getTargetIRAnalysis(); });
+
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  MPM = PB.buildPerModuleDefaultPipeline(OptimizationLevel::O3);
+}
+
+Error OptimizationPipeline::setPipeline(StringRef PassPipeline) {
+  ModulePassManager NewMPM;
+  if (Error E = PB.parsePassPipeline(NewMPM, PassPipeline))
+    return E;
+  MPM = std::move(NewMPM);
+  return Error::success();
+}
+
+void OptimizationPipeline::run(Module &M) {
+  MPM.run(M, MAM);
+
+  // Cached results refer to M, which the caller may destroy next.
+  MAM.clear();
+  CGAM.clear();
+  FAM.clear();
+  LAM.clear();
+}
+
+void OptimizationPipeline::printPipeline(raw_ostream &OS) {
+  MPM.printPipeline(OS, [this](StringRef ClassName) {
+    StringRef PassName = PIC.getPassNameForClassName(ClassName);
+    return PassName.empty() ? ClassName : PassName;
+  });
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,82 @@
+//===- OptimizationPipeline.h - ml_compiler Optimization Pipeline ---===//
+//
+// This file declares the pipeline ml_compiler runs on a module: the
+// standard O3 pipeline with the memory coalescing pass registered at one
+// of its extension points, or a textual pipeline in the syntax of
+// opt -passes. The pipeline owns its PassBuilder and analysis managers, so
+// one instance can be kept per thread and reused across modules. Cost
+// queries are answered for the target triple of each module.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_DRIVER_OPTIMIZATION_PIPELINE_H
+#define MLCOMPILEROPT_DRIVER_OPTIMIZATION_PIPELINE_H
+
+#include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/Error.h"
+
+#include "driver/TargetMachineCache.h"
+#include "passes/MemoryCoalescing.h"
+
+namespace llvm {
+class Module;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+class PassProfiler;
+
+class OptimizationPipeline {
+public:
+  // When UseCustomPasses is false only the O3 pipeline is run; otherwise
+  // the memory coalescing pass runs at the extension point selected with
+  // -memory-coalescing-ep and the reduction vectorization pass before the
+  // loop vectorizer, unless disabled with -reduction-vectorize=false. The
+  // loop fusion, loop parallelization and loop tiling passes at the start
+  // of the pipeline and the software prefetch pass at the end only run
+  // when selected with -loop-fusion-mode, -loop-parallelize, -loop-tiling
+  // and -software-prefetch, or per function with tuning parameters. If
+  // Profiler is given, every pass and analysis run is recorded in it.
+  explicit OptimizationPipeline(bool UseCustomPasses = true,
+                                PassProfiler *Profiler = nullptr);
+
+  // Adds the memory coalescing pass to the O3 pipeline at EP, and the
+  // other custom passes unless EP is None or CoalescingOnly is set.
+  explicit OptimizationPipeline(CoalescingExtensionPoint EP,
+                                PassProfiler *Profiler = nullptr,
+                                bool CoalescingOnly = false);
+
+  // Replaces the O3 pipeline with PassPipeline, e.g.
+  // "function(memory-coalescing),default<O3>". The extension point
+  // callbacks still apply to default<On> in it.
+  llvm::Error setPipeline(llvm::StringRef PassPipeline);
+
+  // Optimizes M in place. Cached analysis results are dropped afterwards,
+  // so M may be destroyed before the pipeline is reused.
+  void run(llvm::Module &M);
+
+  // Prints the passes run() runs, in the syntax of opt -passes
+  void printPipeline(llvm::raw_ostream &OS);
+
+  // Analysis manager used by run(); callers may query function analyses
+  // on a module before running the pipeline on it.
+  llvm::FunctionAnalysisManager &getFunctionAnalysisManager() { return FAM; }
+
+private:
+  llvm::PassInstrumentationCallbacks PIC;
+  TargetMachineCache Targets;
+  llvm::PassBuilder PB;
+  llvm::LoopAnalysisManager LAM;
+  llvm::FunctionAnalysisManager FAM;
+  llvm::CGSCCAnalysisManager CGAM;
+  llvm::ModuleAnalysisManager MAM;
+  llvm::ModulePassManager MPM;
+};
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_DRIVER_OPTIMIZATION_PIPELINE_H
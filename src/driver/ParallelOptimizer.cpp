@@ -0,0 +1,277 @@
+//===- ParallelOptimizer.cpp - Partitioned Parallel Optimization ----===//
+//
+// Implementation of the parallel driver mode. Partitions travel between
+// contexts as bitcode: SplitModule produces them in the source context,
+// every worker parses its partition into a private context, and the
+// optimized bitcode is parsed back into the source context for linking.
+//
+//===----------------------------------------------------------------===//
+
+#include "driver/ParallelOptimizer.h"
+
+#include "driver/OptimizationPipeline.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LLVMRemarkStreamer.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Remarks/RemarkStreamer.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define DEBUG_TYPE "parallel-optimizer"
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double millisecondsSince(Clock::time_point Start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - Start)
+      .count();
+}
+
+// A partition only sees declarations of the functions defined in other
+// partitions, so O3 would delete linkonce/available_externally definitions
+// whose users live elsewhere. Pin them with llvm.compiler.used.
+void keepDiscardableDefinitions(Module &Part) {
+  SmallVector<GlobalValue *, 16> Keep;
+  for (GlobalValue &GV : Part.global_values())
+    if (!GV.isDeclaration() && !GV.hasLocalLinkage() &&
+        GV.isDiscardableIfUnused())
+      Keep.push_back(&GV);
+  appendToCompilerUsed(Part, Keep);
+}
+
+// Replaces llvm.compiler.used in the linked module by the original list,
+// which removes the pins of keepDiscardableDefinitions.
+void restoreCompilerUsed(Module &M, ArrayRef<std::string> OriginalNames) {
+  if (GlobalVariable *Used = M.getGlobalVariable("llvm.compiler.used"))
+    Used->eraseFromParent();
+
+  SmallVector<GlobalValue *, 16> Values;
+  for (const std::string &Name : OriginalNames)
+    if (GlobalValue *GV = M.getNamedValue(Name))
+      Values.push_back(GV);
+  appendToCompilerUsed(M, Values);
+}
+
+// Deletes the discardable definitions nothing uses once the pins are gone,
+// and the declarations nothing uses, e.g. of available_externally functions
+// a partition dropped, as GlobalDCE does in the serial pipeline. Deleting
+// one can leave another unused, so this repeats until nothing changes.
+void dropUnusedGlobals(Module &M) {
+  SmallVector<GlobalValue *, 16> Dead;
+  do {
+    Dead.clear();
+    for (GlobalValue &GV : M.global_values()) {
+      if (!GV.isDeclaration() && !GV.isDiscardableIfUnused())
+        continue;
+      GV.removeDeadConstantUsers();
+      if (GV.use_empty())
+        Dead.push_back(&GV);
+    }
+    for (GlobalValue *GV : Dead) {
+      LLVM_DEBUG(dbgs() << "Dropping unused " << GV->getName() << "\n");
+      GV->eraseFromParent();
+    }
+  } while (!Dead.empty());
+}
+
+// Forwards the optimization remarks emitted in a partition's context to
+// the remark streamer of the input module's context. Streamers are not
+// thread-safe, so all partitions share one lock.
+struct RemarkForwarder : public DiagnosticHandler {
+  RemarkForwarder(LLVMContext &Target, std::mutex &Lock)
+      : Streamer(*Target.getLLVMRemarkStreamer()),
+        Filter(*Target.getMainRemarkStreamer()), Lock(Lock) {}
+
+  bool isAnalysisRemarkEnabled(StringRef PassName) const override {
+    return Filter.matchesFilter(PassName);
+  }
+  bool isMissedOptRemarkEnabled(StringRef PassName) const override {
+    return Filter.matchesFilter(PassName);
+  }
+  bool isPassedOptRemarkEnabled(StringRef PassName) const override {
+    return Filter.matchesFilter(PassName);
+  }
+  bool isAnyRemarkEnabled() const override { return true; }
+
+  bool handleDiagnostics(const DiagnosticInfo &DI) override {
+    auto *Remark = dyn_cast<DiagnosticInfoOptimizationBase>(&DI);
+    if (!Remark)
+      return false;
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      Streamer.emit(*Remark);
+    }
+    // Warnings are still printed
+    return DI.getSeverity() == DS_Remark;
+  }
+
+  LLVMRemarkStreamer &Streamer;
+  remarks::RemarkStreamer &Filter;
+  std::mutex &Lock;
+};
+
+Expected<std::unique_ptr<Module>> parsePartition(ArrayRef<char> Bitcode,
+                                                 LLVMContext &Context) {
+  MemoryBufferRef Buffer(StringRef(Bitcode.data(), Bitcode.size()),
+                         "partition");
+  return parseBitcodeFile(Buffer, Context);
+}
+
+} // end anonymous namespace
+
+Expected<std::unique_ptr<Module>>
+optimizeModuleInParallel(Module &M, const ParallelOptimizerOptions &Opts,
+                         ParallelOptimizerStats *Stats) {
+  ParallelOptimizerStats LocalStats;
+  if (!Stats)
+    Stats = &LocalStats;
+
+  // 1. Split the module. The partition count is a function of the module
+  // alone so that the result does not depend on Opts.Jobs.
+  auto Start = Clock::now();
+
+  unsigned NumDefined = 0;
+  for (Function &F : M)
+    if (!F.isDeclaration())
+      ++NumDefined;
+  unsigned NumPartitions =
+      std::max(1u, std::min(NumDefined, std::max(1u, Opts.MaxPartitions)));
+
+  SmallVector<GlobalValue *, 16> OriginalUsed;
+  collectUsedGlobalVariables(M, OriginalUsed, /*CompilerUsed=*/true);
+  std::vector<std::string> OriginalUsedNames;
+  for (GlobalValue *GV : OriginalUsed)
+    OriginalUsedNames.push_back(GV->getName().str());
+
+  std::vector<SmallVector<char, 0>> Partitions;
+  // Locals stay with their users, so no symbol has to be renamed.
+  SplitModule(
+      M, NumPartitions,
+      [&](std::unique_ptr<Module> Part) {
+        keepDiscardableDefinitions(*Part);
+        Partitions.emplace_back();
+        // Use lists, and with them the order of block predecessors, are
+        // kept so partitions optimize as they would in the whole module.
+        raw_svector_ostream OS(Partitions.back());
+        WriteBitcodeToFile(*Part, OS, /*ShouldPreserveUseListOrder=*/true);
+      },
+      /*PreserveLocals=*/true);
+
+  Stats->NumPartitions = Partitions.size();
+  Stats->SplitTime = millisecondsSince(Start);
+  LLVM_DEBUG(dbgs() << "Split " << M.getName() << " into "
+                    << Partitions.size() << " partitions\n");
+
+  // 2. Optimize every partition in a private context.
+  Start = Clock::now();
+
+  std::vector<SmallVector<char, 0>> Results(Partitions.size());
+  std::vector<std::string> Errors(Partitions.size());
+
+  std::mutex RemarksLock;
+  bool ForwardRemarks = M.getContext().getLLVMRemarkStreamer() != nullptr;
+
+  auto OptimizePartition = [&](unsigned I, OptimizationPipeline &Pipeline) {
+    LLVMContext Context;
+    if (ForwardRemarks)
+      Context.setDiagnosticHandler(
+          std::make_unique<RemarkForwarder>(M.getContext(), RemarksLock));
+    auto PartOrErr = parsePartition(Partitions[I], Context);
+    if (!PartOrErr) {
+      Errors[I] = toString(PartOrErr.takeError());
+      return;
+    }
+    std::unique_ptr<Module> Part = std::move(*PartOrErr);
+
+    Pipeline.run(*Part);
+
+    raw_svector_ostream OS(Results[I]);
+    WriteBitcodeToFile(*Part, OS, /*ShouldPreserveUseListOrder=*/true);
+  };
+
+  // All partitions are known up front, so the workers simply claim the
+  // next unprocessed index until none are left. Each worker builds its
+  // pipeline once and reuses it for every partition it claims.
+  std::atomic<unsigned> NextPartition(0);
+  auto Worker = [&](OptimizationPipeline &Pipeline) {
+    for (unsigned I = NextPartition++; I < Partitions.size();
+         I = NextPartition++)
+      OptimizePartition(I, Pipeline);
+  };
+
+  // The calling thread's pipeline is built first so that an invalid
+  // pipeline is reported once, before any thread is started.
+  OptimizationPipeline Pipeline(Opts.UseCustomPasses, Opts.Profiler);
+  if (!Opts.PassPipeline.empty())
+    if (Error E = Pipeline.setPipeline(Opts.PassPipeline))
+      return std::move(E);
+
+  unsigned NumThreads = std::max(
+      1u, std::min<unsigned>(Opts.Jobs, Partitions.size()));
+  std::vector<std::thread> Threads;
+  for (unsigned T = 1; T < NumThreads; ++T)
+    Threads.emplace_back([&] {
+      OptimizationPipeline Pipeline(Opts.UseCustomPasses, Opts.Profiler);
+      if (!Opts.PassPipeline.empty())
+        cantFail(Pipeline.setPipeline(Opts.PassPipeline));
+      Worker(Pipeline);
+    });
+  Worker(Pipeline);
+  for (std::thread &T : Threads)
+    T.join();
+
+  Stats->OptimizeTime = millisecondsSince(Start);
+  for (unsigned I = 0, E = Errors.size(); I != E; ++I)
+    if (!Errors[I].empty())
+      return createStringError(inconvertibleErrorCode(),
+                               "partition %u: %s", I, Errors[I].c_str());
+
+  // 3. Link the partitions back in their original order.
+  Start = Clock::now();
+
+  auto Linked = std::make_unique<Module>(M.getModuleIdentifier(),
+                                         M.getContext());
+  Linked->setSourceFileName(M.getSourceFileName());
+  Linked->setDataLayout(M.getDataLayout());
+  Linked->setTargetTriple(M.getTargetTriple());
+
+  Linker L(*Linked);
+  for (unsigned I = 0, E = Results.size(); I != E; ++I) {
+    auto PartOrErr = parsePartition(Results[I], M.getContext());
+    if (!PartOrErr)
+      return PartOrErr.takeError();
+    if (L.linkInModule(std::move(*PartOrErr)))
+      return createStringError(inconvertibleErrorCode(),
+                               "failed to link partition %u", I);
+  }
+  restoreCompilerUsed(*Linked, OriginalUsedNames);
+  dropUnusedGlobals(*Linked);
+
+  Stats->LinkTime = millisecondsSince(Start);
+  return std::move(Linked);
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,65 @@
+//===- ParallelOptimizer.h - Partitioned Parallel Optimization ------===//
+//
+// This file declares the parallel driver mode. The module is split into
+// partitions, each partition is optimized in its own LLVMContext by a
+// set of worker threads and the optimized partitions are linked back together.
+//
+// The number of partitions depends only on the module, never on the
+// number of threads, and partitions are linked in a fixed order, so the
+// output is the same for every thread count.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_DRIVER_PARALLEL_OPTIMIZER_H
+#define MLCOMPILEROPT_DRIVER_PARALLEL_OPTIMIZER_H
+
+#include "llvm/Support/Error.h"
+
+#include <memory>
+#include <string>
+
+namespace llvm {
+class Module;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+class PassProfiler;
+
+struct ParallelOptimizerOptions {
+  // Number of worker threads
+  unsigned Jobs = 1;
+
+  // Upper bound on the number of partitions; the module is split into one
+  // partition per defined function up to this limit.
+  unsigned MaxPartitions = 64;
+
+  // Add the memory coalescing pass to the O3 pipeline
+  bool UseCustomPasses = true;
+
+  // Pipeline run instead of O3, in the syntax of opt -passes, if not empty
+  std::string PassPipeline;
+
+  // Records the passes run on every partition, if set
+  PassProfiler *Profiler = nullptr;
+};
+
+// Wall-clock time of each phase, in milliseconds.
+struct ParallelOptimizerStats {
+  unsigned NumPartitions = 0;
+  double SplitTime = 0.0;
+  double OptimizeTime = 0.0;
+  double LinkTime = 0.0;
+
+  double getTotalTime() const { return SplitTime + OptimizeTime + LinkTime; }
+};
+
+// Optimizes M with the ml_compiler pipeline using Opts.Jobs threads. M is
+// left unchanged; the optimized module is created in M's context.
+llvm::Expected<std::unique_ptr<llvm::Module>>
+optimizeModuleInParallel(llvm::Module &M, const ParallelOptimizerOptions &Opts,
+                         ParallelOptimizerStats *Stats = nullptr);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_DRIVER_PARALLEL_OPTIMIZER_H
@@ -0,0 +1,259 @@
+//===- PassProfiler.cpp - Per-Pass Timing and Trace Recording -------===//
+//
+// Implementation of the pass timing report and the Chrome trace writer.
+//
+//===----------------------------------------------------------------===//
+
+#include "driver/PassProfiler.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Analysis/LazyCallGraph.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+// Trace rows of functions are numbered after the thread rows
+const unsigned FirstFunctionRow = 1000;
+
+// Returns the IR unit held by IR if it has type T, or null.
+template <typename T> const T *getIRUnit(const Any &IR) {
+#if LLVM_VERSION_MAJOR >= 16
+  return any_cast<T>(&IR);
+#else
+  return any_isa<T>(IR) ? any_cast<T>(&IR) : nullptr;
+#endif
+}
+
+// Names the IR unit a pass runs on and the function it belongs to.
+void describeIR(const Any &IR, std::string &IRName, std::string &Function) {
+  if (const auto *M = getIRUnit<const Module *>(IR)) {
+    IRName = (*M)->getName().str();
+  } else if (const auto *F = getIRUnit<const llvm::Function *>(IR)) {
+    IRName = Function = (*F)->getName().str();
+  } else if (const auto *L = getIRUnit<const Loop *>(IR)) {
+    Function = (*L)->getHeader()->getParent()->getName().str();
+    IRName = "loop " + (*L)->getName().str() + " in " + Function;
+  } else if (const auto *C = getIRUnit<const LazyCallGraph::SCC *>(IR)) {
+    IRName = (*C)->getName();
+  }
+}
+
+struct Aggregate {
+  double SelfTime = 0.0;
+  double TotalTime = 0.0;
+  unsigned Runs = 0;
+};
+
+void printAggregates(raw_ostream &OS, StringRef Title,
+                     const StringMap<Aggregate> &Aggregates, double Total) {
+  std::vector<std::pair<StringRef, Aggregate>> Sorted;
+  for (const auto &Entry : Aggregates)
+    Sorted.emplace_back(Entry.getKey(), Entry.getValue());
+  llvm::sort(Sorted, [](const auto &A, const auto &B) {
+    return A.second.SelfTime > B.second.SelfTime ||
+           (A.second.SelfTime == B.second.SelfTime && A.first < B.first);
+  });
+
+  OS << "\n  " << Title << "\n";
+  OS << "    Self (ms)       %   Total (ms)    Runs  Name\n";
+  for (const auto &Entry : Sorted) {
+    const Aggregate &A = Entry.second;
+    OS << format("  %11.3f  %5.1f%%  %11.3f  %6u  ", A.SelfTime / 1000.0,
+                 Total > 0 ? 100.0 * A.SelfTime / Total : 0.0,
+                 A.TotalTime / 1000.0, A.Runs)
+       << Entry.first << "\n";
+  }
+}
+
+} // namespace
+
+PassProfiler::PassProfiler(std::string Label)
+    : Label(std::move(Label)), Epoch(Clock::now()) {}
+
+void PassProfiler::registerCallbacks(PassInstrumentationCallbacks &PIC) {
+  PIC.registerBeforeNonSkippedPassCallback(
+      [this](StringRef P, Any IR) { begin(P, IR, /*IsAnalysis=*/false); });
+  PIC.registerAfterPassCallback(
+      [this](StringRef, Any, const PreservedAnalyses &) { end(); });
+  PIC.registerAfterPassInvalidatedCallback(
+      [this](StringRef, const PreservedAnalyses &) { end(); });
+  PIC.registerBeforeAnalysisCallback(
+      [this](StringRef P, Any IR) { begin(P, IR, /*IsAnalysis=*/true); });
+  PIC.registerAfterAnalysisCallback([this](StringRef, Any) { end(); });
+}
+
+void PassProfiler::begin(StringRef Name, const Any &IR, bool IsAnalysis) {
+  OpenRun Run;
+  Run.E.Name = Name.str();
+  Run.E.IsAnalysis = IsAnalysis;
+  describeIR(IR, Run.E.IRName, Run.E.Function);
+
+  std::lock_guard<std::mutex> Lock(Mutex);
+  std::thread::id Id = std::this_thread::get_id();
+  auto Inserted = ThreadIndices.emplace(Id, ThreadIndices.size() + 1);
+  Run.E.Thread = Inserted.first->second;
+  Run.Start = Clock::now();
+  Stacks[Id].push_back(std::move(Run));
+}
+
+void PassProfiler::end() {
+  Clock::time_point Now = Clock::now();
+  std::lock_guard<std::mutex> Lock(Mutex);
+  std::vector<OpenRun> &Stack = Stacks[std::this_thread::get_id()];
+  assert(!Stack.empty() && "pass ended without having begun");
+  OpenRun Run = std::move(Stack.back());
+  Stack.pop_back();
+
+  using Micro = std::chrono::duration<double, std::micro>;
+  Run.E.Start = Micro(Run.Start - Epoch).count();
+  Run.E.Duration = Micro(Now - Run.Start).count();
+  Run.E.SelfTime = std::max(0.0, Run.E.Duration - Run.ChildTime);
+  if (!Stack.empty())
+    Stack.back().ChildTime += Run.E.Duration;
+  Events.push_back(std::move(Run.E));
+}
+
+bool PassProfiler::empty() const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  return Events.empty();
+}
+
+void PassProfiler::printReport(raw_ostream &OS, unsigned NumFunctions) const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+
+  // Self times add up to the time spent in the pipeline
+  StringMap<Aggregate> Passes, Analyses;
+  StringMap<double> Functions;
+  double Total = 0.0;
+  unsigned NumPassRuns = 0, NumAnalysisRuns = 0;
+  for (const Event &E : Events) {
+    Aggregate &A = (E.IsAnalysis ? Analyses : Passes)[E.Name];
+    A.SelfTime += E.SelfTime;
+    A.TotalTime += E.Duration;
+    ++A.Runs;
+    ++(E.IsAnalysis ? NumAnalysisRuns : NumPassRuns);
+    Total += E.SelfTime;
+    if (!E.Function.empty())
+      Functions[E.Function] += E.SelfTime;
+  }
+
+  OS << "===- Pass execution timing report (" << Label << ") -===\n";
+  OS << format("  Total: %.3f ms in %u pass runs and %u analysis runs\n",
+               Total / 1000.0, NumPassRuns, NumAnalysisRuns);
+  printAggregates(OS, "Passes", Passes, Total);
+  printAggregates(OS, "Analyses", Analyses, Total);
+
+  std::vector<std::pair<StringRef, double>> Sorted;
+  for (const auto &Entry : Functions)
+    Sorted.emplace_back(Entry.getKey(), Entry.getValue());
+  llvm::sort(Sorted, [](const auto &A, const auto &B) {
+    return A.second > B.second || (A.second == B.second && A.first < B.first);
+  });
+  if (Sorted.size() > NumFunctions)
+    Sorted.resize(NumFunctions);
+
+  OS << "\n  Functions by time in function and loop passes\n";
+  OS << "    Self (ms)       %  Function\n";
+  for (const auto &Entry : Sorted)
+    OS << format("  %11.3f  %5.1f%%  ", Entry.second / 1000.0,
+                 Total > 0 ? 100.0 * Entry.second / Total : 0.0)
+       << Entry.first << "\n";
+}
+
+StringMap<double> PassProfiler::getPassTimes() const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  StringMap<double> Times;
+  for (const Event &E : Events)
+    if (!E.IsAnalysis)
+      Times[E.Name] += E.Duration / 1000.0;
+  return Times;
+}
+
+StringMap<double> PassProfiler::getPassSelfTimes() const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  StringMap<double> Times;
+  for (const Event &E : Events)
+    if (!E.IsAnalysis)
+      Times[E.Name] += E.SelfTime / 1000.0;
+  return Times;
+}
+
+void PassProfiler::writeTraceEvents(json::OStream &J, unsigned Pid) const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+
+  // Functions get rows in the order they were first seen
+  StringMap<unsigned> FunctionRows;
+  std::vector<StringRef> FunctionNames;
+  for (const Event &E : Events)
+    if (!E.Function.empty() &&
+        FunctionRows.try_emplace(E.Function, FirstFunctionRow + FunctionRows.size())
+            .second)
+      FunctionNames.push_back(E.Function);
+
+  auto Metadata = [&](StringRef Kind, unsigned Tid, const Twine &Name) {
+    J.object([&] {
+      J.attribute("name", Kind);
+      J.attribute("ph", "M");
+      J.attribute("pid", int64_t(Pid));
+      J.attribute("tid", int64_t(Tid));
+      J.attributeObject("args", [&] { J.attribute("name", Name.str()); });
+    });
+  };
+  Metadata("process_name", 0, Label);
+  for (unsigned T = 1; T <= ThreadIndices.size(); ++T)
+    Metadata("thread_name", T, "thread " + Twine(T));
+  for (StringRef F : FunctionNames)
+    Metadata("thread_name", FunctionRows[F], "function " + F);
+
+  for (const Event &E : Events) {
+    J.object([&] {
+      J.attribute("name", E.Name);
+      J.attribute("cat", E.IsAnalysis ? "analysis" : "pass");
+      J.attribute("ph", "X");
+      J.attribute("ts", E.Start);
+      J.attribute("dur", E.Duration);
+      J.attribute("pid", int64_t(Pid));
+      J.attribute("tid", int64_t(E.Function.empty() ? E.Thread
+                                                    : FunctionRows[E.Function]));
+      J.attributeObject("args", [&] {
+        J.attribute("ir", E.IRName);
+        J.attribute("thread", int64_t(E.Thread));
+      });
+    });
+  }
+}
+
+Error writeChromeTrace(StringRef Filename,
+                       ArrayRef<const PassProfiler *> Profilers) {
+  std::error_code EC;
+  raw_fd_ostream OS(Filename, EC, sys::fs::OF_Text);
+  if (EC)
+    return createStringError(EC, "cannot write trace '" + Filename +
+                                     "': " + EC.message());
+
+  json::OStream J(OS);
+  J.object([&] {
+    J.attributeArray("traceEvents", [&] {
+      for (unsigned I = 0; I < Profilers.size(); ++I)
+        Profilers[I]->writeTraceEvents(J, I + 1);
+    });
+    J.attribute("displayTimeUnit", "ms");
+  });
+  OS << "\n";
+  return Error::success();
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,109 @@
+//===- PassProfiler.h - Per-Pass Timing and Trace Recording ---------===//
+//
+// This file declares an instrumentation that records every pass and
+// analysis run of a pipeline through PassInstrumentationCallbacks. The
+// recording is reported as per-pass aggregate times (--time-passes) and
+// as a Chrome trace-event timeline (--trace) that has one row per thread
+// for module and SCC level work and one row per function.
+//
+// A profiler may be shared by the pipelines of several threads.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_DRIVER_PASS_PROFILER_H
+#define MLCOMPILEROPT_DRIVER_PASS_PROFILER_H
+
+#include "llvm/ADT/Any.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace llvm {
+class PassInstrumentationCallbacks;
+class raw_ostream;
+namespace json {
+class OStream;
+} // namespace json
+} // namespace llvm
+
+namespace mlcompileropt {
+
+class PassProfiler {
+public:
+  // Label names the profiled process in reports and traces.
+  explicit PassProfiler(std::string Label = "ml_compiler");
+
+  void registerCallbacks(llvm::PassInstrumentationCallbacks &PIC);
+
+  // Prints the time spent in each pass and analysis, excluding nested
+  // runs, followed by the NumFunctions functions that took longest.
+  void printReport(llvm::raw_ostream &OS, unsigned NumFunctions = 10) const;
+
+  // Returns the milliseconds spent in the runs of each pass, keyed by the
+  // name passed to the instrumentation, e.g. PassT::name(). The analyses a
+  // run computes count towards it, as do nested passes towards their
+  // adaptors.
+  llvm::StringMap<double> getPassTimes() const;
+
+  // Like getPassTimes, but without the time of the nested pass and
+  // analysis runs, as in printReport.
+  llvm::StringMap<double> getPassSelfTimes() const;
+
+  // Writes the recorded runs as trace events of process Pid.
+  void writeTraceEvents(llvm::json::OStream &J, unsigned Pid) const;
+
+  const std::string &getLabel() const { return Label; }
+  bool empty() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Event {
+    std::string Name;
+    std::string IRName;
+
+    // Function the IR unit belongs to; empty for modules and SCCs
+    std::string Function;
+    bool IsAnalysis = false;
+    unsigned Thread = 0;
+
+    // Microseconds since the profiler was created
+    double Start = 0.0;
+    double Duration = 0.0;
+    double SelfTime = 0.0;
+  };
+
+  struct OpenRun {
+    Event E;
+    Clock::time_point Start;
+    double ChildTime = 0.0;
+  };
+
+  void begin(llvm::StringRef Name, const llvm::Any &IR, bool IsAnalysis);
+  void end();
+
+  std::string Label;
+  Clock::time_point Epoch;
+
+  mutable std::mutex Mutex;
+  std::map<std::thread::id, std::vector<OpenRun>> Stacks;
+  std::map<std::thread::id, unsigned> ThreadIndices;
+  std::vector<Event> Events;
+};
+
+// Writes the runs of every profiler to Filename as one Chrome trace, with
+// one process per profiler.
+llvm::Error writeChromeTrace(llvm::StringRef Filename,
+                             llvm::ArrayRef<const PassProfiler *> Profilers);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_DRIVER_PASS_PROFILER_H
@@ -0,0 +1,54 @@
+//===- SampleStats.cpp - Summary Statistics of Timing Samples -------===//
+//
+// Implementation of the sample summary helper.
+//
+//===----------------------------------------------------------------===//
+
+#include "driver/SampleStats.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mlcompileropt {
+
+namespace {
+
+// Nearest-rank percentile of an ascending, non-empty list.
+double percentile(const std::vector<double> &Sorted, double P) {
+  size_t Rank = static_cast<size_t>(std::ceil(P / 100.0 * Sorted.size()));
+  return Sorted[std::min(std::max<size_t>(Rank, 1), Sorted.size()) - 1];
+}
+
+} // end anonymous namespace
+
+SampleSummary summarizeSamples(std::vector<double> Samples) {
+  SampleSummary S;
+  if (Samples.empty())
+    return S;
+
+  std::sort(Samples.begin(), Samples.end());
+  S.Count = Samples.size();
+  S.Min = Samples.front();
+  S.Max = Samples.back();
+
+  double Sum = 0.0;
+  for (double X : Samples)
+    Sum += X;
+  S.Mean = Sum / S.Count;
+
+  size_t Mid = S.Count / 2;
+  S.Median = S.Count % 2 ? Samples[Mid] : (Samples[Mid - 1] + Samples[Mid]) / 2;
+  S.P95 = percentile(Samples, 95.0);
+  S.P99 = percentile(Samples, 99.0);
+
+  // Sample standard deviation
+  if (S.Count > 1) {
+    double SqSum = 0.0;
+    for (double X : Samples)
+      SqSum += (X - S.Mean) * (X - S.Mean);
+    S.StdDev = std::sqrt(SqSum / (S.Count - 1));
+  }
+  return S;
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,34 @@
+//===- SampleStats.h - Summary Statistics of Timing Samples ---------===//
+//
+// This file declares a helper that reduces a list of timing samples to
+// the order statistics and moments reported by the driver and the
+// benchmarks.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_DRIVER_SAMPLE_STATS_H
+#define MLCOMPILEROPT_DRIVER_SAMPLE_STATS_H
+
+#include <cstddef>
+#include <vector>
+
+namespace mlcompileropt {
+
+struct SampleSummary {
+  size_t Count = 0;
+  double Min = 0.0;
+  double Max = 0.0;
+  double Mean = 0.0;
+  double Median = 0.0;
+  double P95 = 0.0;
+  double P99 = 0.0;
+  double StdDev = 0.0;
+};
+
+// Summarizes Samples. Percentiles use the nearest-rank method; an empty
+// list yields all zeros.
+SampleSummary summarizeSamples(std::vector<double> Samples);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_DRIVER_SAMPLE_STATS_H
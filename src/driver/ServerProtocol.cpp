@@ -0,0 +1,79 @@
+//===- ServerProtocol.cpp - Compile Server Framing ------------------===//
+//
+// Implementation of the compile server framing.
+//
+//===----------------------------------------------------------------===//
+
+#include "driver/ServerProtocol.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+Error malformed(const Twine &Msg) {
+  return createStringError(inconvertibleErrorCode(),
+                           "malformed request: " + Msg.str());
+}
+
+} // end anonymous namespace
+
+Expected<bool> readServerRequest(std::istream &IS, ServerRequest &Req,
+                                 uint64_t MaxPayloadSize) {
+  std::string Line;
+  // Blank lines between frames are ignored.
+  do {
+    if (!std::getline(IS, Line))
+      return false;
+  } while (StringRef(Line).trim().empty());
+
+  SmallVector<StringRef, 4> Fields;
+  StringRef(Line).split(Fields, ' ', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+
+  Req = ServerRequest();
+  if (Fields[0] == "stats") {
+    if (Fields.size() != 2)
+      return malformed("expected 'stats <id>'");
+    Req.Command = ServerRequest::Stats;
+    Req.Id = Fields[1].str();
+    return true;
+  }
+
+  if (Fields[0] != "optimize")
+    return malformed("unknown command '" + Fields[0] + "'");
+  if (Fields.size() != 4)
+    return malformed("expected 'optimize <id> <ll|bc> <size>'");
+
+  Req.Command = ServerRequest::Optimize;
+  Req.Id = Fields[1].str();
+  if (Fields[2] == "bc")
+    Req.EmitBitcode = true;
+  else if (Fields[2] != "ll")
+    return malformed("unknown output format '" + Fields[2] + "'");
+
+  uint64_t Size;
+  if (Fields[3].getAsInteger(10, Size))
+    return malformed("invalid payload size '" + Fields[3] + "'");
+  // Checked before the payload is allocated
+  if (Size > MaxPayloadSize)
+    return malformed("payload size " + Twine(Size) + " exceeds the limit of " +
+                     Twine(MaxPayloadSize) + " bytes");
+
+  Req.Payload.resize(Size);
+  if (!IS.read(&Req.Payload[0], Size))
+    return malformed("truncated payload for request '" + Req.Id + "'");
+  return true;
+}
+
+void writeServerResponse(raw_ostream &OS, StringRef Id, bool Success,
+                         StringRef Payload) {
+  OS << Id << (Success ? " ok " : " error ") << Payload.size() << "\n"
+     << Payload;
+  OS.flush();
+}
+
+} // namespace mlcompileropt
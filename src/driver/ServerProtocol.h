@@ -0,0 +1,62 @@
+//===- ServerProtocol.h - Compile Server Framing --------------------===//
+//
+// This file declares the framing used by the ml_compiler compile server.
+// Requests and responses are a single header line followed by a binary
+// payload whose size is given in the header:
+//
+//   request:   optimize <id> <ll|bc> <size>\n<IR text or bitcode>
+//              stats <id>\n
+//   response:  <id> ok <size>\n<payload>
+//              <id> error <size>\n<message>
+//
+// <id> is any token without white space chosen by the client. Responses
+// may arrive in a different order than the requests.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_DRIVER_SERVER_PROTOCOL_H
+#define MLCOMPILEROPT_DRIVER_SERVER_PROTOCOL_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <cstdint>
+#include <istream>
+#include <string>
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+struct ServerRequest {
+  enum CommandKind { Optimize, Stats };
+
+  CommandKind Command = Optimize;
+  std::string Id;
+
+  // Write the optimized module as bitcode rather than textual IR
+  bool EmitBitcode = false;
+
+  // IR text or bitcode; the format is detected when parsing
+  std::string Payload;
+};
+
+// Payloads larger than this are rejected rather than allocated
+constexpr uint64_t DefaultMaxPayloadSize = uint64_t(256) << 20;
+
+// Reads the next request from IS. Returns false at the end of the input,
+// and an error if the input is not a well-formed request or its payload
+// is larger than MaxPayloadSize.
+llvm::Expected<bool>
+readServerRequest(std::istream &IS, ServerRequest &Req,
+                  uint64_t MaxPayloadSize = DefaultMaxPayloadSize);
+
+// Writes one response frame and flushes OS.
+void writeServerResponse(llvm::raw_ostream &OS, llvm::StringRef Id,
+                         bool Success, llvm::StringRef Payload);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_DRIVER_SERVER_PROTOCOL_H
@@ -0,0 +1,125 @@
+//===- TargetMachineCache.cpp - Target Machines for Module Triples --===//
+//
+// Implementation of the TargetMachine cache behind the optimization
+// pipeline's TargetIRAnalysis.
+//
+//===----------------------------------------------------------------===//
+
+#include "driver/TargetMachineCache.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetOptions.h"
+
+#if LLVM_VERSION_MAJOR >= 14
+#include "llvm/MC/TargetRegistry.h"
+#else
+#include "llvm/Support/TargetRegistry.h"
+#endif
+
+#include <mutex>
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+cl::opt<std::string> TargetCPU(
+    "target-cpu",
+    cl::desc("CPU to optimize and generate code for, whose costs guide the "
+             "custom passes and the O3 pipeline: a CPU name of the module's "
+             "target, or 'native' for the host CPU (default: generic)"),
+    cl::value_desc("cpu"));
+
+cl::opt<std::string> TargetFeatures(
+    "target-features",
+    cl::desc("Target features to enable (+name) or disable (-name) on top "
+             "of the CPU's, e.g. '+avx2,-fma'"),
+    cl::value_desc("features"));
+
+// The code generator also needs the host target's assembly printer, and
+// its assembly parser for inline assembly
+void initializeNativeTarget() {
+  static std::once_flag Once;
+  std::call_once(Once, [] {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+  });
+}
+
+} // end anonymous namespace
+
+StringRef getSelectedTargetCPU() { return TargetCPU; }
+
+StringRef getSelectedTargetFeatures() { return TargetFeatures; }
+
+TargetMachineCache::TargetMachineCache(StringRef CPU, StringRef Features)
+    : CPU(CPU.str()) {
+  // Explicit features come after the host's so that they override them
+  SubtargetFeatures SF;
+  if (CPU == "native") {
+    this->CPU = sys::getHostCPUName().str();
+    StringMap<bool> HostFeatures;
+    if (sys::getHostCPUFeatures(HostFeatures))
+      for (auto &Feature : HostFeatures)
+        SF.AddFeature(Feature.first(), Feature.second);
+  }
+  SubtargetFeatures Explicit(Features);
+  for (const std::string &Feature : Explicit.getFeatures())
+    SF.AddFeature(Feature);
+  this->Features = SF.getString();
+}
+
+Expected<std::unique_ptr<TargetMachine>>
+TargetMachineCache::createTargetMachine(StringRef TripleName,
+                                        Optional<Reloc::Model> RM,
+                                        CodeGenOpt::Level OptLevel) const {
+  initializeNativeTarget();
+  std::string Error;
+  const Target *T = TargetRegistry::lookupTarget(TripleName.str(), Error);
+  if (!T)
+    return createStringError(inconvertibleErrorCode(), Error);
+  return std::unique_ptr<TargetMachine>(T->createTargetMachine(
+      TripleName, CPU.empty() ? "generic" : CPU, Features, TargetOptions(), RM,
+      /*CM=*/None, OptLevel));
+}
+
+TargetMachine *TargetMachineCache::getTargetMachine(StringRef TripleName) {
+  if (TripleName.empty())
+    return nullptr;
+  auto Insertion = TargetMachines.try_emplace(TripleName);
+  if (!Insertion.second)
+    return Insertion.first->second.get();
+
+  auto TMOrErr = createTargetMachine(TripleName);
+  if (!TMOrErr) {
+    consumeError(TMOrErr.takeError());
+    return nullptr;
+  }
+  Insertion.first->second = std::move(*TMOrErr);
+  return Insertion.first->second.get();
+}
+
+TargetTransformInfo
+TargetMachineCache::getTargetTransformInfo(const Function &F) {
+  const Module &M = *F.getParent();
+  if (TargetMachine *TM = getTargetMachine(M.getTargetTriple()))
+    return TM->getTargetTransformInfo(F);
+  return TargetTransformInfo(M.getDataLayout());
+}
+
+TargetIRAnalysis TargetMachineCache::getTargetIRAnalysis() {
+  return TargetIRAnalysis(
+      [this](const Function &F) { return getTargetTransformInfo(F); });
+}
+
+} // namespace mlcompileropt
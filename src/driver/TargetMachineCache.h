@@ -0,0 +1,71 @@
+//===- TargetMachineCache.h - Target Machines for Module Triples ----===//
+//
+// This file declares a cache of TargetMachines keyed by target triple. The
+// optimization pipeline uses it to give TargetIRAnalysis, and with it the
+// cost model of the memory coalescing pass, the cache line size, vector
+// register width and instruction costs of the target each module is
+// compiled for. The code generator creates its TargetMachines from the
+// same CPU and features. Only the host's target is linked in; modules for
+// other targets, and modules without a triple, get the target-independent
+// defaults.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_DRIVER_TARGET_MACHINE_CACHE_H
+#define MLCOMPILEROPT_DRIVER_TARGET_MACHINE_CACHE_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <memory>
+#include <string>
+
+namespace mlcompileropt {
+
+// CPU selected with -target-cpu: empty for the generic CPU of each
+// triple, or "native" for the host CPU and its features
+llvm::StringRef getSelectedTargetCPU();
+
+// Features selected with -target-features, e.g. "+avx2,-fma", added to
+// those of the CPU
+llvm::StringRef getSelectedTargetFeatures();
+
+class TargetMachineCache {
+public:
+  explicit TargetMachineCache(
+      llvm::StringRef CPU = getSelectedTargetCPU(),
+      llvm::StringRef Features = getSelectedTargetFeatures());
+
+  // Creates a TargetMachine for Triple that is owned by the caller, e.g.
+  // one per code generation thread. Fails if the target is not available.
+  llvm::Expected<std::unique_ptr<llvm::TargetMachine>>
+  createTargetMachine(
+      llvm::StringRef Triple,
+      llvm::Optional<llvm::Reloc::Model> RM = llvm::None,
+      llvm::CodeGenOpt::Level OptLevel = llvm::CodeGenOpt::Default) const;
+
+  // Returns the TargetMachine for Triple, creating it on first use, or null
+  // if the triple is empty or its target is not available
+  llvm::TargetMachine *getTargetMachine(llvm::StringRef Triple);
+
+  // Returns the target's TTI for the triple of F's module, or the
+  // target-independent one if there is no TargetMachine for it
+  llvm::TargetTransformInfo getTargetTransformInfo(const llvm::Function &F);
+
+  // TargetIRAnalysis answering from getTargetTransformInfo. The cache must
+  // outlive the analysis managers the analysis is registered with.
+  llvm::TargetIRAnalysis getTargetIRAnalysis();
+
+private:
+  std::string CPU;
+  std::string Features;
+
+  // Null entries record triples whose target is not available
+  llvm::StringMap<std::unique_ptr<llvm::TargetMachine>> TargetMachines;
+};
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_DRIVER_TARGET_MACHINE_CACHE_H
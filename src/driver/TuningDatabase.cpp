@@ -0,0 +1,168 @@
+//===- TuningDatabase.cpp - Autotuned Configurations per Kernel -----===//
+//
+// Implementation of kernel signatures and the tuning database file.
+//
+//===----------------------------------------------------------------===//
+
+#include "driver/TuningDatabase.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+const char *const DatabaseVersion = "# ml_compiler tuning database v1";
+
+} // end anonymous namespace
+
+std::string getKernelSignature(const Function &F) {
+  // Hashes the structure of the body rather than its printed form, which
+  // depends on value names, metadata and attribute group numbering, and
+  // so on the rest of the module
+  DenseMap<const Value *, unsigned> Numbers;
+  unsigned Next = 0;
+  for (const Argument &A : F.args())
+    Numbers[&A] = Next++;
+  for (const BasicBlock &BB : F) {
+    Numbers[&BB] = Next++;
+    for (const Instruction &I : BB)
+      Numbers[&I] = Next++;
+  }
+
+  std::string Text;
+  raw_string_ostream OS(Text);
+  F.getFunctionType()->print(OS);
+  for (const BasicBlock &BB : F) {
+    OS << "\n" << Numbers[&BB] << ':';
+    for (const Instruction &I : BB) {
+      OS << "\n  " << I.getOpcodeName() << ' ';
+      I.getType()->print(OS);
+      if (const auto *Cmp = dyn_cast<CmpInst>(&I))
+        OS << ' ' << CmpInst::getPredicateName(Cmp->getPredicate());
+      // With opaque pointers the operand types no longer carry the shape
+      // of what is addressed, so record the element types and alignments
+      if (const auto *GEP = dyn_cast<GEPOperator>(&I)) {
+        OS << (GEP->isInBounds() ? " inbounds " : " ");
+        GEP->getSourceElementType()->print(OS);
+      } else if (const auto *AI = dyn_cast<AllocaInst>(&I)) {
+        OS << ' ';
+        AI->getAllocatedType()->print(OS);
+        OS << " align " << AI->getAlign().value();
+      } else if (const auto *LI = dyn_cast<LoadInst>(&I)) {
+        OS << " align " << LI->getAlign().value();
+      } else if (const auto *SI = dyn_cast<StoreInst>(&I)) {
+        OS << " align " << SI->getAlign().value();
+      }
+      for (const Value *Op : I.operands()) {
+        OS << ", ";
+        auto It = Numbers.find(Op);
+        if (It != Numbers.end())
+          OS << '%' << It->second;
+        else if (isa<GlobalValue>(Op))
+          OS << '@' << Op->getName();
+        else
+          Op->printAsOperand(OS, /*PrintType=*/true);
+      }
+    }
+  }
+  return (F.getName() + "#" + utohexstr(xxHash64(OS.str()), /*LowerCase=*/true))
+      .str();
+}
+
+Expected<TuningDatabase> TuningDatabase::load(StringRef Path) {
+  TuningDatabase DB;
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufferOrErr =
+      MemoryBuffer::getFile(Path, /*IsText=*/true);
+  if (!BufferOrErr) {
+    if (BufferOrErr.getError() == std::errc::no_such_file_or_directory)
+      return DB;
+    return createStringError(BufferOrErr.getError(), "cannot read '%s': %s",
+                             Path.str().c_str(),
+                             BufferOrErr.getError().message().c_str());
+  }
+
+  SmallVector<StringRef, 32> Lines;
+  (*BufferOrErr)->getBuffer().split(Lines, '\n', /*MaxSplit=*/-1,
+                                    /*KeepEmpty=*/false);
+  if (Lines.empty() || Lines.front().rtrim() != DatabaseVersion)
+    return createStringError(inconvertibleErrorCode(),
+                             "'%s' is not a tuning database",
+                             Path.str().c_str());
+
+  for (unsigned I = 1; I < Lines.size(); ++I) {
+    SmallVector<StringRef, 3> Fields;
+    Lines[I].rtrim().split(Fields, ' ', /*MaxSplit=*/2, /*KeepEmpty=*/false);
+    Entry E;
+    if (Fields.size() != 3 || Fields[1].getAsDouble(E.Time))
+      return createStringError(inconvertibleErrorCode(),
+                               "%s:%u: malformed entry", Path.str().c_str(),
+                               I + 1);
+    Expected<TuningConfig> Config = TuningConfig::parse(Fields[2]);
+    if (!Config)
+      return createStringError(inconvertibleErrorCode(), "%s:%u: %s",
+                               Path.str().c_str(), I + 1,
+                               toString(Config.takeError()).c_str());
+    E.Config = *Config;
+    DB.Entries[Fields[0].str()] = E;
+  }
+  return DB;
+}
+
+std::string TuningDatabase::str() const {
+  std::string Text;
+  raw_string_ostream OS(Text);
+  OS << DatabaseVersion << '\n';
+  for (const auto &KV : Entries)
+    OS << KV.first << ' ' << format("%.4f", KV.second.Time) << ' '
+       << KV.second.Config.toString() << '\n';
+  return OS.str();
+}
+
+Error TuningDatabase::save(StringRef Path) const {
+  if (Error E = writeFileAtomically((Path + ".tmp-%%%%%%").str(), Path, str()))
+    return createStringError(inconvertibleErrorCode(), "cannot write '%s': %s",
+                             Path.str().c_str(),
+                             toString(std::move(E)).c_str());
+  return Error::success();
+}
+
+const TuningDatabase::Entry *TuningDatabase::lookup(StringRef Signature) const {
+  auto It = Entries.find(Signature.str());
+  return It == Entries.end() ? nullptr : &It->second;
+}
+
+void TuningDatabase::insert(StringRef Signature, const Entry &E) {
+  Entries[Signature.str()] = E;
+}
+
+unsigned TuningDatabase::apply(Module &M) const {
+  if (Entries.empty())
+    return 0;
+
+  unsigned NumTuned = 0;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    if (const Entry *E = lookup(getKernelSignature(F))) {
+      E->Config.attachTo(F);
+      ++NumTuned;
+    }
+  }
+  return NumTuned;
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,73 @@
+//===- TuningDatabase.h - Autotuned Configurations per Kernel -------===//
+//
+// This file declares the database the autotuner stores the best
+// transformation parameters it found in, and ml_compiler reads them from.
+// Entries are keyed by kernel signature: the function name and a hash of
+// the structure of the function's unoptimized IR, so a kernel whose body
+// changes is tuned afresh while renaming its values does not matter. The
+// file is plain text, one kernel per line:
+//
+//   # ml_compiler tuning database v1
+//   <signature> <time-us> <config>
+//
+// where the config is in the syntax of TuningConfig::toString.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_DRIVER_TUNING_DATABASE_H
+#define MLCOMPILEROPT_DRIVER_TUNING_DATABASE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include "passes/TuningConfig.h"
+
+#include <map>
+#include <string>
+
+namespace llvm {
+class Function;
+class Module;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+// Signature of F, e.g. "matmul_0#5f0c2d9a13b4e877". Only meaningful for
+// unoptimized functions; optimization changes the hash.
+std::string getKernelSignature(const llvm::Function &F);
+
+class TuningDatabase {
+public:
+  struct Entry {
+    TuningConfig Config;
+
+    // Median time per call the config was measured at, in microseconds
+    double Time = 0.0;
+  };
+
+  // Reads a database. A file that does not exist gives an empty database.
+  static llvm::Expected<TuningDatabase> load(llvm::StringRef Path);
+
+  // Writes the database, replacing the file atomically
+  llvm::Error save(llvm::StringRef Path) const;
+
+  const Entry *lookup(llvm::StringRef Signature) const;
+  void insert(llvm::StringRef Signature, const Entry &E);
+
+  // Attaches the configuration of every function of M that has an entry.
+  // Returns the number of functions tuned.
+  unsigned apply(llvm::Module &M) const;
+
+  // The database in its file format, e.g. for cache keys
+  std::string str() const;
+
+  size_t size() const { return Entries.size(); }
+
+private:
+  // Ordered, so that saved files do not depend on the insertion order
+  std::map<std::string, Entry> Entries;
+};
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_DRIVER_TUNING_DATABASE_H
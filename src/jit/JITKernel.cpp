@@ -0,0 +1,236 @@
+//===- JITKernel.cpp - JIT-Compiled Benchmark Kernel ----------------===//
+//
+// Implementation of the JIT-compiled benchmark kernel and the dynamic
+// floating-point operation counter.
+//
+//===----------------------------------------------------------------===//
+
+#include "jit/JITKernel.h"
+#include "jit/KernelBuffers.h"
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+
+#include <mutex>
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+const char *const EntryPointName = "__ml_bench_entry";
+const char *const FlopCounterName = "__ml_bench_flops";
+
+Error makeError(const Twine &Msg) {
+  return createStringError(inconvertibleErrorCode(), Msg);
+}
+
+void initializeNativeTarget() {
+  static std::once_flag Once;
+  std::call_once(Once, [] {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+  });
+}
+
+// Builds the entry point described in the header: the arguments are loaded
+// once and the call sits in a loop of Iters iterations.
+void createEntryPoint(Module &M, Function &Kernel) {
+  LLVMContext &Ctx = M.getContext();
+  Type *I8Ptr = Type::getInt8PtrTy(Ctx);
+  Type *I64 = Type::getInt64Ty(Ctx);
+  FunctionType *EntryTy = FunctionType::get(
+      Type::getVoidTy(Ctx), {PointerType::getUnqual(I8Ptr), I64}, false);
+  Function *Entry =
+      Function::Create(EntryTy, GlobalValue::ExternalLinkage, EntryPointName, M);
+  Value *ArgArray = Entry->getArg(0);
+  Value *Iters = Entry->getArg(1);
+
+  BasicBlock *EntryBB = BasicBlock::Create(Ctx, "entry", Entry);
+  BasicBlock *LoopBB = BasicBlock::Create(Ctx, "loop", Entry);
+  BasicBlock *ExitBB = BasicBlock::Create(Ctx, "exit", Entry);
+
+  IRBuilder<> B(EntryBB);
+  SmallVector<Value *, 8> CallArgs;
+  for (Argument &A : Kernel.args()) {
+    Value *Slot = B.CreateLoad(
+        I8Ptr, B.CreateConstInBoundsGEP1_64(I8Ptr, ArgArray, A.getArgNo()));
+    Type *Ty = A.getType();
+    if (Ty->isPointerTy())
+      CallArgs.push_back(B.CreatePointerBitCastOrAddrSpaceCast(Slot, Ty));
+    else
+      CallArgs.push_back(
+          B.CreateLoad(Ty, B.CreateBitCast(Slot, PointerType::getUnqual(Ty))));
+  }
+  B.CreateCondBr(B.CreateICmpEQ(Iters, B.getInt64(0)), ExitBB, LoopBB);
+
+  B.SetInsertPoint(LoopBB);
+  PHINode *IV = B.CreatePHI(I64, 2);
+  IV->addIncoming(B.getInt64(0), EntryBB);
+  CallInst *Call = B.CreateCall(&Kernel, CallArgs);
+  Call->setCallingConv(Kernel.getCallingConv());
+  Call->setIsNoInline();
+  Value *Next = B.CreateAdd(IV, B.getInt64(1));
+  IV->addIncoming(Next, LoopBB);
+  B.CreateCondBr(B.CreateICmpULT(Next, Iters), LoopBB, ExitBB);
+
+  B.SetInsertPoint(ExitBB);
+  B.CreateRetVoid();
+}
+
+unsigned getNumLanes(Type *Ty) {
+  if (auto *VT = dyn_cast<FixedVectorType>(Ty))
+    return VT->getNumElements();
+  return 1;
+}
+
+unsigned getNumFlops(const Instruction &I) {
+  switch (I.getOpcode()) {
+  case Instruction::FAdd:
+  case Instruction::FSub:
+  case Instruction::FMul:
+  case Instruction::FDiv:
+  case Instruction::FRem:
+    return getNumLanes(I.getType());
+  default:
+    break;
+  }
+
+  if (const auto *II = dyn_cast<IntrinsicInst>(&I)) {
+    switch (II->getIntrinsicID()) {
+    case Intrinsic::fma:
+    case Intrinsic::fmuladd:
+      return 2 * getNumLanes(I.getType());
+    case Intrinsic::sqrt:
+      return getNumLanes(I.getType());
+    case Intrinsic::vector_reduce_fadd:
+    case Intrinsic::vector_reduce_fmul:
+      return getNumLanes(II->getArgOperand(1)->getType());
+    default:
+      break;
+    }
+  }
+  return 0;
+}
+
+} // namespace
+
+JITKernel::~JITKernel() = default;
+
+Expected<std::unique_ptr<JITKernel>>
+JITKernel::compile(std::unique_ptr<Module> M, std::unique_ptr<LLVMContext> Ctx,
+                   StringRef KernelName) {
+  Function *Kernel = M->getFunction(KernelName);
+  if (!Kernel || Kernel->isDeclaration())
+    return makeError("kernel @" + KernelName + " is not defined");
+  if (Kernel->isVarArg())
+    return makeError("kernel @" + KernelName + " is variadic");
+  createEntryPoint(*M, *Kernel);
+  if (verifyModule(*M, &errs()))
+    return makeError("generated entry point for @" + KernelName +
+                     " is invalid");
+
+  initializeNativeTarget();
+  auto JIT = orc::LLJITBuilder().create();
+  if (!JIT)
+    return JIT.takeError();
+
+  // Kernels may call into the C library, e.g. for math functions
+  const DataLayout &DL = (*JIT)->getDataLayout();
+  auto Generator = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      DL.getGlobalPrefix());
+  if (!Generator)
+    return Generator.takeError();
+  (*JIT)->getMainJITDylib().addGenerator(std::move(*Generator));
+
+  if (M->getDataLayout() != DL)
+    M->setDataLayout(DL);
+  // JIT errors can refer to the JIT's state, so they become plain strings
+  // before the JIT is destroyed
+  if (Error E = (*JIT)->addIRModule(
+          orc::ThreadSafeModule(std::move(M), std::move(Ctx))))
+    return makeError(toString(std::move(E)));
+
+  std::unique_ptr<JITKernel> Result(new JITKernel());
+  Result->JIT = std::move(*JIT);
+  auto Entry = Result->lookup(EntryPointName);
+  if (!Entry)
+    return makeError(toString(Entry.takeError()));
+  Result->Entry = reinterpret_cast<EntryFn>(*Entry);
+  return Result;
+}
+
+void JITKernel::run(void **Args, uint64_t Iterations) const {
+  Entry(Args, Iterations);
+}
+
+Expected<void *> JITKernel::lookup(StringRef Name) {
+  auto Sym = JIT->lookup(Name);
+  if (!Sym)
+    return Sym.takeError();
+#if LLVM_VERSION_MAJOR >= 15
+  return Sym->toPtr<void *>();
+#else
+  return jitTargetAddressToPointer<void *>(Sym->getAddress());
+#endif
+}
+
+Expected<std::unique_ptr<JITKernel>>
+compileKernelModule(MemoryBufferRef Input, StringRef KernelName,
+                    function_ref<void(Module &)> Prepare) {
+  auto Ctx = std::make_unique<LLVMContext>();
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = parseIR(Input, Err, *Ctx);
+  if (!M)
+    return makeError(Input.getBufferIdentifier() + ": " + Err.getMessage());
+  if (Function *Kernel = M->getFunction(KernelName))
+    if (Kernel->hasLocalLinkage())
+      Kernel->setLinkage(GlobalValue::ExternalLinkage);
+  Prepare(*M);
+  return JITKernel::compile(std::move(M), std::move(Ctx), KernelName);
+}
+
+Expected<uint64_t> countFlops(std::unique_ptr<Module> M,
+                              std::unique_ptr<LLVMContext> Ctx,
+                              StringRef KernelName, KernelBuffers &Buffers) {
+  Type *I64 = Type::getInt64Ty(*Ctx);
+  auto *Counter = new GlobalVariable(*M, I64, /*isConstant=*/false,
+                                     GlobalValue::ExternalLinkage,
+                                     ConstantInt::get(I64, 0), FlopCounterName);
+
+  for (Function &F : *M) {
+    for (BasicBlock &BB : F) {
+      uint64_t N = 0;
+      for (const Instruction &I : BB)
+        N += getNumFlops(I);
+      if (!N)
+        continue;
+      IRBuilder<> B(&*BB.getFirstInsertionPt());
+      Value *Count = B.CreateLoad(I64, Counter);
+      B.CreateStore(B.CreateAdd(Count, B.getInt64(N)), Counter);
+    }
+  }
+
+  auto Kernel = JITKernel::compile(std::move(M), std::move(Ctx), KernelName);
+  if (!Kernel)
+    return Kernel.takeError();
+  auto Address = (*Kernel)->lookup(FlopCounterName);
+  if (!Address)
+    return Address.takeError();
+
+  Buffers.reset();
+  (*Kernel)->run(Buffers.getArgumentArray(), 1);
+  Buffers.reset();
+  return *static_cast<uint64_t *>(*Address);
+}
+
+} // namespace mlcompileropt
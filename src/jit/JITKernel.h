@@ -0,0 +1,78 @@
+//===- JITKernel.h - JIT-Compiled Benchmark Kernel ------------------===//
+//
+// This file declares a kernel compiled for the host with ORC's LLJIT. A
+// generated entry point, "void __ml_bench_entry(i8** Args, i64 Iters)",
+// loads the kernel arguments from an array of argument addresses (see
+// KernelBuffers) and calls the kernel Iters times, so that kernels with
+// arbitrary signatures can be timed without per-call overhead from the
+// host side.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_JIT_JIT_KERNEL_H
+#define MLCOMPILEROPT_JIT_JIT_KERNEL_H
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBufferRef.h"
+
+#include <memory>
+
+namespace llvm {
+class LLVMContext;
+class Module;
+namespace orc {
+class LLJIT;
+} // namespace orc
+} // namespace llvm
+
+namespace mlcompileropt {
+
+class KernelBuffers;
+
+class JITKernel {
+public:
+  ~JITKernel();
+
+  // Adds the entry point for KernelName to M and compiles M. The kernel
+  // must be defined in M.
+  static llvm::Expected<std::unique_ptr<JITKernel>>
+  compile(std::unique_ptr<llvm::Module> M,
+          std::unique_ptr<llvm::LLVMContext> Ctx, llvm::StringRef KernelName);
+
+  // Calls the kernel Iterations times on the given argument addresses.
+  void run(void **Args, uint64_t Iterations) const;
+
+  // Returns the address of the symbol Name in the compiled module.
+  llvm::Expected<void *> lookup(llvm::StringRef Name);
+
+private:
+  using EntryFn = void (*)(void **, uint64_t);
+
+  JITKernel() = default;
+
+  std::unique_ptr<llvm::orc::LLJIT> JIT;
+  EntryFn Entry = nullptr;
+};
+
+// Parses the textual or bitcode module in Input into a fresh context, lets
+// Prepare transform it, e.g. optimize it, and compiles it for KernelName.
+// A kernel with local linkage is made external first so that the optimizer
+// keeps it.
+llvm::Expected<std::unique_ptr<JITKernel>>
+compileKernelModule(llvm::MemoryBufferRef Input, llvm::StringRef KernelName,
+                    llvm::function_ref<void(llvm::Module &)> Prepare);
+
+// Counts the floating-point operations one call of KernelName performs on
+// Buffers by instrumenting every basic block of M with a counter. Vector
+// operations count once per lane and fused multiply-adds count twice.
+// Buffers are reset before and after the call.
+llvm::Expected<uint64_t> countFlops(std::unique_ptr<llvm::Module> M,
+                                    std::unique_ptr<llvm::LLVMContext> Ctx,
+                                    llvm::StringRef KernelName,
+                                    KernelBuffers &Buffers);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_JIT_JIT_KERNEL_H
@@ -0,0 +1,312 @@
+//===- KernelBuffers.cpp - Kernel Argument Storage ------------------===//
+//
+// Implementation of the storage a JIT-compiled kernel is run on.
+//
+//===----------------------------------------------------------------===//
+
+#include "jit/KernelBuffers.h"
+
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/MemAlloc.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+const size_t BufferAlignment = 64;
+
+size_t getElementSize(KernelBuffers::ElementKind Kind) {
+  switch (Kind) {
+  case KernelBuffers::ElementKind::I8:
+    return 1;
+  case KernelBuffers::ElementKind::I16:
+    return 2;
+  case KernelBuffers::ElementKind::F32:
+  case KernelBuffers::ElementKind::I32:
+    return 4;
+  case KernelBuffers::ElementKind::F64:
+  case KernelBuffers::ElementKind::I64:
+    return 8;
+  }
+  llvm_unreachable("unknown element kind");
+}
+
+bool isFloatingPoint(KernelBuffers::ElementKind Kind) {
+  return Kind == KernelBuffers::ElementKind::F32 ||
+         Kind == KernelBuffers::ElementKind::F64;
+}
+
+Optional<KernelBuffers::ElementKind> getElementKind(StringRef Name) {
+  return StringSwitch<Optional<KernelBuffers::ElementKind>>(Name)
+      .Case("f32", KernelBuffers::ElementKind::F32)
+      .Case("f64", KernelBuffers::ElementKind::F64)
+      .Case("i8", KernelBuffers::ElementKind::I8)
+      .Case("i16", KernelBuffers::ElementKind::I16)
+      .Case("i32", KernelBuffers::ElementKind::I32)
+      .Case("i64", KernelBuffers::ElementKind::I64)
+      .Default(None);
+}
+
+Optional<KernelBuffers::ElementKind> getElementKind(Type *Ty) {
+  if (Ty->isFloatTy())
+    return KernelBuffers::ElementKind::F32;
+  if (Ty->isDoubleTy())
+    return KernelBuffers::ElementKind::F64;
+  switch (Ty->isIntegerTy() ? Ty->getIntegerBitWidth() : 0) {
+  case 8:
+    return KernelBuffers::ElementKind::I8;
+  case 16:
+    return KernelBuffers::ElementKind::I16;
+  case 32:
+    return KernelBuffers::ElementKind::I32;
+  case 64:
+    return KernelBuffers::ElementKind::I64;
+  default:
+    return None;
+  }
+}
+
+std::shared_ptr<char> allocateAligned(size_t Size) {
+  Size = std::max(Size, BufferAlignment);
+  return std::shared_ptr<char>(
+      static_cast<char *>(allocate_buffer(Size, BufferAlignment)),
+      [Size](char *P) { deallocate_buffer(P, Size, BufferAlignment); });
+}
+
+template <typename T> void storeElement(std::vector<char> &Bytes, T Value) {
+  Bytes.resize(sizeof(T));
+  std::memcpy(Bytes.data(), &Value, sizeof(T));
+}
+
+// Parses a scalar argument value into its in-memory representation.
+bool parseScalar(StringRef Text, KernelBuffers::ElementKind Kind,
+                 std::vector<char> &Bytes) {
+  if (isFloatingPoint(Kind)) {
+    double V;
+    if (Text.getAsDouble(V))
+      return false;
+    if (Kind == KernelBuffers::ElementKind::F32)
+      storeElement(Bytes, static_cast<float>(V));
+    else
+      storeElement(Bytes, V);
+    return true;
+  }
+
+  int64_t V;
+  if (Text.getAsInteger(0, V))
+    return false;
+  switch (Kind) {
+  case KernelBuffers::ElementKind::I8:
+    storeElement(Bytes, static_cast<int8_t>(V));
+    break;
+  case KernelBuffers::ElementKind::I16:
+    storeElement(Bytes, static_cast<int16_t>(V));
+    break;
+  case KernelBuffers::ElementKind::I32:
+    storeElement(Bytes, static_cast<int32_t>(V));
+    break;
+  default:
+    storeElement(Bytes, V);
+    break;
+  }
+  return true;
+}
+
+// Fills a pointer argument with values in [-1, 1) for floating-point
+// elements and in [0, 16) for integers, which keeps integer buffers usable
+// as small indices or trip counts.
+void fillRandom(KernelBuffers::Buffer &B, std::mt19937_64 &Rng) {
+  std::uniform_real_distribution<double> Real(-1.0, 1.0);
+  std::uniform_int_distribution<int> Int(0, 15);
+  size_t ElemSize = getElementSize(B.Kind);
+  for (uint64_t I = 0; I < B.NumElements; ++I) {
+    char *Dst = B.Initial.data() + I * ElemSize;
+    switch (B.Kind) {
+    case KernelBuffers::ElementKind::F32: {
+      float V = static_cast<float>(Real(Rng));
+      std::memcpy(Dst, &V, sizeof(V));
+      break;
+    }
+    case KernelBuffers::ElementKind::F64: {
+      double V = Real(Rng);
+      std::memcpy(Dst, &V, sizeof(V));
+      break;
+    }
+    default: {
+      // Little-endian: the low bytes carry the value for every width
+      int64_t V = Int(Rng);
+      std::memcpy(Dst, &V, ElemSize);
+      break;
+    }
+    }
+  }
+}
+
+template <typename T> double loadAs(const char *P) {
+  T V;
+  std::memcpy(&V, P, sizeof(T));
+  return static_cast<double>(V);
+}
+
+double loadElement(const char *P, KernelBuffers::ElementKind Kind) {
+  switch (Kind) {
+  case KernelBuffers::ElementKind::F32:
+    return loadAs<float>(P);
+  case KernelBuffers::ElementKind::F64:
+    return loadAs<double>(P);
+  case KernelBuffers::ElementKind::I8:
+    return loadAs<int8_t>(P);
+  case KernelBuffers::ElementKind::I16:
+    return loadAs<int16_t>(P);
+  case KernelBuffers::ElementKind::I32:
+    return loadAs<int32_t>(P);
+  case KernelBuffers::ElementKind::I64:
+    return loadAs<int64_t>(P);
+  }
+  llvm_unreachable("unknown element kind");
+}
+
+} // namespace
+
+Expected<KernelBuffers> KernelBuffers::create(const Function &Kernel,
+                                              const KernelSpec &Spec,
+                                              uint64_t Seed) {
+  auto Invalid = [&](const Twine &Msg) {
+    return createStringError(inconvertibleErrorCode(),
+                             "@" + Kernel.getName().str() + ": " + Msg.str());
+  };
+
+  KernelBuffers Result;
+  std::mt19937_64 Rng(Seed);
+  for (const Argument &Arg : Kernel.args()) {
+    // Unnamed arguments are referred to by their position
+    std::string Name = Arg.hasName() ? Arg.getName().str()
+                                     : std::to_string(Arg.getArgNo());
+    const KernelArgSpec *ArgSpec = Spec.getArg(Name);
+    if (!ArgSpec)
+      return Invalid("no shape given for argument '" + Name + "'");
+
+    Buffer B;
+    B.Name = Name;
+    Type *Ty = Arg.getType();
+    if (auto *PtrTy = dyn_cast<PointerType>(Ty)) {
+      StringRef Count, TypeName;
+      std::tie(Count, TypeName) = StringRef(ArgSpec->Value).split('x');
+      if (Count.getAsInteger(10, B.NumElements))
+        return Invalid("'" + Name + "' expects <elements>[x<type>]");
+
+      Optional<ElementKind> Kind;
+      if (!TypeName.empty())
+        Kind = getElementKind(TypeName);
+      else if (PtrTy->isOpaque())
+        Kind = ElementKind::F32;
+      else
+        Kind = getElementKind(PtrTy->getNonOpaquePointerElementType());
+      if (!Kind)
+        return Invalid("cannot determine the element type of '" + Name +
+                       "', append x<f32|f64|i8|i16|i32|i64>");
+      B.Kind = *Kind;
+      B.Initial.resize(B.NumElements * getElementSize(B.Kind));
+      fillRandom(B, Rng);
+    } else {
+      Optional<ElementKind> Kind = getElementKind(Ty);
+      if (!Kind)
+        return Invalid("unsupported type for scalar argument '" + Name + "'");
+      B.Kind = *Kind;
+      B.IsPointer = false;
+      B.NumElements = 1;
+      if (!parseScalar(ArgSpec->Value, B.Kind, B.Initial))
+        return Invalid("invalid value '" + ArgSpec->Value + "' for '" + Name +
+                       "'");
+    }
+    B.Data = allocateAligned(B.Initial.size());
+    Result.Buffers.push_back(std::move(B));
+  }
+
+  for (const KernelArgSpec &ArgSpec : Spec.Args)
+    if (!any_of(Result.Buffers,
+                [&](const Buffer &B) { return B.Name == ArgSpec.Name; }))
+      return Invalid("no argument named '" + ArgSpec.Name + "'");
+
+  Result.reset();
+  return std::move(Result);
+}
+
+KernelBuffers KernelBuffers::clone() const {
+  KernelBuffers Result;
+  Result.Buffers = Buffers;
+  for (Buffer &B : Result.Buffers) {
+    std::shared_ptr<char> Current = std::move(B.Data);
+    B.Data = allocateAligned(B.Initial.size());
+    std::memcpy(B.Data.get(), Current.get(), B.Initial.size());
+  }
+  Result.updateArgumentArray();
+  return Result;
+}
+
+void KernelBuffers::reset() {
+  for (Buffer &B : Buffers)
+    std::memcpy(B.Data.get(), B.Initial.data(), B.Initial.size());
+  updateArgumentArray();
+}
+
+void KernelBuffers::updateArgumentArray() {
+  // Pointer arguments are passed as the buffer address, scalars as the
+  // address of their value
+  Args.clear();
+  for (Buffer &B : Buffers)
+    Args.push_back(B.Data.get());
+}
+
+uint64_t KernelBuffers::getTotalBytes() const {
+  uint64_t Total = 0;
+  for (const Buffer &B : Buffers)
+    if (B.IsPointer)
+      Total += B.getSizeInBytes();
+  return Total;
+}
+
+std::string KernelBuffers::compare(const KernelBuffers &Expected,
+                                   double RelTol, double AbsTol) const {
+  assert(Buffers.size() == Expected.Buffers.size() && "signature mismatch");
+  for (size_t I = 0; I < Buffers.size(); ++I) {
+    const Buffer &A = Buffers[I];
+    const Buffer &E = Expected.Buffers[I];
+    if (!A.IsPointer)
+      continue;
+
+    size_t ElemSize = getElementSize(A.Kind);
+    for (uint64_t J = 0; J < A.NumElements; ++J) {
+      const char *GotPtr = A.Data.get() + J * ElemSize;
+      const char *WantPtr = E.Data.get() + J * ElemSize;
+      double Got = loadElement(GotPtr, A.Kind);
+      double Want = loadElement(WantPtr, E.Kind);
+      bool Match;
+      if (!isFloatingPoint(A.Kind))
+        Match = std::memcmp(GotPtr, WantPtr, ElemSize) == 0;
+      else if (std::isnan(Got) || std::isnan(Want))
+        Match = std::isnan(Got) && std::isnan(Want);
+      else
+        Match = Got == Want ||
+                std::fabs(Got - Want) <= AbsTol + RelTol * std::fabs(Want);
+      if (!Match) {
+        std::string Msg;
+        raw_string_ostream(Msg) << A.Name << "[" << J << "] is " << Got
+                                << ", expected " << Want;
+        return Msg;
+      }
+    }
+  }
+  return "";
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,89 @@
+//===- KernelBuffers.h - Kernel Argument Storage --------------------===//
+//
+// This file declares the storage a JIT-compiled kernel is run on. One
+// buffer is allocated per pointer argument and one slot per scalar
+// argument, laid out as the array of argument addresses that the
+// generated benchmark entry point expects. Buffers are filled with
+// reproducible pseudo-random data and can be restored to that data
+// before every run, so that each compiled variant sees identical inputs.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_JIT_KERNEL_BUFFERS_H
+#define MLCOMPILEROPT_JIT_KERNEL_BUFFERS_H
+
+#include "jit/KernelSpec.h"
+
+#include "llvm/Support/Error.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Function;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+class KernelBuffers {
+public:
+  enum class ElementKind { F32, F64, I8, I16, I32, I64 };
+
+  struct Buffer {
+    std::string Name;
+    ElementKind Kind = ElementKind::F32;
+    uint64_t NumElements = 0;
+
+    // False for scalar arguments, which hold a single element that is
+    // passed by value
+    bool IsPointer = true;
+
+    // Initial contents and the 64-byte aligned storage handed to the
+    // kernel
+    std::vector<char> Initial;
+    std::shared_ptr<char> Data;
+
+    uint64_t getSizeInBytes() const { return Initial.size(); }
+  };
+
+  // Allocates and fills the storage for Kernel's arguments as described
+  // by Spec. Every argument must be listed in the spec.
+  static llvm::Expected<KernelBuffers>
+  create(const llvm::Function &Kernel, const KernelSpec &Spec,
+         uint64_t Seed = 1);
+
+  // Returns a copy with its own storage holding the current contents.
+  KernelBuffers clone() const;
+
+  // Restores every buffer to its initial contents.
+  void reset();
+
+  // Returns the argument address array passed to the entry point.
+  void **getArgumentArray() { return Args.data(); }
+
+  // Returns the total size of the pointer arguments.
+  uint64_t getTotalBytes() const;
+
+  // Compares the pointer arguments with those of Other, which must have
+  // been created for the same signature. Floating-point elements match if
+  // they are within AbsTol + RelTol * |expected| of each other, integers
+  // must be equal. Returns a description of the first mismatch, or an
+  // empty string.
+  std::string compare(const KernelBuffers &Expected, double RelTol,
+                      double AbsTol) const;
+
+  const std::vector<Buffer> &getBuffers() const { return Buffers; }
+
+private:
+  KernelBuffers() = default;
+
+  void updateArgumentArray();
+
+  std::vector<Buffer> Buffers;
+  std::vector<void *> Args;
+};
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_JIT_KERNEL_BUFFERS_H
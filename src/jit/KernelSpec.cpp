@@ -0,0 +1,61 @@
+//===- KernelSpec.cpp - Runtime Benchmark Kernel Description --------===//
+//
+// Implementation of the kernel shape spec parser.
+//
+//===----------------------------------------------------------------===//
+
+#include "jit/KernelSpec.h"
+
+#include "llvm/ADT/SmallVector.h"
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+const KernelArgSpec *KernelSpec::getArg(StringRef Name) const {
+  for (const KernelArgSpec &A : Args)
+    if (A.Name == Name)
+      return &A;
+  return nullptr;
+}
+
+Expected<KernelSpec> parseKernelSpec(StringRef Spec) {
+  auto Invalid = [&](const Twine &Msg) {
+    return createStringError(inconvertibleErrorCode(),
+                             "invalid kernel spec '" + Spec.str() +
+                                 "': " + Msg.str());
+  };
+
+  StringRef Function, Rest;
+  std::tie(Function, Rest) = Spec.split(':');
+  KernelSpec Result;
+  Result.Function = Function.trim().str();
+  if (Result.Function.empty())
+    return Invalid("missing function name");
+
+  SmallVector<StringRef, 8> Entries;
+  Rest.split(Entries, ',', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+  for (StringRef Entry : Entries) {
+    StringRef Key, Value;
+    std::tie(Key, Value) = Entry.split('=');
+    Key = Key.trim();
+    Value = Value.trim();
+    if (Key.empty() || Value.empty())
+      return Invalid("expected <name>=<value>, got '" + Entry + "'");
+
+    if (Key == "flops" || Key == "bytes") {
+      uint64_t N;
+      if (Value.getAsInteger(10, N))
+        return Invalid("'" + Key + "' must be an integer");
+      (Key == "flops" ? Result.Flops : Result.Bytes) = N;
+      continue;
+    }
+
+    if (Result.getArg(Key))
+      return Invalid("argument '" + Key + "' given twice");
+    Result.Args.push_back({Key.str(), Value.str()});
+  }
+  return Result;
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,54 @@
+//===- KernelSpec.h - Runtime Benchmark Kernel Description ----------===//
+//
+// This file declares the shape spec that tells the runtime benchmark how
+// to call a kernel. A spec names the kernel and gives every argument by
+// its IR name:
+//
+//   matmul_2x2:A=4,B=4,C=4
+//   saxpy:x=1024xf32,y=1024xf32,n=1024,a=2.5,flops=2048
+//
+// Pointer arguments take an element count and an optional element type
+// (f32, f64, i8, i16, i32 or i64), which defaults to the pointee type when
+// the IR has typed pointers and to f32 otherwise. Scalar arguments take
+// their value. The reserved keys flops and bytes override the work per
+// call that is otherwise measured or estimated.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_JIT_KERNEL_SPEC_H
+#define MLCOMPILEROPT_JIT_KERNEL_SPEC_H
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <string>
+#include <vector>
+
+namespace mlcompileropt {
+
+struct KernelArgSpec {
+  std::string Name;
+
+  // Text after '=', interpreted according to the argument's IR type
+  std::string Value;
+};
+
+struct KernelSpec {
+  std::string Function;
+  std::vector<KernelArgSpec> Args;
+
+  // Floating-point operations and bytes moved per call, if given
+  llvm::Optional<uint64_t> Flops;
+  llvm::Optional<uint64_t> Bytes;
+
+  // Returns the spec of the argument called Name, or null.
+  const KernelArgSpec *getArg(llvm::StringRef Name) const;
+};
+
+// Parses a spec of the form "<function>:<key>=<value>,...".
+llvm::Expected<KernelSpec> parseKernelSpec(llvm::StringRef Spec);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_JIT_KERNEL_SPEC_H
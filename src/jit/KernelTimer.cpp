@@ -0,0 +1,58 @@
+//===- KernelTimer.cpp - Timing of JIT-Compiled Kernels -------------===//
+//
+// Implementation of the calibrated kernel timer.
+//
+//===----------------------------------------------------------------===//
+
+#include "jit/KernelTimer.h"
+#include "jit/JITKernel.h"
+#include "jit/KernelBuffers.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace mlcompileropt {
+
+namespace {
+
+// Milliseconds that Iterations calls of Kernel take from fresh inputs
+double timeSample(const JITKernel &Kernel, KernelBuffers &Buffers,
+                  uint64_t Iterations) {
+  Buffers.reset();
+  auto Start = std::chrono::steady_clock::now();
+  Kernel.run(Buffers.getArgumentArray(), Iterations);
+  auto End = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(End - Start).count();
+}
+
+} // end anonymous namespace
+
+uint64_t calibrateKernel(const JITKernel &Kernel, KernelBuffers &Buffers,
+                         double MinSampleTime) {
+  uint64_t Iterations = 1;
+  while (Iterations < (uint64_t(1) << 40)) {
+    double Elapsed = timeSample(Kernel, Buffers, Iterations);
+    if (Elapsed >= MinSampleTime)
+      break;
+    uint64_t Next =
+        Elapsed > 1.0
+            ? uint64_t(Iterations * MinSampleTime / Elapsed * 1.1) + 1
+            : Iterations * 2;
+    Iterations = std::max(Next, Iterations * 2);
+  }
+  return Iterations;
+}
+
+KernelTiming timeKernel(const JITKernel &Kernel, KernelBuffers &Buffers,
+                        const KernelTimingOptions &Options) {
+  KernelTiming Timing;
+  Timing.Iterations = calibrateKernel(Kernel, Buffers, Options.MinSampleTime);
+  for (unsigned I = 0; I < Options.Warmup + Options.Repetitions; ++I) {
+    double Elapsed = timeSample(Kernel, Buffers, Timing.Iterations);
+    if (I >= Options.Warmup)
+      Timing.Samples.push_back(Elapsed * 1e3 / Timing.Iterations);
+  }
+  return Timing;
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,54 @@
+//===- KernelTimer.h - Timing of JIT-Compiled Kernels ---------------===//
+//
+// This file declares the measurement shared by the runtime benchmark, the
+// autotuner and the training data collector, so that the times they report
+// can be compared. The number of calls per sample is calibrated until a
+// sample takes at least the minimum sample time; then untimed warm-up
+// samples and the timed samples follow. The inputs are restored before
+// every sample.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_JIT_KERNEL_TIMER_H
+#define MLCOMPILEROPT_JIT_KERNEL_TIMER_H
+
+#include <cstdint>
+#include <vector>
+
+namespace mlcompileropt {
+
+class JITKernel;
+class KernelBuffers;
+
+struct KernelTimingOptions {
+  // Untimed samples after the calibration
+  unsigned Warmup = 1;
+
+  // Timed samples
+  unsigned Repetitions = 10;
+
+  // Shortest sample in milliseconds
+  double MinSampleTime = 20.0;
+};
+
+struct KernelTiming {
+  // Calls of the kernel per sample
+  uint64_t Iterations = 0;
+
+  // Time per call of every timed sample, in microseconds
+  std::vector<double> Samples;
+};
+
+// Returns the number of calls per sample after which a sample of Kernel
+// takes at least MinSampleTime milliseconds. Once a sample is long enough
+// to extrapolate from, the count jumps close to the target.
+uint64_t calibrateKernel(const JITKernel &Kernel, KernelBuffers &Buffers,
+                         double MinSampleTime);
+
+// Calibrates Kernel and times it on Buffers as described in Options.
+KernelTiming timeKernel(const JITKernel &Kernel, KernelBuffers &Buffers,
+                        const KernelTimingOptions &Options);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_JIT_KERNEL_TIMER_H
@@ -0,0 +1,554 @@
+//===- KernelGenerator.cpp - Synthetic ML Kernel IR Generator -------===//
+//
+// Implementation of the synthetic kernel generator. Kernels are emitted
+// with IRBuilder as bottom-tested loops with i64 induction variables, and
+// reductions accumulate into the output buffer through memory.
+//
+//===----------------------------------------------------------------===//
+
+#include "kernelgen/KernelGenerator.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Host.h"
+
+#include <algorithm>
+#include <string>
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+const KernelKind AllKinds[] = {
+    KernelKind::Matmul,     KernelKind::BatchedMatmul,
+    KernelKind::Conv2DNCHW, KernelKind::Conv2DNHWC,
+    KernelKind::DepthwiseConv, KernelKind::Elementwise,
+    KernelKind::ColumnWalk, KernelKind::TransposeAdd,
+    KernelKind::Transpose,  KernelKind::ColumnAdd};
+
+// One loop of a nest
+struct LoopDim {
+  const char *Name;
+  uint64_t TripCount;
+};
+
+// A term IV * Stride of a linear buffer index
+using IndexTerm = std::pair<Value *, uint64_t>;
+using IndexTerms = SmallVector<IndexTerm, 8>;
+
+using BodyFn = function_ref<void(ArrayRef<Value *>)>;
+
+// Trip count of the innermost loop of Kind, which the unroll factor must
+// divide
+uint64_t getInnermostTripCount(KernelKind Kind,
+                               const KernelGeneratorOptions &Opts) {
+  switch (Kind) {
+  case KernelKind::Matmul:
+  case KernelKind::BatchedMatmul:
+    return Opts.K;
+  case KernelKind::Conv2DNCHW:
+  case KernelKind::DepthwiseConv:
+    return Opts.KernelSize;
+  case KernelKind::Conv2DNHWC:
+    return Opts.Channels;
+  case KernelKind::Elementwise:
+    return Opts.Length;
+  case KernelKind::ColumnWalk:
+  case KernelKind::ColumnAdd:
+    return Opts.M;
+  case KernelKind::TransposeAdd:
+  case KernelKind::Transpose:
+    return Opts.N;
+  }
+  llvm_unreachable("unknown kernel kind");
+}
+
+class KernelEmitter {
+public:
+  KernelEmitter(Module &M, const KernelGeneratorOptions &Opts)
+      : M(M), Opts(Opts), B(M.getContext()),
+        FloatTy(Type::getFloatTy(M.getContext())),
+        IndexTy(Type::getInt64Ty(M.getContext())) {}
+
+  void emit(KernelKind Kind, StringRef Name);
+
+private:
+  // Creates a void function of noalias float pointers and its entry block
+  Function *createFunction(StringRef Name, ArrayRef<const char *> ArgNames);
+
+  // Emits the outer batch loops and Dims around Body, which receives the
+  // induction variables, outermost first
+  void emitNest(ArrayRef<LoopDim> Dims, BodyFn Body);
+  void emitLoops(ArrayRef<LoopDim> Dims, SmallVectorImpl<Value *> &IVs,
+                 BodyFn Body);
+
+  // Index terms that select the batch slice of a buffer of Size elements
+  IndexTerms batchTerms(ArrayRef<Value *> IVs, uint64_t Size) const;
+
+  // Address of Base[sum of IV * Stride]
+  Value *element(Value *Base, ArrayRef<IndexTerm> Terms, const Twine &Name);
+
+  // Address of Base[Row][Col] in the batch slice of a buffer of Rows x
+  // Cols elements. Row and column are indices of one GEP over an array
+  // type, so LICM cannot hoist the row offset out of the innermost loop
+  // and the nest stays perfect.
+  Value *matrixElement(Value *Base, ArrayRef<Value *> IVs, uint64_t Rows,
+                       uint64_t Cols, Value *Row, Value *Col,
+                       const Twine &Name);
+
+  // Base[Terms] += Value
+  void accumulate(Value *Base, ArrayRef<IndexTerm> Terms, Value *V);
+
+  void emitMatmul(Function *F);
+  void emitConv2DNCHW(Function *F);
+  void emitConv2DNHWC(Function *F);
+  void emitDepthwiseConv(Function *F);
+  void emitElementwise(Function *F);
+  void emitColumnWalk(Function *F);
+  void emitTransposeAdd(Function *F);
+  void emitTranspose(Function *F);
+  void emitColumnAdd(Function *F);
+
+  Module &M;
+  const KernelGeneratorOptions &Opts;
+  IRBuilder<> B;
+  Type *FloatTy;
+  Type *IndexTy;
+
+  // Number of batch loops around the nest of the current kernel
+  unsigned NumBatchLoops = 0;
+};
+
+void KernelEmitter::emit(KernelKind Kind, StringRef Name) {
+  unsigned Depth = Opts.LoopDepth ? Opts.LoopDepth : getNaturalLoopDepth(Kind);
+  // The batch loop of batched-matmul is part of its natural depth
+  unsigned KernelDepth = Kind == KernelKind::BatchedMatmul
+                             ? getNaturalLoopDepth(KernelKind::Matmul)
+                             : getNaturalLoopDepth(Kind);
+  NumBatchLoops = Depth - KernelDepth;
+
+  switch (Kind) {
+  case KernelKind::Matmul:
+  case KernelKind::BatchedMatmul:
+    return emitMatmul(createFunction(Name, {"A", "B", "C"}));
+  case KernelKind::Conv2DNCHW:
+    return emitConv2DNCHW(createFunction(Name, {"input", "weights", "output"}));
+  case KernelKind::Conv2DNHWC:
+    return emitConv2DNHWC(createFunction(Name, {"input", "weights", "output"}));
+  case KernelKind::DepthwiseConv:
+    return emitDepthwiseConv(
+        createFunction(Name, {"input", "weights", "output"}));
+  case KernelKind::Elementwise:
+    return emitElementwise(createFunction(Name, {"X", "Y", "out"}));
+  case KernelKind::ColumnWalk:
+    return emitColumnWalk(createFunction(Name, {"input", "output"}));
+  case KernelKind::TransposeAdd:
+    return emitTransposeAdd(createFunction(Name, {"X", "Y", "out"}));
+  case KernelKind::Transpose:
+    return emitTranspose(createFunction(Name, {"input", "output"}));
+  case KernelKind::ColumnAdd:
+    return emitColumnAdd(createFunction(Name, {"X", "Y", "out"}));
+  }
+}
+
+Function *KernelEmitter::createFunction(StringRef Name,
+                                        ArrayRef<const char *> ArgNames) {
+  SmallVector<Type *, 4> Params(ArgNames.size(), FloatTy->getPointerTo());
+  auto *FTy = FunctionType::get(B.getVoidTy(), Params, /*isVarArg=*/false);
+  Function *F = Function::Create(FTy, Function::ExternalLinkage, Name, M);
+  for (unsigned I = 0, E = ArgNames.size(); I != E; ++I) {
+    F->getArg(I)->setName(ArgNames[I]);
+    F->addParamAttr(I, Attribute::NoAlias);
+  }
+  B.SetInsertPoint(BasicBlock::Create(M.getContext(), "entry", F));
+  return F;
+}
+
+void KernelEmitter::emitNest(ArrayRef<LoopDim> Dims, BodyFn Body) {
+  SmallVector<LoopDim, 8> AllDims(NumBatchLoops, LoopDim{"b", Opts.Batch});
+  AllDims.append(Dims.begin(), Dims.end());
+  SmallVector<Value *, 8> IVs;
+  emitLoops(AllDims, IVs, Body);
+  B.CreateRetVoid();
+}
+
+void KernelEmitter::emitLoops(ArrayRef<LoopDim> Dims,
+                              SmallVectorImpl<Value *> &IVs, BodyFn Body) {
+  const LoopDim &Dim = Dims.front();
+  bool Innermost = Dims.size() == 1;
+  unsigned Step = Innermost ? Opts.Unroll : 1;
+  Function *F = B.GetInsertBlock()->getParent();
+  LLVMContext &Ctx = M.getContext();
+
+  BasicBlock *Preheader = B.GetInsertBlock();
+  BasicBlock *Header =
+      BasicBlock::Create(Ctx, Twine(Dim.Name) + ".loop", F);
+  B.CreateBr(Header);
+  B.SetInsertPoint(Header);
+  PHINode *IV = B.CreatePHI(IndexTy, 2, Dim.Name);
+  IV->addIncoming(B.getInt64(0), Preheader);
+
+  if (Innermost) {
+    // One copy of the body per unrolled iteration
+    for (unsigned U = 0; U != Step; ++U) {
+      IVs.push_back(U ? B.CreateAdd(IV, B.getInt64(U),
+                                    Twine(Dim.Name) + "." + Twine(U),
+                                    /*HasNUW=*/true, /*HasNSW=*/true)
+                      : IV);
+      Body(IVs);
+      IVs.pop_back();
+    }
+  } else {
+    IVs.push_back(IV);
+    emitLoops(Dims.drop_front(), IVs, Body);
+    IVs.pop_back();
+  }
+
+  Value *Next = B.CreateAdd(IV, B.getInt64(Step), Twine(Dim.Name) + ".next",
+                            /*HasNUW=*/true, /*HasNSW=*/true);
+  Value *Cond = B.CreateICmpULT(Next, B.getInt64(Dim.TripCount),
+                                Twine(Dim.Name) + ".cond");
+  BasicBlock *Exit = BasicBlock::Create(Ctx, Twine(Dim.Name) + ".exit", F);
+  IV->addIncoming(Next, B.GetInsertBlock());
+  B.CreateCondBr(Cond, Header, Exit);
+  B.SetInsertPoint(Exit);
+}
+
+IndexTerms KernelEmitter::batchTerms(ArrayRef<Value *> IVs,
+                                     uint64_t Size) const {
+  IndexTerms Terms;
+  uint64_t Stride = Size;
+  for (unsigned D = NumBatchLoops; D-- > 0;) {
+    Terms.push_back({IVs[D], Stride});
+    Stride *= Opts.Batch;
+  }
+  return Terms;
+}
+
+Value *KernelEmitter::element(Value *Base, ArrayRef<IndexTerm> Terms,
+                              const Twine &Name) {
+  Value *Index = nullptr;
+  for (const IndexTerm &T : Terms) {
+    Value *V = T.first;
+    if (T.second != 1)
+      V = B.CreateMul(V, B.getInt64(T.second), "", /*HasNUW=*/true,
+                      /*HasNSW=*/true);
+    Index = Index ? B.CreateAdd(Index, V, "", /*HasNUW=*/true,
+                                /*HasNSW=*/true)
+                  : V;
+  }
+  if (!Index)
+    Index = B.getInt64(0);
+  return B.CreateInBoundsGEP(FloatTy, Base, Index, Name);
+}
+
+Value *KernelEmitter::matrixElement(Value *Base, ArrayRef<Value *> IVs,
+                                   uint64_t Rows, uint64_t Cols, Value *Row,
+                                   Value *Col, const Twine &Name) {
+  IndexTerms Batch = batchTerms(IVs, Rows * Cols);
+  if (!Batch.empty())
+    Base = element(Base, Batch, Name + ".slice");
+  auto *RowTy = ArrayType::get(FloatTy, Cols);
+  Value *Matrix = B.CreateBitCast(Base, RowTy->getPointerTo());
+  return B.CreateInBoundsGEP(RowTy, Matrix, {Row, Col}, Name);
+}
+
+void KernelEmitter::accumulate(Value *Base, ArrayRef<IndexTerm> Terms,
+                               Value *V) {
+  Value *Ptr = element(Base, Terms, Base->getName() + ".ptr");
+  Value *Old = B.CreateLoad(FloatTy, Ptr, Base->getName() + ".old");
+  B.CreateStore(B.CreateFAdd(Old, V, Base->getName() + ".new"), Ptr);
+}
+
+void KernelEmitter::emitMatmul(Function *F) {
+  Value *A = F->getArg(0), *Bm = F->getArg(1), *C = F->getArg(2);
+  uint64_t M = Opts.M, N = Opts.N, K = Opts.K;
+  emitNest({{"m", M}, {"n", N}, {"k", K}}, [&](ArrayRef<Value *> IVs) {
+    Value *Mi = IVs[NumBatchLoops], *Ni = IVs[NumBatchLoops + 1],
+          *Ki = IVs[NumBatchLoops + 2];
+    IndexTerms AIdx = batchTerms(IVs, M * K);
+    AIdx.append({{Mi, K}, {Ki, 1}});
+    IndexTerms BIdx = batchTerms(IVs, K * N);
+    BIdx.append({{Ki, N}, {Ni, 1}});
+    IndexTerms CIdx = batchTerms(IVs, M * N);
+    CIdx.append({{Mi, N}, {Ni, 1}});
+
+    Value *AV = B.CreateLoad(FloatTy, element(A, AIdx, "A.ptr"), "a");
+    Value *BV = B.CreateLoad(FloatTy, element(Bm, BIdx, "B.ptr"), "b");
+    accumulate(C, CIdx, B.CreateFMul(AV, BV, "prod"));
+  });
+}
+
+void KernelEmitter::emitConv2DNCHW(Function *F) {
+  Value *In = F->getArg(0), *W = F->getArg(1), *Out = F->getArg(2);
+  uint64_t C = Opts.Channels, H = Opts.Height, Wd = Opts.Width,
+           Fl = Opts.Filters, KS = Opts.KernelSize;
+  uint64_t OH = H - KS + 1, OW = Wd - KS + 1;
+  emitNest({{"f", Fl}, {"y", OH}, {"x", OW}, {"c", C}, {"r", KS}, {"s", KS}},
+           [&](ArrayRef<Value *> IVs) {
+             ArrayRef<Value *> L = IVs.drop_front(NumBatchLoops);
+             Value *Fi = L[0], *Y = L[1], *X = L[2], *Ci = L[3], *R = L[4],
+                   *S = L[5];
+             IndexTerms InIdx = batchTerms(IVs, C * H * Wd);
+             InIdx.append({{Ci, H * Wd}, {Y, Wd}, {R, Wd}, {X, 1}, {S, 1}});
+             IndexTerms WIdx = {{Fi, C * KS * KS}, {Ci, KS * KS}, {R, KS},
+                                {S, 1}};
+             IndexTerms OutIdx = batchTerms(IVs, Fl * OH * OW);
+             OutIdx.append({{Fi, OH * OW}, {Y, OW}, {X, 1}});
+
+             Value *InV = B.CreateLoad(FloatTy, element(In, InIdx, "in.ptr"),
+                                       "in");
+             Value *WV = B.CreateLoad(FloatTy, element(W, WIdx, "w.ptr"), "w");
+             accumulate(Out, OutIdx, B.CreateFMul(InV, WV, "prod"));
+           });
+}
+
+void KernelEmitter::emitConv2DNHWC(Function *F) {
+  Value *In = F->getArg(0), *W = F->getArg(1), *Out = F->getArg(2);
+  uint64_t C = Opts.Channels, H = Opts.Height, Wd = Opts.Width,
+           Fl = Opts.Filters, KS = Opts.KernelSize;
+  uint64_t OH = H - KS + 1, OW = Wd - KS + 1;
+  emitNest({{"y", OH}, {"x", OW}, {"f", Fl}, {"r", KS}, {"s", KS}, {"c", C}},
+           [&](ArrayRef<Value *> IVs) {
+             ArrayRef<Value *> L = IVs.drop_front(NumBatchLoops);
+             Value *Y = L[0], *X = L[1], *Fi = L[2], *R = L[3], *S = L[4],
+                   *Ci = L[5];
+             IndexTerms InIdx = batchTerms(IVs, H * Wd * C);
+             InIdx.append(
+                 {{Y, Wd * C}, {R, Wd * C}, {X, C}, {S, C}, {Ci, 1}});
+             IndexTerms WIdx = {{R, KS * C * Fl}, {S, C * Fl}, {Ci, Fl},
+                                {Fi, 1}};
+             IndexTerms OutIdx = batchTerms(IVs, OH * OW * Fl);
+             OutIdx.append({{Y, OW * Fl}, {X, Fl}, {Fi, 1}});
+
+             Value *InV = B.CreateLoad(FloatTy, element(In, InIdx, "in.ptr"),
+                                       "in");
+             Value *WV = B.CreateLoad(FloatTy, element(W, WIdx, "w.ptr"), "w");
+             accumulate(Out, OutIdx, B.CreateFMul(InV, WV, "prod"));
+           });
+}
+
+void KernelEmitter::emitDepthwiseConv(Function *F) {
+  Value *In = F->getArg(0), *W = F->getArg(1), *Out = F->getArg(2);
+  uint64_t C = Opts.Channels, H = Opts.Height, Wd = Opts.Width,
+           KS = Opts.KernelSize;
+  uint64_t OH = H - KS + 1, OW = Wd - KS + 1;
+  emitNest({{"c", C}, {"y", OH}, {"x", OW}, {"r", KS}, {"s", KS}},
+           [&](ArrayRef<Value *> IVs) {
+             ArrayRef<Value *> L = IVs.drop_front(NumBatchLoops);
+             Value *Ci = L[0], *Y = L[1], *X = L[2], *R = L[3], *S = L[4];
+             IndexTerms InIdx = batchTerms(IVs, C * H * Wd);
+             InIdx.append({{Ci, H * Wd}, {Y, Wd}, {R, Wd}, {X, 1}, {S, 1}});
+             IndexTerms WIdx = {{Ci, KS * KS}, {R, KS}, {S, 1}};
+             IndexTerms OutIdx = batchTerms(IVs, C * OH * OW);
+             OutIdx.append({{Ci, OH * OW}, {Y, OW}, {X, 1}});
+
+             Value *InV = B.CreateLoad(FloatTy, element(In, InIdx, "in.ptr"),
+                                       "in");
+             Value *WV = B.CreateLoad(FloatTy, element(W, WIdx, "w.ptr"), "w");
+             accumulate(Out, OutIdx, B.CreateFMul(InV, WV, "prod"));
+           });
+}
+
+void KernelEmitter::emitElementwise(Function *F) {
+  Value *X = F->getArg(0), *Y = F->getArg(1), *Out = F->getArg(2);
+  uint64_t Len = Opts.Length;
+  emitNest({{"i", Len}}, [&](ArrayRef<Value *> IVs) {
+    IndexTerms Idx = batchTerms(IVs, Len);
+    Idx.push_back({IVs.back(), 1});
+    Value *XV = B.CreateLoad(FloatTy, element(X, Idx, "X.ptr"), "x");
+    Value *YV = B.CreateLoad(FloatTy, element(Y, Idx, "Y.ptr"), "y");
+
+    // Cycle through mul, add, relu and sub
+    Value *V = XV;
+    Constant *Zero = ConstantFP::get(FloatTy, 0.0);
+    for (unsigned Op = 0; Op != Opts.ChainLength; ++Op) {
+      switch (Op % 4) {
+      case 0:
+        V = B.CreateFMul(V, YV, "mul");
+        break;
+      case 1:
+        V = B.CreateFAdd(V, XV, "add");
+        break;
+      case 2:
+        V = B.CreateSelect(B.CreateFCmpOGT(V, Zero), V, Zero, "relu");
+        break;
+      case 3:
+        V = B.CreateFSub(V, ConstantFP::get(FloatTy, 1.0), "sub");
+        break;
+      }
+    }
+    B.CreateStore(V, element(Out, Idx, "out.ptr"));
+  });
+}
+
+// Both buffers are walked down their columns, so every access of the
+// innermost loop is strided and interchanging the loops makes them all
+// unit-stride.
+void KernelEmitter::emitColumnWalk(Function *F) {
+  Value *In = F->getArg(0), *Out = F->getArg(1);
+  uint64_t M = Opts.M, N = Opts.N;
+  emitNest({{"n", N}, {"m", M}}, [&](ArrayRef<Value *> IVs) {
+    Value *Ni = IVs[NumBatchLoops], *Mi = IVs[NumBatchLoops + 1];
+    Value *V = B.CreateLoad(
+        FloatTy, matrixElement(In, IVs, M, N, Mi, Ni, "in.ptr"), "in");
+    B.CreateStore(B.CreateFMul(V, ConstantFP::get(FloatTy, 2.0), "scaled"),
+                  matrixElement(Out, IVs, M, N, Mi, Ni, "out.ptr"));
+  });
+}
+
+// Only the load of X is strided in the innermost loop; interchanging the
+// loops makes it unit-stride at the price of striding Y and the output.
+void KernelEmitter::emitTransposeAdd(Function *F) {
+  Value *X = F->getArg(0), *Y = F->getArg(1), *Out = F->getArg(2);
+  uint64_t M = Opts.M, N = Opts.N;
+  emitNest({{"m", M}, {"n", N}}, [&](ArrayRef<Value *> IVs) {
+    Value *Mi = IVs[NumBatchLoops], *Ni = IVs[NumBatchLoops + 1];
+    Value *XV = B.CreateLoad(
+        FloatTy, matrixElement(X, IVs, N, M, Ni, Mi, "X.ptr"), "x");
+    Value *YV = B.CreateLoad(
+        FloatTy, matrixElement(Y, IVs, M, N, Mi, Ni, "Y.ptr"), "y");
+    B.CreateStore(B.CreateFAdd(XV, YV, "sum"),
+                  matrixElement(Out, IVs, M, N, Mi, Ni, "out.ptr"));
+  });
+}
+
+// The load is strided and the store unit-stride in the innermost loop;
+// interchanging the loops swaps the two.
+void KernelEmitter::emitTranspose(Function *F) {
+  Value *In = F->getArg(0), *Out = F->getArg(1);
+  uint64_t M = Opts.M, N = Opts.N;
+  emitNest({{"m", M}, {"n", N}}, [&](ArrayRef<Value *> IVs) {
+    Value *Mi = IVs[NumBatchLoops], *Ni = IVs[NumBatchLoops + 1];
+    Value *V = B.CreateLoad(
+        FloatTy, matrixElement(In, IVs, N, M, Ni, Mi, "in.ptr"), "in");
+    B.CreateStore(V, matrixElement(Out, IVs, M, N, Mi, Ni, "out.ptr"));
+  });
+}
+
+// Like column-walk with two inputs: all three accesses of the innermost
+// loop are strided and become unit-stride when the loops are interchanged.
+void KernelEmitter::emitColumnAdd(Function *F) {
+  Value *X = F->getArg(0), *Y = F->getArg(1), *Out = F->getArg(2);
+  uint64_t M = Opts.M, N = Opts.N;
+  emitNest({{"n", N}, {"m", M}}, [&](ArrayRef<Value *> IVs) {
+    Value *Ni = IVs[NumBatchLoops], *Mi = IVs[NumBatchLoops + 1];
+    Value *XV = B.CreateLoad(
+        FloatTy, matrixElement(X, IVs, M, N, Mi, Ni, "X.ptr"), "x");
+    Value *YV = B.CreateLoad(
+        FloatTy, matrixElement(Y, IVs, M, N, Mi, Ni, "Y.ptr"), "y");
+    B.CreateStore(B.CreateFAdd(XV, YV, "sum"),
+                  matrixElement(Out, IVs, M, N, Mi, Ni, "out.ptr"));
+  });
+}
+
+// Reports the first option that makes Kind impossible to generate
+Error validateOptions(KernelKind Kind, const KernelGeneratorOptions &Opts) {
+  StringRef Name = getKernelKindName(Kind);
+  for (unsigned Size : {Opts.M, Opts.N, Opts.K, Opts.Channels, Opts.Height,
+                        Opts.Width, Opts.Filters, Opts.KernelSize, Opts.Length,
+                        Opts.Batch, Opts.Unroll})
+    if (Size == 0)
+      return createStringError(inconvertibleErrorCode(),
+                               "sizes must be at least 1");
+  if (Opts.KernelSize > Opts.Height || Opts.KernelSize > Opts.Width)
+    return createStringError(inconvertibleErrorCode(),
+                             "kernel size %u exceeds the %ux%u input",
+                             Opts.KernelSize, Opts.Height, Opts.Width);
+  if (Opts.LoopDepth && Opts.LoopDepth < getNaturalLoopDepth(Kind))
+    return createStringError(inconvertibleErrorCode(),
+                             "%s needs a loop depth of at least %u",
+                             Name.str().c_str(), getNaturalLoopDepth(Kind));
+  uint64_t TripCount = getInnermostTripCount(Kind, Opts);
+  if (TripCount % Opts.Unroll)
+    return createStringError(
+        inconvertibleErrorCode(),
+        "unroll factor %u does not divide the innermost trip count %llu of %s",
+        Opts.Unroll, (unsigned long long)TripCount, Name.str().c_str());
+  return Error::success();
+}
+
+} // end anonymous namespace
+
+StringRef getKernelKindName(KernelKind Kind) {
+  switch (Kind) {
+  case KernelKind::Matmul:
+    return "matmul";
+  case KernelKind::BatchedMatmul:
+    return "batched-matmul";
+  case KernelKind::Conv2DNCHW:
+    return "conv2d-nchw";
+  case KernelKind::Conv2DNHWC:
+    return "conv2d-nhwc";
+  case KernelKind::DepthwiseConv:
+    return "depthwise-conv";
+  case KernelKind::Elementwise:
+    return "elementwise";
+  case KernelKind::ColumnWalk:
+    return "column-walk";
+  case KernelKind::TransposeAdd:
+    return "transpose-add";
+  case KernelKind::Transpose:
+    return "transpose";
+  case KernelKind::ColumnAdd:
+    return "column-add";
+  }
+  llvm_unreachable("unknown kernel kind");
+}
+
+Optional<KernelKind> parseKernelKind(StringRef Name) {
+  for (KernelKind Kind : AllKinds)
+    if (getKernelKindName(Kind) == Name)
+      return Kind;
+  return None;
+}
+
+unsigned getNaturalLoopDepth(KernelKind Kind) {
+  switch (Kind) {
+  case KernelKind::Matmul:
+    return 3;
+  case KernelKind::BatchedMatmul:
+    return 4;
+  case KernelKind::Conv2DNCHW:
+  case KernelKind::Conv2DNHWC:
+    return 6;
+  case KernelKind::DepthwiseConv:
+    return 5;
+  case KernelKind::Elementwise:
+    return 1;
+  case KernelKind::ColumnWalk:
+  case KernelKind::TransposeAdd:
+  case KernelKind::Transpose:
+  case KernelKind::ColumnAdd:
+    return 2;
+  }
+  llvm_unreachable("unknown kernel kind");
+}
+
+Expected<std::unique_ptr<Module>>
+generateKernelModule(LLVMContext &Context, const KernelGeneratorOptions &Opts) {
+  if (Opts.Kinds.empty())
+    return createStringError(inconvertibleErrorCode(), "no kernel kinds given");
+  for (KernelKind Kind : Opts.Kinds)
+    if (Error E = validateOptions(Kind, Opts))
+      return E;
+
+  auto M = std::make_unique<Module>("generated", Context);
+  M->setTargetTriple(sys::getDefaultTargetTriple());
+  KernelEmitter Emitter(*M, Opts);
+  for (unsigned I = 0; I != Opts.NumKernels; ++I) {
+    KernelKind Kind = Opts.Kinds[I % Opts.Kinds.size()];
+    std::string Name = getKernelKindName(Kind).str();
+    std::replace(Name.begin(), Name.end(), '-', '_');
+    Emitter.emit(Kind, Name + "_" + std::to_string(I));
+  }
+  return M;
+}
+
+} // namespace mlcompileropt
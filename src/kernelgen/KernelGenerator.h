@@ -0,0 +1,101 @@
+//===- KernelGenerator.h - Synthetic ML Kernel IR Generator ---------===//
+//
+// This file declares a generator of synthetic ML kernels for compile-time
+// scaling benchmarks. Every kernel is a perfect nest of counted loops over
+// float buffers, in the form a frontend emits before optimization:
+//
+//   matmul          C[m][n] += A[m][k] * B[k][n]                depth 3
+//   batched-matmul  the same with a batch loop                 depth 4
+//   conv2d-nchw     O[f][y][x] += I[c][y+r][x+s] * W[f][c][r][s] depth 6
+//   conv2d-nhwc     O[y][x][f] += I[y+r][x+s][c] * W[r][s][c][f] depth 6
+//   depthwise-conv  O[c][y][x] += I[c][y+r][x+s] * W[c][r][s]   depth 5
+//   elementwise     O[i] = chain of mul/add/relu/sub of X[i], Y[i] depth 1
+//   column-walk     O[m][n] = 2 * I[m][n], m innermost          depth 2
+//   transpose-add   O[m][n] = X[n][m] + Y[m][n]                 depth 2
+//   transpose       O[m][n] = I[n][m]                           depth 2
+//   column-add      O[m][n] = X[m][n] + Y[m][n], m innermost    depth 2
+//
+// Nests deeper than the natural depth get outer batch loops, each of which
+// walks a further dimension of every buffer.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_KERNELGEN_KERNEL_GENERATOR_H
+#define MLCOMPILEROPT_KERNELGEN_KERNEL_GENERATOR_H
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <memory>
+#include <vector>
+
+namespace llvm {
+class LLVMContext;
+class Module;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+enum class KernelKind {
+  Matmul,
+  BatchedMatmul,
+  Conv2DNCHW,
+  Conv2DNHWC,
+  DepthwiseConv,
+  Elementwise,
+  ColumnWalk,
+  TransposeAdd,
+  Transpose,
+  ColumnAdd,
+};
+
+// Name of Kind on the command line, e.g. "conv2d-nchw"
+llvm::StringRef getKernelKindName(KernelKind Kind);
+
+// Inverse of getKernelKindName
+llvm::Optional<KernelKind> parseKernelKind(llvm::StringRef Name);
+
+// Depth of the loop nest of Kind without extra batch loops
+unsigned getNaturalLoopDepth(KernelKind Kind);
+
+struct KernelGeneratorOptions {
+  // Kinds of the generated kernels, used in round-robin order
+  std::vector<KernelKind> Kinds = {KernelKind::Matmul};
+
+  // Number of kernels in the module
+  unsigned NumKernels = 1;
+
+  // Matrix multiplication: C is M x N, A is M x K and B is K x N. The
+  // outputs of column-walk, transpose-add, transpose and column-add are
+  // M x N as well.
+  unsigned M = 32, N = 32, K = 32;
+
+  // Convolutions: Channels x Height x Width input, Filters output
+  // channels and a KernelSize x KernelSize window, without padding
+  unsigned Channels = 8, Height = 16, Width = 16, Filters = 8;
+  unsigned KernelSize = 3;
+
+  // Elementwise chains: buffer length and number of operations
+  unsigned Length = 1024, ChainLength = 4;
+
+  // Trip count of every batch loop
+  unsigned Batch = 4;
+
+  // Depth of every loop nest; 0 selects the natural depth of the kernel
+  unsigned LoopDepth = 0;
+
+  // Unroll factor of the innermost loop, which must divide its trip count
+  unsigned Unroll = 1;
+};
+
+// Generates a module with Opts.NumKernels kernels named <kind>_<index>,
+// e.g. conv2d_nchw_3. Fails if a size is zero, a nest would be shallower
+// than its natural depth or Unroll does not divide an innermost trip count.
+llvm::Expected<std::unique_ptr<llvm::Module>>
+generateKernelModule(llvm::LLVMContext &Context,
+                     const KernelGeneratorOptions &Opts);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_KERNELGEN_KERNEL_GENERATOR_H
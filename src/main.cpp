@@ -1,123 +1,642 @@
 // src/main.cpp
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
 
 // LLVM core headers
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LLVMRemarkStreamer.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/PassTimingInfo.h"
 #include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/SystemUtils.h"
+#include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 
-// LLVM new pass manager
-#include "llvm/Passes/PassBuilder.h"
-#include "llvm/Analysis/LoopAnalysisManager.h"
-#include "llvm/Analysis/CGSCCPassManager.h"
-#include "llvm/Transforms/Scalar/LoopUnrollPass.h"
-#include "llvm/Passes/OptimizationLevel.h"
+// Loop analysis for the verbose function summary
+#include "llvm/Analysis/LoopInfo.h"
 
-// Custom passes
-#include "passes/MemoryCoalescing.h"
+// Driver
+#include "driver/CodeGenerator.h"
+#include "driver/CompileServer.h"
+#include "driver/ModuleCache.h"
+#include "driver/ModuleIO.h"
+#include "driver/OptimizationPipeline.h"
+#include "driver/ParallelOptimizer.h"
+#include "driver/PassProfiler.h"
+#include "driver/TuningDatabase.h"
+
+static llvm::cl::OptionCategory DriverCategory("ml_compiler options");
+
+// Options that change the optimized module, and so the cache key
+static llvm::cl::OptionCategory PipelineCategory("Pipeline options");
+
+static llvm::cl::opt<std::string> InputFilename(
+    llvm::cl::Positional, llvm::cl::desc("<input-IR-file>"),
+    llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<std::string> OutputFilename(
+    "o", llvm::cl::desc("Output file (default: stdout)"),
+    llvm::cl::value_desc("filename"), llvm::cl::init("-"),
+    llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<mlcompileropt::OutputFormat> Emit(
+    "emit",
+    llvm::cl::desc("Output format (default: by extension, bc for .bc, obj for "
+                   ".o and asm for .s outputs, ll otherwise)"),
+    llvm::cl::values(
+        clEnumValN(mlcompileropt::OutputFormat::Text, "ll", "Textual IR"),
+        clEnumValN(mlcompileropt::OutputFormat::Bitcode, "bc", "Bitcode"),
+        clEnumValN(mlcompileropt::OutputFormat::Assembly, "asm",
+                   "Native assembly"),
+        clEnumValN(mlcompileropt::OutputFormat::Object, "obj",
+                   "Native object file")),
+    llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<unsigned> CodeGenPartitions(
+    "codegen-partitions",
+    llvm::cl::desc("Split native code generation into N partitions compiled "
+                   "concurrently, written to out.o, out.1.o, ... (threads: "
+                   "--jobs, or one per partition)"),
+    llvm::cl::value_desc("N"), llvm::cl::init(1),
+    llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<bool> Quiet(
+    "quiet", llvm::cl::desc("Only write the optimized module, no status output"),
+    llvm::cl::cat(DriverCategory));
+static llvm::cl::alias QuietShort("q", llvm::cl::desc("Alias for --quiet"),
+                                  llvm::cl::aliasopt(Quiet),
+                                  llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<bool> Verbose(
+    "verbose", llvm::cl::desc("Print per-function details and statistics"),
+    llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<unsigned> Jobs(
+    "jobs",
+    llvm::cl::desc("Optimize module partitions on N threads (0 = serial); "
+                   "in --server mode, the number of workers"),
+    llvm::cl::value_desc("N"), llvm::cl::init(0),
+    llvm::cl::cat(DriverCategory));
+static llvm::cl::alias JobsShort("j", llvm::cl::desc("Alias for --jobs"),
+                                 llvm::cl::aliasopt(Jobs),
+                                 llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<unsigned> MaxPartitions(
+    "max-partitions",
+    llvm::cl::desc("Upper bound on the number of partitions in --jobs mode"),
+    llvm::cl::init(64), llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<bool> CompareSerial(
+    "compare-serial",
+    llvm::cl::desc("In --jobs mode, also time the serial pipeline and report "
+                   "the speedup"),
+    llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<bool> Server(
+    "server",
+    llvm::cl::desc("Serve optimization requests framed on stdin until end of "
+                   "input, keeping the pipeline built between requests"),
+    llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<std::string> CacheDir(
+    "cache-dir",
+    llvm::cl::desc("Reuse optimized modules from, and store them in, this "
+                   "directory"),
+    llvm::cl::value_desc("directory"), llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<std::string> CachePolicy(
+    "cache-policy",
+    llvm::cl::desc("Pruning policy of the cache directory, in the format of "
+                   "LLVM's CachePruning (e.g. cache_size_bytes=1g)"),
+    llvm::cl::init("cache_size_bytes=1g"), llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<std::string> TraceFile(
+    "trace",
+    llvm::cl::desc("Write a Chrome trace of every pass and analysis run, "
+                   "with one row per function"),
+    llvm::cl::value_desc("filename"), llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<std::string> RemarksFile(
+    "remarks-file",
+    llvm::cl::desc("Write optimization remarks to this file; bypasses cache "
+                   "lookups"),
+    llvm::cl::value_desc("filename"), llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<std::string> RemarksFormat(
+    "remarks-format",
+    llvm::cl::desc("Format of the remarks file: yaml or bitstream"),
+    llvm::cl::value_desc("format"), llvm::cl::init("yaml"),
+    llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<std::string> RemarksFilter(
+    "remarks-filter",
+    llvm::cl::desc("Only write remarks of passes matching this regex "
+                   "(default: the memory coalescing, loop fusion, loop "
+                   "tiling, reduction vectorization, software prefetch and "
+                   "loop parallelization passes)"),
+    llvm::cl::value_desc("regex"),
+    llvm::cl::init("memory-coalescing|loop-fusion|loop-tiling|"
+                   "reduction-vectorize|software-prefetch|loop-parallelize"),
+    llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<std::string> PassPipeline(
+    "passes",
+    llvm::cl::desc("Run this pipeline, in the syntax of opt -passes, instead "
+                   "of O3 (e.g. 'function(memory-coalescing),default<O3>')"),
+    llvm::cl::value_desc("pipeline"), llvm::cl::cat(PipelineCategory));
+
+static llvm::cl::opt<std::string> TuningDB(
+    "tuning-db",
+    llvm::cl::desc("Apply the configurations the autotuner stored in this "
+                   "database to the kernels it has entries for"),
+    llvm::cl::value_desc("filename"), llvm::cl::cat(DriverCategory));
+
+static llvm::cl::opt<bool> PrintPipeline(
+    "print-pipeline",
+    llvm::cl::desc("Print the passes of the pipeline before running it"),
+    llvm::cl::cat(DriverCategory));
+
+using Clock = std::chrono::steady_clock;
+
+static double millisecondsSince(Clock::time_point Start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - Start).count();
+}
+
+// Describes everything besides the input module that affects the output:
+// the pipeline shape, the options of the passes and of LLVM itself, and
+// the tuning database. Driver options only control how the result is
+// produced or reported.
+static std::string getCacheConfig(int argc, char **argv,
+                                  const mlcompileropt::TuningDatabase *Tuning) {
+    std::string Config = (Jobs > 0 && !Server)
+        ? "partitioned " + std::to_string(MaxPartitions)
+        : std::string("serial");
+    if (Tuning)
+        Config += "\n" + Tuning->str();
+    
+    auto &Options = llvm::cl::getRegisteredOptions();
+    for (int I = 1; I < argc; ++I) {
+        llvm::StringRef Arg(argv[I]);
+        if (!Arg.startswith("-") || Arg == "-")
+            continue;
+        std::pair<llvm::StringRef, llvm::StringRef> NameValue = Arg.ltrim('-').split('=');
+        auto It = Options.find(NameValue.first);
+        if (It == Options.end() ||
+            llvm::is_contained(It->second->Categories, &DriverCategory))
+            continue;
+        
+        // Spell "-opt value" and "--opt=value" the same way
+        Config += " -" + NameValue.first.str();
+        if (Arg.contains('='))
+            Config += "=" + NameValue.second.str();
+        else if (It->second->getValueExpectedFlag() == llvm::cl::ValueRequired &&
+                 I + 1 < argc)
+            Config += "=" + std::string(argv[++I]);
+    }
+    return Config;
+}
+
+// Opens the cache selected by --cache-dir, or returns null without one
+static std::unique_ptr<mlcompileropt::ModuleCache>
+openCache(int argc, char **argv, const mlcompileropt::TuningDatabase *Tuning) {
+    if (CacheDir.empty())
+        return nullptr;
+    
+    auto PolicyOrErr = llvm::parseCachePruningPolicy(CachePolicy);
+    if (!PolicyOrErr) {
+        llvm::errs() << "Invalid --cache-policy: "
+                     << llvm::toString(PolicyOrErr.takeError()) << "\n";
+        return nullptr;
+    }
+    
+    auto Cache = std::make_unique<mlcompileropt::ModuleCache>(
+        CacheDir, getCacheConfig(argc, argv, Tuning), *PolicyOrErr);
+    if (llvm::Error E = Cache->initialize()) {
+        llvm::errs() << llvm::toString(std::move(E)) << "\n";
+        return nullptr;
+    }
+    return Cache;
+}
+
+// Lists an option LLVM or the passes already register, such as
+// --time-passes, in --help. Options in DriverCategory are kept out of the
+// cache key.
+static void exposeLLVMOption(llvm::StringRef Name,
+                             llvm::cl::OptionCategory &Category = DriverCategory) {
+    auto &Options = llvm::cl::getRegisteredOptions();
+    auto It = Options.find(Name);
+    if (It != Options.end()) {
+        It->second->addCategory(Category);
+        It->second->setHiddenFlag(llvm::cl::NotHidden);
+    }
+}
+
+// Prints the block, loop and memory operation counts of F
+static void printFunctionSummary(llvm::raw_ostream &OS, llvm::Function &F,
+                                 llvm::FunctionAnalysisManager &FAM) {
+    OS << "Analyzing function: " << F.getName() << "\n";
+    
+    // Print basic blocks in function
+    OS << "  Function has " << F.size() << " basic blocks\n";
+    
+    // Check for loops
+    auto &LI = FAM.getResult<llvm::LoopAnalysis>(F);
+    OS << "  Function has " << std::distance(LI.begin(), LI.end()) << " top-level loops\n";
+    
+    // Count memory operations
+    int LoadCount = 0;
+    int StoreCount = 0;
+    for (auto &BB : F) {
+        for (auto &I : BB) {
+            if (llvm::isa<llvm::LoadInst>(I)) LoadCount++;
+            if (llvm::isa<llvm::StoreInst>(I)) StoreCount++;
+        }
+    }
+    OS << "  Function has " << LoadCount << " loads and " 
+       << StoreCount << " stores\n";
+}
+
+// Runs the serial or the partitioned pipeline on Module, replacing it by
+// the optimized module. Returns false on failure.
+static bool optimizeModule(std::unique_ptr<llvm::Module> &Module, llvm::raw_ostream &Log,
+                           mlcompileropt::PassProfiler *Profiler) {
+    if (Jobs == 0) {
+        // 2. Setup the pipeline: O3 with memory coalescing at its extension
+        //    point, unless --passes gives the pipeline
+        mlcompileropt::OptimizationPipeline Pipeline(/*UseCustomPasses=*/true, Profiler);
+        if (PassPipeline.empty())
+            Log << "Adding custom memory coalescing pass at "
+                << mlcompileropt::getExtensionPointName(
+                       mlcompileropt::getSelectedExtensionPoint())
+                << "...\n";
+        else
+            llvm::cantFail(Pipeline.setPipeline(PassPipeline));
+        if (PrintPipeline) {
+            Pipeline.printPipeline(Log);
+            Log << "\n";
+        }
+        
+        if (Verbose) {
+            for (auto &F : *Module) {
+                if (!F.isDeclaration())
+                    printFunctionSummary(Log, F, Pipeline.getFunctionAnalysisManager());
+            }
+        }
+        
+        // 3. Run the optimization passes
+        Log << "Running optimization passes...\n";
+        Pipeline.run(*Module);
+    } else {
+        // Time the serial pipeline on a copy of the module for reference
+        double SerialTime = 0.0;
+        if (CompareSerial) {
+            std::unique_ptr<llvm::Module> Copy = llvm::CloneModule(*Module);
+            auto Start = Clock::now();
+            mlcompileropt::OptimizationPipeline Pipeline;
+            if (!PassPipeline.empty())
+                llvm::cantFail(Pipeline.setPipeline(PassPipeline));
+            Pipeline.run(*Copy);
+            SerialTime = millisecondsSince(Start);
+        }
+        
+        // 2. Split the module and optimize the partitions concurrently
+        Log << "Running optimization passes on " << Jobs << " threads...\n";
+        mlcompileropt::ParallelOptimizerOptions Opts;
+        Opts.Jobs = Jobs;
+        Opts.MaxPartitions = MaxPartitions;
+        Opts.PassPipeline = PassPipeline;
+        Opts.Profiler = Profiler;
+        
+        mlcompileropt::ParallelOptimizerStats Stats;
+        auto Start = Clock::now();
+        auto OptimizedOrErr =
+            mlcompileropt::optimizeModuleInParallel(*Module, Opts, &Stats);
+        double ParallelTime = millisecondsSince(Start);
+        
+        if (!OptimizedOrErr) {
+            llvm::errs() << "Error optimizing '" << InputFilename << "': "
+                         << llvm::toString(OptimizedOrErr.takeError()) << "\n";
+            return false;
+        }
+        Module = std::move(*OptimizedOrErr);
+        
+        if (Verbose) {
+            Log << "  Partitions: " << Stats.NumPartitions << "\n";
+            Log << "  Split:    " << llvm::format("%.2f", Stats.SplitTime) << " ms\n";
+            Log << "  Optimize: " << llvm::format("%.2f", Stats.OptimizeTime) << " ms\n";
+            Log << "  Link:     " << llvm::format("%.2f", Stats.LinkTime) << " ms\n";
+        }
+        
+        if (CompareSerial) {
+            Log << "Serial:   " << llvm::format("%.2f", SerialTime) << " ms\n";
+            Log << "Parallel: " << llvm::format("%.2f", ParallelTime)
+                << " ms (" << Jobs << " jobs)\n";
+            Log << "Speedup:  " << llvm::format("%.2fx", SerialTime / ParallelTime) << "\n";
+        }
+    }
+    return true;
+}
+
+// Picks the output format from the extension of the output file
+static mlcompileropt::OutputFormat getDefaultFormat(llvm::StringRef Filename) {
+    if (Filename.endswith(".bc"))
+        return mlcompileropt::OutputFormat::Bitcode;
+    if (Filename.endswith(".o") || Filename.endswith(".obj"))
+        return mlcompileropt::OutputFormat::Object;
+    if (Filename.endswith(".s"))
+        return mlcompileropt::OutputFormat::Assembly;
+    return mlcompileropt::OutputFormat::Text;
+}
+
+// Compiles Module to the --codegen-partitions output files. Returns false
+// on failure.
+static bool emitNativeCode(llvm::Module &Module, mlcompileropt::OutputFormat Format,
+                           llvm::raw_ostream &Log) {
+    auto OutputsOrErr = mlcompileropt::PartitionOutputFiles::open(
+        OutputFilename, CodeGenPartitions, Format);
+    if (!OutputsOrErr) {
+        llvm::errs() << llvm::toString(OutputsOrErr.takeError()) << "\n";
+        return false;
+    }
+    mlcompileropt::PartitionOutputFiles &Outputs = **OutputsOrErr;
+    
+    mlcompileropt::CodeGenOptions Opts;
+    Opts.Format = Format;
+    Opts.Jobs = Jobs;
+    mlcompileropt::CodeGenStats Stats;
+    if (CodeGenPartitions > 1)
+        Log << "Generating native code for " << CodeGenPartitions << " partitions...\n";
+    else
+        Log << "Generating native code...\n";
+    // Log may share stdout with the assembly
+    Log.flush();
+    if (llvm::Error E = mlcompileropt::emitNativeCode(Module, Outputs.getStreams(), Opts, &Stats)) {
+        llvm::errs() << "Error generating code for '" << InputFilename << "': "
+                     << llvm::toString(std::move(E)) << "\n";
+        return false;
+    }
+    Outputs.keep();
+    
+    if (Verbose) {
+        Log << "  Target:   " << Module.getTargetTriple() << "\n";
+        if (CodeGenPartitions > 1)
+            Log << "  Split:    " << llvm::format("%.2f", Stats.SplitTime) << " ms\n";
+        Log << "  Codegen:  " << llvm::format("%.2f", Stats.CodeGenTime) << " ms\n";
+    }
+    return true;
+}
 
 int main(int argc, char** argv) {
-    // Check command line arguments
-    if (argc < 2) {
-        std::cerr << "ML Compiler Optimization Framework\n"
-                  << "--------------------------------\n"
-                  << "Usage: " << argv[0] << " <input-IR-file> [--verbose]\n";
-        return 1;
+    llvm::InitLLVM X(argc, argv);
+    exposeLLVMOption("time-passes");
+    exposeLLVMOption("memory-coalescing-ep", PipelineCategory);
+    exposeLLVMOption("target-cpu", PipelineCategory);
+    exposeLLVMOption("target-features", PipelineCategory);
+    exposeLLVMOption("memory-coalescing-advisor", PipelineCategory);
+    exposeLLVMOption("loop-fusion-mode", PipelineCategory);
+    exposeLLVMOption("loop-tiling", PipelineCategory);
+    exposeLLVMOption("loop-tiling-size", PipelineCategory);
+    exposeLLVMOption("loop-tiling-l2-size", PipelineCategory);
+    exposeLLVMOption("reduction-vectorize", PipelineCategory);
+    exposeLLVMOption("reduction-vectorize-reassoc", PipelineCategory);
+    exposeLLVMOption("software-prefetch", PipelineCategory);
+    exposeLLVMOption("software-prefetch-distance", PipelineCategory);
+    exposeLLVMOption("loop-parallelize", PipelineCategory);
+    exposeLLVMOption("loop-parallelize-chunk", PipelineCategory);
+    llvm::cl::HideUnrelatedOptions({&DriverCategory, &PipelineCategory});
+    llvm::cl::ParseCommandLineOptions(argc, argv,
+                                      "ML Compiler Optimization Framework\n");
+    
+    // Reject a malformed --passes before any work is done
+    if (!PassPipeline.empty()) {
+        mlcompileropt::OptimizationPipeline Pipeline;
+        if (llvm::Error E = Pipeline.setPipeline(PassPipeline)) {
+            llvm::errs() << "Error in --passes: " << llvm::toString(std::move(E)) << "\n";
+            return 1;
+        }
+    }
+
+    // Configurations found by the autotuner
+    std::unique_ptr<mlcompileropt::TuningDatabase> Tuning;
+    if (!TuningDB.empty()) {
+        auto DBOrErr = mlcompileropt::TuningDatabase::load(TuningDB);
+        if (!DBOrErr) {
+            llvm::errs() << "Error in --tuning-db: " << llvm::toString(DBOrErr.takeError()) << "\n";
+            return 1;
+        }
+        Tuning = std::make_unique<mlcompileropt::TuningDatabase>(std::move(*DBOrErr));
     }
 
-    std::string InputFilename = argv[1];
-    bool Verbose = false;
+    // Server mode: stdout carries the responses, everything else goes to stderr
+    if (Server) {
+        std::unique_ptr<mlcompileropt::ModuleCache> Cache = openCache(argc, argv, Tuning.get());
+        if (!CacheDir.empty() && !Cache)
+            return 1;
+        
+        mlcompileropt::CompileServerOptions Opts;
+        Opts.Workers = std::max(1u, unsigned(Jobs));
+        Opts.PassPipeline = PassPipeline;
+        Opts.Cache = Cache.get();
+        Opts.Tuning = Tuning.get();
+        mlcompileropt::CompileServer CS(Opts);
+        
+        std::ios::sync_with_stdio(false);
+        bool WellFormed = CS.serve(std::cin, llvm::outs());
+        CS.printStats(llvm::errs());
+        return WellFormed ? 0 : 1;
+    }
     
-    // Check for verbose flag
-    if (argc > 2 && std::string(argv[2]) == "--verbose") {
-        Verbose = true;
-        llvm::outs() << "Verbose mode enabled\n";
+    if (InputFilename.empty()) {
+        llvm::errs() << argv[0] << ": no input file (see --help)\n";
+        return 1;
     }
     
-    // 1. Setup LLVM context and parse the IR file
+    mlcompileropt::OutputFormat Format = Emit;
+    if (!Emit.getNumOccurrences())
+        Format = getDefaultFormat(OutputFilename);
+    bool ToStdout = OutputFilename == "-";
+    
+    if (CodeGenPartitions == 0 ||
+        (CodeGenPartitions > 1 && (!mlcompileropt::isNativeFormat(Format) || ToStdout))) {
+        llvm::errs() << "--codegen-partitions=" << CodeGenPartitions
+                     << " needs --emit=obj or asm and an output file\n";
+        return 1;
+    }
+    
+    // Status output goes to stdout unless that would corrupt a binary
+    // stream or interleave with the assembly
+    llvm::raw_ostream &Log = Quiet ? llvm::nulls()
+        : (ToStdout && Format != mlcompileropt::OutputFormat::Text) ? llvm::errs()
+        : llvm::outs();
+    
+    if (Verbose) {
+        Log << "Verbose mode enabled\n";
+        
+        // Collect pass statistics, e.g. the number of interchanged loop nests
+        llvm::EnableStatistics(/*DoPrintOnExit=*/false);
+    }
+    
+    // 1. Setup LLVM context and read the input
     llvm::LLVMContext Context;
     llvm::SMDiagnostic Err;
-    std::unique_ptr<llvm::Module> Module = llvm::parseIRFile(InputFilename, Err, Context);
-    
-    if (!Module) {
+    std::unique_ptr<llvm::MemoryBuffer> Input =
+        mlcompileropt::openInputFile(InputFilename, Err);
+    if (!Input) {
         llvm::errs() << "Error loading file '" << InputFilename << "':\n";
         Err.print(argv[0], llvm::errs());
         return 1;
     }
+    
+    // Remarks are emitted by the passes, also those run in other contexts
+    // by the parallel driver
+    std::unique_ptr<llvm::ToolOutputFile> Remarks;
+    if (!RemarksFile.empty()) {
+        auto RemarksOrErr = llvm::setupLLVMOptimizationRemarks(
+            Context, RemarksFile, RemarksFilter, RemarksFormat,
+            /*RemarksWithHotness=*/false);
+        if (!RemarksOrErr) {
+            llvm::errs() << "Error opening remarks file '" << RemarksFile << "': "
+                         << llvm::toString(RemarksOrErr.takeError()) << "\n";
+            return 1;
+        }
+        Remarks = std::move(*RemarksOrErr);
+    }
+    
+    // A cache hit skips the optimization pipeline, and also parsing when
+    // bitcode is requested; objects and assembly are still generated from
+    // the cached module. Remarks are emitted while the pipeline runs, so
+    // with --remarks-file the lookup is skipped and the result only stored.
+    std::unique_ptr<mlcompileropt::ModuleCache> Cache = openCache(argc, argv, Tuning.get());
+    if (!CacheDir.empty() && !Cache)
+        return 1;
+    std::string CacheKey;
+    std::unique_ptr<llvm::MemoryBuffer> Cached;
+    if (Cache) {
+        CacheKey = Cache->getKey(Input->getBuffer());
+        if (!Remarks) {
+            Cached = Cache->lookup(CacheKey);
+            Log << "Cache " << (Cached ? "hit" : "miss") << " (" << CacheKey << ")\n";
+        }
+    }
+    
+    std::unique_ptr<llvm::Module> Module;
+    if (!Cached || Format != mlcompileropt::OutputFormat::Bitcode) {
+        // Cached modules are named after the input, like fresh ones
+        Module = mlcompileropt::parseModule(
+            Cached ? llvm::MemoryBufferRef(Cached->getBuffer(), InputFilename)
+                   : Input->getMemBufferRef(),
+            Context, Err);
+        
+        if (!Module) {
+            llvm::errs() << "Error loading file '" << InputFilename << "':\n";
+            Err.print(argv[0], llvm::errs());
+            return 1;
+        }
 
-    llvm::outs() << "Successfully loaded IR module '" << Module->getName().str() << "'\n";
-    
-    // 2. Setup the new pass manager
-    llvm::LoopAnalysisManager LAM;
-    llvm::FunctionAnalysisManager FAM;
-    llvm::CGSCCAnalysisManager CGAM;
-    llvm::ModuleAnalysisManager MAM;
-    
-    // Create pass builder and register analysis passes
-    llvm::PassBuilder PB;
-    PB.registerModuleAnalyses(MAM);
-    PB.registerCGSCCAnalyses(CGAM);
-    PB.registerFunctionAnalyses(FAM);
-    PB.registerLoopAnalyses(LAM);
-    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
-    
-    // Create module pass manager with standard optimization passes
-    llvm::ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(
-        llvm::OptimizationLevel::O3);
-    
-    // 3. Add our custom memory coalescing pass
-    llvm::outs() << "Adding custom memory coalescing pass...\n";
-    for (auto &F : *Module) {
-        if (!F.isDeclaration()) {
-            // Create and run the custom memory coalescing pass
-            mlcompileropt::MemoryCoalescingPass MemCoalesce;
-            
-            if (Verbose) {
-                llvm::outs() << "Analyzing function: " << F.getName() << "\n";
-                
-                // Print basic blocks in function
-                llvm::outs() << "  Function has " << F.size() << " basic blocks\n";
-                
-                // Check for loops
-                auto &LI = FAM.getResult<llvm::LoopAnalysis>(F);
-                llvm::outs() << "  Function has " << std::distance(LI.begin(), LI.end()) << " top-level loops\n";
-                
-                // Count memory operations
-                int LoadCount = 0;
-                int StoreCount = 0;
-                for (auto &BB : F) {
-                    for (auto &I : BB) {
-                        if (llvm::isa<llvm::LoadInst>(I)) LoadCount++;
-                        if (llvm::isa<llvm::StoreInst>(I)) StoreCount++;
-                    }
-                }
-                llvm::outs() << "  Function has " << LoadCount << " loads and " 
-                            << StoreCount << " stores\n";
-            }
-            
-            // Run the pass
-            auto Result = MemCoalesce.run(F, FAM);
-            
-            if (Verbose) {
-                llvm::outs() << "  Pass preserved analyses: " 
-                            << (Result.areAllPreserved() ? "all" : "none") << "\n";
-            }
+        Log << "Successfully loaded IR module '" << Module->getName().str() << "'\n";
+    }
+    
+    // Pass timing and tracing cover both driver modes
+    std::unique_ptr<mlcompileropt::PassProfiler> Profiler;
+    if (llvm::TimePassesIsEnabled || !TraceFile.empty())
+        Profiler = std::make_unique<mlcompileropt::PassProfiler>();
+    
+    // 2.-3. Optimize, unless the cache already has the result
+    if (!Cached) {
+        if (Tuning) {
+            unsigned NumTuned = Tuning->apply(*Module);
+            Log << "Applied tuned configurations to " << NumTuned << " of "
+                << Tuning->size() << " kernels in the tuning database\n";
         }
+        
+        if (!optimizeModule(Module, Log, Profiler.get()))
+            return 1;
+        
+        if (Cache) {
+            llvm::SmallVector<char, 0> Bitcode;
+            llvm::raw_svector_ostream BitcodeOS(Bitcode);
+            llvm::WriteBitcodeToFile(*Module, BitcodeOS);
+            if (llvm::Error E = Cache->insert(CacheKey, llvm::StringRef(Bitcode.data(), Bitcode.size())))
+                llvm::errs() << "Warning: " << llvm::toString(std::move(E)) << "\n";
+        }
+    }
+    
+    if (Verbose) {
+        llvm::PrintStatistics(Log);
     }
     
-    // 4. Run the standard optimization passes
-    llvm::outs() << "Running optimization passes...\n";
-    MPM.run(*Module, MAM);
+    if (Profiler && llvm::TimePassesIsEnabled)
+        Profiler->printReport(llvm::errs());
+    if (!TraceFile.empty()) {
+        if (llvm::Error E = mlcompileropt::writeChromeTrace(TraceFile, {Profiler.get()})) {
+            llvm::errs() << llvm::toString(std::move(E)) << "\n";
+            return 1;
+        }
+        Log << "Pass trace written to '" << TraceFile << "'\n";
+    }
+    
+    if (Cache) {
+        Log << "Cache: " << Cache->getNumHits() << " hits, "
+            << Cache->getNumMisses() << " misses\n";
+    }
+    
+    // 4. Write the optimized module, or compile it
+    if (mlcompileropt::isNativeFormat(Format)) {
+        if (!emitNativeCode(*Module, Format, Log))
+            return 1;
+        if (Remarks)
+            Remarks->keep();
+        if (!ToStdout)
+            Log << "Native code written to '" << OutputFilename << "'"
+                << (CodeGenPartitions > 1 ? " and the files of the other partitions" : "")
+                << "\n";
+        return 0;
+    }
+    
+    std::error_code EC;
+    llvm::ToolOutputFile Out(OutputFilename, EC,
+                             Format == mlcompileropt::OutputFormat::Text
+                                 ? llvm::sys::fs::OF_Text
+                                 : llvm::sys::fs::OF_None);
+    if (EC) {
+        llvm::errs() << "Error opening '" << OutputFilename << "': " << EC.message() << "\n";
+        return 1;
+    }
+    if (Format == mlcompileropt::OutputFormat::Bitcode &&
+        llvm::CheckBitcodeOutputToConsole(Out.os()))
+        return 1;
+    
+    if (ToStdout && Format == mlcompileropt::OutputFormat::Text) {
+        Log << "Optimized IR:\n";
+        Log << "------------\n";
+    }
+    // Log may share stdout with the module
+    Log.flush();
+    if (Module)
+        mlcompileropt::writeModule(*Module, Out.os(), Format);
+    else
+        Out.os() << Cached->getBuffer();
+    Out.keep();
+    if (Remarks)
+        Remarks->keep();
     
-    // 5. Output the optimized IR to stdout
-    llvm::outs() << "Optimized IR:\n";
-    llvm::outs() << "------------\n";
-    Module->print(llvm::outs(), nullptr);
+    if (!ToStdout)
+        Log << "Optimized module written to '" << OutputFilename << "'\n";
     
     return 0;
-}
\ No newline at end of file
+}
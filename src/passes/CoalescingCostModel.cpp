@@ -0,0 +1,189 @@
+//===- CoalescingCostModel.cpp - Memory Coalescing Cost Model -------===//
+//
+// Implementation of the cost model behind the interchange and merge
+// decisions of the memory coalescing pass.
+//
+//===----------------------------------------------------------------===//
+
+#include "passes/CoalescingCostModel.h"
+#include "passes/MemoryAccessPattern.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <limits>
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+// Overrides the cache line size the target reports
+cl::opt<unsigned> CacheLineSizeOpt(
+    "memory-coalescing-cache-line-size", cl::init(0), cl::Hidden,
+    cl::desc("Cache line size in bytes used to decide whether a loop "
+             "interchange reduces the number of cache lines touched "
+             "(default: the target's, or 64)"));
+
+// Caps the vector register width the target reports
+cl::opt<unsigned> MaxMergeWidth(
+    "memory-coalescing-max-merge-width", cl::init(0), cl::Hidden,
+    cl::desc("Maximum width in bits of a vector access formed by merging "
+             "adjacent scalar loads or stores (default: the target's "
+             "vector register width)"));
+
+const unsigned DefaultCacheLineSize = 64;
+
+// Invalid costs, e.g. of types the target cannot load, never win
+double toDouble(InstructionCost Cost) {
+  if (!Cost.isValid())
+    return std::numeric_limits<double>::infinity();
+  return static_cast<double>(*Cost.getValue());
+}
+
+} // end anonymous namespace
+
+bool MemoryCost::operator<(const MemoryCost &Other) const {
+  if (CacheLines != Other.CacheLines)
+    return CacheLines < Other.CacheLines;
+  if (Instructions != Other.Instructions)
+    return Instructions < Other.Instructions;
+  return MemoryOps < Other.MemoryOps;
+}
+
+void MemoryCost::print(raw_ostream &OS) const {
+  OS << format("%.2f cache lines, cost %.2f, %.2f memory ops", CacheLines,
+               Instructions, MemoryOps);
+}
+
+CoalescingCostModel::CoalescingCostModel(const TargetTransformInfo &TTI,
+                                         const DataLayout &DL)
+    : TTI(TTI), DL(DL) {
+  CacheLineSize = CacheLineSizeOpt;
+  if (!CacheLineSize)
+    CacheLineSize = TTI.getCacheLineSize();
+  if (!CacheLineSize)
+    CacheLineSize = DefaultCacheLineSize;
+
+  VectorWidth =
+      TTI.getRegisterBitWidth(TargetTransformInfo::RGK_FixedWidthVector)
+          .getFixedSize();
+  if (MaxMergeWidth)
+    VectorWidth = std::min<unsigned>(VectorWidth, MaxMergeWidth);
+}
+
+unsigned CoalescingCostModel::getMaxMergeFactor(Type *ElemTy) const {
+  uint64_t Bits = DL.getTypeSizeInBits(ElemTy);
+  if (!Bits)
+    return 1;
+  return std::max<uint64_t>(1, VectorWidth / Bits);
+}
+
+MemoryCost CoalescingCostModel::getLoopCost(const Loop *Innermost,
+                                            const Loop *Candidate,
+                                            const MemoryAccessPatternInfo &MAP) const {
+  MemoryCost Cost;
+  for (const AccessPattern &P : MAP.patterns()) {
+    if (P.InnermostLoop != Innermost)
+      continue;
+
+    unsigned Opcode = P.isLoad() ? Instruction::Load : Instruction::Store;
+    Type *Ty = getLoadStoreType(P.I);
+    Align Alignment = getLoadStoreAlignment(P.I);
+    unsigned AS = getLoadStoreAddressSpace(P.I);
+    double ScalarCost = toDouble(
+        TTI.getMemoryOpCost(Opcode, Ty, Alignment, AS,
+                            TargetTransformInfo::TCK_RecipThroughput, P.I));
+
+    // Unknown strides are assumed to touch a new line every iteration
+    const LoopStride *S = P.IsAffine ? P.getStride(Candidate) : nullptr;
+    if (!S || !S->ConstantBytes) {
+      Cost.CacheLines += 1.0;
+      Cost.Instructions += ScalarCost;
+      Cost.MemoryOps += 1.0;
+      continue;
+    }
+
+    // Invariant accesses are hoisted out of the loop
+    uint64_t Bytes = std::abs(*S->ConstantBytes);
+    if (!Bytes)
+      continue;
+
+    // A loop of known trip count touches each line of its footprint once;
+    // otherwise a new line is reached every CacheLineSize / Bytes iterations
+    double Lines;
+    if (S->TripCount) {
+      uint64_t Footprint = (S->TripCount - 1) * Bytes + P.AccessSize;
+      Lines = std::min<double>(S->TripCount, divideCeil(Footprint, CacheLineSize)) /
+              S->TripCount;
+    } else {
+      Lines = std::min(1.0, static_cast<double>(Bytes) / CacheLineSize);
+    }
+    Cost.CacheLines += Lines;
+
+    // Consecutive elements can be loaded or stored a vector at a time
+    unsigned VF = getMaxMergeFactor(Ty);
+    if (Bytes == P.AccessSize && VF > 1 && VectorType::isValidElementType(Ty)) {
+      auto *VecTy = FixedVectorType::get(Ty, VF);
+      Cost.Instructions +=
+          toDouble(TTI.getMemoryOpCost(Opcode, VecTy, Alignment, AS)) / VF;
+      Cost.MemoryOps += 1.0 / VF;
+    } else {
+      Cost.Instructions += ScalarCost;
+      Cost.MemoryOps += 1.0;
+    }
+  }
+  return Cost;
+}
+
+TransformCost CoalescingCostModel::getInterchangeCost(
+    const Loop *Innermost, const Loop *Outer,
+    const MemoryAccessPatternInfo &MAP) const {
+  return {getLoopCost(Innermost, Innermost, MAP),
+          getLoopCost(Innermost, Outer, MAP)};
+}
+
+TransformCost CoalescingCostModel::getMergeCost(Type *ElemTy, unsigned NumElts,
+                                                Align Alignment,
+                                                unsigned AddrSpace,
+                                                bool IsLoad) const {
+  unsigned Opcode = IsLoad ? Instruction::Load : Instruction::Store;
+  auto *VecTy = FixedVectorType::get(ElemTy, NumElts);
+
+  // Merging does not change the bytes accessed, only how they are issued
+  double Lines = static_cast<double>(
+      divideCeil(DL.getTypeStoreSize(VecTy), CacheLineSize));
+
+  TransformCost Cost;
+  Cost.Before.CacheLines = Lines;
+  Cost.Before.Instructions =
+      NumElts * toDouble(TTI.getMemoryOpCost(Opcode, ElemTy, Alignment, AddrSpace));
+  Cost.Before.MemoryOps = NumElts;
+
+  APInt DemandedElts = APInt::getAllOnes(NumElts);
+#if LLVM_VERSION_MAJOR >= 16
+  InstructionCost Overhead = TTI.getScalarizationOverhead(
+      VecTy, DemandedElts, /*Insert=*/!IsLoad, /*Extract=*/IsLoad,
+      TargetTransformInfo::TCK_RecipThroughput);
+#else
+  InstructionCost Overhead = TTI.getScalarizationOverhead(
+      VecTy, DemandedElts, /*Insert=*/!IsLoad, /*Extract=*/IsLoad);
+#endif
+  Cost.After.CacheLines = Lines;
+  Cost.After.Instructions =
+      toDouble(TTI.getMemoryOpCost(Opcode, VecTy, Alignment, AddrSpace)) +
+      toDouble(Overhead);
+  Cost.After.MemoryOps = 1.0;
+  return Cost;
+}
+
+} // namespace mlcompileropt
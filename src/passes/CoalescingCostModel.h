@@ -0,0 +1,108 @@
+//===- CoalescingCostModel.h - Memory Coalescing Cost Model ---------===//
+//
+// This file declares the cost model the memory coalescing pass consults
+// before it transforms anything. It combines TargetTransformInfo, the
+// DataLayout and the strides and trip counts of MemoryAccessPatternInfo to
+// estimate the cache lines touched and the cost of the memory instructions
+// before and after a loop interchange or a merge of adjacent accesses.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_PASSES_COALESCING_COST_MODEL_H
+#define MLCOMPILEROPT_PASSES_COALESCING_COST_MODEL_H
+
+#include "llvm/Support/Alignment.h"
+
+#include <algorithm>
+
+namespace llvm {
+class DataLayout;
+class Loop;
+class TargetTransformInfo;
+class Type;
+class raw_ostream;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+class MemoryAccessPatternInfo;
+
+// Memory traffic of a group of accesses, per iteration of the loop they
+// run in, or in total for straight-line code.
+struct MemoryCost {
+  // Distinct cache lines touched
+  double CacheLines = 0.0;
+
+  // Reciprocal throughput of the loads, stores and the element inserts or
+  // extracts they need, in TargetTransformInfo units
+  double Instructions = 0.0;
+
+  // Loads and stores issued
+  double MemoryOps = 0.0;
+
+  // Orders costs by cache lines, then instruction cost, then memory
+  // operations; the cheaper cost compares less.
+  bool operator<(const MemoryCost &Other) const;
+
+  void print(llvm::raw_ostream &OS) const;
+};
+
+// Cost of the accesses a transformation rewrites, before and after it.
+struct TransformCost {
+  MemoryCost Before;
+  MemoryCost After;
+
+  bool isProfitable() const { return After < Before; }
+};
+
+class CoalescingCostModel {
+public:
+  CoalescingCostModel(const llvm::TargetTransformInfo &TTI,
+                      const llvm::DataLayout &DL);
+
+  // Cache line size in bytes: -memory-coalescing-cache-line-size if given,
+  // otherwise the target's, or 64 if the target does not say
+  unsigned getCacheLineSize() const { return CacheLineSize; }
+
+  // Width in bits of the widest vector access: the target's fixed-width
+  // vector register size, capped by -memory-coalescing-max-merge-width
+  unsigned getVectorWidth() const { return VectorWidth; }
+
+  // Caps the vector width further, e.g. to a tuned merge width
+  void limitVectorWidth(unsigned Bits) {
+    VectorWidth = std::min(VectorWidth, Bits);
+  }
+
+  // Largest number of ElemTy accesses one vector access can replace; 1 if
+  // the target has no vector registers wide enough for two
+  unsigned getMaxMergeFactor(llvm::Type *ElemTy) const;
+
+  // Cost of the accesses whose innermost loop is Innermost, per iteration,
+  // if loop Candidate of the same nest were innermost instead. Unit-stride
+  // accesses are costed as vectorized at the target's vector width.
+  MemoryCost getLoopCost(const llvm::Loop *Innermost,
+                         const llvm::Loop *Candidate,
+                         const MemoryAccessPatternInfo &MAP) const;
+
+  // Cost of interchanging Innermost with the enclosing loop Outer
+  TransformCost getInterchangeCost(const llvm::Loop *Innermost,
+                                   const llvm::Loop *Outer,
+                                   const MemoryAccessPatternInfo &MAP) const;
+
+  // Cost of replacing NumElts adjacent scalar accesses of ElemTy with one
+  // vector access of the given alignment, including the extracts (for
+  // loads) or inserts (for stores) between the vector and the scalars
+  TransformCost getMergeCost(llvm::Type *ElemTy, unsigned NumElts,
+                             llvm::Align Alignment, unsigned AddrSpace,
+                             bool IsLoad) const;
+
+private:
+  const llvm::TargetTransformInfo &TTI;
+  const llvm::DataLayout &DL;
+  unsigned CacheLineSize;
+  unsigned VectorWidth;
+};
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_PASSES_COALESCING_COST_MODEL_H
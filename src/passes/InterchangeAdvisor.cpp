@@ -0,0 +1,143 @@
+//===- InterchangeAdvisor.cpp - Loop Interchange Decisions ----------===//
+//
+// Implementation of the interchange advisors, the evaluation of the
+// embedded decision tree and the training log.
+//
+//===----------------------------------------------------------------===//
+
+#include "passes/InterchangeAdvisor.h"
+#include "passes/CoalescingCostModel.h"
+#include "passes/InterchangeModel.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+static_assert(sizeof(interchange_model::FeatureNames) /
+                      sizeof(interchange_model::FeatureNames[0]) ==
+                  NumLoopFeatures,
+              "InterchangeModel.h was trained on a different feature set; "
+              "regenerate it with bench/train_interchange_model.py");
+
+const char *const LogVersion = "# memory-coalescing interchange training log v2";
+
+cl::opt<InterchangeAdvisorKind> SelectedAdvisor(
+    "memory-coalescing-advisor", cl::init(InterchangeAdvisorKind::Heuristic),
+    cl::desc("What decides which loop interchanges the memory coalescing "
+             "pass performs"),
+    cl::values(
+        clEnumValN(InterchangeAdvisorKind::Heuristic, "heuristic",
+                   "the cost model (default)"),
+        clEnumValN(InterchangeAdvisorKind::Model, "model",
+                   "the embedded decision tree, or the cost model if it was "
+                   "trained on no data"),
+        clEnumValN(InterchangeAdvisorKind::Always, "always",
+                   "every legal candidate, to collect training data"),
+        clEnumValN(InterchangeAdvisorKind::Never, "never",
+                   "no candidate, to collect training data")));
+
+std::atomic<InterchangeTrainingLog *> ActiveLog(nullptr);
+
+} // end anonymous namespace
+
+StringRef getInterchangeAdvisorName(InterchangeAdvisorKind Kind) {
+  switch (Kind) {
+  case InterchangeAdvisorKind::Heuristic:
+    return "heuristic";
+  case InterchangeAdvisorKind::Model:
+    return "model";
+  case InterchangeAdvisorKind::Always:
+    return "always";
+  case InterchangeAdvisorKind::Never:
+    return "never";
+  }
+  llvm_unreachable("unknown interchange advisor");
+}
+
+InterchangeAdvisorKind getSelectedInterchangeAdvisor() {
+  return SelectedAdvisor;
+}
+
+void setSelectedInterchangeAdvisor(InterchangeAdvisorKind Kind) {
+  SelectedAdvisor = Kind;
+}
+
+bool hasInterchangeModel() {
+  return interchange_model::NumTrainingRecords > 0;
+}
+
+bool evaluateInterchangeModel(const InterchangeFeatures &Features) {
+  return evaluateInterchangeTree(interchange_model::Nodes, Features);
+}
+
+bool evaluateInterchangeTree(ArrayRef<interchange_model::Node> Nodes,
+                             const InterchangeFeatures &Features) {
+  const interchange_model::Node *N = &Nodes[0];
+  while (N->Feature >= 0)
+    N = &Nodes[Features.Values[N->Feature] <= N->Threshold ? N->TrueChild
+                                                           : N->FalseChild];
+  return N->Interchange;
+}
+
+bool adviseInterchange(InterchangeAdvisorKind Kind,
+                       const InterchangeFeatures &Features,
+                       const TransformCost &Cost) {
+  switch (Kind) {
+  case InterchangeAdvisorKind::Heuristic:
+    return Cost.isProfitable();
+  case InterchangeAdvisorKind::Model:
+    return hasInterchangeModel() ? evaluateInterchangeModel(Features)
+                                 : Cost.isProfitable();
+  case InterchangeAdvisorKind::Always:
+    return true;
+  case InterchangeAdvisorKind::Never:
+    return false;
+  }
+  llvm_unreachable("unknown interchange advisor");
+}
+
+void InterchangeTrainingLog::record(InterchangeRecord Record) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  Records.push_back(std::move(Record));
+}
+
+std::vector<InterchangeRecord> InterchangeTrainingLog::takeRecords() {
+  std::lock_guard<std::mutex> Guard(Lock);
+  std::vector<InterchangeRecord> Taken;
+  Taken.swap(Records);
+  return Taken;
+}
+
+void InterchangeTrainingLog::writeHeader(raw_ostream &OS) {
+  OS << LogVersion << "\nfunction,loop,outer_loop";
+  for (unsigned I = 0; I != NumLoopFeatures; ++I)
+    OS << ',' << getLoopFeatureName(static_cast<LoopFeature>(I));
+  OS << ",heuristic,speedup\n";
+}
+
+void InterchangeTrainingLog::writeRecord(raw_ostream &OS,
+                                         const InterchangeRecord &R,
+                                         double Speedup) {
+  OS << R.Function << ',' << R.Loop << ',' << R.OuterLoop;
+  for (float Value : R.Features.Values)
+    OS << ',' << format("%.9g", Value);
+  OS << ',' << (R.Profitable ? 1 : 0) << ',' << format("%.4f", Speedup)
+     << '\n';
+}
+
+InterchangeTrainingLog *getInterchangeTrainingLog() { return ActiveLog; }
+
+void setInterchangeTrainingLog(InterchangeTrainingLog *Log) {
+  ActiveLog = Log;
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,116 @@
+//===- InterchangeAdvisor.h - Loop Interchange Decisions ------------===//
+//
+// This file declares where the memory coalescing pass gets its loop
+// interchange decisions from: the cost model heuristic, the decision tree
+// compiled in from InterchangeModel.h, or a fixed answer used to collect
+// training data. It also declares the training log, which records the
+// features of every candidate the pass evaluates.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_PASSES_INTERCHANGE_ADVISOR_H
+#define MLCOMPILEROPT_PASSES_INTERCHANGE_ADVISOR_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+
+#include "passes/LoopFeatures.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+struct TransformCost;
+
+namespace interchange_model {
+struct Node;
+} // namespace interchange_model
+
+enum class InterchangeAdvisorKind {
+  Heuristic, // Interchange when the cost model finds it profitable
+  Model,     // Ask the embedded decision tree
+  Always,    // Interchange every candidate; for training data
+  Never,     // Interchange nothing; for training data
+};
+
+// Command-line name of Kind, e.g. "heuristic"
+llvm::StringRef getInterchangeAdvisorName(InterchangeAdvisorKind Kind);
+
+// Advisor selected with -memory-coalescing-advisor
+InterchangeAdvisorKind getSelectedInterchangeAdvisor();
+
+// Overrides -memory-coalescing-advisor. Not thread-safe; meant for tools
+// that run one pipeline at a time.
+void setSelectedInterchangeAdvisor(InterchangeAdvisorKind Kind);
+
+// True if the embedded model was trained on at least one record. Without
+// one, the model advisor falls back to the heuristic.
+bool hasInterchangeModel();
+
+// Decision of the embedded model for Features
+bool evaluateInterchangeModel(const InterchangeFeatures &Features);
+
+// Decision of the tree Nodes, laid out as in InterchangeModel.h with the
+// root first, for Features
+bool evaluateInterchangeTree(llvm::ArrayRef<interchange_model::Node> Nodes,
+                             const InterchangeFeatures &Features);
+
+// Decides whether to interchange a candidate with the given features and
+// cost estimate.
+bool adviseInterchange(InterchangeAdvisorKind Kind,
+                       const InterchangeFeatures &Features,
+                       const TransformCost &Cost);
+
+// One interchange candidate evaluated by the pass
+struct InterchangeRecord {
+  std::string Function;
+  std::string Loop;
+  std::string OuterLoop;
+  InterchangeFeatures Features;
+
+  // What the advisor decided, whether the interchange was then found
+  // legal and performed, and what the cost model heuristic would have
+  // decided
+  bool Decision = false;
+  bool Applied = false;
+  bool Profitable = false;
+};
+
+// Collects the candidates the pass evaluates while it is installed with
+// setInterchangeTrainingLog. Passes on several threads may record into
+// the same log.
+class InterchangeTrainingLog {
+public:
+  void record(InterchangeRecord Record);
+
+  // Returns the records collected so far and clears the log
+  std::vector<InterchangeRecord> takeRecords();
+
+  // Writes the two header lines of the training log format: a version
+  // line and the comma-separated column names
+  static void writeHeader(llvm::raw_ostream &OS);
+
+  // Writes one line with the names, features, heuristic decision and
+  // measured speedup of R
+  static void writeRecord(llvm::raw_ostream &OS, const InterchangeRecord &R,
+                          double Speedup);
+
+private:
+  std::mutex Lock;
+  std::vector<InterchangeRecord> Records;
+};
+
+// Log the pass records into, or null
+InterchangeTrainingLog *getInterchangeTrainingLog();
+void setInterchangeTrainingLog(InterchangeTrainingLog *Log);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_PASSES_INTERCHANGE_ADVISOR_H
@@ -0,0 +1,58 @@
+//===- InterchangeModel.h - Embedded Loop Interchange Model ---------===//
+//
+// Generated by bench/train_interchange_model.py from 677 training
+// records with --min-speedup=1.05. Do not edit; rerun the script.
+// Held-out accuracy in 5-fold cross-validation:
+// 99.3%, against 99.3% for the cost model heuristic.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_PASSES_INTERCHANGE_MODEL_H
+#define MLCOMPILEROPT_PASSES_INTERCHANGE_MODEL_H
+
+namespace mlcompileropt {
+namespace interchange_model {
+
+// Records the tree was trained on
+constexpr unsigned NumTrainingRecords = 677;
+
+// Features the tree was trained on, in LoopFeature order
+constexpr const char *FeatureNames[] = {
+    "loop_depth",
+    "band_depth",
+    "outer_distance",
+    "inner_trip_count",
+    "outer_trip_count",
+    "num_loads",
+    "num_stores",
+    "num_strided",
+    "unit_stride_before",
+    "unit_stride_after",
+    "cache_lines_before",
+    "cache_lines_after",
+    "instructions_before",
+    "instructions_after",
+    "reuse_distance_before",
+    "reuse_distance_after",
+};
+
+// An inner node continues at TrueChild if Values[Feature] <= Threshold and
+// at FalseChild otherwise. Leaves have Feature -1 and decide Interchange.
+struct Node {
+  int Feature;
+  float Threshold;
+  int TrueChild;
+  int FalseChild;
+  bool Interchange;
+};
+
+constexpr Node Nodes[] = {
+    {7, 1.5f, 1, 2, true},
+    {-1, 0.0f, 0, 0, false},
+    {-1, 0.0f, 0, 0, true},
+};
+
+} // namespace interchange_model
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_PASSES_INTERCHANGE_MODEL_H
@@ -0,0 +1,152 @@
+//===- LoopFeatures.cpp - Features of Loop Interchange Candidates ---===//
+//
+// Implementation of the feature extraction for loop interchange
+// candidates.
+//
+//===----------------------------------------------------------------===//
+
+#include "passes/LoopFeatures.h"
+#include "passes/CoalescingCostModel.h"
+#include "passes/MemoryAccessPattern.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <cmath>
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+// Trip count assumed for loops whose trip count is not known
+const uint64_t UnknownTripCount = 128;
+
+bool isUnitStride(const AccessPattern &P, const Loop *L) {
+  const LoopStride *S = P.IsAffine ? P.getStride(L) : nullptr;
+  return S && S->ConstantBytes &&
+         static_cast<uint64_t>(std::abs(*S->ConstantBytes)) == P.AccessSize;
+}
+
+// Mean log2 reuse distance of the accesses of Innermost when the loops of
+// Order, outermost first, are nested in that order. The reuse of an access
+// is carried by the innermost loop it does not depend on; the distance is
+// the bytes the accesses of Innermost touch in one iteration of that loop.
+float getMeanReuseDistance(ArrayRef<const Loop *> Order, const Loop *Innermost,
+                           const MemoryAccessPatternInfo &MAP) {
+  uint64_t BytesPerIteration = 0;
+  unsigned NumAccesses = 0;
+  for (const AccessPattern &P : MAP.patterns())
+    if (P.InnermostLoop == Innermost) {
+      BytesPerIteration += P.AccessSize;
+      ++NumAccesses;
+    }
+  if (!NumAccesses)
+    return 0.0f;
+
+  double Sum = 0.0;
+  for (const AccessPattern &P : MAP.patterns()) {
+    if (P.InnermostLoop != Innermost)
+      continue;
+    float Distance = NoReuseDistance;
+    double Iterations = 1.0;
+    for (const Loop *L : llvm::reverse(Order)) {
+      const LoopStride *S = P.IsAffine ? P.getStride(L) : nullptr;
+      if (S && S->ConstantBytes && *S->ConstantBytes == 0) {
+        Distance = std::min<float>(
+            NoReuseDistance, std::log2(1.0 + Iterations * BytesPerIteration));
+        break;
+      }
+      unsigned TripCount = MAP.getTripCount(L);
+      Iterations *= TripCount ? TripCount : UnknownTripCount;
+    }
+    Sum += Distance;
+  }
+  return static_cast<float>(Sum / NumAccesses);
+}
+
+} // end anonymous namespace
+
+StringRef getLoopFeatureName(LoopFeature Feature) {
+  switch (Feature) {
+  case LoopFeature::LoopDepth:
+    return "loop_depth";
+  case LoopFeature::BandDepth:
+    return "band_depth";
+  case LoopFeature::OuterDistance:
+    return "outer_distance";
+  case LoopFeature::InnerTripCount:
+    return "inner_trip_count";
+  case LoopFeature::OuterTripCount:
+    return "outer_trip_count";
+  case LoopFeature::NumLoads:
+    return "num_loads";
+  case LoopFeature::NumStores:
+    return "num_stores";
+  case LoopFeature::NumStrided:
+    return "num_strided";
+  case LoopFeature::UnitStrideBefore:
+    return "unit_stride_before";
+  case LoopFeature::UnitStrideAfter:
+    return "unit_stride_after";
+  case LoopFeature::CacheLinesBefore:
+    return "cache_lines_before";
+  case LoopFeature::CacheLinesAfter:
+    return "cache_lines_after";
+  case LoopFeature::InstructionsBefore:
+    return "instructions_before";
+  case LoopFeature::InstructionsAfter:
+    return "instructions_after";
+  case LoopFeature::ReuseDistanceBefore:
+    return "reuse_distance_before";
+  case LoopFeature::ReuseDistanceAfter:
+    return "reuse_distance_after";
+  case LoopFeature::NumFeatures:
+    break;
+  }
+  llvm_unreachable("unknown loop feature");
+}
+
+InterchangeFeatures
+extractInterchangeFeatures(ArrayRef<const Loop *> Band, unsigned OuterIdx,
+                           const MemoryAccessPatternInfo &MAP,
+                           const CoalescingCostModel &CM) {
+  assert(OuterIdx + 1 < Band.size() && "candidate must enclose the innermost loop");
+  const Loop *Innermost = Band.back();
+  const Loop *Outer = Band[OuterIdx];
+  InterchangeFeatures F;
+
+  F[LoopFeature::LoopDepth] = Innermost->getLoopDepth();
+  F[LoopFeature::BandDepth] = Band.size();
+  F[LoopFeature::OuterDistance] = Band.size() - 1 - OuterIdx;
+  F[LoopFeature::InnerTripCount] = MAP.getTripCount(Innermost);
+  F[LoopFeature::OuterTripCount] = MAP.getTripCount(Outer);
+
+  for (const AccessPattern &P : MAP.patterns()) {
+    if (P.InnermostLoop != Innermost)
+      continue;
+    F[LoopFeature::NumLoads] += P.isLoad();
+    F[LoopFeature::NumStores] += P.isStore();
+    F[LoopFeature::NumStrided] += P.isStrided();
+    F[LoopFeature::UnitStrideBefore] += isUnitStride(P, Innermost);
+    F[LoopFeature::UnitStrideAfter] += isUnitStride(P, Outer);
+  }
+
+  TransformCost Cost = CM.getInterchangeCost(Innermost, Outer, MAP);
+  F[LoopFeature::CacheLinesBefore] = Cost.Before.CacheLines;
+  F[LoopFeature::CacheLinesAfter] = Cost.After.CacheLines;
+  F[LoopFeature::InstructionsBefore] = Cost.Before.Instructions;
+  F[LoopFeature::InstructionsAfter] = Cost.After.Instructions;
+
+  SmallVector<const Loop *, 8> Order(Band.begin(), Band.end());
+  F[LoopFeature::ReuseDistanceBefore] =
+      getMeanReuseDistance(Order, Innermost, MAP);
+  std::swap(Order[OuterIdx], Order.back());
+  F[LoopFeature::ReuseDistanceAfter] =
+      getMeanReuseDistance(Order, Innermost, MAP);
+  return F;
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,82 @@
+//===- LoopFeatures.h - Features of Loop Interchange Candidates -----===//
+//
+// This file declares the feature vector that describes one loop
+// interchange candidate of the memory coalescing pass: the shape of the
+// nest, the mix and strides of its accesses, and cache, cost and reuse
+// estimates before and after the interchange. The vector is the input of
+// the embedded interchange model and is what training logs record.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_PASSES_LOOP_FEATURES_H
+#define MLCOMPILEROPT_PASSES_LOOP_FEATURES_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <array>
+
+namespace llvm {
+class Loop;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+class CoalescingCostModel;
+class MemoryAccessPatternInfo;
+
+// Features of an interchange candidate. Trip counts are 0 when unknown.
+// Reuse distances are the mean over the accesses of the innermost loop of
+// log2(1 + bytes touched between two uses of the same element), and
+// NoReuseDistance for accesses without reuse in the nest.
+enum class LoopFeature : unsigned {
+  LoopDepth,           // Depth of the innermost loop in its function
+  BandDepth,           // Loops in the perfect nest
+  OuterDistance,       // Levels between the candidate and the innermost loop
+  InnerTripCount,      // Trip count of the innermost loop
+  OuterTripCount,      // Trip count of the candidate loop
+  NumLoads,            // Loads in the innermost loop
+  NumStores,           // Stores in the innermost loop
+  NumStrided,          // Accesses with a non-unit constant innermost stride
+  UnitStrideBefore,    // Unit-stride accesses in the current order
+  UnitStrideAfter,     // Unit-stride accesses after the interchange
+  CacheLinesBefore,    // CoalescingCostModel estimates per iteration
+  CacheLinesAfter,
+  InstructionsBefore,
+  InstructionsAfter,
+  ReuseDistanceBefore, // Mean log2 reuse distance in bytes
+  ReuseDistanceAfter,
+  NumFeatures
+};
+
+constexpr unsigned NumLoopFeatures =
+    static_cast<unsigned>(LoopFeature::NumFeatures);
+
+// Reuse distance of an access that is not reused within the nest
+constexpr float NoReuseDistance = 64.0f;
+
+// Name of Feature in training logs, e.g. "cache_lines_before"
+llvm::StringRef getLoopFeatureName(LoopFeature Feature);
+
+struct InterchangeFeatures {
+  std::array<float, NumLoopFeatures> Values{};
+
+  float operator[](LoopFeature Feature) const {
+    return Values[static_cast<unsigned>(Feature)];
+  }
+  float &operator[](LoopFeature Feature) {
+    return Values[static_cast<unsigned>(Feature)];
+  }
+};
+
+// Describes interchanging the innermost loop of the perfect nest Band,
+// given outermost first, with Band[OuterIdx].
+InterchangeFeatures
+extractInterchangeFeatures(llvm::ArrayRef<const llvm::Loop *> Band,
+                           unsigned OuterIdx,
+                           const MemoryAccessPatternInfo &MAP,
+                           const CoalescingCostModel &CM);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_PASSES_LOOP_FEATURES_H
@@ -0,0 +1,684 @@
+//===- LoopFusion.cpp - Producer-Consumer Loop Fusion and Fission ---===//
+//
+// Implementation of loop fusion and fission. Both transformations rewrite
+// the CFG, so the pass applies one of them at a time and recomputes its
+// analyses before looking for the next.
+//
+//===----------------------------------------------------------------===//
+
+#include "passes/LoopFusion.h"
+#include "passes/LoopNest.h"
+#include "passes/MemoryAccessPattern.h"
+#include "passes/MemoryCoalescing.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/DependenceAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/MemoryLocation.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/LoopSimplify.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#define DEBUG_TYPE "loop-fusion"
+
+using namespace llvm;
+using ore::NV;
+
+namespace mlcompileropt {
+
+ALWAYS_ENABLED_STATISTIC(NumLoopsFused,
+                         "Number of loops fused into the preceding loop");
+ALWAYS_ENABLED_STATISTIC(NumLoopsSplit,
+                         "Number of loops split by loop fission");
+
+namespace {
+
+cl::opt<LoopFusionMode> SelectedMode(
+    "loop-fusion-mode", cl::init(LoopFusionMode::None),
+    cl::desc("Which of loop fusion and loop fission the loop fusion pass "
+             "performs in the default pipelines"),
+    cl::values(clEnumValN(LoopFusionMode::None, "none",
+                          "neither; the pass is not added"),
+               clEnumValN(LoopFusionMode::Fuse, "fuse",
+                          "fuse adjacent loops only"),
+               clEnumValN(LoopFusionMode::Fission, "fission",
+                          "split loops with too many live values only"),
+               clEnumValN(LoopFusionMode::Both, "both",
+                          "fuse, then split loops with too many live "
+                          "values")));
+
+cl::opt<unsigned> MaxPressureOpt(
+    "loop-fission-max-pressure", cl::init(0), cl::Hidden,
+    cl::desc("Registers the body of an innermost loop may keep live before "
+             "loop fission splits it, and fusion stops merging into it "
+             "(default: the target's number of scalar registers)"));
+
+// Every transformation is followed by a recomputation of the analyses, so
+// the number per function is bounded
+const unsigned MaxTransformsPerFunction = 64;
+
+// Blocks of straight-line code between two loops that may sit in between
+// fused loops
+const unsigned MaxBlocksBetween = 8;
+
+struct FunctionAnalyses {
+  LoopInfo &LI;
+  AAResults &AA;
+  DependenceInfo &DI;
+  const MemoryAccessPatternInfo &MAP;
+  OptimizationRemarkEmitter &ORE;
+};
+
+FunctionAnalyses getAnalyses(Function &F, FunctionAnalysisManager &AM) {
+  return {AM.getResult<LoopAnalysis>(F), AM.getResult<AAManager>(F),
+          AM.getResult<DependenceAnalysis>(F),
+          AM.getResult<MemoryAccessPatternAnalysis>(F),
+          AM.getResult<OptimizationRemarkEmitterAnalysis>(F)};
+}
+
+// Collects the loads and stores of L. Returns false if L accesses memory
+// in any other way.
+bool collectAccesses(const Loop *L, SmallVectorImpl<Instruction *> &Accesses) {
+  for (BasicBlock *BB : L->blocks()) {
+    for (Instruction &I : *BB) {
+      if (!I.mayReadOrWriteMemory())
+        continue;
+      auto *LI = dyn_cast<LoadInst>(&I);
+      auto *SI = dyn_cast<StoreInst>(&I);
+      if ((!LI || !LI->isSimple()) && (!SI || !SI->isSimple()))
+        return false;
+      Accesses.push_back(&I);
+    }
+  }
+  return true;
+}
+
+// True if a value computed in L is used after it
+bool isUsedOutside(const Loop *L) {
+  for (BasicBlock *BB : L->blocks())
+    for (Instruction &I : *BB)
+      for (User *U : I.users())
+        if (!L->contains(cast<Instruction>(U)->getParent()))
+          return true;
+  return false;
+}
+
+// Loops are fused with their control in the latch, where the fused loop
+// decides whether to run the next iteration after both bodies
+bool haveSameIterationSpace(const LoopControl &A, const LoopControl &B) {
+  return A.IndVar->getType() == B.IndVar->getType() && A.Start == B.Start &&
+         A.Bound == B.Bound && A.Step == B.Step &&
+         A.ContinuePred == B.ContinuePred &&
+         A.ComparesIncrement == B.ComparesIncrement && !A.ExitsFromHeader &&
+         !B.ExitsFromHeader;
+}
+
+// Returns the loop that immediately follows L: the blocks from L's exit
+// to the loop's preheader, which are collected in Between, form a chain
+// of straight-line code in L's parent loop.
+Loop *findNextLoop(Loop *L, LoopInfo &LI,
+                   SmallVectorImpl<BasicBlock *> &Between) {
+  BasicBlock *BB = L->getExitBlock();
+  while (BB && Between.size() < MaxBlocksBetween) {
+    if (!BB->getSinglePredecessor() || LI.getLoopFor(BB) != L->getParentLoop())
+      return nullptr;
+    Between.push_back(BB);
+    BasicBlock *Succ = BB->getSingleSuccessor();
+    if (!Succ)
+      return nullptr;
+    Loop *Next = LI.getLoopFor(Succ);
+    if (Next && Next->getHeader() == Succ)
+      return Next->getParentLoop() == L->getParentLoop() &&
+                     Next->getLoopPreheader() == BB
+                 ? Next
+                 : nullptr;
+    BB = Succ;
+  }
+  return nullptr;
+}
+
+// The code between fused loops moves out of the way: in front of the
+// first loop if the second one uses it, behind the second one otherwise.
+// It must be free of side effects and independent of the first loop.
+bool canMoveBetween(ArrayRef<BasicBlock *> Between, const Loop *First) {
+  for (BasicBlock *BB : Between) {
+    for (Instruction &I : *BB) {
+      if (I.isTerminator())
+        continue;
+      if (isa<PHINode>(I) || I.mayReadOrWriteMemory() ||
+          !isSafeToSpeculativelyExecute(&I))
+        return false;
+      for (Value *Op : I.operands())
+        if (auto *OpI = dyn_cast<Instruction>(Op))
+          if (First->contains(OpI))
+            return false;
+    }
+  }
+  return true;
+}
+
+// Byte range an access touches in one iteration of the loop Fused,
+// relative to its address at the start of that iteration. Returns false
+// if the inner loops do not have constant strides and trip counts.
+bool getRangePerIteration(const AccessPattern &P, const Loop *Fused,
+                          int64_t &Lo, int64_t &Hi) {
+  Lo = 0;
+  Hi = P.AccessSize - 1;
+  for (const LoopStride &S : P.Strides) {
+    if (S.L == Fused)
+      return true;
+    if (!S.ConstantBytes)
+      return false;
+    if (*S.ConstantBytes == 0)
+      continue;
+    if (!S.TripCount)
+      return false;
+    int64_t Span = *S.ConstantBytes * int64_t(S.TripCount - 1);
+    (Span < 0 ? Lo : Hi) += Span;
+  }
+  return false;
+}
+
+// Checks that A, in the nest of First, and B, in the nest of Second, never
+// access the same address in different iterations of the fused loop:
+// they start at the same address, move by the same stride in the fused
+// loop and the loops around it, and what they touch in one iteration is
+// narrower than that stride.
+bool accessSameElementPerIteration(const AccessPattern &A, const Loop *First,
+                                   const AccessPattern &B, const Loop *Second) {
+  if (!A.IsAffine || !B.IsAffine || A.Base != B.Base)
+    return false;
+
+  const LoopStride *SA = A.getStride(First);
+  const LoopStride *SB = B.getStride(Second);
+  if (!SA || !SB || !SA->ConstantBytes || SA->ConstantBytes != SB->ConstantBytes ||
+      *SA->ConstantBytes == 0)
+    return false;
+  for (const LoopStride &S : A.Strides) {
+    if (!S.L->contains(First) || S.L == First)
+      continue;
+    const LoopStride *Other = B.getStride(S.L);
+    if (!Other || Other->Step != S.Step)
+      return false;
+  }
+
+  int64_t LoA, HiA, LoB, HiB;
+  if (!getRangePerIteration(A, First, LoA, HiA) ||
+      !getRangePerIteration(B, Second, LoB, HiB))
+    return false;
+  int64_t Stride = std::abs(*SA->ConstantBytes);
+  return Stride > std::max(HiA - LoB, HiB - LoA);
+}
+
+// Fusion runs the body of Second for an iteration right after the body of
+// First for it, instead of after all iterations of First. That reverses
+// every dependence from an access of First to an access of Second in an
+// earlier iteration.
+bool isFusionLegal(const Loop *First, const Loop *Second,
+                   FunctionAnalyses &FA) {
+  SmallVector<Instruction *, 16> FirstAccesses, SecondAccesses;
+  if (!collectAccesses(First, FirstAccesses) ||
+      !collectAccesses(Second, SecondAccesses))
+    return false;
+
+  for (Instruction *A : FirstAccesses) {
+    for (Instruction *B : SecondAccesses) {
+      if (!isa<StoreInst>(A) && !isa<StoreInst>(B))
+        continue;
+      auto LocA = MemoryLocation::getBeforeOrAfter(getLoadStorePointerOperand(A));
+      auto LocB = MemoryLocation::getBeforeOrAfter(getLoadStorePointerOperand(B));
+      if (FA.AA.isNoAlias(LocA, LocB))
+        continue;
+
+      const AccessPattern *PA = FA.MAP.getPattern(A);
+      const AccessPattern *PB = FA.MAP.getPattern(B);
+      if (!PA || !PB || !accessSameElementPerIteration(*PA, First, *PB, Second)) {
+        LLVM_DEBUG(dbgs() << "  Fusion blocked by " << *A << " and " << *B
+                          << "\n");
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// True if the two loops access a common object, so that fusing them
+// reuses data
+bool shareData(const Loop *First, const Loop *Second) {
+  SmallPtrSet<const Value *, 8> Objects;
+  for (BasicBlock *BB : First->blocks())
+    for (Instruction &I : *BB)
+      if (const Value *Ptr = getLoadStorePointerOperand(&I))
+        Objects.insert(getUnderlyingObject(Ptr));
+  for (BasicBlock *BB : Second->blocks())
+    for (Instruction &I : *BB)
+      if (const Value *Ptr = getLoadStorePointerOperand(&I))
+        if (Objects.count(getUnderlyingObject(Ptr)))
+          return true;
+  return false;
+}
+
+// Estimates the registers a loop body made of Insts keeps live: a base
+// pointer per object it accesses, every loop invariant operand and the
+// induction variable
+unsigned estimatePressure(ArrayRef<Instruction *> Insts, const Loop *L) {
+  SmallPtrSet<const Value *, 16> Live;
+  for (Instruction *I : Insts) {
+    const Value *Ptr = getLoadStorePointerOperand(I);
+    if (Ptr)
+      Live.insert(getUnderlyingObject(Ptr));
+    for (Value *Op : I->operands()) {
+      if (Op == Ptr || isa<Constant>(Op) || isa<BasicBlock>(Op))
+        continue;
+      auto *OpI = dyn_cast<Instruction>(Op);
+      if (!OpI || !L->contains(OpI))
+        Live.insert(Op);
+    }
+  }
+  return Live.size() + 1;
+}
+
+unsigned estimatePressure(const Loop *L) {
+  SmallVector<Instruction *, 32> Insts;
+  for (BasicBlock *BB : L->blocks())
+    for (Instruction &I : *BB)
+      Insts.push_back(&I);
+  return estimatePressure(Insts, L);
+}
+
+// Fuses Second into First, whose controls have the same iteration space:
+//
+//   First.header ... First.latch --exit--> Between --> Second.header ...
+//   Second.latch --exit--> Exit
+//
+// becomes
+//
+//   First.header ... First.latch --> Second.header ... Second.latch
+//   with First's exit branch at the end, leaving to Exit
+void fuseLoops(const LoopControl &First, const LoopControl &Second,
+               ArrayRef<BasicBlock *> Between) {
+  BasicBlock *FirstHeader = First.L->getHeader();
+  BasicBlock *FirstLatch = First.L->getLoopLatch();
+  BasicBlock *FirstExit = First.L->getExitBlock();
+  BasicBlock *SecondHeader = Second.L->getHeader();
+  BasicBlock *SecondLatch = Second.L->getLoopLatch();
+  BasicBlock *SecondExit = Second.L->getExitBlock();
+
+  // The straight-line code in between runs before the fused loop if
+  // Second uses it. The rest, such as the control of an enclosing loop
+  // when inner loops are fused, stays behind Second, which keeps
+  // enclosing loops in the form analyzeLoopControl expects.
+  SmallPtrSet<Instruction *, 8> Hoisted;
+  SmallVector<Instruction *, 8> Sunk;
+  for (BasicBlock *BB : reverse(Between)) {
+    for (Instruction &I : make_early_inc_range(reverse(*BB))) {
+      if (I.isTerminator())
+        continue;
+      bool UsedBySecond = any_of(I.users(), [&](User *U) {
+        auto *UI = cast<Instruction>(U);
+        return Second.L->contains(UI) || Hoisted.count(UI);
+      });
+      if (UsedBySecond)
+        Hoisted.insert(&I);
+      else
+        Sunk.push_back(&I);
+    }
+  }
+  Instruction *HoistPt = First.L->getLoopPreheader()->getTerminator();
+  for (BasicBlock *BB : Between)
+    for (Instruction &I : make_early_inc_range(*BB))
+      if (Hoisted.count(&I))
+        I.moveBefore(HoistPt);
+  for (Instruction *I : Sunk)
+    I->moveBefore(&*SecondExit->getFirstInsertionPt());
+
+  // Second's body runs on First's induction variable
+  Second.IndVar->replaceAllUsesWith(First.IndVar);
+  Second.Increment->replaceAllUsesWith(First.Increment);
+
+  // First's latch continues with Second's body, and Second's latch takes
+  // over First's exit test
+  BranchInst *ExitBranch = First.ExitBranch;
+  for (unsigned I = 0; I < ExitBranch->getNumSuccessors(); ++I)
+    if (ExitBranch->getSuccessor(I) == FirstExit)
+      ExitBranch->setSuccessor(I, SecondExit);
+  ExitBranch->removeFromParent();
+  BranchInst::Create(SecondHeader, FirstLatch);
+
+  Second.ExitBranch->eraseFromParent();
+  if (Second.Compare->use_empty())
+    Second.Compare->eraseFromParent();
+  SecondLatch->getInstList().push_back(ExitBranch);
+  First.Compare->moveBefore(ExitBranch);
+  for (PHINode &Phi : FirstHeader->phis())
+    Phi.replaceIncomingBlockWith(FirstLatch, SecondLatch);
+
+  // Second's header is now only entered from First's latch
+  Second.IndVar->eraseFromParent();
+  if (Second.Increment->use_empty())
+    Second.Increment->eraseFromParent();
+  SmallVector<BasicBlock *, 2> Dead(Between.begin(), Between.end());
+  DeleteDeadBlocks(Dead);
+}
+
+// Finds two adjacent loops worth fusing and fuses them. Returns true if it
+// changed the function.
+bool fuseNextPair(Function &F, FunctionAnalysisManager &AM, unsigned MaxPressure,
+                  SmallPtrSetImpl<const BasicBlock *> &Reported) {
+  FunctionAnalyses FA = getAnalyses(F, AM);
+  for (Loop *L : FA.LI.getLoopsInPreorder()) {
+    SmallVector<BasicBlock *, 2> Between;
+    Loop *Next = findNextLoop(L, FA.LI, Between);
+    if (!Next)
+      continue;
+
+    LoopControl First, Second;
+    if (!analyzeLoopControl(L, First) || !analyzeLoopControl(Next, Second) ||
+        !haveSameIterationSpace(First, Second))
+      continue;
+    // Other header phis of Second carry values across its iterations
+    if (std::next(Next->getHeader()->phis().begin()) !=
+            Next->getHeader()->phis().end() ||
+        L->getLoopLatch() != First.ExitBranch->getParent() ||
+        Next->getLoopLatch() != Second.ExitBranch->getParent() ||
+        !Next->getExitBlock() || !Next->getExitBlock()->getSinglePredecessor())
+      continue;
+    if (isUsedOutside(L) || !canMoveBetween(Between, L) || !shareData(L, Next))
+      continue;
+    if (L->isInnermost() && Next->isInnermost() &&
+        estimatePressure(L) + estimatePressure(Next) > MaxPressure)
+      continue;
+
+    if (!isFusionLegal(L, Next, FA)) {
+      if (Reported.insert(L->getHeader()).second)
+        FA.ORE.emit([&]() {
+          return OptimizationRemarkMissed(DEBUG_TYPE, "NotFused",
+                                          L->getStartLoc(), L->getHeader())
+                 << "loop not fused with the loop that follows it: fusion "
+                    "would reverse a dependence";
+        });
+      continue;
+    }
+
+    LLVM_DEBUG(dbgs() << "  Fusing " << L->getHeader()->getName() << " and "
+                      << Next->getHeader()->getName() << "\n");
+    FA.ORE.emit([&]() {
+      return OptimizationRemark(DEBUG_TYPE, "Fused", L->getStartLoc(),
+                                L->getHeader())
+             << "fused loop with the following loop "
+             << NV("Loop", Next->getHeader()->getName());
+    });
+    fuseLoops(First, Second, Between);
+    ++NumLoopsFused;
+    return true;
+  }
+  return false;
+}
+
+// Adds the instructions of L's only block that S depends on to Slice
+void addSlice(Instruction *S, const LoopControl &C,
+              SetVector<Instruction *> &Slice) {
+  SmallVector<Instruction *, 8> Worklist{S};
+  while (!Worklist.empty()) {
+    Instruction *I = Worklist.pop_back_val();
+    if (I == C.IndVar || !C.L->contains(I) || !Slice.insert(I))
+      continue;
+    for (Value *Op : I->operands())
+      if (auto *OpI = dyn_cast<Instruction>(Op))
+        Worklist.push_back(OpI);
+  }
+}
+
+// Fission runs every instance of the accesses of First before every
+// instance of those of Second. That reverses the dependences from Second
+// to First within one iteration of the enclosing loops.
+bool isFissionLegal(const LoopControl &C, ArrayRef<Instruction *> First,
+                    ArrayRef<Instruction *> Second, DependenceInfo &DI) {
+  unsigned Level = C.L->getLoopDepth();
+  for (Instruction *I : First) {
+    for (Instruction *J : Second) {
+      if (I == J || (!isa<StoreInst>(I) && !isa<StoreInst>(J)))
+        continue;
+
+      // Query in program order; the instance of Second is the problem if
+      // it may run first: in an earlier iteration, or in the same one
+      // before the instance of First
+      bool FirstRunsFirst = I->comesBefore(J);
+      auto D = FirstRunsFirst ? DI.depends(I, J, /*PossiblyLoopIndependent=*/true)
+                              : DI.depends(J, I, /*PossiblyLoopIndependent=*/true);
+      if (!D)
+        continue;
+      if (D->isConfused())
+        return false;
+
+      bool SameOuterIteration = true;
+      for (unsigned L = 1; L < Level && L <= D->getLevels(); ++L)
+        SameOuterIteration &= (D->getDirection(L) & Dependence::DVEntry::EQ) != 0;
+      if (!SameOuterIteration || Level > D->getLevels())
+        continue;
+
+      unsigned Dir = D->getDirection(Level);
+      unsigned Reversed = FirstRunsFirst
+                              ? Dependence::DVEntry::GT
+                              : Dependence::DVEntry::LT | Dependence::DVEntry::EQ;
+      if (Dir & Reversed) {
+        LLVM_DEBUG(dbgs() << "  Fission would reverse the dependence between "
+                          << *I << " and " << *J << "\n");
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Splits the single-block loop of C into a loop that runs the slices of
+// the stores in First and one that runs the rest, which follows it
+void splitLoop(const LoopControl &C, const SetVector<Instruction *> &First) {
+  BasicBlock *Body = C.L->getHeader();
+  BasicBlock *Preheader = C.L->getLoopPreheader();
+  BasicBlock *Exit = C.L->getExitBlock();
+  LLVMContext &Ctx = Body->getContext();
+  Function *F = Body->getParent();
+
+  ValueToValueMapTy VMap;
+  BasicBlock *SecondBody = CloneBasicBlock(Body, VMap, ".split", F);
+  auto *SecondPreheader =
+      BasicBlock::Create(Ctx, Body->getName() + ".split.ph", F, Exit);
+  SecondBody->moveAfter(SecondPreheader);
+  BranchInst::Create(SecondBody, SecondPreheader);
+  VMap[Body] = SecondBody;
+  SmallVector<BasicBlock *, 1> Cloned{SecondBody};
+  remapInstructionsInBlocks(Cloned, VMap);
+  for (PHINode &Phi : SecondBody->phis())
+    Phi.replaceIncomingBlockWith(Preheader, SecondPreheader);
+  // Loop IDs are distinct per loop; the hints applied later are per loop
+  SecondBody->getTerminator()->setMetadata(LLVMContext::MD_loop, nullptr);
+  C.ExitBranch->replaceUsesOfWith(Exit, SecondPreheader);
+
+  // Each loop keeps its own stores and what they depend on
+  SmallVector<Instruction *, 8> FirstStores, SecondStores;
+  for (Instruction &I : *Body) {
+    if (!isa<StoreInst>(I))
+      continue;
+    auto *Copy = cast<Instruction>(VMap[&I]);
+    if (First.count(&I))
+      SecondStores.push_back(Copy);
+    else
+      FirstStores.push_back(&I);
+  }
+  for (Instruction *I : concat<Instruction *>(FirstStores, SecondStores))
+    I->eraseFromParent();
+  for (BasicBlock *BB : {Body, SecondBody})
+    for (Instruction &I : make_early_inc_range(reverse(*BB)))
+      if (isInstructionTriviallyDead(&I))
+        I.eraseFromParent();
+}
+
+// Finds an innermost loop whose body needs more than MaxPressure
+// registers and splits it. Returns true if it changed the function.
+bool splitNextLoop(Function &F, FunctionAnalysisManager &AM,
+                   unsigned MaxPressure) {
+  FunctionAnalyses FA = getAnalyses(F, AM);
+  for (Loop *L : FA.LI.getLoopsInPreorder()) {
+    LoopControl C;
+    if (!L->isInnermost() || L->getNumBlocks() != 1 ||
+        !analyzeLoopControl(L, C) ||
+        std::next(L->getHeader()->phis().begin()) != L->getHeader()->phis().end())
+      continue;
+    SmallVector<Instruction *, 16> Accesses;
+    if (!collectAccesses(L, Accesses) || isUsedOutside(L) ||
+        !L->getExitBlock()->phis().empty())
+      continue;
+
+    SmallVector<Instruction *, 8> Stores;
+    for (Instruction *I : Accesses)
+      if (isa<StoreInst>(I))
+        Stores.push_back(I);
+    if (Stores.size() < 2)
+      continue;
+    unsigned Pressure = estimatePressure(L);
+    if (Pressure <= MaxPressure)
+      continue;
+
+    // The first loop takes as many stores, in program order, as fit
+    SetVector<Instruction *> First, Second;
+    addSlice(Stores.front(), C, First);
+    unsigned NumFirst = 1;
+    for (; NumFirst < Stores.size(); ++NumFirst) {
+      SetVector<Instruction *> Extended = First;
+      addSlice(Stores[NumFirst], C, Extended);
+      if (estimatePressure(Extended.getArrayRef(), L) > MaxPressure)
+        break;
+      First = std::move(Extended);
+    }
+    if (NumFirst == Stores.size())
+      continue;
+    for (Instruction *S : makeArrayRef(Stores).drop_front(NumFirst))
+      addSlice(S, C, Second);
+
+    SmallVector<Instruction *, 16> FirstAccesses, SecondAccesses;
+    for (Instruction *I : Accesses) {
+      if (First.count(I))
+        FirstAccesses.push_back(I);
+      if (Second.count(I))
+        SecondAccesses.push_back(I);
+    }
+    if (!isFissionLegal(C, FirstAccesses, SecondAccesses, FA.DI))
+      continue;
+
+    LLVM_DEBUG(dbgs() << "  Splitting " << L->getHeader()->getName() << "\n");
+    FA.ORE.emit([&]() {
+      return OptimizationRemark(DEBUG_TYPE, "Split", L->getStartLoc(),
+                                L->getHeader())
+             << "split loop after " << NV("NumStores", NumFirst) << " of "
+             << NV("TotalStores", unsigned(Stores.size()))
+             << " stores: its body keeps about "
+             << NV("Pressure", Pressure) << " values live, more than the "
+             << NV("MaxPressure", MaxPressure) << " registers available";
+    });
+    splitLoop(C, First);
+    ++NumLoopsSplit;
+    return true;
+  }
+  return false;
+}
+
+} // end anonymous namespace
+
+StringRef getLoopFusionModeName(LoopFusionMode Mode) {
+  switch (Mode) {
+  case LoopFusionMode::None:
+    return "none";
+  case LoopFusionMode::Fuse:
+    return "fuse";
+  case LoopFusionMode::Fission:
+    return "fission";
+  case LoopFusionMode::Both:
+    return "both";
+  }
+  llvm_unreachable("unknown loop fusion mode");
+}
+
+LoopFusionMode getSelectedLoopFusionMode() { return SelectedMode; }
+
+PreservedAnalyses LoopFusionPass::run(Function &F, FunctionAnalysisManager &AM) {
+  LLVM_DEBUG(dbgs() << "Running Loop Fusion Pass on function: " << F.getName()
+                    << " (" << getLoopFusionModeName(Mode) << ")\n");
+  if (Mode == LoopFusionMode::None)
+    return PreservedAnalyses::all();
+
+  unsigned Limit = MaxPressure ? MaxPressure : unsigned(MaxPressureOpt);
+  if (!Limit) {
+    auto &TTI = AM.getResult<TargetIRAnalysis>(F);
+    Limit = TTI.getNumberOfRegisters(
+        TTI.getRegisterClassForType(/*Vector=*/false));
+  }
+
+  // Fuse as far as possible first, so that fission only splits what
+  // fusion produced if it is too big
+  bool Changed = false;
+  SmallPtrSet<const BasicBlock *, 8> Reported;
+  for (unsigned N = 0; N < MaxTransformsPerFunction; ++N) {
+    bool Transformed =
+        (Mode != LoopFusionMode::Fission &&
+         fuseNextPair(F, AM, Limit, Reported)) ||
+        (Mode != LoopFusionMode::Fuse && splitNextLoop(F, AM, Limit));
+    if (!Transformed)
+      break;
+    Changed = true;
+    AM.invalidate(F, PreservedAnalyses::none());
+  }
+
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
+void registerLoopFusionPass(PassBuilder &PB, bool AddToPipelines) {
+  if (PassInstrumentationCallbacks *PIC = PB.getPassInstrumentationCallbacks())
+    PIC->addClassToPassName(LoopFusionPass::name(), "loop-fusion");
+  PB.registerAnalysisRegistrationCallback(
+      [](FunctionAnalysisManager &FAM) { registerMemoryCoalescingAnalyses(FAM); });
+  PB.registerPipelineParsingCallback(
+      [](StringRef Name, FunctionPassManager &FPM,
+         ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name == "loop-fusion") {
+          // Asking for the pass fuses and splits even without
+          // -loop-fusion-mode
+          LoopFusionMode Mode = getSelectedLoopFusionMode();
+          FPM.addPass(LoopFusionPass(Mode == LoopFusionMode::None
+                                         ? LoopFusionMode::Both
+                                         : Mode));
+          return true;
+        }
+        if (Name == "loop-fission") {
+          FPM.addPass(LoopFusionPass(LoopFusionMode::Fission));
+          return true;
+        }
+        return false;
+      });
+
+  if (!AddToPipelines)
+    return;
+  PB.registerPipelineStartEPCallback(
+      [](ModulePassManager &MPM, OptimizationLevel) {
+        FunctionPassManager FPM;
+        FPM.addPass(LoopSimplifyPass());
+        FPM.addPass(LoopFusionPass());
+        MPM.addPass(createModuleToFunctionPassAdaptor(std::move(FPM)));
+      });
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,73 @@
+//===- LoopFusion.h - Producer-Consumer Loop Fusion and Fission -----===//
+//
+// This file defines a pass that fuses adjacent loops with the same
+// iteration space, such as a convolution nest followed by the bias-add
+// and activation loops over its output, so that the values one loop
+// produces are consumed while they are still in registers or in L1:
+//
+//   for i, for j: O[i][j] = conv       for i, for j:
+//   for i, for j: O[i][j] += b[j]  =>     O[i][j] = conv
+//   for i, for j: O[i][j] = relu(..)      O[i][j] += b[j]
+//                                         O[i][j] = relu(O[i][j])
+//
+// Fusion works one loop level at a time, outermost first, so nests of
+// different depth are fused down to their common iteration space. In the
+// opposite direction, its fission mode splits innermost loops whose
+// bodies would need more registers than the target has into loops over
+// groups of their stores.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_PASSES_LOOP_FUSION_H
+#define MLCOMPILEROPT_PASSES_LOOP_FUSION_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+class PassBuilder;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+enum class LoopFusionMode {
+  None,    // Leave loops as they are
+  Fuse,    // Only fuse adjacent loops
+  Fission, // Only split loops with too many live values
+  Both,    // Fuse, then split what fusion could not keep in registers
+};
+
+// Command-line name of Mode, e.g. "fission"
+llvm::StringRef getLoopFusionModeName(LoopFusionMode Mode);
+
+// Mode selected with -loop-fusion-mode, None by default
+LoopFusionMode getSelectedLoopFusionMode();
+
+class LoopFusionPass : public llvm::PassInfoMixin<LoopFusionPass> {
+public:
+  // MaxPressure is the register budget of a loop body; 0 selects
+  // -loop-fission-max-pressure, or the target's number of registers
+  explicit LoopFusionPass(LoopFusionMode Mode = getSelectedLoopFusionMode(),
+                          unsigned MaxPressure = 0)
+      : Mode(Mode), MaxPressure(MaxPressure) {}
+
+  llvm::PreservedAnalyses run(llvm::Function &F,
+                              llvm::FunctionAnalysisManager &AM);
+
+  static bool isRequired() { return true; }
+
+private:
+  LoopFusionMode Mode;
+  unsigned MaxPressure;
+};
+
+// Makes the pass available to PB as "loop-fusion", in the selected mode or
+// both, and as "loop-fission" in fission mode, and, if AddToPipelines, adds
+// it after LoopSimplify to the start of the default pipelines. Register it
+// before the loop tiling pass, so that fused nests are tiled rather than
+// tiled nests fused.
+void registerLoopFusionPass(llvm::PassBuilder &PB, bool AddToPipelines);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_PASSES_LOOP_FUSION_H
@@ -0,0 +1,357 @@
+//===- LoopNest.cpp - Loop Nest Utilities ---------------------------===//
+//
+// Implementation of the canonical loop recognition, perfect band
+// discovery and loop interchange helpers.
+//
+//===----------------------------------------------------------------===//
+
+#include "passes/LoopNest.h"
+
+#include "llvm/Analysis/DependenceAnalysis.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#define DEBUG_TYPE "loop-nest"
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+// Operand index of the induction variable side of the exit compare
+unsigned getIndVarOperand(const LoopControl &C) {
+  Value *Op0 = C.Compare->getOperand(0);
+  return (Op0 == C.IndVar || Op0 == C.Increment) ? 0 : 1;
+}
+
+// True if the exit branch leaves the loop when the compare is true
+bool exitsOnTrue(const LoopControl &C) {
+  return !C.L->contains(C.ExitBranch->getSuccessor(0));
+}
+
+unsigned getStepOperand(const LoopControl &C) {
+  return C.Increment->getOperand(0) == C.IndVar ? 1 : 0;
+}
+
+// Returns true if every instruction of L outside of Child belongs to the
+// control of L
+bool hasOnlyControlOutside(Loop *L, Loop *Child, const LoopControl &C) {
+  for (BasicBlock *BB : L->blocks()) {
+    if (Child->contains(BB))
+      continue;
+    for (Instruction &I : *BB)
+      if (!C.isControlInstruction(&I))
+        return false;
+  }
+  return true;
+}
+
+// Bound that lets the exit test of C compare the incremented induction
+// variable instead of the induction variable, or null if the test cannot
+// be rewritten. instcombine gives loops with a constant bound the latter
+// form, but leaves the tests against other bounds alone.
+ConstantInt *getIncrementedBound(const LoopControl &C) {
+  auto *Bound = dyn_cast<ConstantInt>(C.Bound);
+  if (!Bound || C.ComparesIncrement || C.ExitsFromHeader ||
+      C.Step->isNegative())
+    return nullptr;
+  bool Overflow;
+  APInt NewBound;
+  if (C.ContinuePred == CmpInst::ICMP_ULT && C.Increment->hasNoUnsignedWrap())
+    NewBound = Bound->getValue().uadd_ov(C.Step->getValue(), Overflow);
+  else if (C.ContinuePred == CmpInst::ICMP_SLT &&
+           C.Increment->hasNoSignedWrap())
+    NewBound = Bound->getValue().sadd_ov(C.Step->getValue(), Overflow);
+  else
+    return nullptr;
+  return Overflow ? nullptr : ConstantInt::get(Bound->getContext(), NewBound);
+}
+
+// Returns true if V can be used at the end of BB
+bool isAvailableAt(Value *V, BasicBlock *BB, DominatorTree &DT) {
+  auto *I = dyn_cast<Instruction>(V);
+  return !I || DT.dominates(I, BB->getTerminator());
+}
+
+} // end anonymous namespace
+
+bool LoopControl::isControlInstruction(const Instruction *I) const {
+  if (I == IndVar || I == Increment || I == Compare || I == ExitBranch)
+    return true;
+  auto *Br = dyn_cast<BranchInst>(I);
+  return Br && Br->isUnconditional();
+}
+
+void LoopControl::setExitTest(CmpInst::Predicate NewPred, Value *NewBound) {
+  unsigned IVOp = getIndVarOperand(*this);
+  CmpInst::Predicate Pred = NewPred;
+  if (exitsOnTrue(*this))
+    Pred = CmpInst::getInversePredicate(Pred);
+  if (IVOp == 1)
+    Pred = CmpInst::getSwappedPredicate(Pred);
+  Compare->setPredicate(Pred);
+  Compare->setOperand(1 - IVOp, NewBound);
+  ContinuePred = NewPred;
+  Bound = NewBound;
+}
+
+bool analyzeLoopControl(Loop *L, LoopControl &Control) {
+  BasicBlock *Header = L->getHeader();
+  BasicBlock *Preheader = L->getLoopPreheader();
+  BasicBlock *Latch = L->getLoopLatch();
+  BasicBlock *Exiting = L->getExitingBlock();
+  if (!Preheader || !Latch || !Exiting || !L->getExitBlock())
+    return false;
+  if (Exiting != Header && Exiting != Latch)
+    return false;
+
+  auto *Br = dyn_cast<BranchInst>(Exiting->getTerminator());
+  if (!Br || !Br->isConditional())
+    return false;
+  auto *Cmp = dyn_cast<ICmpInst>(Br->getCondition());
+  if (!Cmp || !Cmp->hasOneUse() || Cmp->getParent() != Exiting)
+    return false;
+
+  for (PHINode &Phi : Header->phis()) {
+    if (!Phi.getType()->isIntegerTy() || Phi.getNumIncomingValues() != 2)
+      continue;
+    auto *Inc = dyn_cast<BinaryOperator>(Phi.getIncomingValueForBlock(Latch));
+    if (!Inc || Inc->getOpcode() != Instruction::Add || !L->contains(Inc))
+      continue;
+
+    Value *StepVal = nullptr;
+    if (Inc->getOperand(0) == &Phi)
+      StepVal = Inc->getOperand(1);
+    else if (Inc->getOperand(1) == &Phi)
+      StepVal = Inc->getOperand(0);
+    auto *Step = dyn_cast_or_null<ConstantInt>(StepVal);
+    if (!Step || Step->isZero())
+      continue;
+
+    unsigned IVOp;
+    if (Cmp->getOperand(0) == &Phi || Cmp->getOperand(0) == Inc)
+      IVOp = 0;
+    else if (Cmp->getOperand(1) == &Phi || Cmp->getOperand(1) == Inc)
+      IVOp = 1;
+    else
+      continue;
+
+    Value *Bound = Cmp->getOperand(1 - IVOp);
+    if (!L->isLoopInvariant(Bound))
+      continue;
+
+    Control.L = L;
+    Control.IndVar = &Phi;
+    Control.Increment = Inc;
+    Control.Compare = Cmp;
+    Control.ExitBranch = Br;
+    Control.Start = Phi.getIncomingValueForBlock(Preheader);
+    Control.Step = Step;
+    Control.Bound = Bound;
+    Control.ComparesIncrement = Cmp->getOperand(IVOp) == Inc;
+    // A single-block loop runs its body before the test, like a do-while
+    Control.ExitsFromHeader = Exiting == Header && Header != Latch;
+
+    CmpInst::Predicate Pred = Cmp->getPredicate();
+    if (IVOp == 1)
+      Pred = CmpInst::getSwappedPredicate(Pred);
+    if (exitsOnTrue(Control))
+      Pred = CmpInst::getInversePredicate(Pred);
+    Control.ContinuePred = Pred;
+    return true;
+  }
+  return false;
+}
+
+void getPerfectLoopBand(Loop *Innermost, SmallVectorImpl<LoopControl> &Band) {
+  Band.clear();
+
+  LoopControl C;
+  if (!Innermost->getSubLoops().empty() || !analyzeLoopControl(Innermost, C))
+    return;
+  // Any other header phi carries a value across iterations
+  if (&*Innermost->getHeader()->phis().begin() != C.IndVar ||
+      std::next(Innermost->getHeader()->phis().begin()) !=
+          Innermost->getHeader()->phis().end())
+    return;
+
+  SmallVector<LoopControl, 4> InnerToOuter{C};
+  Loop *Child = Innermost;
+  for (Loop *Parent = Child->getParentLoop(); Parent;
+       Child = Parent, Parent = Parent->getParentLoop()) {
+    LoopControl PC;
+    if (Parent->getSubLoops().size() != 1 || !analyzeLoopControl(Parent, PC))
+      break;
+    if (!hasOnlyControlOutside(Parent, Child, PC))
+      break;
+
+    // The iteration space has to be rectangular for the loops to be
+    // reordered freely
+    bool Rectangular = llvm::all_of(InnerToOuter, [&](const LoopControl &X) {
+      return Parent->isLoopInvariant(X.Start) &&
+             Parent->isLoopInvariant(X.Bound);
+    });
+    if (!Rectangular)
+      break;
+
+    InnerToOuter.push_back(PC);
+  }
+
+  Band.append(InnerToOuter.rbegin(), InnerToOuter.rend());
+}
+
+bool isInterchangeLegal(ArrayRef<LoopControl> Band, unsigned OuterIdx,
+                        unsigned InnerIdx, DependenceInfo &DI) {
+  SmallVector<Instruction *, 16> MemInsts;
+  for (BasicBlock *BB : Band.front().L->blocks()) {
+    for (Instruction &I : *BB) {
+      if (!I.mayReadOrWriteMemory())
+        continue;
+      auto *LI = dyn_cast<LoadInst>(&I);
+      auto *SI = dyn_cast<StoreInst>(&I);
+      if ((!LI || !LI->isSimple()) && (!SI || !SI->isSimple())) {
+        LLVM_DEBUG(dbgs() << "  Interchange blocked by " << I << "\n");
+        return false;
+      }
+      MemInsts.push_back(&I);
+    }
+  }
+
+  unsigned OuterLevel = Band[OuterIdx].L->getLoopDepth();
+  unsigned InnerLevel = Band[InnerIdx].L->getLoopDepth();
+
+  for (unsigned I = 0, E = MemInsts.size(); I != E; ++I) {
+    for (unsigned J = I; J != E; ++J) {
+      Instruction *Src = MemInsts[I];
+      Instruction *Dst = MemInsts[J];
+      if (!isa<StoreInst>(Src) && !isa<StoreInst>(Dst))
+        continue;
+
+      auto D = DI.depends(Src, Dst, /*PossiblyLoopIndependent=*/true);
+      if (!D)
+        continue;
+      if (D->isConfused()) {
+        LLVM_DEBUG(dbgs() << "  Confused dependence between " << *Src
+                          << " and " << *Dst << "\n");
+        return false;
+      }
+
+      // Walk the direction vector in the new loop order. The dependence
+      // stays satisfied as long as no level may run backwards before the
+      // first level that is strictly forward.
+      for (unsigned Pos = 1; Pos <= D->getLevels(); ++Pos) {
+        unsigned Level = Pos;
+        if (Pos == OuterLevel)
+          Level = InnerLevel;
+        else if (Pos == InnerLevel)
+          Level = OuterLevel;
+        if (Level > D->getLevels())
+          break;
+
+        unsigned Dir = D->getDirection(Level);
+        if (Dir & Dependence::DVEntry::GT) {
+          LLVM_DEBUG(dbgs() << "  Interchange would reverse the dependence "
+                            << *Src << " -> " << *Dst << "\n");
+          return false;
+        }
+        if (Dir == Dependence::DVEntry::LT)
+          break;
+      }
+    }
+  }
+  return true;
+}
+
+bool interchangeLoops(LoopControl &Outer, LoopControl &Inner,
+                      ScalarEvolution &SE, DominatorTree &DT) {
+  if (Outer.IndVar->getType() != Inner.IndVar->getType() ||
+      Outer.ExitsFromHeader != Inner.ExitsFromHeader)
+    return false;
+
+  // Loops whose tests compare different values are brought to the same
+  // form once the interchange is known to go ahead
+  LoopControl *Retested = nullptr;
+  ConstantInt *RetestedBound = nullptr;
+  if (Outer.ComparesIncrement != Inner.ComparesIncrement) {
+    Retested = Outer.ComparesIncrement ? &Inner : &Outer;
+    RetestedBound = getIncrementedBound(*Retested);
+    if (!RetestedBound)
+      return false;
+  }
+
+  // The incremented values may only feed the control itself
+  for (LoopControl *C : {&Outer, &Inner})
+    for (User *U : C->Increment->users())
+      if (U != C->IndVar && U != C->Compare)
+        return false;
+
+  // Collect the body uses of both induction variables. They all have to be
+  // inside the inner loop, where both are available.
+  SmallVector<Use *, 8> OuterUses, InnerUses;
+  for (auto Entry : {std::make_pair(&Outer, &OuterUses),
+                     std::make_pair(&Inner, &InnerUses)}) {
+    LoopControl *C = Entry.first;
+    for (Use &U : C->IndVar->uses()) {
+      auto *UserInst = cast<Instruction>(U.getUser());
+      if (C->isControlInstruction(UserInst))
+        continue;
+      if (!Inner.L->contains(UserInst))
+        return false;
+      Entry.second->push_back(&U);
+    }
+  }
+
+  // The inner loop's start and bound move to the outer loop's control
+  BasicBlock *OuterPreheader = Outer.L->getLoopPreheader();
+  if (!isAvailableAt(Inner.Start, OuterPreheader, DT) ||
+      !isAvailableAt(Inner.Bound, OuterPreheader, DT))
+    return false;
+
+  LLVM_DEBUG(dbgs() << "  Interchanging loops " << Outer.L->getHeader()->getName()
+                    << " and " << Inner.L->getHeader()->getName() << "\n");
+
+  if (Retested) {
+    Retested->Compare->setOperand(getIndVarOperand(*Retested),
+                                  Retested->Increment);
+    Retested->ComparesIncrement = true;
+    Retested->setExitTest(Retested->ContinuePred, RetestedBound);
+  }
+
+  // Exchange the iteration spaces
+  Value *OuterStart = Outer.Start;
+  Outer.IndVar->setIncomingValueForBlock(OuterPreheader, Inner.Start);
+  Inner.IndVar->setIncomingValueForBlock(Inner.L->getLoopPreheader(), OuterStart);
+  std::swap(Outer.Start, Inner.Start);
+
+  ConstantInt *OuterStep = Outer.Step;
+  Outer.Increment->setOperand(getStepOperand(Outer), Inner.Step);
+  Inner.Increment->setOperand(getStepOperand(Inner), OuterStep);
+  std::swap(Outer.Step, Inner.Step);
+
+  bool OuterNSW = Outer.Increment->hasNoSignedWrap();
+  bool OuterNUW = Outer.Increment->hasNoUnsignedWrap();
+  Outer.Increment->setHasNoSignedWrap(Inner.Increment->hasNoSignedWrap());
+  Outer.Increment->setHasNoUnsignedWrap(Inner.Increment->hasNoUnsignedWrap());
+  Inner.Increment->setHasNoSignedWrap(OuterNSW);
+  Inner.Increment->setHasNoUnsignedWrap(OuterNUW);
+
+  CmpInst::Predicate OuterPred = Outer.ContinuePred;
+  Value *OuterBound = Outer.Bound;
+  Outer.setExitTest(Inner.ContinuePred, Inner.Bound);
+  Inner.setExitTest(OuterPred, OuterBound);
+
+  // The body now sees the outer iteration variable in the inner loop and
+  // vice versa
+  for (Use *U : OuterUses)
+    U->set(Inner.IndVar);
+  for (Use *U : InnerUses)
+    U->set(Outer.IndVar);
+
+  SE.forgetLoop(Outer.L);
+  return true;
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,93 @@
+//===- LoopNest.h - Loop Nest Utilities -----------------------------===//
+//
+// This file declares helpers shared by the loop transformations in this
+// directory: recognition of loops controlled by a single canonical
+// induction variable, discovery of perfectly nested loop bands and loop
+// interchange within such a band.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_PASSES_LOOP_NEST_H
+#define MLCOMPILEROPT_PASSES_LOOP_NEST_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Instructions.h"
+
+namespace llvm {
+class DependenceInfo;
+class DominatorTree;
+class ScalarEvolution;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+// Control structure of a loop driven by one integer induction variable:
+//
+//   header:  %iv = phi [Start, preheader], [Increment, latch]
+//            ...
+//   exiting: %c = icmp pred (%iv | Increment), Bound
+//            br %c, ...
+//   latch:   Increment = add %iv, Step
+//
+// The exiting block is either the header (while loop) or the latch
+// (do-while loop). The exit test is described by ContinuePred, the
+// predicate that keeps the loop running when the induction variable side
+// is its left operand; the IR itself is left in whatever form it was.
+struct LoopControl {
+  llvm::Loop *L = nullptr;
+  llvm::PHINode *IndVar = nullptr;
+  llvm::BinaryOperator *Increment = nullptr;
+  llvm::ICmpInst *Compare = nullptr;
+  llvm::BranchInst *ExitBranch = nullptr;
+  llvm::Value *Start = nullptr;
+  llvm::ConstantInt *Step = nullptr;
+  llvm::Value *Bound = nullptr;
+  llvm::CmpInst::Predicate ContinuePred = llvm::CmpInst::BAD_ICMP_PREDICATE;
+
+  // True if the compare tests Increment rather than IndVar
+  bool ComparesIncrement = false;
+
+  // True if the exit test is in the header rather than in the latch
+  bool ExitsFromHeader = false;
+
+  // Returns true if I is part of the loop control rather than the body
+  bool isControlInstruction(const llvm::Instruction *I) const;
+
+  // Rewrites the exit test to continue while "IV ContinuePred Bound"
+  void setExitTest(llvm::CmpInst::Predicate ContinuePred, llvm::Value *Bound);
+};
+
+// Recognizes the control structure of L. Returns false when L does not
+// have the expected shape.
+bool analyzeLoopControl(llvm::Loop *L, LoopControl &Control);
+
+// Collects the perfectly nested band that ends at Innermost, outermost
+// loop first. Every loop in the band is in canonical form, every loop but
+// the innermost contains nothing besides its control and its only child,
+// and the bounds of all loops are invariant in the whole band. The band
+// always contains at least Innermost if it is in canonical form, and is
+// empty otherwise.
+void getPerfectLoopBand(llvm::Loop *Innermost,
+                        llvm::SmallVectorImpl<LoopControl> &Band);
+
+// Checks with dependence analysis whether swapping Band[OuterIdx] and
+// Band[InnerIdx] preserves every dependence between memory accesses in
+// the band.
+bool isInterchangeLegal(llvm::ArrayRef<LoopControl> Band, unsigned OuterIdx,
+                        unsigned InnerIdx, llvm::DependenceInfo &DI);
+
+// Interchanges two loops of a perfect band by exchanging their iteration
+// spaces: the start, step, bound and predicate of the two loops are
+// swapped and so are the uses of the induction variables in the loop body.
+// The CFG and the loop structure stay unchanged. If only one of the loops
+// tests its incremented induction variable, the test of the other one is
+// rewritten to do the same. Returns false without modifying the IR if the
+// two loops' controls cannot be exchanged.
+bool interchangeLoops(LoopControl &Outer, LoopControl &Inner,
+                      llvm::ScalarEvolution &SE, llvm::DominatorTree &DT);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_PASSES_LOOP_NEST_H
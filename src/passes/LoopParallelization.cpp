@@ -0,0 +1,595 @@
+//===- LoopParallelization.cpp - Multicore Loop Parallelization -----===//
+//
+// Implementation of the legality check and the outlining of parallel
+// loops. All loops of a function are checked before the first one is
+// outlined; the analyses are recomputed after every outlined loop.
+//
+//===----------------------------------------------------------------===//
+
+#include "passes/LoopParallelization.h"
+#include "passes/TuningConfig.h"
+#include "runtime/ParallelRuntime.h"
+
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/DependenceAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/LoopSimplify.h"
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#define DEBUG_TYPE "loop-parallelize"
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+using ore::NV;
+
+namespace mlcompileropt {
+
+ALWAYS_ENABLED_STATISTIC(NumLoopsParallelized, "Number of loops parallelized");
+ALWAYS_ENABLED_STATISTIC(NumLoopsRejected,
+                         "Number of outermost loops not parallelized");
+
+namespace {
+
+cl::opt<ParallelSchedule> SelectedSchedule(
+    "loop-parallelize", cl::init(ParallelSchedule::None),
+    cl::desc("Run dependence-free outermost loops on a thread pool of the "
+             "parallel loop runtime, which the program has to be linked "
+             "against"),
+    cl::values(clEnumValN(ParallelSchedule::None, "none",
+                          "only functions with a parallel tuning parameter"),
+               clEnumValN(ParallelSchedule::Static, "static",
+                          "one block of iterations per thread"),
+               clEnumValN(ParallelSchedule::Dynamic, "dynamic",
+                          "chunks of iterations balanced by work stealing")));
+
+cl::opt<unsigned> ChunkOpt(
+    "loop-parallelize-chunk", cl::init(0),
+    cl::desc("Iterations per chunk of parallelized loops (default: one "
+             "block per thread for static, an eighth of that for dynamic)"));
+
+cl::opt<unsigned> MinTripCountOpt(
+    "loop-parallelize-min-trip-count", cl::init(4), cl::Hidden,
+    cl::desc("Smallest constant trip count of a loop worth parallelizing"));
+
+// Name of the entry point of the parallel loop runtime
+const char *const ParallelForName = "__ml_parallel_for";
+
+// Induction variable of the loop: a header phi that takes the values
+// Start + t * Step in iteration t
+struct InductionVariable {
+  PHINode *Phi;
+  const SCEV *Start;
+  const SCEV *Step;
+};
+
+// Loop that can be parallelized, with everything the outlining needs
+struct ParallelLoop {
+  Loop *L;
+  const SCEV *BackedgeTakenCount;
+  SmallVector<InductionVariable, 2> IndVars;
+};
+
+// Checks the shape of L and collects its induction variables. Returns the
+// reason if L cannot be outlined.
+Optional<StringRef> analyzeLoopShape(Loop *L, ScalarEvolution &SE,
+                                     ParallelLoop &PL) {
+  PL.L = L;
+  if (!L->isLoopSimplifyForm())
+    return StringRef("it is not in simplified form");
+  BasicBlock *Latch = L->getLoopLatch();
+  auto *LatchBranch = dyn_cast<BranchInst>(Latch->getTerminator());
+  if (L->getExitingBlock() != Latch || !LatchBranch ||
+      !LatchBranch->isConditional())
+    return StringRef("it does not exit from its latch only");
+
+  PL.BackedgeTakenCount = SE.getBackedgeTakenCount(L);
+  if (isa<SCEVCouldNotCompute>(PL.BackedgeTakenCount) ||
+      SE.getTypeSizeInBits(PL.BackedgeTakenCount->getType()) > 64)
+    return StringRef("its trip count is unknown");
+  unsigned TripCount = SE.getSmallConstantTripCount(L);
+  if (TripCount && TripCount < MinTripCountOpt)
+    return StringRef("it runs too few iterations");
+
+  PL.IndVars.clear();
+  for (PHINode &Phi : L->getHeader()->phis()) {
+    const auto *AR = SE.isSCEVable(Phi.getType())
+                         ? dyn_cast<SCEVAddRecExpr>(SE.getSCEV(&Phi))
+                         : nullptr;
+    if (!AR || AR->getLoop() != L || !AR->isAffine() ||
+        SE.getTypeSizeInBits(Phi.getType()) > 64)
+      return StringRef("a value is carried from one iteration to the next");
+    PL.IndVars.push_back({&Phi, AR->getStart(), AR->getStepRecurrence(SE)});
+  }
+  return None;
+}
+
+// Checks that the iterations of L are independent. Returns the reason if
+// they may not be.
+Optional<StringRef> analyzeIndependence(Loop *L, DependenceInfo &DI) {
+  SmallVector<Instruction *, 16> MemInsts;
+  for (BasicBlock *BB : L->blocks()) {
+    for (Instruction &I : *BB) {
+      // Results of the loop would have to be collected from all threads
+      for (User *U : I.users())
+        if (!L->contains(cast<Instruction>(U)))
+          return StringRef("a value computed in it is used after it");
+
+      if (auto *CB = dyn_cast<CallBase>(&I))
+        if (CB->isConvergent() || CB->cannotDuplicate() || CB->mayThrow())
+          return StringRef("it contains a call that cannot be outlined");
+      if (!I.mayReadOrWriteMemory())
+        continue;
+      auto *LI = dyn_cast<LoadInst>(&I);
+      auto *SI = dyn_cast<StoreInst>(&I);
+      if ((!LI || !LI->isSimple()) && (!SI || !SI->isSimple())) {
+        LLVM_DEBUG(dbgs() << "  Parallelization blocked by " << I << "\n");
+        return StringRef("it contains an instruction with side effects");
+      }
+      MemInsts.push_back(&I);
+    }
+  }
+
+  for (unsigned I = 0, E = MemInsts.size(); I != E; ++I) {
+    for (unsigned J = I; J != E; ++J) {
+      Instruction *Src = MemInsts[I];
+      Instruction *Dst = MemInsts[J];
+      if (!isa<StoreInst>(Src) && !isa<StoreInst>(Dst))
+        continue;
+
+      auto D = DI.depends(Src, Dst, /*PossiblyLoopIndependent=*/true);
+      if (!D)
+        continue;
+      if (D->isConfused()) {
+        LLVM_DEBUG(dbgs() << "  Confused dependence between " << *Src
+                          << " and " << *Dst << "\n");
+        return StringRef("the dependences of its accesses are unknown");
+      }
+      // L is outermost, so it is level 1 of every dependence in it
+      if (D->getLevels() >= 1 &&
+          D->getDirection(1) != Dependence::DVEntry::EQ) {
+        LLVM_DEBUG(dbgs() << "  Loop-carried dependence " << *Src << " -> "
+                          << *Dst << "\n");
+        return StringRef("an iteration depends on another one");
+      }
+    }
+  }
+  return None;
+}
+
+// Declaration of __ml_parallel_for in M
+FunctionCallee getParallelFor(Module &M) {
+  LLVMContext &Ctx = M.getContext();
+  Type *I64 = Type::getInt64Ty(Ctx);
+  Type *BytePtr = Type::getInt8PtrTy(Ctx);
+  FunctionType *BodyTy =
+      FunctionType::get(Type::getVoidTy(Ctx), {I64, I64, BytePtr}, false);
+  FunctionType *Ty = FunctionType::get(
+      Type::getVoidTy(Ctx),
+      {I64, I64, BodyTy->getPointerTo(), BytePtr, Type::getInt32Ty(Ctx), I64},
+      false);
+  FunctionCallee Callee = M.getOrInsertFunction(ParallelForName, Ty);
+  if (auto *Decl = dyn_cast<Function>(Callee.getCallee()))
+    Decl->addFnAttr(Attribute::NoUnwind);
+  return Callee;
+}
+
+// Copies the attributes of F's argument ArgNo that still hold for the
+// same pointer passed to an outlined function
+void copyParamAttributes(const Function &F, unsigned ArgNo, Function &To,
+                         unsigned ToArgNo) {
+  for (Attribute::AttrKind Kind :
+       {Attribute::NoAlias, Attribute::NonNull, Attribute::NoCapture,
+        Attribute::ReadOnly, Attribute::ReadNone, Attribute::WriteOnly,
+        Attribute::NoUndef, Attribute::Alignment, Attribute::Dereferenceable,
+        Attribute::DereferenceableOrNull}) {
+    Attribute Attr = F.getParamAttribute(ArgNo, Kind);
+    if (Attr.isValid())
+      To.addParamAttr(ToArgNo, Attr);
+  }
+}
+
+// Memory and synchronization attributes that no longer hold for a
+// function that calls the runtime; they are inferred again later
+const Attribute::AttrKind CallerOnlyAttributes[] = {
+    Attribute::NoSync,   Attribute::ArgMemOnly,
+    Attribute::ReadNone, Attribute::ReadOnly,
+    Attribute::WriteOnly, Attribute::InaccessibleMemOrArgMemOnly};
+
+// Creates an internal function called Name of type Ty in the module of F,
+// with F's function attributes and marked as a parallel body
+Function *createOutlinedFunction(Function &F, FunctionType *Ty,
+                                 const Twine &Name) {
+  Function *New = Function::Create(Ty, GlobalValue::InternalLinkage, Name,
+                                   F.getParent());
+  New->setAttributes(AttributeList::get(
+      F.getContext(), F.getAttributes().getFnAttrs(), AttributeSet(), {}));
+  New->removeFnAttr(Attribute::AlwaysInline);
+  for (Attribute::AttrKind Kind : CallerOnlyAttributes)
+    New->removeFnAttr(Kind);
+  New->addFnAttr(ParallelBodyAttributeName);
+  return New;
+}
+
+// Outlines the loop of PL and replaces it with a call of the runtime
+void parallelizeLoop(const ParallelLoop &PL, ParallelSchedule Schedule,
+                     unsigned Chunk, ScalarEvolution &SE) {
+  Loop *L = PL.L;
+  Function &F = *L->getHeader()->getParent();
+  Module &M = *F.getParent();
+  LLVMContext &Ctx = F.getContext();
+  const DataLayout &DL = M.getDataLayout();
+  BasicBlock *Preheader = L->getLoopPreheader();
+  BasicBlock *Header = L->getHeader();
+  BasicBlock *Latch = L->getLoopLatch();
+  BasicBlock *Exit = L->getExitBlock();
+  Type *I64 = Type::getInt64Ty(Ctx);
+
+  // 1. Compute the trip count and the induction variables' start and step
+  // in the preheader; they are passed to the body like the other values
+  // defined outside the loop.
+  SCEVExpander Expander(SE, DL, "parallel");
+  Instruction *InsertPt = Preheader->getTerminator();
+  Value *TripCount = Expander.expandCodeFor(
+      SE.getAddExpr(SE.getZeroExtendExpr(PL.BackedgeTakenCount, I64),
+                    SE.getOne(I64)),
+      I64, InsertPt);
+  SmallVector<std::pair<Value *, Value *>, 2> StartSteps;
+  for (const InductionVariable &IV : PL.IndVars) {
+    Type *StepTy = IV.Step->getType();
+    StartSteps.push_back(
+        {Expander.expandCodeFor(IV.Start, IV.Phi->getType(), InsertPt),
+         Expander.expandCodeFor(IV.Step, StepTy, InsertPt)});
+  }
+
+  SetVector<Value *> Inputs;
+  for (auto &StartStep : StartSteps)
+    for (Value *V : {StartStep.first, StartStep.second})
+      if (!isa<Constant>(V))
+        Inputs.insert(V);
+  for (BasicBlock *BB : L->blocks())
+    for (Instruction &I : *BB) {
+      if (I.getParent() == Header && isa<PHINode>(I))
+        continue;
+      for (Value *Op : I.operands())
+        if ((isa<Instruction>(Op) &&
+             !L->contains(cast<Instruction>(Op)->getParent())) ||
+            isa<Argument>(Op))
+          Inputs.insert(Op);
+    }
+
+  // 2. Outline the loop into F.parallel.body(begin, end, inputs...), where
+  // a chunk loop replaces the control of the original loop
+  SmallVector<Type *, 8> BodyParams{I64, I64};
+  for (Value *V : Inputs)
+    BodyParams.push_back(V->getType());
+  Function *Body = createOutlinedFunction(
+      F, FunctionType::get(Type::getVoidTy(Ctx), BodyParams, false),
+      F.getName() + ".parallel.body");
+  Argument *Begin = Body->getArg(0);
+  Argument *End = Body->getArg(1);
+  Begin->setName("begin");
+  End->setName("end");
+
+  ValueToValueMapTy VMap;
+  for (unsigned I = 0, E = Inputs.size(); I != E; ++I) {
+    Argument *Arg = Body->getArg(I + 2);
+    Arg->setName(Inputs[I]->getName());
+    VMap[Inputs[I]] = Arg;
+    if (auto *FArg = dyn_cast<Argument>(Inputs[I]))
+      copyParamAttributes(F, FArg->getArgNo(), *Body, I + 2);
+  }
+  auto Map = [&](Value *V) -> Value * {
+    auto It = VMap.find(V);
+    return It == VMap.end() ? V : static_cast<Value *>(It->second);
+  };
+
+  auto *BodyEntry = BasicBlock::Create(Ctx, "entry", Body);
+  auto *ChunkHeader = BasicBlock::Create(Ctx, "chunk", Body);
+  IRBuilder<> B(BodyEntry);
+  // The runtime only runs non-empty chunks of [0, TripCount). Bounding the
+  // chunk by a constant trip count keeps the subscripts of the body within
+  // their array dimensions for dependence analysis, so loop interchange can
+  // still reorder the outlined nest
+  Value *ChunkBegin = Begin;
+  Value *ChunkEnd = End;
+  if (auto *ConstTripCount = dyn_cast<ConstantInt>(TripCount)) {
+    ChunkBegin = B.CreateBinaryIntrinsic(
+        Intrinsic::umin, Begin,
+        B.getInt64(ConstTripCount->getZExtValue() - 1), nullptr,
+        "begin.bounded");
+    ChunkEnd = B.CreateBinaryIntrinsic(Intrinsic::umin, End, ConstTripCount,
+                                       nullptr, "end.bounded");
+  }
+  B.CreateBr(ChunkHeader);
+
+  B.SetInsertPoint(ChunkHeader);
+  PHINode *Iteration = B.CreatePHI(I64, 2, "iteration");
+  Iteration->addIncoming(ChunkBegin, BodyEntry);
+  SmallVector<Value *, 2> IVs;
+  for (unsigned I = 0, E = PL.IndVars.size(); I != E; ++I) {
+    PHINode *Phi = PL.IndVars[I].Phi;
+    Value *Start = Map(StartSteps[I].first);
+    Value *Step = Map(StartSteps[I].second);
+    // Unit-step counters from 0 become the chunk loop's own counter, which
+    // keeps the nest perfect for loop tiling
+    Value *Offset = B.CreateZExtOrTrunc(Iteration, Step->getType());
+    if (!match(Step, m_One()))
+      Offset = B.CreateMul(Offset, Step);
+    Value *IV;
+    if (match(Start, m_Zero()) && Phi->getType() == Offset->getType()) {
+      IV = Offset;
+    } else if (Phi->getType()->isPointerTy()) {
+      Type *BytePtrTy =
+          B.getInt8PtrTy(Phi->getType()->getPointerAddressSpace());
+      IV = B.CreateGEP(B.getInt8Ty(), B.CreateBitCast(Start, BytePtrTy),
+                       Offset);
+      IV = B.CreateBitCast(IV, Phi->getType(), Phi->getName());
+    } else {
+      IV = B.CreateAdd(Start, Offset, Phi->getName());
+    }
+    IVs.push_back(IV);
+  }
+
+  SmallVector<BasicBlock *, 8> Blocks;
+  for (BasicBlock *BB : L->blocks()) {
+    BasicBlock *Clone = CloneBasicBlock(BB, VMap, ".body", Body);
+    VMap[BB] = Clone;
+    Blocks.push_back(Clone);
+  }
+  B.CreateBr(cast<BasicBlock>(VMap[Header]));
+
+  auto *ChunkLatch = BasicBlock::Create(Ctx, "chunk.latch", Body);
+  auto *BodyExit = BasicBlock::Create(Ctx, "exit", Body);
+  B.SetInsertPoint(ChunkLatch);
+  Value *Next = B.CreateAdd(Iteration, B.getInt64(1), "iteration.next");
+  B.CreateCondBr(B.CreateICmpULT(Next, ChunkEnd), ChunkHeader, BodyExit);
+  Iteration->addIncoming(Next, ChunkLatch);
+  B.SetInsertPoint(BodyExit);
+  B.CreateRetVoid();
+
+  // The header phis are replaced by the values computed in the chunk
+  // header, and the latch continues with the chunk loop
+  auto *ClonedHeader = cast<BasicBlock>(VMap[Header]);
+  while (auto *Phi = dyn_cast<PHINode>(&ClonedHeader->front()))
+    Phi->eraseFromParent();
+  for (unsigned I = 0, E = PL.IndVars.size(); I != E; ++I)
+    VMap[PL.IndVars[I].Phi] = IVs[I];
+  // Debug information refers to F's subprogram
+  for (BasicBlock *Clone : Blocks)
+    for (Instruction &I : make_early_inc_range(*Clone)) {
+      if (isa<DbgInfoIntrinsic>(I))
+        I.eraseFromParent();
+      else
+        I.setDebugLoc(DebugLoc());
+    }
+  for (BasicBlock *Clone : Blocks)
+    for (Instruction &I : *Clone)
+      RemapInstruction(&I, VMap,
+                       RF_NoModuleLevelChanges | RF_IgnoreMissingLocals);
+  auto *ClonedLatch = cast<BasicBlock>(VMap[Latch]);
+  Instruction *OldBranch = ClonedLatch->getTerminator();
+  BranchInst::Create(ChunkLatch, OldBranch);
+  Value *OldCondition = cast<BranchInst>(OldBranch)->getCondition();
+  OldBranch->eraseFromParent();
+  RecursivelyDeleteTriviallyDeadInstructions(OldCondition);
+
+  // 3. The runtime calls F.parallel(begin, end, ctx), which unpacks the
+  // inputs from the context structure
+  SmallVector<Type *, 8> InputTypes(BodyParams.begin() + 2, BodyParams.end());
+  StructType *ContextTy = StructType::get(Ctx, InputTypes);
+  Function *Wrapper = createOutlinedFunction(
+      F,
+      FunctionType::get(Type::getVoidTy(Ctx), {I64, I64, B.getInt8PtrTy()},
+                        false),
+      F.getName() + ".parallel");
+  Wrapper->getArg(0)->setName("begin");
+  Wrapper->getArg(1)->setName("end");
+  Wrapper->getArg(2)->setName("context");
+  B.SetInsertPoint(BasicBlock::Create(Ctx, "entry", Wrapper));
+  SmallVector<Value *, 8> Args{Wrapper->getArg(0), Wrapper->getArg(1)};
+  Value *Context =
+      B.CreateBitCast(Wrapper->getArg(2), ContextTy->getPointerTo(), "ctx");
+  for (unsigned I = 0, E = InputTypes.size(); I != E; ++I)
+    Args.push_back(B.CreateLoad(InputTypes[I],
+                                B.CreateStructGEP(ContextTy, Context, I),
+                                Inputs[I]->getName()));
+  B.CreateCall(Body, Args);
+  B.CreateRetVoid();
+
+  // 4. Replace the loop with the call of the runtime
+  B.SetInsertPoint(&F.getEntryBlock(), F.getEntryBlock().getFirstInsertionPt());
+  AllocaInst *ContextAlloca = B.CreateAlloca(ContextTy, nullptr, "parallel.ctx");
+  B.SetInsertPoint(InsertPt);
+  for (unsigned I = 0, E = Inputs.size(); I != E; ++I)
+    B.CreateStore(Inputs[I], B.CreateStructGEP(ContextTy, ContextAlloca, I));
+  int32_t ScheduleValue = Schedule == ParallelSchedule::Dynamic
+                              ? ML_SCHEDULE_DYNAMIC
+                              : ML_SCHEDULE_STATIC;
+  B.CreateCall(getParallelFor(M),
+               {B.getInt64(0), TripCount, Wrapper,
+                B.CreateBitCast(ContextAlloca, B.getInt8PtrTy()),
+                B.getInt32(ScheduleValue), B.getInt64(Chunk)});
+  B.CreateBr(Exit);
+  InsertPt->eraseFromParent();
+
+  // Values leaving through the exit phis are invariant, so they are
+  // available in the preheader
+  for (PHINode &Phi : Exit->phis())
+    Phi.addIncoming(Phi.getIncomingValueForBlock(Latch), Preheader);
+
+  for (Attribute::AttrKind Kind : CallerOnlyAttributes)
+    F.removeFnAttr(Kind);
+
+  SE.forgetLoop(L);
+  SmallVector<BasicBlock *, 8> Dead(L->blocks());
+  DeleteDeadBlocks(Dead);
+}
+
+// Schedule of F: its tuning parameter, or Default
+ParallelSchedule getSchedule(const Function &F, ParallelSchedule Default) {
+  if (Optional<TuningConfig> Tuning = TuningConfig::get(F))
+    if (Tuning->Parallel)
+      return *Tuning->Parallel;
+  return Default;
+}
+
+// Parallelizes the outermost loops of F that qualify. Returns true if F
+// was changed.
+bool parallelizeFunction(Function &F, FunctionAnalysisManager &FAM,
+                         ParallelSchedule Schedule, unsigned Chunk) {
+  // The outermost loops need preheaders and dedicated exits. The pass
+  // runs at the start of the pipeline, before any loop simplification,
+  // so it puts them into this form itself
+  bool Simplified = false;
+  {
+    auto &LI = FAM.getResult<LoopAnalysis>(F);
+    auto &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+    auto &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+    auto &AC = FAM.getResult<AssumptionAnalysis>(F);
+    for (Loop *L : LI)
+      Simplified |= simplifyLoop(L, &DT, &LI, &SE, &AC, /*MSSAU=*/nullptr,
+                                 /*PreserveLCSSA=*/false);
+  }
+  if (Simplified)
+    FAM.invalidate(F, PreservedAnalyses::none());
+
+  auto &LI = FAM.getResult<LoopAnalysis>(F);
+  auto &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+  auto &DI = FAM.getResult<DependenceAnalysis>(F);
+  auto &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+
+  // Loops are identified by their headers, which outlining other loops
+  // leaves in place
+  SmallVector<BasicBlock *, 4> Headers;
+  for (Loop *L : LI) {
+    ParallelLoop PL;
+    Optional<StringRef> Reason = analyzeLoopShape(L, SE, PL);
+    if (!Reason)
+      Reason = analyzeIndependence(L, DI);
+    if (Reason) {
+      LLVM_DEBUG(dbgs() << "  Loop " << L->getHeader()->getName()
+                        << " not parallelized: " << *Reason << "\n");
+      ORE.emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "NotParallelized",
+                                        L->getStartLoc(), L->getHeader())
+               << "loop not parallelized: " << NV("Reason", *Reason);
+      });
+      ++NumLoopsRejected;
+      continue;
+    }
+    Headers.push_back(L->getHeader());
+  }
+
+  for (BasicBlock *Header : Headers) {
+    // The analyses of the previous iteration were invalidated
+    auto &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+    auto &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+    ParallelLoop PL;
+    Loop *L = FAM.getResult<LoopAnalysis>(F).getLoopFor(Header);
+    if (analyzeLoopShape(L, SE, PL))
+      continue;
+
+    DebugLoc Loc = PL.L->getStartLoc();
+    unsigned TripCount = SE.getSmallConstantTripCount(PL.L);
+    LLVM_DEBUG(dbgs() << "  Parallelizing the loop " << Header->getName()
+                      << "\n");
+    ORE.emit([&]() {
+      OptimizationRemark R(DEBUG_TYPE, "Parallelized", Loc, Header);
+      R << "parallelized loop with a " << getParallelScheduleName(Schedule)
+        << " schedule";
+      if (TripCount)
+        R << " over " << NV("TripCount", TripCount) << " iterations";
+      return R;
+    });
+    parallelizeLoop(PL, Schedule, Chunk, SE);
+    ++NumLoopsParallelized;
+    FAM.invalidate(F, PreservedAnalyses::none());
+  }
+  return Simplified || !Headers.empty();
+}
+
+} // end anonymous namespace
+
+StringRef getParallelScheduleName(ParallelSchedule Schedule) {
+  switch (Schedule) {
+  case ParallelSchedule::None:
+    return "none";
+  case ParallelSchedule::Static:
+    return "static";
+  case ParallelSchedule::Dynamic:
+    return "dynamic";
+  }
+  llvm_unreachable("unknown parallel schedule");
+}
+
+ParallelSchedule getSelectedParallelSchedule() { return SelectedSchedule; }
+
+PreservedAnalyses LoopParallelizePass::run(Module &M,
+                                           ModuleAnalysisManager &AM) {
+  auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  unsigned ChunkSize = Chunk ? Chunk : ChunkOpt;
+
+  // Outlining adds functions to M
+  SmallVector<Function *, 16> Functions;
+  for (Function &F : M)
+    if (!F.isDeclaration() && !F.hasOptNone() &&
+        !F.hasFnAttribute(ParallelBodyAttributeName))
+      Functions.push_back(&F);
+
+  bool Changed = false;
+  for (Function *F : Functions) {
+    ParallelSchedule FSchedule = getSchedule(*F, Schedule);
+    if (FSchedule == ParallelSchedule::None)
+      continue;
+    LLVM_DEBUG(dbgs() << "Running Loop Parallelize Pass on function: "
+                      << F->getName() << " ("
+                      << getParallelScheduleName(FSchedule) << ")\n");
+    Changed |= parallelizeFunction(*F, FAM, FSchedule, ChunkSize);
+  }
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
+void registerLoopParallelizePass(PassBuilder &PB, bool AddToPipelines) {
+  if (PassInstrumentationCallbacks *PIC = PB.getPassInstrumentationCallbacks())
+    PIC->addClassToPassName(LoopParallelizePass::name(), "loop-parallelize");
+  PB.registerPipelineParsingCallback(
+      [](StringRef Name, ModulePassManager &MPM,
+         ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name != "loop-parallelize")
+          return false;
+        // Asking for the pass parallelizes even without -loop-parallelize
+        ParallelSchedule Schedule = getSelectedParallelSchedule();
+        MPM.addPass(LoopParallelizePass(Schedule == ParallelSchedule::None
+                                            ? ParallelSchedule::Static
+                                            : Schedule));
+        return true;
+      });
+
+  if (!AddToPipelines)
+    return;
+  PB.registerPipelineStartEPCallback(
+      [](ModulePassManager &MPM, OptimizationLevel) {
+        MPM.addPass(LoopParallelizePass());
+      });
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,86 @@
+//===- LoopParallelization.h - Multicore Loop Parallelization -------===//
+//
+// This file defines a pass that runs the outermost loops of a function on
+// all cores. A loop qualifies if dependence analysis shows that none of
+// its iterations reads or writes memory another iteration writes, such as
+// the row loop of a matrix multiplication:
+//
+//   for i: for j: for k: C[i][j] += A[i][k] * B[k][j]
+//
+// The loop is outlined into a function that runs a range of iterations,
+// and replaced by a call of the parallel loop runtime (ml_runtime), which
+// hands out chunks of the iteration space to a work-stealing thread pool:
+//
+//   F.parallel.body(begin, end, A, B, C):
+//     for t in [begin, end): i = start + t * step; <loop body>
+//   F.parallel(begin, end, ctx):  F.parallel.body(begin, end, ctx->A, ...)
+//   F:  __ml_parallel_for(0, trip count, F.parallel, &ctx, schedule, chunk)
+//
+// The pass runs at the start of the pipelines, after loop fusion and
+// before loop tiling, so that the threads split the whole outermost loop
+// and tile their share of it; the outlined bodies are then optimized and
+// vectorized like any other loop. Programs that contain parallelized
+// loops have to be linked against ml_runtime, so the pass only transforms
+// functions selected with -loop-parallelize or a "parallel" tuning
+// parameter.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_PASSES_LOOP_PARALLELIZATION_H
+#define MLCOMPILEROPT_PASSES_LOOP_PARALLELIZATION_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+class PassBuilder;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+// Name of the attribute of the functions the pass outlines. They are not
+// parallelized again.
+constexpr const char *ParallelBodyAttributeName = "ml-parallel-body";
+
+// How the runtime distributes the iterations of a parallelized loop; the
+// values are the ML_SCHEDULE_* constants of runtime/ParallelRuntime.h
+enum class ParallelSchedule {
+  None,    // Do not parallelize
+  Static,  // One block of iterations per thread
+  Dynamic, // Chunks that idle threads steal from busy ones
+};
+
+llvm::StringRef getParallelScheduleName(ParallelSchedule Schedule);
+
+// Schedule selected with -loop-parallelize
+ParallelSchedule getSelectedParallelSchedule();
+
+class LoopParallelizePass : public llvm::PassInfoMixin<LoopParallelizePass> {
+public:
+  // Schedule of the functions without a "parallel" tuning parameter.
+  // Chunk is the number of iterations per chunk; 0 uses
+  // -loop-parallelize-chunk, whose default leaves it to the runtime.
+  explicit LoopParallelizePass(
+      ParallelSchedule Schedule = getSelectedParallelSchedule(),
+      unsigned Chunk = 0)
+      : Schedule(Schedule), Chunk(Chunk) {}
+
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &AM);
+
+  static bool isRequired() { return true; }
+
+private:
+  ParallelSchedule Schedule;
+  unsigned Chunk;
+};
+
+// Makes the pass available to PB as "loop-parallelize" and, if
+// AddToPipelines, adds it to the start of the default pipelines. Register
+// it after the loop fusion pass and before the loop tiling pass. It only
+// changes functions whose schedule is not none.
+void registerLoopParallelizePass(llvm::PassBuilder &PB, bool AddToPipelines);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_PASSES_LOOP_PARALLELIZATION_H
@@ -0,0 +1,542 @@
+//===- LoopTiling.cpp - Cache-Blocking Loop Tiling Pass -------------===//
+//
+// Implementation of the tile size selection, the legality check and the
+// tiling transformation.
+//
+//===----------------------------------------------------------------===//
+
+#include "passes/LoopTiling.h"
+#include "passes/MemoryAccessPattern.h"
+#include "passes/MemoryCoalescing.h"
+#include "passes/TuningConfig.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/DependenceAnalysis.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/LoopSimplify.h"
+
+#define DEBUG_TYPE "loop-tiling"
+
+using namespace llvm;
+using ore::NV;
+
+namespace mlcompileropt {
+
+ALWAYS_ENABLED_STATISTIC(NumBandsTiled, "Number of loop bands tiled");
+ALWAYS_ENABLED_STATISTIC(NumTwoLevelTiled,
+                         "Number of loop bands tiled for L1 and L2");
+
+namespace {
+
+cl::opt<bool> EnableTiling(
+    "loop-tiling", cl::init(false),
+    cl::desc("Tile the perfect loop nests of every function for the cache "
+             "at the start of the default pipelines, not only of those with "
+             "a tile tuning parameter"));
+
+cl::opt<unsigned> TileSizeOpt(
+    "loop-tiling-size", cl::init(0),
+    cl::desc("Tile size in iterations of every tiled loop; 1 disables "
+             "tiling (default: derived from the L1 cache size)"));
+
+cl::opt<unsigned> L2TileSizeOpt(
+    "loop-tiling-l2-size", cl::init(0),
+    cl::desc("Size in iterations of the outer tiles of two-level tiling, "
+             "a multiple of the inner tile size (default: derived from "
+             "the L2 cache size)"));
+
+cl::opt<unsigned> L1CacheSizeOpt(
+    "loop-tiling-l1-cache-size", cl::init(0), cl::Hidden,
+    cl::desc("L1 data cache size in bytes the tile sizes are chosen for "
+             "(default: the target's, or 32768)"));
+
+cl::opt<unsigned> L2CacheSizeOpt(
+    "loop-tiling-l2-cache-size", cl::init(0), cl::Hidden,
+    cl::desc("L2 cache size in bytes the outer tile sizes are chosen for "
+             "(default: the target's, or 262144)"));
+
+const unsigned DefaultL1CacheSize = 32 * 1024;
+const unsigned DefaultL2CacheSize = 256 * 1024;
+
+// Iterations assumed for loops whose trip count is not known
+const unsigned UnknownTripCount = 1024;
+
+// Range of the automatically chosen tile sizes. Tiles of a few iterations
+// cost more in loop overhead than they save in misses.
+const unsigned MinTileSize = 8;
+const unsigned MaxL1TileSize = 256;
+const unsigned MaxL2TileSize = 4096;
+
+// Cache capacities in bytes the automatic tile sizes are derived from
+struct TilingCacheSizes {
+  unsigned L1 = 0;
+  unsigned L2 = 0;
+};
+
+TilingCacheSizes getCacheSizes(const TargetTransformInfo &TTI) {
+  TilingCacheSizes Caches;
+  Caches.L1 = L1CacheSizeOpt;
+  if (!Caches.L1)
+    Caches.L1 = TTI.getCacheSize(TargetTransformInfo::CacheLevel::L1D)
+                    .getValueOr(DefaultL1CacheSize);
+  Caches.L2 = L2CacheSizeOpt;
+  if (!Caches.L2)
+    Caches.L2 = TTI.getCacheSize(TargetTransformInfo::CacheLevel::L2D)
+                    .getValueOr(DefaultL2CacheSize);
+  return Caches;
+}
+
+// The strip-mined loops keep their own exit tests, so only loops that run
+// through [Start, Bound) upwards can be given a tile as their range
+bool hasTileableControl(const LoopControl &C) {
+  if (C.ContinuePred != CmpInst::ICMP_SLT &&
+      C.ContinuePred != CmpInst::ICMP_ULT)
+    return false;
+  if (C.Step->isNegative() || C.Step->getValue().getActiveBits() > 32)
+    return false;
+  // A do-while loop that tests its induction variable before incrementing
+  // it also runs the iteration at Bound
+  return C.ComparesIncrement != C.ExitsFromHeader;
+}
+
+// True if some access of Band reads or writes the same address in
+// different iterations of a band loop, the reuse tiling exploits
+bool hasReuse(ArrayRef<LoopControl> Band, const MemoryAccessPatternInfo &MAP) {
+  for (BasicBlock *BB : Band.back().L->blocks())
+    for (Instruction &I : *BB) {
+      const AccessPattern *P = MAP.getPattern(&I);
+      if (!P || !P->IsAffine)
+        continue;
+      for (const LoopControl &C : Band) {
+        const LoopStride *S = P->getStride(C.L);
+        if (S && S->Step->isZero())
+          return true;
+      }
+    }
+  return false;
+}
+
+// Largest power of two tile size between Min and Max whose footprint
+// fits into Capacity, with the loops limited to Limits iterations. Returns
+// Min if no size fits.
+unsigned chooseTileSize(ArrayRef<LoopControl> Band, ArrayRef<unsigned> Limits,
+                        const MemoryAccessPatternInfo &MAP, uint64_t Capacity,
+                        unsigned Min, unsigned Max) {
+  for (unsigned Size = Max; Size > Min; Size /= 2) {
+    SmallVector<unsigned, 4> Extents;
+    for (unsigned Limit : Limits)
+      Extents.push_back(std::min(Size, Limit));
+    if (estimateTileFootprint(Band, Extents, MAP) <= Capacity)
+      return Size;
+  }
+  return Min;
+}
+
+// Chooses the tile sizes of Band: L1Size and L2Size if they are given,
+// otherwise the largest sizes whose footprint fills half of the cache, so
+// that the tiles of different arrays do not evict each other. Returns no
+// levels if tiling is disabled or does not pay off.
+TileSizes chooseTileSizes(ArrayRef<LoopControl> Band,
+                          ArrayRef<unsigned> TripCounts,
+                          const MemoryAccessPatternInfo &MAP,
+                          const TilingCacheSizes &Caches, unsigned L1Size,
+                          unsigned L2Size) {
+  if (L1Size == 1)
+    return {};
+
+  SmallVector<unsigned, 4> Limits;
+  for (unsigned TC : TripCounts)
+    Limits.push_back(TC ? TC : UnknownTripCount);
+  uint64_t Footprint = estimateTileFootprint(Band, Limits, MAP);
+
+  if (!L1Size) {
+    // Without reuse there is nothing to keep in cache, and a working set
+    // that already fits gains nothing
+    if (!hasReuse(Band, MAP) || Footprint <= Caches.L1 / 2)
+      return {};
+    L1Size = chooseTileSize(Band, Limits, MAP, Caches.L1 / 2, MinTileSize,
+                            MaxL1TileSize);
+  }
+
+  if (!L2Size && Footprint > Caches.L2 / 2 && hasReuse(Band, MAP)) {
+    unsigned Max = L1Size;
+    while (Max * 2 <= MaxL2TileSize)
+      Max *= 2;
+    L2Size = chooseTileSize(Band, Limits, MAP, Caches.L2 / 2, L1Size, Max);
+  }
+  // Outer tiles consist of whole inner tiles
+  L2Size = L2Size / L1Size * L1Size;
+
+  SmallVector<unsigned, 4> Outer, Inner;
+  bool HasOuter = false, HasInner = false;
+  for (unsigned D = 0; D < Band.size(); ++D) {
+    // A loop is tiled at a level if it has more than one tile there
+    unsigned Range = Limits[D];
+    bool TileOuter = L2Size > L1Size && (!TripCounts[D] || Range > L2Size);
+    Outer.push_back(TileOuter ? L2Size : 0);
+    if (TileOuter)
+      Range = L2Size;
+    bool TileInner = !TripCounts[D] || Range > L1Size;
+    Inner.push_back(TileInner ? L1Size : 0);
+    HasOuter |= TileOuter;
+    HasInner |= TileInner;
+  }
+
+  TileSizes Sizes;
+  if (HasOuter)
+    Sizes.push_back(Outer);
+  if (HasInner)
+    Sizes.push_back(Inner);
+  return Sizes;
+}
+
+// Formats the sizes of one level, e.g. "32x32x0"
+std::string formatTileSizes(ArrayRef<unsigned> Sizes) {
+  std::string Str;
+  raw_string_ostream OS(Str);
+  interleave(Sizes, OS, "x");
+  return OS.str();
+}
+
+} // end anonymous namespace
+
+uint64_t estimateTileFootprint(ArrayRef<LoopControl> Band,
+                               ArrayRef<unsigned> Extents,
+                               const MemoryAccessPatternInfo &MAP) {
+  // Accesses with the same base and steps touch the same addresses, like
+  // the load and the store of an accumulator
+  SmallVector<SmallVector<const SCEV *, 5>, 8> Seen;
+  uint64_t Footprint = 0;
+  for (BasicBlock *BB : Band.back().L->blocks()) {
+    for (Instruction &I : *BB) {
+      const AccessPattern *P = MAP.getPattern(&I);
+      if (!P)
+        continue;
+
+      uint64_t Bytes = P->AccessSize;
+      SmallVector<const SCEV *, 5> Key{P->IsAffine ? P->Base : nullptr};
+      for (unsigned D = 0; D < Band.size(); ++D) {
+        const LoopStride *S = P->IsAffine ? P->getStride(Band[D].L) : nullptr;
+        Key.push_back(S ? S->Step : nullptr);
+        if (!S || !S->Step->isZero())
+          Bytes = SaturatingMultiply<uint64_t>(Bytes, Extents[D]);
+      }
+
+      if (P->IsAffine) {
+        if (is_contained(Seen, Key))
+          continue;
+        Seen.push_back(Key);
+      }
+      Footprint = SaturatingAdd(Footprint, Bytes);
+    }
+  }
+  return Footprint;
+}
+
+bool isTilingLegal(ArrayRef<LoopControl> Band, DependenceInfo &DI) {
+  SmallVector<Instruction *, 16> MemInsts;
+  for (BasicBlock *BB : Band.front().L->blocks()) {
+    for (Instruction &I : *BB) {
+      if (!I.mayReadOrWriteMemory())
+        continue;
+      auto *LI = dyn_cast<LoadInst>(&I);
+      auto *SI = dyn_cast<StoreInst>(&I);
+      if ((!LI || !LI->isSimple()) && (!SI || !SI->isSimple())) {
+        LLVM_DEBUG(dbgs() << "  Tiling blocked by " << I << "\n");
+        return false;
+      }
+      MemInsts.push_back(&I);
+    }
+  }
+
+  unsigned FirstLevel = Band.front().L->getLoopDepth();
+  unsigned LastLevel = Band.back().L->getLoopDepth();
+
+  for (unsigned I = 0, E = MemInsts.size(); I != E; ++I) {
+    for (unsigned J = I; J != E; ++J) {
+      Instruction *Src = MemInsts[I];
+      Instruction *Dst = MemInsts[J];
+      if (!isa<StoreInst>(Src) && !isa<StoreInst>(Dst))
+        continue;
+
+      auto D = DI.depends(Src, Dst, /*PossiblyLoopIndependent=*/true);
+      if (!D)
+        continue;
+      if (D->isConfused()) {
+        LLVM_DEBUG(dbgs() << "  Confused dependence between " << *Src
+                          << " and " << *Dst << "\n");
+        return false;
+      }
+
+      // Dependences carried by a loop outside the band are not affected;
+      // the order of those that may run either way there is unknown
+      bool CarriedOutside = false;
+      for (unsigned Level = 1; Level < FirstLevel && Level <= D->getLevels();
+           ++Level) {
+        unsigned Dir = D->getDirection(Level);
+        if (Dir == Dependence::DVEntry::EQ)
+          continue;
+        if (Dir != Dependence::DVEntry::LT)
+          return false;
+        CarriedOutside = true;
+        break;
+      }
+      if (CarriedOutside)
+        continue;
+
+      // Tiling keeps the order of the iterations along every single loop,
+      // so a dependence between iterations that differ in one loop only is
+      // preserved whatever its direction. Otherwise no loop may run it
+      // backwards.
+      unsigned NumCarrying = 0;
+      bool Backwards = false;
+      for (unsigned Level = FirstLevel;
+           Level <= LastLevel && Level <= D->getLevels(); ++Level) {
+        unsigned Dir = D->getDirection(Level);
+        NumCarrying += Dir != Dependence::DVEntry::EQ;
+        Backwards |= (Dir & Dependence::DVEntry::GT) != 0;
+      }
+      if (Backwards && NumCarrying > 1) {
+        LLVM_DEBUG(dbgs() << "  Tiling would reverse the dependence " << *Src
+                          << " -> " << *Dst << "\n");
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool tileLoopBand(ArrayRef<LoopControl> Band, const TileSizes &Sizes,
+                  ArrayRef<unsigned> TripCounts) {
+  const LoopControl &Outermost = Band.front();
+  BasicBlock *Preheader = Outermost.L->getLoopPreheader();
+  BasicBlock *Header = Outermost.L->getHeader();
+  BasicBlock *Exit = Outermost.L->getExitBlock();
+  BasicBlock *Exiting = Outermost.ExitBranch->getParent();
+  if (!Preheader || Preheader->getSingleSuccessor() != Header || !Exit ||
+      Exit->getSinglePredecessor() != Exiting || !Exit->phis().empty())
+    return false;
+  if (!all_of(Band, hasTileableControl))
+    return false;
+
+  // The band's values would have to be carried out of the tile loops
+  for (BasicBlock *BB : Outermost.L->blocks())
+    for (Instruction &I : *BB)
+      for (User *U : I.users())
+        if (!Outermost.L->contains(cast<Instruction>(U)->getParent()))
+          return false;
+
+  LLVM_DEBUG(dbgs() << "  Tiling the band at " << Header->getName() << "\n");
+
+  struct TileLoop {
+    PHINode *IndVar;
+    BasicBlock *Header;
+    Constant *Stride;
+    Value *Bound;
+    CmpInst::Predicate ContinuePred;
+  };
+  SmallVector<TileLoop, 8> TileLoops;
+
+  // Range of every band loop inside the tile loops built so far
+  SmallVector<Value *, 4> Lo, Hi;
+  for (const LoopControl &C : Band) {
+    Lo.push_back(C.Start);
+    Hi.push_back(C.Bound);
+  }
+
+  // Build the headers of the tile loops, outermost first, between the
+  // preheader and the band. Each header computes the range of the loops
+  // of its dimension inside it.
+  LLVMContext &Ctx = Header->getContext();
+  Function *F = Header->getParent();
+  BasicBlock *Pred = Preheader;
+  for (ArrayRef<unsigned> LevelSizes : Sizes) {
+    for (unsigned D = 0; D < Band.size(); ++D) {
+      unsigned Size = LevelSizes[D];
+      if (!Size)
+        continue;
+
+      const LoopControl &C = Band[D];
+      auto *TileHeader = BasicBlock::Create(
+          Ctx, C.L->getHeader()->getName() + ".tile", F, Header);
+      Pred->getTerminator()->replaceUsesOfWith(Header, TileHeader);
+
+      IRBuilder<> B(TileHeader);
+      PHINode *IV = B.CreatePHI(C.IndVar->getType(), 2,
+                                C.IndVar->getName() + ".tile");
+      IV->addIncoming(Lo[D], Pred);
+      Constant *Stride =
+          ConstantInt::get(IV->getType(), Size * C.Step->getZExtValue());
+      TileLoops.push_back({IV, TileHeader, Stride, Hi[D], C.ContinuePred});
+
+      // The last tile is partial unless the size divides the trip count
+      Value *End = B.CreateAdd(IV, Stride, IV->getName() + ".end");
+      if (!TripCounts[D] || TripCounts[D] % Size) {
+        Value *IsFull = B.CreateICmp(C.ContinuePred, End, Hi[D],
+                                     IV->getName() + ".full");
+        End = B.CreateSelect(IsFull, End, Hi[D], IV->getName() + ".bound");
+      }
+      B.CreateBr(Header);
+
+      Lo[D] = IV;
+      Hi[D] = End;
+      Pred = TileHeader;
+    }
+  }
+
+  // The band loops become the point loops and run through their tile
+  for (PHINode &Phi : Header->phis())
+    Phi.replaceIncomingBlockWith(Preheader, Pred);
+  for (unsigned D = 0; D < Band.size(); ++D) {
+    LoopControl C = Band[D];
+    BasicBlock *PointPreheader = D ? C.L->getLoopPreheader() : Pred;
+    C.IndVar->setIncomingValueForBlock(PointPreheader, Lo[D]);
+    if (Hi[D] != C.Bound)
+      C.setExitTest(C.ContinuePred, Hi[D]);
+  }
+
+  // Build the latches, innermost first, between the band and its exit.
+  // The tile loops are do-while loops: every tile loop runs at least once,
+  // which the band loops, tested at their own entries, are fine with.
+  BasicBlock *From = Exiting;
+  for (const TileLoop &T : reverse(TileLoops)) {
+    auto *Latch = BasicBlock::Create(Ctx, T.Header->getName() + ".latch", F,
+                                     Exit);
+    From->getTerminator()->replaceUsesOfWith(Exit, Latch);
+
+    IRBuilder<> B(Latch);
+    Value *Next = B.CreateAdd(T.IndVar, T.Stride, T.IndVar->getName() + ".next");
+    Value *Continue =
+        B.CreateICmp(T.ContinuePred, Next, T.Bound, T.IndVar->getName() + ".cond");
+    B.CreateCondBr(Continue, T.Header, Exit);
+    T.IndVar->addIncoming(Next, Latch);
+    From = Latch;
+  }
+  return true;
+}
+
+PreservedAnalyses LoopTilingPass::run(Function &F, FunctionAnalysisManager &AM) {
+  LLVM_DEBUG(dbgs() << "Running Loop Tiling Pass on function: " << F.getName()
+                    << "\n");
+
+  // A tuning configuration attached to F overrides the options
+  unsigned L1Size = TileSizeOpt;
+  unsigned L2Size = L2TileSizeOpt;
+  bool Selected = TileAll;
+  if (Optional<TuningConfig> Tuning = TuningConfig::get(F)) {
+    if (Tuning->TileSize)
+      L1Size = Tuning->TileSize;
+    if (Tuning->TileSizeL2)
+      L2Size = Tuning->TileSizeL2;
+    Selected |= Tuning->TileSize || Tuning->TileSizeL2;
+  }
+  if (!Selected)
+    return PreservedAnalyses::all();
+
+  auto &LI = AM.getResult<LoopAnalysis>(F);
+  auto &DI = AM.getResult<DependenceAnalysis>(F);
+  auto &MAP = AM.getResult<MemoryAccessPatternAnalysis>(F);
+  auto &ORE = AM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+  auto &TTI = AM.getResult<TargetIRAnalysis>(F);
+  TilingCacheSizes Caches = getCacheSizes(TTI);
+
+  // All bands are analyzed before the first one is transformed, because
+  // tiling leaves LoopInfo and the other analyses stale
+  struct Candidate {
+    SmallVector<LoopControl, 4> Band;
+    SmallVector<unsigned, 4> TripCounts;
+    TileSizes Sizes;
+  };
+  SmallVector<Candidate, 4> Candidates;
+  for (Loop *L : LI.getLoopsInPreorder()) {
+    if (!L->isInnermost())
+      continue;
+
+    Candidate C;
+    getPerfectLoopBand(L, C.Band);
+    if (C.Band.size() < 2 || !all_of(C.Band, hasTileableControl))
+      continue;
+    for (const LoopControl &LC : C.Band)
+      C.TripCounts.push_back(MAP.getTripCount(LC.L));
+
+    C.Sizes = chooseTileSizes(C.Band, C.TripCounts, MAP, Caches, L1Size, L2Size);
+    if (C.Sizes.empty())
+      continue;
+
+    Loop *Outermost = C.Band.front().L;
+    if (!isTilingLegal(C.Band, DI)) {
+      ORE.emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "NotTiled",
+                                        Outermost->getStartLoc(),
+                                        Outermost->getHeader())
+               << "loop nest not tiled: tiling would reverse a dependence";
+      });
+      continue;
+    }
+    Candidates.push_back(std::move(C));
+  }
+
+  bool Changed = false;
+  for (Candidate &C : Candidates) {
+    Loop *Outermost = C.Band.front().L;
+    DebugLoc Loc = Outermost->getStartLoc();
+    BasicBlock *Header = Outermost->getHeader();
+    if (!tileLoopBand(C.Band, C.Sizes, C.TripCounts))
+      continue;
+
+    ++NumBandsTiled;
+    if (C.Sizes.size() > 1)
+      ++NumTwoLevelTiled;
+    Changed = true;
+    ORE.emit([&]() {
+      OptimizationRemark R(DEBUG_TYPE, "Tiled", Loc, Header);
+      R << "tiled loop nest of depth " << NV("Depth", unsigned(C.Band.size()))
+        << " with tiles of " << NV("TileSizes", formatTileSizes(C.Sizes.back()))
+        << " iterations";
+      if (C.Sizes.size() > 1)
+        R << " inside tiles of "
+          << NV("OuterTileSizes", formatTileSizes(C.Sizes.front()));
+      return R;
+    });
+  }
+
+  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
+bool isLoopTilingEnabled() { return EnableTiling; }
+
+void registerLoopTilingPass(PassBuilder &PB, bool AddToPipelines) {
+  if (PassInstrumentationCallbacks *PIC = PB.getPassInstrumentationCallbacks())
+    PIC->addClassToPassName(LoopTilingPass::name(), "loop-tiling");
+  PB.registerAnalysisRegistrationCallback(
+      [](FunctionAnalysisManager &FAM) { registerMemoryCoalescingAnalyses(FAM); });
+  PB.registerPipelineParsingCallback(
+      [](StringRef Name, FunctionPassManager &FPM,
+         ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name != "loop-tiling")
+          return false;
+        FPM.addPass(LoopTilingPass());
+        return true;
+      });
+
+  if (!AddToPipelines)
+    return;
+  PB.registerPipelineStartEPCallback(
+      [](ModulePassManager &MPM, OptimizationLevel) {
+        FunctionPassManager FPM;
+        FPM.addPass(LoopSimplifyPass());
+        FPM.addPass(LoopTilingPass(isLoopTilingEnabled()));
+        MPM.addPass(createModuleToFunctionPassAdaptor(std::move(FPM)));
+      });
+}
+
+} // namespace mlcompileropt
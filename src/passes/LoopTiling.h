@@ -0,0 +1,91 @@
+//===- LoopTiling.h - Cache-Blocking Loop Tiling Pass ---------------===//
+//
+// This file defines a pass that tiles perfectly nested affine loop bands,
+// such as those of matrix multiplications and convolutions, so that the
+// data one tile touches stays in cache while it is reused. Every loop of
+// the band is strip-mined into a tile loop and a point loop and the tile
+// loops are moved outside the whole band:
+//
+//   for i, for j, for k          for ii, for jj, for kk
+//     body             =>          for i in [ii, min(ii+T, N))
+//                                    for j ..., for k ...
+//                                      body
+//
+// With two-level tiling, tile loops for the L2 cache enclose those for
+// the L1 cache. The min, a runtime check for the remainder iterations, is
+// only emitted where the tile size does not divide the trip count.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_PASSES_LOOP_TILING_H
+#define MLCOMPILEROPT_PASSES_LOOP_TILING_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/PassManager.h"
+
+#include "passes/LoopNest.h"
+
+namespace llvm {
+class DependenceInfo;
+class PassBuilder;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+class MemoryAccessPatternInfo;
+
+// Tile sizes of one band, in iterations of each loop, outermost level
+// first. A size of 0 leaves the loop untiled at that level; inner levels
+// divide the sizes of outer ones.
+using TileSizes = llvm::SmallVector<llvm::SmallVector<unsigned, 4>, 2>;
+
+// Estimated bytes the accesses of Band touch while each band loop runs
+// through Extents[D] iterations; accesses to the same address are counted
+// once.
+uint64_t estimateTileFootprint(llvm::ArrayRef<LoopControl> Band,
+                               llvm::ArrayRef<unsigned> Extents,
+                               const MemoryAccessPatternInfo &MAP);
+
+// Checks with dependence analysis whether the loops of Band may be tiled,
+// i.e. whether the band is fully permutable: no dependence carried by the
+// band runs backwards in any of its loops, except along a single loop.
+bool isTilingLegal(llvm::ArrayRef<LoopControl> Band, llvm::DependenceInfo &DI);
+
+// Wraps Band in the tile loops described by Sizes and turns its loops into
+// the point loops. Returns false without modifying the IR if Band does not
+// have a preheader and a dedicated exit without phis, or its values are
+// used after it. LoopInfo and the DominatorTree are not updated.
+bool tileLoopBand(llvm::ArrayRef<LoopControl> Band, const TileSizes &Sizes,
+                  llvm::ArrayRef<unsigned> TripCounts);
+
+class LoopTilingPass : public llvm::PassInfoMixin<LoopTilingPass> {
+public:
+  // With TileAll false, only functions with a tile or tile-l2 tuning
+  // parameter are tiled
+  explicit LoopTilingPass(bool TileAll = true) : TileAll(TileAll) {}
+
+  llvm::PreservedAnalyses run(llvm::Function &F,
+                              llvm::FunctionAnalysisManager &AM);
+
+  static bool isRequired() { return true; }
+
+private:
+  bool TileAll;
+};
+
+// True if every function is tiled in the default pipelines, selected with
+// -loop-tiling
+bool isLoopTilingEnabled();
+
+// Makes the pass available to PB as "loop-tiling" and, if AddToPipelines,
+// adds it after LoopSimplify to the start of the default pipelines, where
+// the loop nests of unoptimized kernels are still perfect; later, LICM
+// keeps accumulators in registers, which makes the nests imperfect. There
+// it only tiles the functions selected with -loop-tiling or a tuning
+// parameter.
+void registerLoopTilingPass(llvm::PassBuilder &PB, bool AddToPipelines);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_PASSES_LOOP_TILING_H
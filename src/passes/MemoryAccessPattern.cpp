@@ -0,0 +1,264 @@
+//===- MemoryAccessPattern.cpp - Memory Access Pattern Analysis -----===//
+//
+// Implementation of the ScalarEvolution based access pattern analysis.
+//
+//===----------------------------------------------------------------===//
+
+#include "passes/MemoryAccessPattern.h"
+
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#define DEBUG_TYPE "memory-access-pattern"
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+AnalysisKey MemoryAccessPatternAnalysis::Key;
+
+namespace {
+
+// Splits an address SCEV into a loop-invariant base and a byte step per
+// loop. Integer casts are looked through, so sext/zext'd induction
+// variables are treated as if they did not wrap.
+class AffineDecomposer {
+public:
+  AffineDecomposer(ScalarEvolution &SE, Type *IndexTy)
+      : SE(SE), IndexTy(IndexTy) {}
+
+  bool decompose(const SCEV *S, int64_t Scale) {
+    if (!SE.containsAddRecurrence(S))
+      return addBaseTerm(S, Scale);
+
+    if (auto *AR = dyn_cast<SCEVAddRecExpr>(S)) {
+      if (!AR->isAffine())
+        return false;
+      const SCEV *Step = scale(AR->getStepRecurrence(SE), Scale);
+      if (!Step)
+        return false;
+      const SCEV *&Acc = Steps[AR->getLoop()];
+      Acc = Acc ? SE.getAddExpr(Acc, Step) : Step;
+      return decompose(AR->getStart(), Scale);
+    }
+
+    if (auto *Add = dyn_cast<SCEVAddExpr>(S)) {
+      for (const SCEV *Op : Add->operands())
+        if (!decompose(Op, Scale))
+          return false;
+      return true;
+    }
+
+    if (auto *Mul = dyn_cast<SCEVMulExpr>(S)) {
+      // SCEV canonicalizes constant factors to the front.
+      auto *C = dyn_cast<SCEVConstant>(Mul->getOperand(0));
+      if (!C || C->getAPInt().getMinSignedBits() > 64)
+        return false;
+      int64_t NewScale;
+      if (MulOverflow(Scale, C->getAPInt().getSExtValue(), NewScale))
+        return false;
+      SmallVector<const SCEV *, 4> Rest(std::next(Mul->op_begin()),
+                                        Mul->op_end());
+      return decompose(SE.getMulExpr(Rest), NewScale);
+    }
+
+    if (auto *Cast = dyn_cast<SCEVIntegralCastExpr>(S))
+      return decompose(Cast->getOperand(), Scale);
+
+    return false;
+  }
+
+  // Sum of all loop-invariant terms, or null if it cannot be formed.
+  const SCEV *getBase() {
+    if (BaseTerms.empty())
+      return SE.getZero(IndexTy);
+    if (NumPointerTerms > 1)
+      return nullptr;
+    return SE.getAddExpr(BaseTerms);
+  }
+
+  const SCEV *getStep(const Loop *L) const {
+    auto It = Steps.find(L);
+    return It == Steps.end() ? nullptr : It->second;
+  }
+
+  bool hasStepsOutside(const Loop *Innermost) const {
+    for (const auto &Entry : Steps)
+      if (!Innermost || !Entry.first->contains(Innermost))
+        return true;
+    return false;
+  }
+
+private:
+  const SCEV *scale(const SCEV *S, int64_t Scale) {
+    if (S->getType()->isPointerTy())
+      return nullptr;
+    S = SE.getTruncateOrSignExtend(S, IndexTy);
+    return SE.getMulExpr(S, SE.getConstant(IndexTy, Scale, /*isSigned=*/true));
+  }
+
+  bool addBaseTerm(const SCEV *S, int64_t Scale) {
+    if (S->getType()->isPointerTy()) {
+      if (Scale != 1)
+        return false;
+      ++NumPointerTerms;
+      BaseTerms.push_back(S);
+      return true;
+    }
+    const SCEV *Scaled = scale(S, Scale);
+    if (!Scaled)
+      return false;
+    BaseTerms.push_back(Scaled);
+    return true;
+  }
+
+  ScalarEvolution &SE;
+  Type *IndexTy;
+  SmallVector<const SCEV *, 4> BaseTerms;
+  unsigned NumPointerTerms = 0;
+  SmallDenseMap<const Loop *, const SCEV *, 4> Steps;
+};
+
+const Loop *outermostLoop(const Loop *L) {
+  while (L->getParentLoop())
+    L = L->getParentLoop();
+  return L;
+}
+
+} // end anonymous namespace
+
+const LoopStride *AccessPattern::getStride(const Loop *L) const {
+  for (const LoopStride &S : Strides)
+    if (S.L == L)
+      return &S;
+  return nullptr;
+}
+
+Optional<int64_t> AccessPattern::getInnermostStride() const {
+  if (!IsAffine || Strides.empty())
+    return None;
+  return Strides.front().ConstantBytes;
+}
+
+bool AccessPattern::isStrided() const {
+  Optional<int64_t> Stride = getInnermostStride();
+  return Stride && *Stride != 0 &&
+         static_cast<uint64_t>(std::abs(*Stride)) != AccessSize;
+}
+
+bool AccessPattern::isUnitStride() const {
+  Optional<int64_t> Stride = getInnermostStride();
+  return Stride && static_cast<uint64_t>(std::abs(*Stride)) == AccessSize;
+}
+
+const AccessPattern *
+MemoryAccessPatternInfo::getPattern(const Instruction *I) const {
+  auto It = PatternIndex.find(I);
+  return It == PatternIndex.end() ? nullptr : &Patterns[It->second];
+}
+
+unsigned MemoryAccessPatternInfo::getTripCount(const Loop *L) const {
+  return TripCounts.lookup(L);
+}
+
+bool MemoryAccessPatternInfo::invalidate(
+    Function &F, const PreservedAnalyses &PA,
+    FunctionAnalysisManager::Invalidator &Inv) {
+  // The result holds SCEV expressions and Loop pointers, so it has to go
+  // whenever either of those analyses goes.
+  auto PAC = PA.getChecker<MemoryAccessPatternAnalysis>();
+  return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>()) ||
+         Inv.invalidate<ScalarEvolutionAnalysis>(F, PA) ||
+         Inv.invalidate<LoopAnalysis>(F, PA);
+}
+
+void MemoryAccessPatternInfo::print(raw_ostream &OS) const {
+  for (const AccessPattern &P : Patterns) {
+    OS << *P.I << "\n";
+    if (!P.IsAffine) {
+      OS << "    non-affine\n";
+      continue;
+    }
+    OS << "    base: " << *P.Base << "  size: " << P.AccessSize << "\n";
+    for (const LoopStride &S : P.Strides) {
+      OS << "    loop " << S.L->getHeader()->getName() << " (depth "
+         << S.L->getLoopDepth() << "): stride " << *S.Step << " bytes, trip ";
+      if (S.TripCount)
+        OS << S.TripCount;
+      else
+        OS << "unknown";
+      OS << "\n";
+    }
+  }
+}
+
+MemoryAccessPatternInfo
+MemoryAccessPatternAnalysis::run(Function &F, FunctionAnalysisManager &AM) {
+  auto &LI = AM.getResult<LoopAnalysis>(F);
+  auto &SE = AM.getResult<ScalarEvolutionAnalysis>(F);
+  const DataLayout &DL = F.getParent()->getDataLayout();
+
+  MemoryAccessPatternInfo Info;
+
+  for (auto &BB : F) {
+    const Loop *Innermost = LI.getLoopFor(&BB);
+    for (auto &I : BB) {
+      if (!isa<LoadInst>(I) && !isa<StoreInst>(I))
+        continue;
+
+      AccessPattern P;
+      P.I = &I;
+      P.InnermostLoop = Innermost;
+      P.AccessSize = DL.getTypeStoreSize(getLoadStoreType(&I));
+
+      Value *Ptr = getLoadStorePointerOperand(&I);
+      Type *IndexTy = DL.getIndexType(Ptr->getType());
+      const SCEV *PtrSCEV = SE.getSCEVAtScope(Ptr, Innermost);
+
+      AffineDecomposer Decomposer(SE, IndexTy);
+      P.IsAffine = Decomposer.decompose(PtrSCEV, 1) &&
+                   !Decomposer.hasStepsOutside(Innermost);
+      if (P.IsAffine)
+        P.Base = Decomposer.getBase();
+      P.IsAffine &= P.Base != nullptr;
+
+      // Terms that vary inside the nest without being add-recurrences,
+      // such as indirect indices, make the access non-affine.
+      if (P.IsAffine && Innermost)
+        P.IsAffine = SE.isLoopInvariant(P.Base, outermostLoop(Innermost));
+
+      if (P.IsAffine) {
+        for (const Loop *L = Innermost; L; L = L->getParentLoop()) {
+          auto TC = Info.TripCounts.try_emplace(L, 0);
+          if (TC.second)
+            TC.first->second = SE.getSmallConstantTripCount(L);
+
+          LoopStride S;
+          S.L = L;
+          S.Step = Decomposer.getStep(L);
+          if (!S.Step)
+            S.Step = SE.getZero(IndexTy);
+          if (auto *C = dyn_cast<SCEVConstant>(S.Step))
+            if (C->getAPInt().getMinSignedBits() <= 64)
+              S.ConstantBytes = C->getAPInt().getSExtValue();
+          S.TripCount = TC.first->second;
+          P.Strides.push_back(S);
+        }
+      }
+
+      LLVM_DEBUG(dbgs() << "  Access " << I << " -> "
+                        << (P.IsAffine ? "affine" : "non-affine") << "\n");
+      Info.PatternIndex[&I] = Info.Patterns.size();
+      Info.Patterns.push_back(std::move(P));
+    }
+  }
+
+  return Info;
+}
+
+} // namespace mlcompileropt
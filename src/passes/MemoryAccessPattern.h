@@ -0,0 +1,123 @@
+//===- MemoryAccessPattern.h - Memory Access Pattern Analysis -------===//
+//
+// This file defines an analysis that describes every load and store in a
+// function as an affine function of its enclosing loops. The description
+// is derived from ScalarEvolution add-recurrences and records the loop
+// invariant base address, the byte stride per loop level and the trip
+// count of each enclosing loop.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_PASSES_MEMORY_ACCESS_PATTERN_H
+#define MLCOMPILEROPT_PASSES_MEMORY_ACCESS_PATTERN_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/PassManager.h"
+
+#include <vector>
+
+namespace llvm {
+class SCEV;
+class raw_ostream;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+// Stride of a memory access with respect to one enclosing loop.
+struct LoopStride {
+  const llvm::Loop *L = nullptr;
+
+  // Address increment in bytes per iteration of L. Never null; loops the
+  // address does not depend on have a zero step.
+  const llvm::SCEV *Step = nullptr;
+
+  // Step as a constant, when it is one.
+  llvm::Optional<int64_t> ConstantBytes;
+
+  // Constant trip count of L, or 0 when it is not known at compile time.
+  unsigned TripCount = 0;
+};
+
+// Affine description of a single load or store.
+struct AccessPattern {
+  llvm::Instruction *I = nullptr;
+
+  // Address at the first iteration of every enclosing loop.
+  const llvm::SCEV *Base = nullptr;
+
+  // Size of the accessed value in bytes.
+  uint64_t AccessSize = 0;
+
+  // Innermost loop containing the access, null outside of loops.
+  const llvm::Loop *InnermostLoop = nullptr;
+
+  // One entry per enclosing loop, innermost loop first.
+  llvm::SmallVector<LoopStride, 4> Strides;
+
+  // False when the address could not be expressed as an affine function
+  // of the enclosing loops; Base and Strides are then meaningless.
+  bool IsAffine = false;
+
+  bool isLoad() const { return llvm::isa<llvm::LoadInst>(I); }
+  bool isStore() const { return llvm::isa<llvm::StoreInst>(I); }
+
+  // Returns the stride entry for L, or null if L does not enclose the access.
+  const LoopStride *getStride(const llvm::Loop *L) const;
+
+  // Constant byte stride with respect to the innermost loop.
+  llvm::Optional<int64_t> getInnermostStride() const;
+
+  // True for affine accesses whose innermost stride is a non-zero constant
+  // different from the access size, i.e. consecutive iterations do not
+  // touch consecutive elements.
+  bool isStrided() const;
+
+  // True if consecutive innermost iterations touch consecutive elements.
+  bool isUnitStride() const;
+};
+
+// Result of MemoryAccessPatternAnalysis. Patterns are stored in program
+// order and can be looked up by instruction.
+class MemoryAccessPatternInfo {
+public:
+  const AccessPattern *getPattern(const llvm::Instruction *I) const;
+  llvm::ArrayRef<AccessPattern> patterns() const { return Patterns; }
+
+  // Constant trip count of L, or 0 when unknown.
+  unsigned getTripCount(const llvm::Loop *L) const;
+
+  bool invalidate(llvm::Function &F, const llvm::PreservedAnalyses &PA,
+                  llvm::FunctionAnalysisManager::Invalidator &Inv);
+
+  void print(llvm::raw_ostream &OS) const;
+
+private:
+  friend class MemoryAccessPatternAnalysis;
+
+  std::vector<AccessPattern> Patterns;
+  llvm::DenseMap<const llvm::Instruction *, unsigned> PatternIndex;
+  llvm::DenseMap<const llvm::Loop *, unsigned> TripCounts;
+};
+
+// Computes a MemoryAccessPatternInfo for a function. The result is cached
+// by the FunctionAnalysisManager and shared by every pass that queries it
+// until ScalarEvolution or LoopInfo are invalidated.
+class MemoryAccessPatternAnalysis
+    : public llvm::AnalysisInfoMixin<MemoryAccessPatternAnalysis> {
+  friend llvm::AnalysisInfoMixin<MemoryAccessPatternAnalysis>;
+  static llvm::AnalysisKey Key;
+
+public:
+  using Result = MemoryAccessPatternInfo;
+
+  Result run(llvm::Function &F, llvm::FunctionAnalysisManager &AM);
+};
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_PASSES_MEMORY_ACCESS_PATTERN_H
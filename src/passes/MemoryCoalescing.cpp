@@ -6,37 +6,325 @@
 //===----------------------------------------------------------------===//
 
 #include "passes/MemoryCoalescing.h"
+#include "passes/InterchangeAdvisor.h"
+#include "passes/LoopNest.h"
+#include "passes/TuningConfig.h"
+#include "passes/WarpTransactions.h"
 
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/MemoryLocation.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Analysis/VectorUtils.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
 
 #define DEBUG_TYPE "memory-coalescing"
 
 using namespace llvm;
+using ore::NV;
 
 namespace mlcompileropt {
 
+ALWAYS_ENABLED_STATISTIC(NumAccessesAnalyzed,
+                         "Number of loads in loops checked for a stride");
+ALWAYS_ENABLED_STATISTIC(NumStridedAccesses, "Number of strided loads found");
+ALWAYS_ENABLED_STATISTIC(NumAccessesMerged,
+                         "Number of loads and stores merged into vector accesses");
+ALWAYS_ENABLED_STATISTIC(NumNestsInterchanged,
+                         "Number of loop nests interchanged");
+
+namespace {
+
+// Remark arguments have no floating-point form
+std::string formatCost(double Cost) {
+  std::string Str;
+  raw_string_ostream(Str) << format("%.2f", Cost);
+  return Str;
+}
+
+// Where registerMemoryCoalescingPass adds the pass by default
+cl::opt<CoalescingExtensionPoint> SelectedExtensionPoint(
+    "memory-coalescing-ep", cl::init(CoalescingExtensionPoint::VectorizerStart),
+    cl::desc("Point of the default pipelines the memory coalescing pass "
+             "runs at"),
+    cl::values(
+        clEnumValN(CoalescingExtensionPoint::None, "none",
+                   "only when named in a textual pipeline"),
+        clEnumValN(CoalescingExtensionPoint::PipelineStart, "pipeline-start",
+                   "before any other pass, on unoptimized IR"),
+        clEnumValN(CoalescingExtensionPoint::ScalarOptimizerLate,
+                   "scalar-optimizer-late",
+                   "end of the function simplification pipeline"),
+        clEnumValN(CoalescingExtensionPoint::VectorizerStart,
+                   "vectorizer-start",
+                   "after loop canonicalization, before vectorization"),
+        clEnumValN(CoalescingExtensionPoint::OptimizerLast, "optimizer-last",
+                   "after the whole optimization pipeline")));
+
+// Off, every change invalidates all analyses of the function; used to
+// measure what preserving them saves
+cl::opt<bool> PreserveAnalyses(
+    "memory-coalescing-preserve-analyses", cl::init(true), cl::Hidden,
+    cl::desc("Keep the CFG, loop and scalar evolution analyses that the "
+             "memory coalescing pass's changes leave valid"));
+
+// Loads or stores that may end up in the same wide access share the
+// underlying base pointer, the element type and the access kind
+using AccessGroupKey = std::tuple<Value *, Type *, unsigned>;
+
+// A scalar access and its byte offset from the group base
+struct ChainElem {
+  Instruction *I;
+  int64_t Offset;
+};
+
+bool isMergeCandidate(Instruction *I, const DataLayout &DL) {
+  Type *Ty = getLoadStoreType(I);
+  if (auto *LI = dyn_cast<LoadInst>(I)) {
+    if (!LI->isSimple())
+      return false;
+  } else if (!cast<StoreInst>(I)->isSimple()) {
+    return false;
+  }
+  // Only scalars whose in-memory size matches their bit width can be
+  // packed into a vector without changing the layout
+  return (Ty->isIntegerTy() || Ty->isFloatingPointTy()) &&
+         VectorType::isValidElementType(Ty) &&
+         DL.getTypeSizeInBits(Ty) == DL.getTypeStoreSizeInBits(Ty);
+}
+
+// Checks whether the accesses in Chunk can be performed at a single point:
+// the first of them for loads, the last of them for stores. Every
+// instruction in between must transfer control to its successor and must
+// not write (for loads) or access (for stores) any of the merged locations.
+// Otherwise Reason is set to why not.
+bool canMergeChunk(ArrayRef<ChainElem> Chunk, Instruction *First,
+                   Instruction *Last, bool IsLoad, AAResults &AA,
+                   StringRef &Reason) {
+  SmallPtrSet<Instruction *, 8> Members;
+  for (const ChainElem &E : Chunk)
+    Members.insert(E.I);
+  
+  for (Instruction *I = First->getNextNode(); I != Last; I = I->getNextNode()) {
+    if (Members.count(I))
+      continue;
+    if (!isGuaranteedToTransferExecutionToSuccessor(I)) {
+      Reason = "an instruction between them may not return";
+      return false;
+    }
+    if (IsLoad ? !I->mayWriteToMemory() : !I->mayReadOrWriteMemory())
+      continue;
+    for (const ChainElem &E : Chunk) {
+      ModRefInfo MRI = AA.getModRefInfo(I, MemoryLocation::get(E.I));
+      if (IsLoad ? isModSet(MRI) : isModOrRefSet(MRI)) {
+        LLVM_DEBUG(dbgs() << "    Merge blocked by " << *I << "\n");
+        Reason = IsLoad ? "an instruction between them may write the loaded memory"
+                        : "an instruction between them may access the stored memory";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Returns a pointer to the lowest address of Chunk that is available at
+// InsertPt, rebuilding it from Base when the original one is defined later
+Value *getChunkPointer(ArrayRef<ChainElem> Chunk, Value *Base,
+                       Instruction *InsertPt, DominatorTree &DT) {
+  Value *Ptr = getLoadStorePointerOperand(Chunk.front().I);
+  auto *PtrInst = dyn_cast<Instruction>(Ptr);
+  if (!PtrInst || DT.dominates(PtrInst, InsertPt))
+    return Ptr;
+  
+  auto *BaseInst = dyn_cast<Instruction>(Base);
+  if (BaseInst && !DT.dominates(BaseInst, InsertPt))
+    return nullptr;
+  
+  IRBuilder<> Builder(InsertPt);
+  unsigned AS = Ptr->getType()->getPointerAddressSpace();
+  Value *BytePtr = Builder.CreateBitCast(Base, Builder.getInt8PtrTy(AS));
+  return Builder.CreateConstGEP1_64(Builder.getInt8Ty(), BytePtr,
+                                    Chunk.front().Offset, "coalesced.addr");
+}
+
+// Replaces the accesses in Chunk with one vector access. If that is not
+// possible or not profitable, Reason is set to why not.
+bool emitWideAccess(ArrayRef<ChainElem> Chunk, Value *Base, AAResults &AA,
+                    DominatorTree &DT, const DataLayout &DL,
+                    OptimizationRemarkEmitter &ORE, const CoalescingCostModel &CM,
+                    StringRef &Reason) {
+  bool IsLoad = isa<LoadInst>(Chunk.front().I);
+  Type *ElemTy = getLoadStoreType(Chunk.front().I);
+  Value *FrontPtr = getLoadStorePointerOperand(Chunk.front().I);
+  Align KnownAlign = std::max(getLoadStoreAlignment(Chunk.front().I),
+                              getKnownAlignment(FrontPtr, DL, nullptr, nullptr, &DT));
+  TransformCost Cost = CM.getMergeCost(ElemTy, Chunk.size(), KnownAlign,
+                                       FrontPtr->getType()->getPointerAddressSpace(), IsLoad);
+  if (!Cost.isProfitable()) {
+    LLVM_DEBUG(dbgs() << "    Merging " << Chunk.size() << " accesses is not profitable\n");
+    Reason = "a vector access is not cheaper than the scalar ones on this target";
+    return false;
+  }
+  
+  Instruction *First = Chunk.front().I;
+  Instruction *Last = Chunk.front().I;
+  for (const ChainElem &E : Chunk) {
+    if (E.I->comesBefore(First))
+      First = E.I;
+    if (Last->comesBefore(E.I))
+      Last = E.I;
+  }
+  
+  if (!canMergeChunk(Chunk, First, Last, IsLoad, AA, Reason))
+    return false;
+  
+  Instruction *InsertPt = IsLoad ? First : Last;
+  Value *Ptr = getChunkPointer(Chunk, Base, InsertPt, DT);
+  if (!Ptr) {
+    Reason = "their address is not available where they would be merged";
+    return false;
+  }
+  
+  auto *VecTy = FixedVectorType::get(ElemTy, Chunk.size());
+  Align Alignment = std::max(getLoadStoreAlignment(Chunk.front().I),
+                             getKnownAlignment(Ptr, DL, InsertPt, nullptr, &DT));
+  
+  SmallVector<Value *, 8> Scalars;
+  for (const ChainElem &E : Chunk)
+    Scalars.push_back(E.I);
+  
+  IRBuilder<> Builder(InsertPt);
+  unsigned AS = Ptr->getType()->getPointerAddressSpace();
+  Value *VecPtr = Builder.CreateBitCast(Ptr, VecTy->getPointerTo(AS), "coalesced.ptr");
+  Instruction *Wide;
+  
+  if (IsLoad) {
+    Wide = Builder.CreateAlignedLoad(VecTy, VecPtr, Alignment, "coalesced.load");
+    propagateMetadata(Wide, Scalars);
+    for (unsigned Idx = 0; Idx < Chunk.size(); ++Idx) {
+      Instruction *Scalar = Chunk[Idx].I;
+      Value *Extract = Builder.CreateExtractElement(Wide, Builder.getInt32(Idx));
+      Extract->takeName(Scalar);
+      Scalar->replaceAllUsesWith(Extract);
+    }
+    LLVM_DEBUG(dbgs() << "  Merged " << Chunk.size() << " loads into " << *Wide << "\n");
+  } else {
+    Value *Vec = PoisonValue::get(VecTy);
+    for (unsigned Idx = 0; Idx < Chunk.size(); ++Idx)
+      Vec = Builder.CreateInsertElement(
+          Vec, cast<StoreInst>(Chunk[Idx].I)->getValueOperand(), Builder.getInt32(Idx),
+          "coalesced.vec");
+    Wide = Builder.CreateAlignedStore(Vec, VecPtr, Alignment);
+    propagateMetadata(Wide, Scalars);
+    LLVM_DEBUG(dbgs() << "  Merged " << Chunk.size() << " stores into " << *Wide << "\n");
+  }
+  
+  ORE.emit([&]() {
+    return OptimizationRemark(DEBUG_TYPE, "MergedAccesses", Wide)
+           << "merged " << NV("NumAccesses", static_cast<unsigned>(Chunk.size()))
+           << (IsLoad ? " adjacent loads into a " : " adjacent stores into a ")
+           << NV("Width", static_cast<unsigned>(DL.getTypeSizeInBits(VecTy)))
+           << (IsLoad ? "-bit vector load" : "-bit vector store");
+  });
+  
+  NumAccessesMerged += Chunk.size();
+  for (const ChainElem &E : Chunk)
+    E.I->eraseFromParent();
+  return true;
+}
+
+// Splits a run of contiguous accesses into power-of-two sized chunks of at
+// most MaxVF elements and merges every chunk that can legally and
+// profitably be merged. Chunks that cannot be merged are halved until they
+// can, or until they are a single access.
+bool mergeRun(ArrayRef<ChainElem> Run, Value *Base, unsigned MaxVF,
+              AAResults &AA, DominatorTree &DT, const DataLayout &DL,
+              OptimizationRemarkEmitter &ORE, const CoalescingCostModel &CM) {
+  bool Changed = false;
+  size_t Begin = 0;
+  
+  // Accesses left scalar because no chunk containing them could be merged
+  Instruction *FirstUnmerged = nullptr;
+  unsigned NumUnmerged = 0;
+  StringRef Reason;
+  
+  while (Begin + 1 < Run.size()) {
+    size_t Len = PowerOf2Floor(std::min<size_t>(MaxVF, Run.size() - Begin));
+    while (Len >= 2 && !emitWideAccess(Run.slice(Begin, Len), Base, AA, DT, DL, ORE, CM, Reason))
+      Len /= 2;
+    if (Len >= 2) {
+      Changed = true;
+      Begin += Len;
+    } else {
+      if (!FirstUnmerged)
+        FirstUnmerged = Run[Begin].I;
+      ++NumUnmerged;
+      ++Begin;
+    }
+  }
+  
+  if (FirstUnmerged) {
+    ORE.emit([&]() {
+      return OptimizationRemarkMissed(DEBUG_TYPE, "AccessesNotMerged", FirstUnmerged)
+             << "could not merge " << NV("NumUnmerged", NumUnmerged) << " of "
+             << NV("NumAccesses", static_cast<unsigned>(Run.size()))
+             << (isa<LoadInst>(FirstUnmerged) ? " contiguous loads: " : " contiguous stores: ")
+             << NV("Reason", Reason);
+    });
+  }
+  return Changed;
+}
+
+} // end anonymous namespace
+
 PreservedAnalyses MemoryCoalescingPass::run(Function &F, FunctionAnalysisManager &AM) {
   LLVM_DEBUG(dbgs() << "Running Memory Coalescing Pass on function: " << F.getName() << "\n");
   
-  // Get loop information for this function
+  // Get loop information and the cached access patterns for this function
   auto &LI = AM.getResult<LoopAnalysis>(F);
-  bool Changed = false;
+  auto &MAP = AM.getResult<MemoryAccessPatternAnalysis>(F);
+  auto &AA = AM.getResult<AAManager>(F);
+  auto &DT = AM.getResult<DominatorTreeAnalysis>(F);
+  auto &SE = AM.getResult<ScalarEvolutionAnalysis>(F);
+  auto &DI = AM.getResult<DependenceAnalysis>(F);
+  auto &ORE = AM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+  auto &TTI = AM.getResult<TargetIRAnalysis>(F);
+  CoalescingCostModel CM(TTI, F.getParent()->getDataLayout());
+  
+  // A tuning configuration attached to F overrides the options
+  Optional<TuningConfig> Tuning = TuningConfig::get(F);
+  Advisor = Tuning && Tuning->Interchange ? *Tuning->Interchange
+                                          : getSelectedInterchangeAdvisor();
+  if (Tuning && Tuning->MergeWidth)
+    CM.limitVectorWidth(Tuning->MergeWidth);
   
-  // Process each loop in the function
+  FunctionAnalyses FA{LI, SE, DT, DI, MAP, ORE, CM};
+  InterchangedLoops.clear();
+  bool Interchanged = false;
+  bool Merged = false;
+  
+  // Process every loop of every nest, inner loops before the loops around
+  // them. Interchanges keep the loop structure, so the order stays valid.
   LLVM_DEBUG(dbgs() << "Analyzing loops in function " << F.getName() << "\n");
-  for (auto *L : LI) {
+  SmallVector<Loop *, 16> Loops = LI.getLoopsInReverseSiblingPreorder();
+  for (Loop *L : llvm::reverse(Loops)) {
     LLVM_DEBUG(dbgs() << "  Processing loop at depth " << L->getLoopDepth() << "\n");
-    Changed |= analyzeLoopMemoryAccess(L, LI);
-    
-    // Recursively process nested loops
-    for (auto *SubLoop : L->getSubLoops()) {
-      LLVM_DEBUG(dbgs() << "  Processing nested loop at depth " << SubLoop->getLoopDepth() << "\n");
-      Changed |= analyzeLoopMemoryAccess(SubLoop, LI);
-    }
+    Interchanged |= analyzeLoopMemoryAccess(L, FA);
   }
   
   // Process basic blocks for adjacent memory access merging
@@ -55,29 +343,58 @@ PreservedAnalyses MemoryCoalescingPass::run(Function &F, FunctionAnalysisManager
     
     if (MemInsts.size() > 1) {
       LLVM_DEBUG(dbgs() << "    Found " << MemInsts.size() << " memory instructions in basic block\n");
-      Changed |= mergeAdjacentAccesses(&BB, MemInsts);
+      Merged |= mergeAdjacentAccesses(&BB, MemInsts, AA, DT, ORE, CM);
     }
   }
   
+  bool Hinted = applyLoopHints(F, LI);
+  
+  bool Changed = Interchanged || Merged || Hinted;
   LLVM_DEBUG(dbgs() << "Memory Coalescing Pass complete. Changed: " << (Changed ? "yes" : "no") << "\n");
-  return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+  if (!Changed)
+    return PreservedAnalyses::all();
+  if (!PreserveAnalyses)
+    return PreservedAnalyses::none();
+  
+  // Interchanges rewrite loop controls and merging rewrites memory
+  // instructions; neither touches the CFG. Interchanges forget the loops
+  // they change in scalar evolution, while merged loads are replaced by
+  // new values. Both move the accesses the patterns describe.
+  PreservedAnalyses PA;
+  PA.preserveSet<CFGAnalyses>();
+  if (!Merged)
+    PA.preserve<ScalarEvolutionAnalysis>();
+  if (!Interchanged && !Merged)
+    PA.preserve<MemoryAccessPatternAnalysis>();
+  return PA;
 }
 
-bool MemoryCoalescingPass::analyzeLoopMemoryAccess(Loop *L, LoopInfo &LI) {
+bool MemoryCoalescingPass::analyzeLoopMemoryAccess(Loop *L, FunctionAnalyses &FA) {
   LLVM_DEBUG(dbgs() << "Analyzing loop for memory access patterns\n");
   
   bool Changed = false;
   SmallVector<Instruction*, 8> StridedLoads;
   
-  // Collect strided load instructions
+  // Collect strided load instructions. Blocks of nested loops are left to
+  // the visits of those loops, so every load is classified once, in its
+  // innermost loop.
   for (auto *BB : L->getBlocks()) {
+    if (FA.LI.getLoopFor(BB) != L)
+      continue;
     LLVM_DEBUG(dbgs() << "  Scanning basic block: " << BB->getName() << " for strided memory accesses\n");
     for (auto &I : *BB) {
       if (auto *LI = dyn_cast<LoadInst>(&I)) {
-        int Stride = 0;
-        if (isStridedAccess(LI, Stride)) {
+        int64_t Stride = 0;
+        ++NumAccessesAnalyzed;
+        if (isStridedAccess(LI, FA.MAP, Stride)) {
+          ++NumStridedAccesses;
           StridedLoads.push_back(LI);
           LLVM_DEBUG(dbgs() << "    Found strided load: " << *LI << " with stride: " << Stride << "\n");
+          FA.ORE.emit([&]() {
+            return OptimizationRemarkAnalysis(DEBUG_TYPE, "StridedAccess", LI)
+                   << "load has a stride of " << NV("Stride", Stride)
+                   << " bytes in loop " << NV("Loop", L->getHeader()->getName());
+          });
         }
       }
     }
@@ -86,7 +403,7 @@ bool MemoryCoalescingPass::analyzeLoopMemoryAccess(Loop *L, LoopInfo &LI) {
   // Transform strided loads if possible
   if (!StridedLoads.empty()) {
     LLVM_DEBUG(dbgs() << "  Found " << StridedLoads.size() << " strided loads to transform\n");
-    Changed |= transformStridedAccess(L, StridedLoads);
+    Changed |= transformStridedAccess(L, StridedLoads, FA);
   } else {
     LLVM_DEBUG(dbgs() << "  No strided loads found in this loop\n");
   }
@@ -94,35 +411,19 @@ bool MemoryCoalescingPass::analyzeLoopMemoryAccess(Loop *L, LoopInfo &LI) {
   return Changed;
 }
 
-bool MemoryCoalescingPass::isStridedAccess(Instruction *I, int &Stride) {
-  // For this simple implementation, we'll detect common patterns of strided access
-  // A more robust implementation would use scalar evolution
-  
+bool MemoryCoalescingPass::isStridedAccess(Instruction *I,
+                                           const MemoryAccessPatternInfo &MAP,
+                                           int64_t &Stride) {
+  // The access pattern analysis has already expressed the address as an
+  // affine function of the enclosing loops; we only look at the stride of
+  // the innermost one.
   LLVM_DEBUG(dbgs() << "    Checking if instruction is a strided access: " << *I << "\n");
   
-  // We're looking for: ptr = base + i * stride
-  if (auto *LI = dyn_cast<LoadInst>(I)) {
-    if (auto *GEP = dyn_cast<GetElementPtrInst>(LI->getPointerOperand())) {
-      LLVM_DEBUG(dbgs() << "      Examining GEP: " << *GEP << "\n");
-      
-      // Simple pattern: constant index multiplied by loop induction variable
-      if (GEP->getNumIndices() == 1) {
-        Value *Index = GEP->getOperand(1);
-        LLVM_DEBUG(dbgs() << "      Index operand: " << *Index << "\n");
-        
-        if (auto *Mul = dyn_cast<BinaryOperator>(Index)) {
-          if (Mul->getOpcode() == Instruction::Mul) {
-            LLVM_DEBUG(dbgs() << "      Found multiplication: " << *Mul << "\n");
-            
-            if (auto *ConstInt = dyn_cast<ConstantInt>(Mul->getOperand(1))) {
-              Stride = ConstInt->getSExtValue();
-              LLVM_DEBUG(dbgs() << "      Detected stride: " << Stride << "\n");
-              return true;
-            }
-          }
-        }
-      }
-    }
+  const AccessPattern *P = MAP.getPattern(I);
+  if (P && P->isStrided()) {
+    Stride = *P->getInnermostStride();
+    LLVM_DEBUG(dbgs() << "      Detected stride: " << Stride << " bytes\n");
+    return true;
   }
   
   LLVM_DEBUG(dbgs() << "      Not a strided access\n");
@@ -130,60 +431,244 @@ bool MemoryCoalescingPass::isStridedAccess(Instruction *I, int &Stride) {
   return false;
 }
 
-bool MemoryCoalescingPass::transformStridedAccess(Loop *L, SmallVector<Instruction*, 8> &StridedLoads) {
+bool MemoryCoalescingPass::transformStridedAccess(Loop *L, SmallVector<Instruction*, 8> &StridedLoads,
+                                                  FunctionAnalyses &FA) {
   LLVM_DEBUG(dbgs() << "Transforming strided memory accesses in loop\n");
   
-  // In a real implementation, this would transform the loop and memory access pattern
-  // For simplicity, we'll just return true indicating the changes would be made
+  // Strided accesses are reordered one innermost loop at a time, together
+  // with the perfect nest around it; a nest already interchanged from
+  // another of its innermost loops is left alone
+  if (!L->isInnermost() || InterchangedLoops.count(L))
+    return false;
+  Loop *Innermost = L;
+  bool Changed = false;
+  
+  SmallVector<LoopControl, 4> Band;
+  getPerfectLoopBand(Innermost, Band);
+  if (Band.size() < 2) {
+    LLVM_DEBUG(dbgs() << "  Loop " << Innermost->getHeader()->getName()
+                      << " is not part of a perfect nest\n");
+    FA.ORE.emit([&]() {
+      return OptimizationRemarkMissed(DEBUG_TYPE, "NotPerfectNest",
+                                      Innermost->getStartLoc(), Innermost->getHeader())
+             << "loop " << NV("Loop", Innermost->getHeader()->getName())
+             << " has strided loads but is not part of a perfect loop nest, "
+                "so it cannot be interchanged";
+    });
+    return false;
+  }
+  
+  unsigned InnerIdx = Band.size() - 1;
+  MemoryCost CurrentCost = FA.CM.getLoopCost(Innermost, Innermost, FA.MAP);
+  
+  // Features are only needed by the model and the training log
+  InterchangeTrainingLog *Log = getInterchangeTrainingLog();
+  bool NeedsFeatures = Advisor == InterchangeAdvisorKind::Model || Log;
+  SmallVector<const Loop *, 4> BandLoops;
+  for (auto &C : Band)
+    BandLoops.push_back(C.L);
+  SmallVector<InterchangeRecord, 4> Records(InnerIdx);
+  
+  // Enclosing loops that give at least one strided access a unit stride
+  // and whose interchange the advisor accepts, cheapest first
+  SmallVector<std::pair<MemoryCost, unsigned>, 4> Candidates;
+  bool HasUnitStrideLoop = false;
+  for (unsigned Idx = 0; Idx < InnerIdx; ++Idx) {
+    Loop *Outer = Band[Idx].L;
+    bool MakesUnitStride = llvm::any_of(StridedLoads, [&](Instruction *I) {
+      const AccessPattern *P = FA.MAP.getPattern(I);
+      if (P->InnermostLoop != Innermost)
+        return false;
+      const LoopStride *S = P->getStride(Outer);
+      return S && S->ConstantBytes &&
+             static_cast<uint64_t>(std::abs(*S->ConstantBytes)) == P->AccessSize;
+    });
+    if (!MakesUnitStride)
+      continue;
+    HasUnitStrideLoop = true;
+    
+    TransformCost Cost = FA.CM.getInterchangeCost(Innermost, Outer, FA.MAP);
+    LLVM_DEBUG({
+      dbgs() << "  Cost per iteration with " << Outer->getHeader()->getName()
+             << " innermost: ";
+      Cost.After.print(dbgs());
+      dbgs() << " (currently ";
+      Cost.Before.print(dbgs());
+      dbgs() << ")\n";
+    });
+    InterchangeFeatures Features;
+    if (NeedsFeatures)
+      Features = extractInterchangeFeatures(BandLoops, Idx, FA.MAP, FA.CM);
+    bool Decision = adviseInterchange(Advisor, Features, Cost);
+    if (Decision)
+      Candidates.push_back({Cost.After, Idx});
+    
+    if (Log) {
+      InterchangeRecord &R = Records[Idx];
+      R.Function = Innermost->getHeader()->getParent()->getName().str();
+      R.Loop = Innermost->getHeader()->getName().str();
+      R.OuterLoop = Outer->getHeader()->getName().str();
+      R.Features = Features;
+      R.Decision = Decision;
+      R.Profitable = Cost.isProfitable();
+    }
+  }
+  llvm::stable_sort(Candidates, [](const std::pair<MemoryCost, unsigned> &A,
+                                   const std::pair<MemoryCost, unsigned> &B) {
+    return A.first < B.first;
+  });
   
-  // The actual transformation would:
-  // 1. Analyze the strided access pattern
-  // 2. Determine if loop interchange would improve coalescing
-  // 3. Transform the loop structure if beneficial
+  auto LoopName = [](Loop *Lp) { return Lp->getHeader()->getName(); };
+  auto Missed = [&](StringRef RemarkName) {
+    return OptimizationRemarkMissed(DEBUG_TYPE, RemarkName, Innermost->getStartLoc(),
+                                    Innermost->getHeader())
+           << "loop " << NV("Loop", LoopName(Innermost)) << ": ";
+  };
+  if (Candidates.empty()) {
+    FA.ORE.emit([&]() {
+      if (!HasUnitStrideLoop)
+        return Missed("NoUnitStrideLoop")
+               << "no enclosing loop of the perfect nest walks its strided loads "
+                  "with unit stride";
+      if (Advisor != InterchangeAdvisorKind::Heuristic)
+        return Missed("NotAdvised")
+               << "the " << NV("Advisor", getInterchangeAdvisorName(Advisor))
+               << " advisor rejected every interchange";
+      return Missed("NotProfitable")
+             << "no interchange reduces the "
+             << NV("CacheLines", formatCost(CurrentCost.CacheLines))
+             << " cache lines touched or the memory instruction cost of "
+             << NV("InstructionCost", formatCost(CurrentCost.Instructions))
+             << " per iteration";
+    });
+  }
   
-  for (auto *Load : StridedLoads) {
-    LLVM_DEBUG(dbgs() << "  Would transform strided load: " << *Load << "\n");
-    // Here we would actually transform the code
+  for (auto &Candidate : Candidates) {
+    unsigned OuterIdx = Candidate.second;
+    Loop *Outer = Band[OuterIdx].L;
+    if (!isInterchangeLegal(Band, OuterIdx, InnerIdx, FA.DI)) {
+      LLVM_DEBUG(dbgs() << "  Interchange with " << Band[OuterIdx].L->getHeader()->getName()
+                        << " is not legal\n");
+      FA.ORE.emit([&]() {
+        return Missed("InterchangeIllegal")
+               << "interchange with loop " << NV("OuterLoop", LoopName(Outer))
+               << " would violate a memory dependence";
+      });
+      continue;
+    }
+    if (!interchangeLoops(Band[OuterIdx], Band[InnerIdx], FA.SE, FA.DT)) {
+      FA.ORE.emit([&]() {
+        return Missed("InterchangeFailed")
+               << "the loop controls of " << NV("OuterLoop", LoopName(Outer))
+               << " and the inner loop cannot be exchanged";
+      });
+      continue;
+    }
+    
+    FA.ORE.emit([&]() {
+      return OptimizationRemark(DEBUG_TYPE, "Interchanged", Innermost->getStartLoc(),
+                                Innermost->getHeader())
+             << "interchanged loop " << NV("Loop", LoopName(Innermost))
+             << " with enclosing loop " << NV("OuterLoop", LoopName(Outer))
+             << ", changing the cache lines touched per iteration from "
+             << NV("OldCacheLines", formatCost(CurrentCost.CacheLines)) << " to "
+             << NV("NewCacheLines", formatCost(Candidate.first.CacheLines))
+             << " and the memory instruction cost from "
+             << NV("OldInstructionCost", formatCost(CurrentCost.Instructions)) << " to "
+             << NV("NewInstructionCost", formatCost(Candidate.first.Instructions));
+    });
+    ++NumNestsInterchanged;
+    for (auto &C : Band)
+      InterchangedLoops.insert(C.L);
+    Records[OuterIdx].Applied = true;
+    Changed = true;
+    break;
   }
   
-  return true; // Pretend we made changes for demonstration
+  if (Log)
+    for (InterchangeRecord &R : Records)
+      if (!R.Function.empty())
+        Log->record(std::move(R));
+  
+  return Changed;
+}
+
+bool MemoryCoalescingPass::applyLoopHints(Function &F, LoopInfo &LI) {
+  Optional<TuningConfig> Tuning = TuningConfig::get(F);
+  if (!Tuning || (!Tuning->UnrollCount && !Tuning->VectorizeWidth))
+    return false;
+  
+  // Loops that already carry the hints, e.g. when the pass runs twice,
+  // keep their loop ID
+  bool Changed = false;
+  for (Loop *L : LI.getLoopsInPreorder()) {
+    if (!L->isInnermost())
+      continue;
+    LLVM_DEBUG(dbgs() << "  Tuning hints for loop " << L->getHeader()->getName()
+                      << ": " << Tuning->toString() << "\n");
+    MDNode *LoopID = L->getLoopID();
+    if (Tuning->UnrollCount)
+      addStringMetadataToLoop(L, "llvm.loop.unroll.count", Tuning->UnrollCount);
+    if (Tuning->VectorizeWidth) {
+      addStringMetadataToLoop(L, "llvm.loop.vectorize.width", Tuning->VectorizeWidth);
+      if (Tuning->VectorizeWidth > 1)
+        addStringMetadataToLoop(L, "llvm.loop.vectorize.enable", 1);
+    }
+    Changed |= L->getLoopID() != LoopID;
+  }
+  return Changed;
 }
 
-bool MemoryCoalescingPass::mergeAdjacentAccesses(BasicBlock *BB, SmallVector<Instruction*, 8> &MemInsts) {
+bool MemoryCoalescingPass::mergeAdjacentAccesses(BasicBlock *BB, SmallVector<Instruction*, 8> &MemInsts,
+                                                 AAResults &AA, DominatorTree &DT,
+                                                 OptimizationRemarkEmitter &ORE,
+                                                 const CoalescingCostModel &CM) {
   LLVM_DEBUG(dbgs() << "Looking for adjacent memory accesses to merge in " << BB->getName() << "\n");
   
+  const DataLayout &DL = BB->getModule()->getDataLayout();
   bool Changed = false;
   
-  // In a real implementation, this would identify adjacent loads/stores and merge them
-  // For simplicity, we'll just look for adjacent loads of the same type and pretend to merge them
-  
-  for (size_t i = 0; i < MemInsts.size() - 1; ++i) {
-    if (auto *Load1 = dyn_cast<LoadInst>(MemInsts[i])) {
-      if (auto *Load2 = dyn_cast<LoadInst>(MemInsts[i + 1])) {
-        LLVM_DEBUG(dbgs() << "  Checking loads for adjacency:\n");
-        LLVM_DEBUG(dbgs() << "    Load1: " << *Load1 << "\n");
-        LLVM_DEBUG(dbgs() << "    Load2: " << *Load2 << "\n");
-        
-        // Check if the loads are from adjacent memory locations
-        // This is a simplified check and would be more complex in real implementation
-        
-        if (Load1->getType() == Load2->getType()) {
-          LLVM_DEBUG(dbgs() << "    Types match, checking for adjacency\n");
-          
-          // For demonstration purposes only - indicate we found a candidate
-          LLVM_DEBUG(dbgs() << "    Found candidate loads to merge: " 
-                           << *Load1 << " and " << *Load2 << "\n");
-          
-          // In a real implementation, we would:
-          // 1. Check if these loads are actually adjacent in memory
-          // 2. Create a wider load instruction if possible
-          // 3. Extract the individual values with bitwise operations
-          // 4. Replace the original loads with the extracted values
-          
-          Changed = true; // Pretend we made changes
-        }
-      }
+  // Group accesses by kind, element type and the underlying object their
+  // address is a constant offset from
+  MapVector<AccessGroupKey, SmallVector<ChainElem, 8>> Groups;
+  for (auto *I : MemInsts) {
+    if (!isMergeCandidate(I, DL))
+      continue;
+    
+    Value *Ptr = getLoadStorePointerOperand(I);
+    APInt Offset(DL.getIndexTypeSizeInBits(Ptr->getType()), 0);
+    Value *Base = Ptr->stripAndAccumulateConstantOffsets(DL, Offset, /*AllowNonInbounds=*/true);
+    if (Offset.getMinSignedBits() > 64)
+      continue;
+    
+    AccessGroupKey Key(Base, getLoadStoreType(I), isa<LoadInst>(I));
+    Groups[Key].push_back({I, Offset.getSExtValue()});
+  }
+  
+  for (auto &Group : Groups) {
+    Type *ElemTy = std::get<1>(Group.first);
+    int64_t ElemSize = DL.getTypeStoreSize(ElemTy);
+    unsigned MaxVF = CM.getMaxMergeFactor(ElemTy);
+    if (MaxVF < 2)
+      continue;
+    
+    // Sort by offset and split into runs of contiguous, distinct addresses
+    auto &Elems = Group.second;
+    llvm::stable_sort(Elems, [](const ChainElem &A, const ChainElem &B) {
+      return A.Offset < B.Offset;
+    });
+    
+    SmallVector<ChainElem, 8> Run;
+    auto FlushRun = [&]() {
+      Changed |= mergeRun(Run, std::get<0>(Group.first), MaxVF, AA, DT, DL, ORE, CM);
+      Run.clear();
+    };
+    for (const ChainElem &E : Elems) {
+      if (!Run.empty() && E.Offset != Run.back().Offset + ElemSize)
+        FlushRun();
+      Run.push_back(E);
     }
+    FlushRun();
   }
   
   return Changed;
@@ -196,4 +681,103 @@ FunctionPassManager buildMemoryCoalescingPipeline() {
   return FPM;
 }
 
+void registerMemoryCoalescingAnalyses(FunctionAnalysisManager &FAM) {
+  FAM.registerPass([] { return MemoryAccessPatternAnalysis(); });
+  FAM.registerPass([] { return WarpTransactionAnalysis(); });
+}
+
+StringRef getExtensionPointName(CoalescingExtensionPoint EP) {
+  switch (EP) {
+  case CoalescingExtensionPoint::None:
+    return "none";
+  case CoalescingExtensionPoint::PipelineStart:
+    return "pipeline-start";
+  case CoalescingExtensionPoint::ScalarOptimizerLate:
+    return "scalar-optimizer-late";
+  case CoalescingExtensionPoint::VectorizerStart:
+    return "vectorizer-start";
+  case CoalescingExtensionPoint::OptimizerLast:
+    return "optimizer-last";
+  }
+  llvm_unreachable("unknown extension point");
+}
+
+Optional<CoalescingExtensionPoint> parseExtensionPoint(StringRef Name) {
+  for (auto EP : {CoalescingExtensionPoint::None,
+                  CoalescingExtensionPoint::PipelineStart,
+                  CoalescingExtensionPoint::ScalarOptimizerLate,
+                  CoalescingExtensionPoint::VectorizerStart,
+                  CoalescingExtensionPoint::OptimizerLast})
+    if (getExtensionPointName(EP) == Name)
+      return EP;
+  return None;
+}
+
+CoalescingExtensionPoint getSelectedExtensionPoint() {
+  return SelectedExtensionPoint;
+}
+
+void registerMemoryCoalescingPass(PassBuilder &PB,
+                                  CoalescingExtensionPoint EP) {
+  if (PassInstrumentationCallbacks *PIC = PB.getPassInstrumentationCallbacks()) {
+    PIC->addClassToPassName(MemoryCoalescingPass::name(), "memory-coalescing");
+    PIC->addClassToPassName(MemoryAccessPatternAnalysis::name(),
+                            "memory-access-pattern");
+    PIC->addClassToPassName(WarpTransactionAnalysis::name(),
+                            "warp-transactions");
+  }
+  PB.registerAnalysisRegistrationCallback(
+      [](FunctionAnalysisManager &FAM) { registerMemoryCoalescingAnalyses(FAM); });
+  PB.registerPipelineParsingCallback(
+      [](StringRef Name, FunctionPassManager &FPM,
+         ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name == "memory-coalescing") {
+          FPM.addPass(MemoryCoalescingPass());
+          return true;
+        }
+        if (Name == "print<warp-transactions>") {
+          FPM.addPass(WarpTransactionPrinterPass(errs()));
+          return true;
+        }
+        return parseAnalysisUtilityPasses<MemoryAccessPatternAnalysis,
+                                          Function>("memory-access-pattern",
+                                                    Name, FPM) ||
+               parseAnalysisUtilityPasses<WarpTransactionAnalysis, Function>(
+                   "warp-transactions", Name, FPM);
+      });
+
+  switch (EP) {
+  case CoalescingExtensionPoint::None:
+    break;
+  case CoalescingExtensionPoint::PipelineStart:
+    PB.registerPipelineStartEPCallback(
+        [](ModulePassManager &MPM, OptimizationLevel) {
+          MPM.addPass(createModuleToFunctionPassAdaptor(MemoryCoalescingPass()));
+        });
+    break;
+  case CoalescingExtensionPoint::ScalarOptimizerLate:
+    PB.registerScalarOptimizerLateEPCallback(
+        [](FunctionPassManager &FPM, OptimizationLevel) {
+          FPM.addPass(MemoryCoalescingPass());
+        });
+    break;
+  case CoalescingExtensionPoint::VectorizerStart:
+    PB.registerVectorizerStartEPCallback(
+        [](FunctionPassManager &FPM, OptimizationLevel) {
+          FPM.addPass(MemoryCoalescingPass());
+        });
+    break;
+  case CoalescingExtensionPoint::OptimizerLast:
+    PB.registerOptimizerLastEPCallback(
+        [](ModulePassManager &MPM, OptimizationLevel) {
+          MPM.addPass(createModuleToFunctionPassAdaptor(MemoryCoalescingPass()));
+        });
+    break;
+  }
+}
+
+void registerMemoryCoalescingPass(PassBuilder &PB) {
+  registerMemoryCoalescingPass(PB, getSelectedExtensionPoint());
+}
+
 } // namespace mlcompileropt 
\ No newline at end of file
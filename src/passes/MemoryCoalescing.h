@@ -9,9 +9,20 @@
 #define MLCOMPILEROPT_PASSES_MEMORY_COALESCING_H
 
 #include "llvm/IR/PassManager.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/DependenceAnalysis.h"
 #include "llvm/Analysis/LoopAnalysisManager.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
+#include "llvm/Passes/PassBuilder.h"
+
+#include "passes/CoalescingCostModel.h"
+#include "passes/InterchangeAdvisor.h"
+#include "passes/MemoryAccessPattern.h"
 
 namespace mlcompileropt {
 
@@ -24,22 +35,88 @@ public:
   static bool isRequired() { return true; }
 
 private:
-  // Analyzes memory access patterns in a loop
-  bool analyzeLoopMemoryAccess(llvm::Loop *L, llvm::LoopInfo &LI);
+  // Analyses used by the helpers while the pass runs on one function
+  struct FunctionAnalyses {
+    llvm::LoopInfo &LI;
+    llvm::ScalarEvolution &SE;
+    llvm::DominatorTree &DT;
+    llvm::DependenceInfo &DI;
+    const MemoryAccessPatternInfo &MAP;
+    llvm::OptimizationRemarkEmitter &ORE;
+    const CoalescingCostModel &CM;
+  };
+
+  // Analyzes the memory accesses of a loop that are not inside one of its
+  // subloops; run visits the loops of a nest innermost first
+  bool analyzeLoopMemoryAccess(llvm::Loop *L, FunctionAnalyses &FA);
   
-  // Checks if a given instruction is a strided memory access
-  bool isStridedAccess(llvm::Instruction *I, int &Stride);
+  // Checks if a given instruction is a strided memory access and returns
+  // its innermost-loop stride in bytes
+  bool isStridedAccess(llvm::Instruction *I, const MemoryAccessPatternInfo &MAP,
+                       int64_t &Stride);
   
-  // Transforms strided memory accesses to coalesced access pattern
-  bool transformStridedAccess(llvm::Loop *L, llvm::SmallVector<llvm::Instruction*, 8> &StridedLoads);
+  // Transforms strided memory accesses to coalesced access pattern by
+  // interchanging the innermost loop with an enclosing loop of the same
+  // perfect nest that walks the strided accesses with unit stride, if the
+  // cost model finds the interchange profitable
+  bool transformStridedAccess(llvm::Loop *L, llvm::SmallVector<llvm::Instruction*, 8> &StridedLoads,
+                              FunctionAnalyses &FA);
   
-  // Merges adjacent memory accesses when beneficial
-  bool mergeAdjacentAccesses(llvm::BasicBlock *BB, llvm::SmallVector<llvm::Instruction*, 8> &MemInsts);
+  // Merges runs of loads (or stores) from contiguous addresses into single
+  // vector loads (stores) where the cost model finds that cheaper
+  bool mergeAdjacentAccesses(llvm::BasicBlock *BB, llvm::SmallVector<llvm::Instruction*, 8> &MemInsts,
+                             llvm::AAResults &AA, llvm::DominatorTree &DT,
+                             llvm::OptimizationRemarkEmitter &ORE,
+                             const CoalescingCostModel &CM);
+
+  // Attaches the unroll and vectorization hints of the function's tuning
+  // configuration to its innermost loops
+  bool applyLoopHints(llvm::Function &F, llvm::LoopInfo &LI);
+
+  // Decides the interchanges in the current function: its tuned advisor,
+  // or the one selected with -memory-coalescing-advisor
+  InterchangeAdvisorKind Advisor = InterchangeAdvisorKind::Heuristic;
+
+  // Loops of nests already interchanged in the current function
+  llvm::SmallPtrSet<const llvm::Loop *, 8> InterchangedLoops;
 };
 
 // Factory function to create the pass for registration
 llvm::FunctionPassManager buildMemoryCoalescingPipeline();
 
+// Registers the analyses the pass depends on, and the warp transaction
+// analysis that scores its effect, with a FunctionAnalysisManager
+void registerMemoryCoalescingAnalyses(llvm::FunctionAnalysisManager &FAM);
+
+// Points of the default pipelines the pass can be added at
+enum class CoalescingExtensionPoint {
+  None,                // Only run when named in a textual pipeline
+  PipelineStart,       // Before any other pass, on unoptimized IR
+  ScalarOptimizerLate, // End of the function simplification pipeline
+  VectorizerStart,     // After loop canonicalization, before vectorization
+  OptimizerLast,       // After the whole optimization pipeline
+};
+
+// Command-line name of EP, e.g. "vectorizer-start"
+llvm::StringRef getExtensionPointName(CoalescingExtensionPoint EP);
+
+// Inverse of getExtensionPointName
+llvm::Optional<CoalescingExtensionPoint> parseExtensionPoint(llvm::StringRef Name);
+
+// Extension point selected with -memory-coalescing-ep
+CoalescingExtensionPoint getSelectedExtensionPoint();
+
+// Makes the pass available to PB: registers its analyses with every
+// FunctionAnalysisManager PB sets up, the pipeline names
+// "memory-coalescing" and "require<memory-access-pattern>", also with PB's
+// instrumentation, and, unless EP is None, adds the pass to the default
+// pipelines at EP.
+void registerMemoryCoalescingPass(llvm::PassBuilder &PB,
+                                  CoalescingExtensionPoint EP);
+
+// Same, at the extension point selected with -memory-coalescing-ep
+void registerMemoryCoalescingPass(llvm::PassBuilder &PB);
+
 } // namespace mlcompileropt
 
 #endif // MLCOMPILEROPT_PASSES_MEMORY_COALESCING_H 
\ No newline at end of file
@@ -0,0 +1,52 @@
+//===- MemoryCoalescingPlugin.cpp - opt Plugin for Memory Coalescing -===//
+//
+// Entry point of the MemoryCoalescingPlugin shared library, which makes
+// the memory coalescing pass available to LLVM tools that load pass
+// plugins:
+//
+//   opt -load-pass-plugin=MemoryCoalescingPlugin.so
+//       -passes='function(memory-coalescing)' input.ll
+//
+// In default<On> pipelines the pass runs at the extension point selected
+// with -memory-coalescing-ep. The loop fusion pass is available as
+// "loop-fusion" and "loop-fission"; it runs at the start of the default
+// pipelines when selected with -loop-fusion-mode. The loop tiling pass,
+// "loop-tiling", runs there on the functions selected with -loop-tiling
+// or a tile tuning parameter. The reduction vectorization pass,
+// "reduction-vectorize", runs before the loop vectorizer unless
+// -reduction-vectorize=false, and the software prefetch pass,
+// "software-prefetch", at the end of the pipelines on the functions
+// selected with -software-prefetch or a prefetch tuning parameter. The loop
+// parallelization pass, "loop-parallelize", runs between loop fusion and
+// loop tiling on the functions selected with -loop-parallelize or a
+// parallel tuning parameter.
+//
+//===----------------------------------------------------------------===//
+
+#include "passes/LoopFusion.h"
+#include "passes/LoopParallelization.h"
+#include "passes/LoopTiling.h"
+#include "passes/MemoryCoalescing.h"
+#include "passes/ReductionVectorization.h"
+#include "passes/SoftwarePrefetch.h"
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+using namespace llvm;
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "MemoryCoalescing", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            mlcompileropt::registerMemoryCoalescingPass(PB);
+            mlcompileropt::registerLoopFusionPass(
+                PB, mlcompileropt::getSelectedLoopFusionMode() !=
+                        mlcompileropt::LoopFusionMode::None);
+            mlcompileropt::registerLoopParallelizePass(PB, true);
+            mlcompileropt::registerLoopTilingPass(PB, true);
+            mlcompileropt::registerReductionVectorizePass(
+                PB, mlcompileropt::isReductionVectorizationEnabled());
+            mlcompileropt::registerSoftwarePrefetchPass(PB, true);
+          }};
+}
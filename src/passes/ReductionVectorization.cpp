@@ -0,0 +1,615 @@
+//===- ReductionVectorization.cpp - Vector Partial-Sum Reductions ---===//
+//
+// Implementation of the reduction vectorization pass. Each vectorized
+// loop gets a vector copy that runs the iterations in multiples of the
+// vector width; the original loop runs the remainder:
+//
+//   preheader --> vector loop --> middle --> scalar preheader --> loop
+//       |                           |                              |
+//       +---------------------------|-----> scalar preheader       v
+//                                   +--------------------------> exit
+//
+//===----------------------------------------------------------------===//
+
+#include "passes/ReductionVectorization.h"
+#include "passes/LoopNest.h"
+#include "passes/MemoryAccessPattern.h"
+#include "passes/MemoryCoalescing.h"
+#include "passes/TuningConfig.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
+
+#define DEBUG_TYPE "reduction-vectorize"
+
+using namespace llvm;
+using ore::NV;
+
+namespace mlcompileropt {
+
+ALWAYS_ENABLED_STATISTIC(NumReductionsVectorized,
+                         "Number of floating-point reductions vectorized");
+ALWAYS_ENABLED_STATISTIC(NumLoopsVectorized,
+                         "Number of loops with vectorized reductions");
+
+namespace {
+
+cl::opt<bool> EnableReductionVectorization(
+    "reduction-vectorize", cl::init(true),
+    cl::desc("Vectorize floating-point reductions before the loop "
+             "vectorizer in the default pipelines"));
+
+cl::opt<unsigned> WidthOpt(
+    "reduction-vectorize-width", cl::init(0), cl::Hidden,
+    cl::desc("Lanes of vectorized reductions (default: the target's vector "
+             "register width)"));
+
+cl::opt<bool> AllowReassociation(
+    "reduction-vectorize-reassoc", cl::init(false),
+    cl::desc("Also reassociate floating-point reductions that do not carry "
+             "the reassoc fast-math flag, which changes their rounding"));
+
+// How the vector loop loads a value the loop loads once per iteration
+enum class LoadKind {
+  Invariant,  // Same address in every iteration: one load, splat
+  Contiguous, // Consecutive elements: one vector load
+  PerLane,    // Any other stride: one load per lane
+};
+
+// acc = phi [Init, preheader], [Update, latch] with Update one of
+//   acc + Addend, Addend + acc, acc - Addend, fmuladd(MulLHS, MulRHS, acc)
+// and acc + MulLHS * MulRHS if the product is only used there
+struct Reduction {
+  PHINode *Phi = nullptr;
+  Instruction *Update = nullptr;
+  Value *Init = nullptr;
+  Value *Addend = nullptr;
+  Value *MulLHS = nullptr;
+  Value *MulRHS = nullptr;
+  bool Subtract = false;
+};
+
+struct Candidate {
+  LoopControl Control;
+  SmallVector<Reduction, 2> Reductions;
+  DenseMap<const LoadInst *, LoadKind> Loads;
+  const SCEV *TripCount = nullptr;
+};
+
+bool matchReduction(PHINode &Phi, const Loop *L, bool Reassociate,
+                    Reduction &R) {
+  if (!Phi.getType()->isFloatingPointTy() || Phi.getNumIncomingValues() != 2 ||
+      !Phi.hasOneUse())
+    return false;
+  auto *Update = dyn_cast<Instruction>(
+      Phi.getIncomingValueForBlock(L->getLoopLatch()));
+  if (!Update || Phi.user_back() != Update)
+    return false;
+  R.Phi = &Phi;
+  R.Update = Update;
+  R.Init = Phi.getIncomingValueForBlock(L->getLoopPreheader());
+
+  if (auto *Call = dyn_cast<IntrinsicInst>(Update)) {
+    if (Call->getIntrinsicID() != Intrinsic::fmuladd ||
+        Call->getArgOperand(2) != &Phi || Call->getArgOperand(0) == &Phi ||
+        Call->getArgOperand(1) == &Phi)
+      return false;
+    R.MulLHS = Call->getArgOperand(0);
+    R.MulRHS = Call->getArgOperand(1);
+    return true;
+  }
+
+  auto *BO = dyn_cast<BinaryOperator>(Update);
+  if (!BO)
+    return false;
+  Value *LHS = BO->getOperand(0), *RHS = BO->getOperand(1);
+  if (BO->getOpcode() == Instruction::FAdd && (LHS == &Phi) != (RHS == &Phi))
+    R.Addend = LHS == &Phi ? RHS : LHS;
+  else if (BO->getOpcode() == Instruction::FSub && LHS == &Phi && RHS != &Phi)
+    R.Addend = RHS, R.Subtract = true;
+  else
+    return false;
+
+  // A product used only here becomes part of the fmuladd, which rounds
+  // once instead of twice
+  auto *Mul = dyn_cast<BinaryOperator>(R.Addend);
+  if (!R.Subtract && Mul && Mul->getOpcode() == Instruction::FMul &&
+      Mul->hasOneUse() && L->contains(Mul) &&
+      (Reassociate || (Mul->hasAllowContract() && BO->hasAllowContract()))) {
+    R.MulLHS = Mul->getOperand(0);
+    R.MulRHS = Mul->getOperand(1);
+    R.Addend = nullptr;
+  }
+  return true;
+}
+
+// True if the vector loop can recompute V for any iteration: V only
+// depends on the induction variable through arithmetic
+bool canRematerialize(Value *V, const LoopControl &C) {
+  auto *I = dyn_cast<Instruction>(V);
+  if (!I || !C.L->contains(I) || I == C.IndVar)
+    return true;
+  if (isa<PHINode>(I) || I->mayReadOrWriteMemory() || I->mayHaveSideEffects())
+    return false;
+  return all_of(I->operands(),
+                [&](Value *Op) { return canRematerialize(Op, C); });
+}
+
+// Checks that the vector loop can compute V for VF iterations at once and
+// records how to load what it loads
+bool classifyOperand(Value *V, const LoopControl &C,
+                     const MemoryAccessPatternInfo &MAP, Candidate &Cand) {
+  auto *I = dyn_cast<Instruction>(V);
+  if (!I || !C.L->contains(I))
+    return true;
+
+  if (auto *Load = dyn_cast<LoadInst>(I)) {
+    if (!Load->isSimple() || !canRematerialize(Load->getPointerOperand(), C))
+      return false;
+    const AccessPattern *P = MAP.getPattern(Load);
+    const LoopStride *S = P && P->IsAffine ? P->getStride(C.L) : nullptr;
+    LoadKind Kind = LoadKind::PerLane;
+    if (S && S->ConstantBytes && *S->ConstantBytes == 0)
+      Kind = LoadKind::Invariant;
+    else if (S && S->ConstantBytes && *S->ConstantBytes == int64_t(P->AccessSize))
+      Kind = LoadKind::Contiguous;
+    Cand.Loads[Load] = Kind;
+    return true;
+  }
+
+  switch (I->getOpcode()) {
+  case Instruction::FAdd:
+  case Instruction::FSub:
+  case Instruction::FMul:
+  case Instruction::FDiv:
+  case Instruction::FNeg:
+  case Instruction::FPExt:
+  case Instruction::FPTrunc:
+    break;
+  case Instruction::Call:
+    if (cast<CallInst>(I)->getIntrinsicID() == Intrinsic::fmuladd)
+      break;
+    return false;
+  default:
+    return false;
+  }
+  auto IsVectorizable = [&](Value *Op) {
+    return classifyOperand(Op, C, MAP, Cand);
+  };
+  if (auto *Call = dyn_cast<CallInst>(I))
+    return all_of(Call->args(), IsVectorizable);
+  return all_of(I->operands(), IsVectorizable);
+}
+
+// Finds the reductions of L and checks that they can be vectorized; the
+// ones without the reassoc flag only if Reassociate. Returns false, with
+// Reason set if L has reductions, otherwise.
+bool analyzeLoop(Loop *L, ScalarEvolution &SE, const MemoryAccessPatternInfo &MAP,
+                 unsigned VF, bool Reassociate, Candidate &Cand,
+                 StringRef &Reason) {
+  if (!L->isInnermost() || L->getNumBlocks() != 1 ||
+      getBooleanLoopAttribute(L, "llvm.loop.isvectorized"))
+    return false;
+  LoopControl &C = Cand.Control;
+  if (!analyzeLoopControl(L, C) || !C.Step->isOne())
+    return false;
+  BasicBlock *Exit = L->getExitBlock();
+  if (!Exit || !Exit->getSinglePredecessor())
+    return false;
+  for (PHINode &Phi : L->getHeader()->phis()) {
+    if (&Phi == C.IndVar)
+      continue;
+    Reduction R;
+    if (!matchReduction(Phi, L, Reassociate, R))
+      return false;
+    Cand.Reductions.push_back(R);
+  }
+  if (Cand.Reductions.empty())
+    return false;
+
+  auto IsUpdate = [&](const Value *V) {
+    return any_of(Cand.Reductions,
+                  [&](const Reduction &R) { return R.Update == V; });
+  };
+  for (Instruction &I : *L->getHeader()) {
+    if (I.mayWriteToMemory() || I.mayHaveSideEffects()) {
+      Reason = "the loop writes memory";
+      return false;
+    }
+    for (User *U : I.users()) {
+      if (L->contains(cast<Instruction>(U)))
+        continue;
+      if (!IsUpdate(&I)) {
+        Reason = "a value other than the sums is used after the loop";
+        return false;
+      }
+    }
+  }
+
+  for (const Reduction &R : Cand.Reductions) {
+    if (!Reassociate && !R.Update->hasAllowReassoc()) {
+      Reason = "summing in a different order needs the reassoc fast-math "
+               "flag or -reduction-vectorize-reassoc";
+      return false;
+    }
+    for (Value *Op : {R.Addend, R.MulLHS, R.MulRHS}) {
+      if (Op && !classifyOperand(Op, C, MAP, Cand)) {
+        Reason = "an accumulated value cannot be computed for several "
+                 "iterations at once";
+        return false;
+      }
+    }
+  }
+  if (none_of(Cand.Loads, [](const auto &Entry) {
+        return Entry.second == LoadKind::Contiguous;
+      })) {
+    Reason = "no accumulated value is loaded from consecutive elements";
+    return false;
+  }
+
+  const SCEV *BackedgeTakenCount = SE.getBackedgeTakenCount(L);
+  if (isa<SCEVCouldNotCompute>(BackedgeTakenCount)) {
+    Reason = "the trip count cannot be computed before the loop";
+    return false;
+  }
+  Cand.TripCount = SE.getTruncateOrZeroExtend(
+      SE.getAddExpr(BackedgeTakenCount, SE.getOne(BackedgeTakenCount->getType())),
+      C.IndVar->getType());
+  if (auto *Constant = dyn_cast<SCEVConstant>(Cand.TripCount)) {
+    if (Constant->getAPInt().ult(VF)) {
+      Reason = "the loop runs fewer iterations than there are lanes";
+      return false;
+    }
+  }
+  return true;
+}
+
+// Builds the vector loop body: the values the reductions accumulate,
+// computed for VF consecutive iterations starting at VecIV
+class Widener {
+public:
+  Widener(const Candidate &Cand, IRBuilder<> &B, Value *VecIV, unsigned VF)
+      : Cand(Cand), C(Cand.Control), B(B), VF(VF), LaneIVs(VF),
+        Rematerialized(VF) {
+    LaneIVs[0] = VecIV;
+  }
+
+  Value *widen(Value *V) {
+    auto *I = dyn_cast<Instruction>(V);
+    if (!I || !C.L->contains(I))
+      return B.CreateVectorSplat(VF, V);
+    Value *&Vec = Widened[I];
+    if (!Vec)
+      Vec = widenInstruction(I);
+    return Vec;
+  }
+
+private:
+  Value *widenInstruction(Instruction *I) {
+    auto *VecTy = FixedVectorType::get(I->getType(), VF);
+    std::string Name = (I->getName() + ".vec").str();
+    if (auto *Load = dyn_cast<LoadInst>(I)) {
+      Value *Ptr = Load->getPointerOperand();
+      switch (Cand.Loads.lookup(Load)) {
+      case LoadKind::Invariant:
+        return B.CreateVectorSplat(
+            VF, B.CreateAlignedLoad(I->getType(), rematerialize(Ptr, 0),
+                                    Load->getAlign()));
+      case LoadKind::Contiguous: {
+        unsigned AS = Load->getPointerAddressSpace();
+        Value *VecPtr =
+            B.CreateBitCast(rematerialize(Ptr, 0), VecTy->getPointerTo(AS));
+        return B.CreateAlignedLoad(VecTy, VecPtr, Load->getAlign(), Name);
+      }
+      case LoadKind::PerLane: {
+        Value *Vec = PoisonValue::get(VecTy);
+        for (unsigned Lane = 0; Lane < VF; ++Lane) {
+          Value *Elt = B.CreateAlignedLoad(I->getType(), rematerialize(Ptr, Lane),
+                                           Load->getAlign());
+          Vec = B.CreateInsertElement(Vec, Elt, B.getInt32(Lane), Name);
+        }
+        return Vec;
+      }
+      }
+      llvm_unreachable("unknown load kind");
+    }
+
+    Value *Vec;
+    if (auto *Call = dyn_cast<IntrinsicInst>(I))
+      Vec = B.CreateIntrinsic(Intrinsic::fmuladd, {VecTy},
+                              {widen(Call->getArgOperand(0)),
+                               widen(Call->getArgOperand(1)),
+                               widen(Call->getArgOperand(2))},
+                              nullptr, Name);
+    else if (auto *BO = dyn_cast<BinaryOperator>(I))
+      Vec = B.CreateBinOp(BO->getOpcode(), widen(BO->getOperand(0)),
+                          widen(BO->getOperand(1)), Name);
+    else if (auto *UO = dyn_cast<UnaryOperator>(I))
+      Vec = B.CreateUnOp(UO->getOpcode(), widen(UO->getOperand(0)), Name);
+    else
+      Vec = B.CreateCast(cast<CastInst>(I)->getOpcode(), widen(I->getOperand(0)),
+                         VecTy, Name);
+    if (auto *VecI = dyn_cast<Instruction>(Vec))
+      VecI->copyIRFlags(I);
+    return Vec;
+  }
+
+  // Computes V, an address, for the iteration of lane Lane
+  Value *rematerialize(Value *V, unsigned Lane) {
+    if (V == C.IndVar) {
+      if (!LaneIVs[Lane])
+        LaneIVs[Lane] = B.CreateAdd(LaneIVs[0],
+                                    ConstantInt::get(V->getType(), Lane));
+      return LaneIVs[Lane];
+    }
+    auto *I = dyn_cast<Instruction>(V);
+    if (!I || !C.L->contains(I))
+      return V;
+    Value *&Copy = Rematerialized[Lane][I];
+    if (!Copy) {
+      Instruction *Clone = I->clone();
+      for (Use &Op : Clone->operands())
+        Op.set(rematerialize(Op.get(), Lane));
+      Copy = B.Insert(Clone, I->getName());
+    }
+    return Copy;
+  }
+
+  const Candidate &Cand;
+  const LoopControl &C;
+  IRBuilder<> &B;
+  unsigned VF;
+  SmallVector<Value *, 8> LaneIVs;
+  SmallVector<DenseMap<Instruction *, Value *>, 8> Rematerialized;
+  DenseMap<Instruction *, Value *> Widened;
+};
+
+MDNode *createVectorizedLoopID(LLVMContext &Ctx) {
+  Metadata *IsVectorized[] = {
+      MDString::get(Ctx, "llvm.loop.isvectorized"),
+      ConstantAsMetadata::get(ConstantInt::get(Type::getInt32Ty(Ctx), 1))};
+  TempMDNode Temp = MDNode::getTemporary(Ctx, None);
+  MDNode *ID = MDNode::getDistinct(Ctx, {Temp.get(), MDNode::get(Ctx, IsVectorized)});
+  ID->replaceOperandWith(0, ID);
+  return ID;
+}
+
+// Adds the vector loop in front of the loop of Cand, which then only runs
+// the iterations left over
+void vectorizeReductions(const Candidate &Cand, unsigned VF,
+                         ScalarEvolution &SE, const DataLayout &DL) {
+  const LoopControl &C = Cand.Control;
+  BasicBlock *Body = C.L->getHeader();
+  BasicBlock *Preheader = C.L->getLoopPreheader();
+  BasicBlock *Exit = C.L->getExitBlock();
+  Function *F = Body->getParent();
+  LLVMContext &Ctx = F->getContext();
+  Type *IVTy = C.IndVar->getType();
+  addStringMetadataToLoop(C.L, "llvm.loop.isvectorized", 1);
+
+  BasicBlock *ScalarPH = SplitBlock(Preheader, Preheader->getTerminator());
+  ScalarPH->setName(Body->getName() + ".scalar.ph");
+  auto *VecBody = BasicBlock::Create(Ctx, Body->getName() + ".vec", F, ScalarPH);
+  auto *Middle =
+      BasicBlock::Create(Ctx, Body->getName() + ".vec.middle", F, ScalarPH);
+
+  // The vector loop runs the largest multiple of VF iterations
+  IRBuilder<> B(Preheader->getTerminator());
+  SCEVExpander Expander(SE, DL, "reduction-vectorize");
+  Value *TripCount =
+      Expander.expandCodeFor(Cand.TripCount, IVTy, Preheader->getTerminator());
+  Value *VecTripCount = B.CreateAnd(
+      TripCount, ConstantInt::get(IVTy, -int64_t(VF), /*isSigned=*/true),
+      "vec.trip.count");
+  Value *VecEnd = B.CreateAdd(C.Start, VecTripCount, "vec.end");
+  Value *SkipVector =
+      B.CreateICmpEQ(VecTripCount, ConstantInt::get(IVTy, 0), "vec.skip");
+  Preheader->getTerminator()->eraseFromParent();
+  BranchInst::Create(ScalarPH, VecBody, SkipVector, Preheader);
+
+  B.SetInsertPoint(VecBody);
+  PHINode *VecIV = B.CreatePHI(IVTy, 2, C.IndVar->getName() + ".vec");
+  SmallVector<PHINode *, 2> VecAccs;
+  for (const Reduction &R : Cand.Reductions) {
+    auto *VecTy = FixedVectorType::get(R.Phi->getType(), VF);
+    PHINode *VecAcc = B.CreatePHI(VecTy, 2, R.Phi->getName() + ".vec");
+    VecAcc->addIncoming(ConstantFP::getNegativeZero(VecTy), Preheader);
+    VecAccs.push_back(VecAcc);
+  }
+  Widener W(Cand, B, VecIV, VF);
+  SmallVector<Value *, 2> VecSums;
+  for (auto [R, VecAcc] : zip(Cand.Reductions, VecAccs)) {
+    Value *Next;
+    if (R.MulLHS)
+      Next = B.CreateIntrinsic(Intrinsic::fmuladd, {VecAcc->getType()},
+                               {W.widen(R.MulLHS), W.widen(R.MulRHS), VecAcc});
+    else if (R.Subtract)
+      Next = B.CreateFSub(VecAcc, W.widen(R.Addend));
+    else
+      Next = B.CreateFAdd(VecAcc, W.widen(R.Addend));
+    cast<Instruction>(Next)->copyFastMathFlags(R.Update);
+    Next->setName(R.Update->getName() + ".vec");
+    VecAcc->addIncoming(Next, VecBody);
+    VecSums.push_back(Next);
+  }
+  Value *VecIVNext = B.CreateAdd(VecIV, ConstantInt::get(IVTy, VF),
+                                 C.IndVar->getName() + ".vec.next");
+  VecIV->addIncoming(C.Start, Preheader);
+  VecIV->addIncoming(VecIVNext, VecBody);
+  B.CreateCondBr(B.CreateICmpNE(VecIVNext, VecEnd), VecBody, Middle)
+      ->setMetadata(LLVMContext::MD_loop, createVectorizedLoopID(Ctx));
+
+  // The partial sums are added to the initial values in any order
+  B.SetInsertPoint(Middle);
+  SmallVector<Value *, 2> Sums;
+  for (auto [R, VecSum] : zip(Cand.Reductions, VecSums)) {
+    auto *Sum = cast<Instruction>(B.CreateFAddReduce(R.Init, VecSum));
+    Sum->copyFastMathFlags(R.Update);
+    Sum->setHasAllowReassoc(true);
+    Sum->setName(R.Phi->getName() + ".vec.sum");
+    Sums.push_back(Sum);
+  }
+  B.CreateCondBr(B.CreateICmpEQ(VecTripCount, TripCount, "vec.done"), Exit,
+                 ScalarPH);
+
+  // The original loop continues where the vector loop stopped
+  B.SetInsertPoint(&ScalarPH->front());
+  PHINode *IVStart = B.CreatePHI(IVTy, 2, C.IndVar->getName() + ".start");
+  IVStart->addIncoming(C.Start, Preheader);
+  IVStart->addIncoming(VecEnd, Middle);
+  C.IndVar->setIncomingValueForBlock(ScalarPH, IVStart);
+  for (auto [R, Sum] : zip(Cand.Reductions, Sums)) {
+    PHINode *AccStart = B.CreatePHI(R.Phi->getType(), 2, R.Phi->getName() + ".start");
+    AccStart->addIncoming(R.Init, Preheader);
+    AccStart->addIncoming(Sum, Middle);
+    R.Phi->setIncomingValueForBlock(ScalarPH, AccStart);
+  }
+
+  // After the loop, the sums come from either loop
+  for (auto [R, Sum] : zip(Cand.Reductions, Sums)) {
+    SmallVector<Use *, 4> OutsideUses;
+    for (Use &U : R.Update->uses())
+      if (!C.L->contains(cast<Instruction>(U.getUser())))
+        OutsideUses.push_back(&U);
+    PHINode *Final = nullptr;
+    for (Use *U : OutsideUses) {
+      auto *UserI = cast<Instruction>(U->getUser());
+      if (auto *Phi = dyn_cast<PHINode>(UserI); Phi && Phi->getParent() == Exit) {
+        Phi->addIncoming(Sum, Middle);
+        continue;
+      }
+      if (!Final) {
+        Final = PHINode::Create(R.Phi->getType(), 2,
+                                R.Update->getName() + ".final", &Exit->front());
+        Final->addIncoming(R.Update, Body);
+        Final->addIncoming(Sum, Middle);
+      }
+      U->set(Final);
+    }
+  }
+}
+
+unsigned getVectorWidth(Function &F, const TargetTransformInfo &TTI,
+                        unsigned Requested, Type *ElementTy) {
+  if (Optional<TuningConfig> Tuning = TuningConfig::get(F))
+    if (Tuning->VectorizeWidth)
+      return Tuning->VectorizeWidth;
+  if (Requested)
+    return Requested;
+  if (WidthOpt)
+    return WidthOpt;
+  uint64_t RegisterBits =
+      TTI.getRegisterBitWidth(TargetTransformInfo::RGK_FixedWidthVector)
+          .getFixedSize();
+  return RegisterBits / ElementTy->getScalarSizeInBits();
+}
+
+} // end anonymous namespace
+
+PreservedAnalyses ReductionVectorizePass::run(Function &F,
+                                              FunctionAnalysisManager &AM) {
+  LLVM_DEBUG(dbgs() << "Running Reduction Vectorize Pass on function: "
+                    << F.getName() << "\n");
+
+  auto &LI = AM.getResult<LoopAnalysis>(F);
+  auto &SE = AM.getResult<ScalarEvolutionAnalysis>(F);
+  auto &MAP = AM.getResult<MemoryAccessPatternAnalysis>(F);
+  auto &ORE = AM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+  auto &TTI = AM.getResult<TargetIRAnalysis>(F);
+
+  // Every loop is analyzed before the first one is transformed, which
+  // leaves LoopInfo stale
+  SmallVector<std::pair<Candidate, unsigned>, 4> Candidates;
+  for (Loop *L : LI.getLoopsInPreorder()) {
+    if (!L->isInnermost())
+      continue;
+    // The lanes are sized for the widest accumulator
+    Type *ElementTy = nullptr;
+    for (PHINode &Phi : L->getHeader()->phis())
+      if (Phi.getType()->isFloatingPointTy() &&
+          (!ElementTy || Phi.getType()->getScalarSizeInBits() >
+                             ElementTy->getScalarSizeInBits()))
+        ElementTy = Phi.getType();
+    if (!ElementTy)
+      continue;
+    unsigned VF = PowerOf2Floor(getVectorWidth(F, TTI, Width, ElementTy));
+    if (VF < 2)
+      continue;
+
+    Candidate Cand;
+    StringRef Reason;
+    if (!analyzeLoop(L, SE, MAP, VF, Reassociate || AllowReassociation, Cand,
+                     Reason)) {
+      if (!Reason.empty())
+        ORE.emit([&]() {
+          return OptimizationRemarkMissed(DEBUG_TYPE, "NotVectorized",
+                                          L->getStartLoc(), L->getHeader())
+                 << "reduction not vectorized: " << Reason;
+        });
+      continue;
+    }
+    Candidates.emplace_back(std::move(Cand), VF);
+  }
+
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  for (auto &[Cand, VF] : Candidates) {
+    Loop *L = Cand.Control.L;
+    LLVM_DEBUG(dbgs() << "  Vectorizing " << Cand.Reductions.size()
+                      << " reductions of " << L->getHeader()->getName()
+                      << " with " << VF << " lanes\n");
+    ORE.emit([&]() {
+      return OptimizationRemark(DEBUG_TYPE, "Vectorized", L->getStartLoc(),
+                                L->getHeader())
+             << "vectorized "
+             << NV("NumReductions", unsigned(Cand.Reductions.size()))
+             << " reductions with " << NV("VectorWidth", VF)
+             << " partial sums each";
+    });
+    vectorizeReductions(Cand, VF, SE, DL);
+    NumReductionsVectorized += Cand.Reductions.size();
+    ++NumLoopsVectorized;
+  }
+
+  return Candidates.empty() ? PreservedAnalyses::all()
+                            : PreservedAnalyses::none();
+}
+
+bool isReductionVectorizationEnabled() { return EnableReductionVectorization; }
+
+void registerReductionVectorizePass(PassBuilder &PB, bool AddToPipelines) {
+  if (PassInstrumentationCallbacks *PIC = PB.getPassInstrumentationCallbacks())
+    PIC->addClassToPassName(ReductionVectorizePass::name(),
+                            "reduction-vectorize");
+  PB.registerAnalysisRegistrationCallback(
+      [](FunctionAnalysisManager &FAM) { registerMemoryCoalescingAnalyses(FAM); });
+  PB.registerPipelineParsingCallback(
+      [](StringRef Name, FunctionPassManager &FPM,
+         ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name != "reduction-vectorize")
+          return false;
+        FPM.addPass(ReductionVectorizePass());
+        return true;
+      });
+
+  if (!AddToPipelines)
+    return;
+  PB.registerVectorizerStartEPCallback(
+      [](FunctionPassManager &FPM, OptimizationLevel) {
+        FPM.addPass(ReductionVectorizePass());
+      });
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,68 @@
+//===- ReductionVectorization.h - Vector Partial-Sum Reductions -----===//
+//
+// This file defines a pass that vectorizes floating-point reductions,
+// such as the dot product of the k loop of a matrix multiplication:
+//
+//   for k: acc += A[i][k] * B[k][j]
+//
+// LoopVectorize leaves these loops alone unless the additions carry the
+// reassoc fast-math flag, because summing in a different order changes
+// the rounding. This pass recognizes the accumulations in innermost
+// loops, keeps one partial sum per vector lane, built with llvm.fmuladd,
+// and adds the lanes up after the loop with llvm.vector.reduce.fadd:
+//
+//   vacc = <-0.0, ...>
+//   for k in steps of VF: vacc = fmuladd(A[i][k..k+VF), B[k..k+VF)[j], vacc)
+//   acc = reduce.fadd(acc, vacc)
+//   for the remaining k: acc += A[i][k] * B[k][j]
+//
+// Contiguous operands become vector loads; strided ones are loaded per
+// lane. Like LoopVectorize, it only reorders sums that allow it, unless
+// asked to reassociate the others too.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_PASSES_REDUCTION_VECTORIZATION_H
+#define MLCOMPILEROPT_PASSES_REDUCTION_VECTORIZATION_H
+
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+class PassBuilder;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+class ReductionVectorizePass
+    : public llvm::PassInfoMixin<ReductionVectorizePass> {
+public:
+  // Width is the number of lanes; 0 selects -reduction-vectorize-width or
+  // the target's vector register width. Only reductions whose update
+  // carries the reassoc fast-math flag are vectorized, unless Reassociate
+  // or -reduction-vectorize-reassoc is set.
+  explicit ReductionVectorizePass(unsigned Width = 0, bool Reassociate = false)
+      : Width(Width), Reassociate(Reassociate) {}
+
+  llvm::PreservedAnalyses run(llvm::Function &F,
+                              llvm::FunctionAnalysisManager &AM);
+
+  static bool isRequired() { return true; }
+
+private:
+  unsigned Width;
+  bool Reassociate;
+};
+
+// False if the pass is disabled with -reduction-vectorize=false
+bool isReductionVectorizationEnabled();
+
+// Makes the pass available to PB as "reduction-vectorize" and, if
+// AddToPipelines, adds it to the default pipelines right before the loop
+// vectorizer, where LICM has turned accumulators into phis. Register it
+// after the memory coalescing pass, so that it sees the loop order that
+// pass chose.
+void registerReductionVectorizePass(llvm::PassBuilder &PB, bool AddToPipelines);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_PASSES_REDUCTION_VECTORIZATION_H
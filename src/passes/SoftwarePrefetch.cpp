@@ -0,0 +1,357 @@
+//===- SoftwarePrefetch.cpp - Prefetching of Large-Stride Accesses --===//
+//
+// Implementation of the software prefetch pass. Accesses of one loop
+// whose addresses fall into the same cache line share a prefetch.
+//
+//===----------------------------------------------------------------===//
+
+#include "passes/SoftwarePrefetch.h"
+#include "passes/MemoryAccessPattern.h"
+#include "passes/MemoryCoalescing.h"
+#include "passes/TuningConfig.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#define DEBUG_TYPE "software-prefetch"
+
+using namespace llvm;
+using ore::NV;
+
+namespace mlcompileropt {
+
+ALWAYS_ENABLED_STATISTIC(NumPrefetches, "Number of prefetches inserted");
+ALWAYS_ENABLED_STATISTIC(NumLoopsPrefetched, "Number of loops with prefetches");
+
+namespace {
+
+cl::opt<bool> EnablePrefetch(
+    "software-prefetch", cl::init(false),
+    cl::desc("Prefetch large-stride loads and stores of the innermost loops "
+             "of every function at the end of the default pipelines, not "
+             "only of those with a prefetch tuning parameter"));
+
+cl::opt<unsigned> DistanceOpt(
+    "software-prefetch-distance", cl::init(0),
+    cl::desc("Iterations to prefetch ahead (default: the memory latency "
+             "divided by the estimated cycles per iteration)"));
+
+cl::opt<unsigned> LatencyOpt(
+    "software-prefetch-latency", cl::init(0), cl::Hidden,
+    cl::desc("Memory latency in cycles the prefetches have to hide "
+             "(default: the target's prefetch distance, or 200)"));
+
+cl::opt<unsigned> MinStrideOpt(
+    "software-prefetch-min-stride", cl::init(0), cl::Hidden,
+    cl::desc("Smallest stride in bytes that is prefetched (default: the "
+             "target's cache line size)"));
+
+cl::opt<bool> PrefetchWritesOpt(
+    "software-prefetch-writes", cl::init(false), cl::Hidden,
+    cl::desc("Prefetch strided stores on targets that do not enable write "
+             "prefetching"));
+
+const unsigned DefaultCacheLineSize = 64;
+const unsigned DefaultMemoryLatency = 200;
+const unsigned DefaultL2CacheSize = 256 * 1024;
+
+// llvm.prefetch arguments: keep the line in all cache levels, data cache
+const unsigned PrefetchLocality = 3;
+const unsigned DataCache = 1;
+
+// Target parameters the prefetch distance is derived from
+struct PrefetchParams {
+  unsigned CacheLineSize = 0;
+  unsigned L2CacheSize = 0;
+  unsigned MemoryLatency = 0;
+  unsigned MaxIterationsAhead = 0;
+  bool PrefetchWrites = false;
+};
+
+PrefetchParams getPrefetchParams(const TargetTransformInfo &TTI) {
+  PrefetchParams Params;
+  Params.CacheLineSize = TTI.getCacheLineSize();
+  if (!Params.CacheLineSize)
+    Params.CacheLineSize = DefaultCacheLineSize;
+  Params.L2CacheSize = TTI.getCacheSize(TargetTransformInfo::CacheLevel::L2D)
+                           .getValueOr(DefaultL2CacheSize);
+  Params.MemoryLatency = LatencyOpt;
+  if (!Params.MemoryLatency)
+    Params.MemoryLatency = TTI.getPrefetchDistance();
+  if (!Params.MemoryLatency)
+    Params.MemoryLatency = DefaultMemoryLatency;
+  Params.MaxIterationsAhead = TTI.getMaxPrefetchIterationsAhead();
+  Params.PrefetchWrites = PrefetchWritesOpt || TTI.enableWritePrefetching();
+  return Params;
+}
+
+// Estimated cycles of one iteration of L: the latencies of its
+// instructions, as if none of them overlapped
+unsigned getIterationCycles(const Loop *L, const TargetTransformInfo &TTI) {
+  uint64_t Cycles = 0;
+  for (BasicBlock *BB : L->blocks())
+    for (Instruction &I : *BB) {
+      if (isa<PHINode>(I) || I.isDebugOrPseudoInst())
+        continue;
+      InstructionCost Cost =
+          TTI.getInstructionCost(&I, TargetTransformInfo::TCK_Latency);
+      if (Optional<InstructionCost::CostType> Value = Cost.getValue())
+        Cycles += std::max<InstructionCost::CostType>(*Value, 0);
+    }
+  return std::max<uint64_t>(Cycles, 1);
+}
+
+// Bytes the addresses of an access move by in all iterations of the loop
+// of Strides[Idx]. A loop without a known trip count, like the point loop
+// of a tile, is assumed to cover one iteration of an enclosing loop that
+// steps over the same dimension by a multiple of its stride.
+Optional<uint64_t> getLoopSpan(ArrayRef<LoopStride> Strides, unsigned Idx,
+                               ScalarEvolution &SE) {
+  const LoopStride &S = Strides[Idx];
+  if (!S.ConstantBytes)
+    return None;
+  int64_t Stride = *S.ConstantBytes;
+  unsigned TripCount = S.TripCount;
+  if (!TripCount)
+    TripCount = SE.getSmallConstantMaxTripCount(const_cast<Loop *>(S.L));
+  if (TripCount || !Stride)
+    return uint64_t(std::abs(Stride)) * (std::max(TripCount, 1u) - 1);
+  for (const LoopStride &Outer : Strides.drop_front(Idx + 1))
+    if (Outer.ConstantBytes && Outer.TripCount &&
+        *Outer.ConstantBytes % Stride == 0 && *Outer.ConstantBytes / Stride > 0)
+      return uint64_t(std::abs(*Outer.ConstantBytes));
+  return None;
+}
+
+// True if the addresses P takes in its whole loop nest span at most Bytes,
+// so that after the first pass over them they are served by the cache
+bool fitsInCache(const AccessPattern &P, ScalarEvolution &SE, uint64_t Bytes) {
+  uint64_t Span = P.AccessSize;
+  for (unsigned Idx = 0; Idx < P.Strides.size(); ++Idx) {
+    Optional<uint64_t> LoopSpan = getLoopSpan(P.Strides, Idx, SE);
+    if (!LoopSpan)
+      return false;
+    Span += *LoopSpan;
+    if (Span > Bytes)
+      return false;
+  }
+  return true;
+}
+
+bool hasPrefetch(const Loop *L) {
+  for (BasicBlock *BB : L->blocks())
+    for (Instruction &I : *BB)
+      if (auto *II = dyn_cast<IntrinsicInst>(&I))
+        if (II->getIntrinsicID() == Intrinsic::prefetch)
+          return true;
+  return false;
+}
+
+// Accesses of one block whose addresses lie within a cache line of each
+// other in every iteration; the first of them gets the prefetch
+struct PrefetchGroup {
+  const AccessPattern *Leader = nullptr;
+  bool IsWrite = false;
+};
+
+// Groups the accesses of L with a stride of at least MinStride bytes whose
+// addresses do not fit in the L2 cache by cache line
+SmallVector<PrefetchGroup, 8>
+collectPrefetchGroups(const Loop *L, const MemoryAccessPatternInfo &MAP,
+                      ScalarEvolution &SE, const PrefetchParams &Params,
+                      unsigned MinStride) {
+  SmallVector<PrefetchGroup, 8> Groups;
+  for (const AccessPattern &P : MAP.patterns()) {
+    if (P.InnermostLoop != L || !P.isStrided() ||
+        (P.isStore() && !Params.PrefetchWrites))
+      continue;
+    int64_t Stride = *P.getInnermostStride();
+    if (uint64_t(std::abs(Stride)) < MinStride ||
+        fitsInCache(P, SE, Params.L2CacheSize))
+      continue;
+
+    PrefetchGroup *Group = llvm::find_if(Groups, [&](const PrefetchGroup &G) {
+      if (G.Leader->I->getParent() != P.I->getParent() ||
+          *G.Leader->getInnermostStride() != Stride)
+        return false;
+      const auto *Distance =
+          dyn_cast<SCEVConstant>(SE.getMinusSCEV(P.Base, G.Leader->Base));
+      return Distance &&
+             Distance->getAPInt().abs().ult(Params.CacheLineSize);
+    });
+    if (Group == Groups.end()) {
+      Groups.push_back({&P, P.isStore()});
+      continue;
+    }
+    Group->IsWrite |= P.isStore();
+    // The group prefetches at its first access in the block
+    if (P.I->comesBefore(Group->Leader->I))
+      Group->Leader = &P;
+  }
+  return Groups;
+}
+
+// Inserts a prefetch of the address Group's leader accesses Distance bytes
+// later, right before the leader
+void emitPrefetch(const PrefetchGroup &Group, int64_t Distance,
+                  const DataLayout &DL) {
+  Instruction *I = Group.Leader->I;
+  Value *Ptr = getLoadStorePointerOperand(I);
+  unsigned AS = Ptr->getType()->getPointerAddressSpace();
+
+  IRBuilder<> Builder(I);
+  Type *BytePtrTy = Builder.getInt8PtrTy(AS);
+  Value *BytePtr = Builder.CreateBitCast(Ptr, BytePtrTy);
+  // Not inbounds: the prefetched address may lie past the end of the
+  // array, which is harmless for a prefetch
+  Value *Addr = Builder.CreateGEP(
+      Builder.getInt8Ty(), BytePtr,
+      ConstantInt::get(DL.getIndexType(BytePtrTy), Distance), "prefetch.addr");
+  Function *Prefetch = Intrinsic::getDeclaration(
+      I->getModule(), Intrinsic::prefetch, {BytePtrTy});
+  Builder.CreateCall(Prefetch, {Addr, Builder.getInt32(Group.IsWrite),
+                                Builder.getInt32(PrefetchLocality),
+                                Builder.getInt32(DataCache)});
+}
+
+} // end anonymous namespace
+
+PreservedAnalyses SoftwarePrefetchPass::run(Function &F,
+                                            FunctionAnalysisManager &AM) {
+  LLVM_DEBUG(dbgs() << "Running Software Prefetch Pass on function: "
+                    << F.getName() << "\n");
+
+  // A tuning configuration attached to F overrides the option
+  unsigned FixedDistance = DistanceOpt;
+  bool Selected = PrefetchAll;
+  if (Optional<TuningConfig> Tuning = TuningConfig::get(F))
+    if (Tuning->PrefetchDistance) {
+      FixedDistance = *Tuning->PrefetchDistance;
+      Selected = FixedDistance != 0;
+    }
+  if (!Selected)
+    return PreservedAnalyses::all();
+
+  auto &LI = AM.getResult<LoopAnalysis>(F);
+  auto &SE = AM.getResult<ScalarEvolutionAnalysis>(F);
+  auto &MAP = AM.getResult<MemoryAccessPatternAnalysis>(F);
+  auto &ORE = AM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+  auto &TTI = AM.getResult<TargetIRAnalysis>(F);
+  PrefetchParams Params = getPrefetchParams(TTI);
+  const DataLayout &DL = F.getParent()->getDataLayout();
+
+  bool Changed = false;
+  for (Loop *L : LI.getLoopsInPreorder()) {
+    if (!L->isInnermost() || hasPrefetch(L))
+      continue;
+
+    // Targets may only want prefetches for even larger strides, depending
+    // on how many accesses the loop has
+    unsigned MinStride = MinStrideOpt;
+    if (!MinStride) {
+      unsigned NumStrided = llvm::count_if(MAP.patterns(), [&](const AccessPattern &P) {
+        return P.InnermostLoop == L && P.isStrided();
+      });
+      unsigned NumMemAccesses = llvm::count_if(MAP.patterns(), [&](const AccessPattern &P) {
+        return P.InnermostLoop == L;
+      });
+      MinStride = std::max(Params.CacheLineSize,
+                           TTI.getMinPrefetchStride(NumMemAccesses, NumStrided,
+                                                    /*NumPrefetches=*/NumStrided,
+                                                    /*HasCall=*/false));
+    }
+    SmallVector<PrefetchGroup, 8> Groups =
+        collectPrefetchGroups(L, MAP, SE, Params, MinStride);
+    if (Groups.empty())
+      continue;
+
+    unsigned Cycles = getIterationCycles(L, TTI);
+    unsigned Iterations = FixedDistance;
+    if (!Iterations)
+      Iterations = std::min(
+          std::max<unsigned>(divideCeil(Params.MemoryLatency, Cycles), 1),
+          Params.MaxIterationsAhead);
+    unsigned TripCount = MAP.getTripCount(L);
+    if (TripCount && Iterations >= TripCount) {
+      LLVM_DEBUG(dbgs() << "  Loop " << L->getHeader()->getName() << " runs "
+                        << TripCount << " iterations, fewer than the distance "
+                        << Iterations << "\n");
+      ORE.emit([&]() {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "NotPrefetched",
+                                        L->getStartLoc(), L->getHeader())
+               << "loop with strided accesses not prefetched: it runs "
+               << NV("TripCount", TripCount)
+               << " iterations, fewer than the prefetch distance of "
+               << NV("Distance", Iterations);
+      });
+      continue;
+    }
+
+    for (const PrefetchGroup &Group : Groups) {
+      int64_t Stride = *Group.Leader->getInnermostStride();
+      int64_t Distance = Stride * Iterations;
+      LLVM_DEBUG(dbgs() << "  Prefetching " << Distance << " bytes ahead of "
+                        << *Group.Leader->I << "\n");
+      emitPrefetch(Group, Distance, DL);
+      ORE.emit([&]() {
+        return OptimizationRemark(DEBUG_TYPE, "Prefetched", Group.Leader->I)
+               << "prefetching " << NV("Iterations", Iterations)
+               << " iterations (" << NV("Distance", Distance) << " bytes) ahead of "
+               << (Group.IsWrite ? "a store" : "a load") << " with a stride of "
+               << NV("Stride", Stride) << " bytes, at "
+               << NV("Cycles", Cycles) << " cycles per iteration";
+      });
+      ++NumPrefetches;
+    }
+    ++NumLoopsPrefetched;
+    Changed = true;
+  }
+
+  if (!Changed)
+    return PreservedAnalyses::all();
+  // Only address computations and calls that do not touch memory were
+  // added; the loops, their SCEVs and the access patterns are unchanged
+  PreservedAnalyses PA;
+  PA.preserveSet<CFGAnalyses>();
+  PA.preserve<ScalarEvolutionAnalysis>();
+  PA.preserve<MemoryAccessPatternAnalysis>();
+  return PA;
+}
+
+bool isSoftwarePrefetchEnabled() { return EnablePrefetch; }
+
+void registerSoftwarePrefetchPass(PassBuilder &PB, bool AddToPipelines) {
+  if (PassInstrumentationCallbacks *PIC = PB.getPassInstrumentationCallbacks())
+    PIC->addClassToPassName(SoftwarePrefetchPass::name(), "software-prefetch");
+  PB.registerAnalysisRegistrationCallback(
+      [](FunctionAnalysisManager &FAM) { registerMemoryCoalescingAnalyses(FAM); });
+  PB.registerPipelineParsingCallback(
+      [](StringRef Name, FunctionPassManager &FPM,
+         ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name != "software-prefetch")
+          return false;
+        FPM.addPass(SoftwarePrefetchPass());
+        return true;
+      });
+
+  if (!AddToPipelines)
+    return;
+  PB.registerOptimizerLastEPCallback(
+      [](ModulePassManager &MPM, OptimizationLevel) {
+        MPM.addPass(createModuleToFunctionPassAdaptor(
+            SoftwarePrefetchPass(isSoftwarePrefetchEnabled())));
+      });
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,66 @@
+//===- SoftwarePrefetch.h - Prefetching of Large-Stride Accesses ----===//
+//
+// This file defines a pass that inserts llvm.prefetch calls for the loads
+// and stores of innermost loops whose stride spans at least a cache line,
+// such as the column walk over B in the k loop of a matrix
+// multiplication:
+//
+//   for k: acc += A[i][k] * B[k][j]
+//
+// Every iteration of such a loop touches a new cache line, which hardware
+// prefetchers often miss. Accesses whose addresses in the whole nest fit
+// in the L2 cache are left alone, since only their first pass misses. The
+// pass prefetches the address the access will use a number of iterations
+// ahead:
+//
+//   distance = ceil(memory latency / cycles per iteration)
+//   prefetch(&B[k + distance][j])
+//
+// The cycles per iteration are estimated from the target's instruction
+// latencies. The memory latency, the cache line size and whether stores
+// are prefetched come from the target and can be overridden with
+// options.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_PASSES_SOFTWARE_PREFETCH_H
+#define MLCOMPILEROPT_PASSES_SOFTWARE_PREFETCH_H
+
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+class PassBuilder;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+class SoftwarePrefetchPass : public llvm::PassInfoMixin<SoftwarePrefetchPass> {
+public:
+  // With PrefetchAll false, only functions with a nonzero prefetch tuning
+  // parameter get prefetches
+  explicit SoftwarePrefetchPass(bool PrefetchAll = true)
+      : PrefetchAll(PrefetchAll) {}
+
+  llvm::PreservedAnalyses run(llvm::Function &F,
+                              llvm::FunctionAnalysisManager &AM);
+
+  static bool isRequired() { return true; }
+
+private:
+  bool PrefetchAll;
+};
+
+// True if every function gets prefetches in the default pipelines,
+// selected with -software-prefetch
+bool isSoftwarePrefetchEnabled();
+
+// Makes the pass available to PB as "software-prefetch" and, if
+// AddToPipelines, adds it to the end of the default pipelines, after
+// vectorization and unrolling have settled the shape of the loops. There
+// it only prefetches in the functions selected with -software-prefetch or
+// a tuning parameter.
+void registerSoftwarePrefetchPass(llvm::PassBuilder &PB, bool AddToPipelines);
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_PASSES_SOFTWARE_PREFETCH_H
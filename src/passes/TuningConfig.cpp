@@ -0,0 +1,152 @@
+//===- TuningConfig.cpp - Per-Function Transformation Parameters ----===//
+//
+// Implementation of the parsing, printing and attachment of tuning
+// configurations.
+//
+//===----------------------------------------------------------------===//
+
+#include "passes/TuningConfig.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+namespace {
+
+const StringRef ParameterNames[] = {"interchange", "merge-width", "parallel",
+                                    "prefetch",    "tile",        "tile-l2",
+                                    "unroll",      "vectorize-width"};
+
+Error makeError(const Twine &Msg) {
+  return createStringError(inconvertibleErrorCode(), Msg);
+}
+
+Error parseCount(StringRef Name, StringRef Value, unsigned &Count) {
+  if (Value.getAsInteger(10, Count))
+    return makeError("invalid value '" + Value + "' of tuning parameter " +
+                     Name);
+  return Error::success();
+}
+
+} // end anonymous namespace
+
+ArrayRef<StringRef> getTuningParameterNames() { return ParameterNames; }
+
+bool TuningConfig::isDefault() const {
+  return !Interchange && !MergeWidth && !Parallel && !PrefetchDistance &&
+         !TileSize && !TileSizeL2 && !UnrollCount && !VectorizeWidth;
+}
+
+Error TuningConfig::set(StringRef Name, StringRef Value) {
+  if (Name == "interchange") {
+    for (auto Kind :
+         {InterchangeAdvisorKind::Heuristic, InterchangeAdvisorKind::Model,
+          InterchangeAdvisorKind::Always, InterchangeAdvisorKind::Never})
+      if (getInterchangeAdvisorName(Kind) == Value) {
+        Interchange = Kind;
+        return Error::success();
+      }
+    return makeError("invalid value '" + Value +
+                     "' of tuning parameter interchange");
+  }
+  if (Name == "merge-width")
+    return parseCount(Name, Value, MergeWidth);
+  if (Name == "parallel") {
+    for (auto Schedule : {ParallelSchedule::None, ParallelSchedule::Static,
+                          ParallelSchedule::Dynamic})
+      if (getParallelScheduleName(Schedule) == Value) {
+        Parallel = Schedule;
+        return Error::success();
+      }
+    return makeError("invalid value '" + Value +
+                     "' of tuning parameter parallel");
+  }
+  if (Name == "prefetch") {
+    unsigned Distance;
+    if (Error E = parseCount(Name, Value, Distance))
+      return E;
+    PrefetchDistance = Distance;
+    return Error::success();
+  }
+  if (Name == "tile")
+    return parseCount(Name, Value, TileSize);
+  if (Name == "tile-l2")
+    return parseCount(Name, Value, TileSizeL2);
+  if (Name == "unroll")
+    return parseCount(Name, Value, UnrollCount);
+  if (Name == "vectorize-width")
+    return parseCount(Name, Value, VectorizeWidth);
+  return makeError("unknown tuning parameter '" + Name + "'");
+}
+
+std::string TuningConfig::toString() const {
+  if (isDefault())
+    return "default";
+
+  std::string Str;
+  raw_string_ostream OS(Str);
+  StringRef Sep = "";
+  auto Print = [&](StringRef Name, const Twine &Value) {
+    OS << Sep << Name << '=' << Value;
+    Sep = ",";
+  };
+  if (Interchange)
+    Print("interchange", getInterchangeAdvisorName(*Interchange));
+  if (MergeWidth)
+    Print("merge-width", Twine(MergeWidth));
+  if (Parallel)
+    Print("parallel", getParallelScheduleName(*Parallel));
+  if (PrefetchDistance)
+    Print("prefetch", Twine(*PrefetchDistance));
+  if (TileSize)
+    Print("tile", Twine(TileSize));
+  if (TileSizeL2)
+    Print("tile-l2", Twine(TileSizeL2));
+  if (UnrollCount)
+    Print("unroll", Twine(UnrollCount));
+  if (VectorizeWidth)
+    Print("vectorize-width", Twine(VectorizeWidth));
+  return OS.str();
+}
+
+Expected<TuningConfig> TuningConfig::parse(StringRef Text) {
+  TuningConfig Config;
+  if (Text == "default")
+    return Config;
+
+  SmallVector<StringRef, 4> Params;
+  Text.split(Params, ',', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+  for (StringRef Param : Params) {
+    std::pair<StringRef, StringRef> NameValue = Param.split('=');
+    if (NameValue.second.empty())
+      return makeError("tuning parameter '" + Param + "' has no value");
+    if (Error E = Config.set(NameValue.first.trim(), NameValue.second.trim()))
+      return E;
+  }
+  return Config;
+}
+
+void TuningConfig::attachTo(Function &F) const {
+  if (isDefault())
+    F.removeFnAttr(TuningAttributeName);
+  else
+    F.addFnAttr(TuningAttributeName, toString());
+}
+
+Optional<TuningConfig> TuningConfig::get(const Function &F) {
+  Attribute Attr = F.getFnAttribute(TuningAttributeName);
+  if (!Attr.isStringAttribute())
+    return None;
+  Expected<TuningConfig> Config = parse(Attr.getValueAsString());
+  if (!Config) {
+    consumeError(Config.takeError());
+    return None;
+  }
+  return *Config;
+}
+
+} // namespace mlcompileropt
@@ -0,0 +1,98 @@
+//===- TuningConfig.h - Per-Function Transformation Parameters ------===//
+//
+// This file declares the transformation parameters an autotuner can set
+// for one function. A configuration travels with the function as the
+// string attribute "ml-tuning", e.g.
+//
+//   "ml-tuning"="interchange=always,unroll=4,vectorize-width=8"
+//
+// so it survives module splitting, cloning and bitcode round trips. The
+// memory coalescing, loop tiling, reduction vectorization, software
+// prefetch and loop parallelization passes read it; parameters that are not
+// set keep the values of the command-line options.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_PASSES_TUNING_CONFIG_H
+#define MLCOMPILEROPT_PASSES_TUNING_CONFIG_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include "passes/InterchangeAdvisor.h"
+#include "passes/LoopParallelization.h"
+
+#include <string>
+
+namespace llvm {
+class Function;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+// Name of the function attribute that holds a configuration
+constexpr const char *TuningAttributeName = "ml-tuning";
+
+struct TuningConfig {
+  // What decides the loop interchanges; -memory-coalescing-advisor if unset
+  llvm::Optional<InterchangeAdvisorKind> Interchange;
+
+  // Widest vector access formed by merging, in bits; 0 keeps the target's
+  unsigned MergeWidth = 0;
+
+  // Schedule of the outermost loops the loop parallelization pass
+  // parallelizes; none keeps the loops serial and unset keeps the
+  // -loop-parallelize schedule
+  llvm::Optional<ParallelSchedule> Parallel;
+
+  // Iterations the software prefetch pass prefetches ahead; 0 disables
+  // prefetching and unset keeps the distance derived from the target
+  llvm::Optional<unsigned> PrefetchDistance;
+
+  // Tile size of the loop tiling pass and the outer tile size of
+  // two-level tiling, in iterations; 0 keeps the options and a TileSize
+  // of 1 disables tiling
+  unsigned TileSize = 0;
+  unsigned TileSizeL2 = 0;
+
+  // llvm.loop.unroll.count of the innermost loops; 0 leaves unrolling to
+  // LLVM and 1 disables it
+  unsigned UnrollCount = 0;
+
+  // llvm.loop.vectorize.width of the innermost loops; 0 leaves the choice
+  // to the loop vectorizer and 1 disables vectorization
+  unsigned VectorizeWidth = 0;
+
+  // True if no parameter is set
+  bool isDefault() const;
+
+  // Sets the parameter Name, e.g. "unroll", from its textual value
+  llvm::Error set(llvm::StringRef Name, llvm::StringRef Value);
+
+  // Comma-separated name=value list of the set parameters, in the order
+  // of getTuningParameterNames, or "default" if none is set
+  std::string toString() const;
+
+  // Inverse of toString
+  static llvm::Expected<TuningConfig> parse(llvm::StringRef Text);
+
+  // Stores the configuration in F's "ml-tuning" attribute, or removes the
+  // attribute for the default configuration
+  void attachTo(llvm::Function &F) const;
+
+  // Configuration attached to F, if it has a well-formed one
+  static llvm::Optional<TuningConfig> get(const llvm::Function &F);
+
+  bool operator==(const TuningConfig &Other) const {
+    return toString() == Other.toString();
+  }
+};
+
+// Names of the parameters TuningConfig::set accepts
+llvm::ArrayRef<llvm::StringRef> getTuningParameterNames();
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_PASSES_TUNING_CONFIG_H
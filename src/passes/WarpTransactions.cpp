@@ -0,0 +1,248 @@
+//===- WarpTransactions.cpp - Warp Memory Transaction Model ----------===//
+//
+// Implementation of the warp memory transaction analysis.
+//
+//===----------------------------------------------------------------===//
+
+#include "passes/WarpTransactions.h"
+
+#include "passes/MemoryAccessPattern.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+#define DEBUG_TYPE "warp-transactions"
+
+using namespace llvm;
+
+namespace mlcompileropt {
+
+AnalysisKey WarpTransactionAnalysis::Key;
+
+namespace {
+
+cl::opt<unsigned> ThreadLoopOpt(
+    "warp-thread-loop", cl::init(0),
+    cl::desc("Loop whose iterations are mapped to the lanes of a warp, "
+             "counted outwards from the innermost loop of an access "
+             "(0: the innermost loop)"));
+
+cl::opt<unsigned> WarpSizeOpt("warp-size", cl::init(32),
+                              cl::desc("Lanes per warp"));
+
+cl::opt<unsigned> WarpCountOpt(
+    "warp-count", cl::init(4),
+    cl::desc("Consecutive warps simulated per load or store"));
+
+// Constant byte offset of Base from its pointer, or 0 if it has none
+int64_t getConstantOffset(const SCEV *Base) {
+  if (auto *C = dyn_cast<SCEVConstant>(Base))
+    return C->getAPInt().getSExtValue();
+  // SCEV canonicalizes constant operands to the front.
+  if (auto *Add = dyn_cast<SCEVAddExpr>(Base))
+    if (auto *C = dyn_cast<SCEVConstant>(Add->getOperand(0)))
+      return C->getAPInt().getSExtValue();
+  return 0;
+}
+
+// Index of the Size byte segment that contains byte Offset
+int64_t getSegment(int64_t Offset, int64_t Size) {
+  return Offset >= 0 ? Offset / Size : -((-Offset + Size - 1) / Size);
+}
+
+// Lanes of one warp request: byte offsets of the lanes whose address is
+// known, and the number of active lanes whose address is not
+struct WarpRequest {
+  SmallVector<int64_t, 32> Offsets;
+  unsigned UnknownLanes = 0;
+
+  bool empty() const { return Offsets.empty() && !UnknownLanes; }
+};
+
+// Maps the lanes of warp Warp to iterations of the thread loop at
+// P.Strides[ThreadLevel] and, past its trip count, of the loops around it
+WarpRequest buildRequest(const AccessPattern &P, unsigned ThreadLevel,
+                         unsigned Warp, unsigned WarpSize) {
+  WarpRequest R;
+  int64_t Base = getConstantOffset(P.Base);
+  for (unsigned Lane = 0; Lane < WarpSize; ++Lane) {
+    uint64_t Thread = uint64_t(Warp) * WarpSize + Lane;
+    int64_t Offset = Base;
+    bool Known = true;
+    for (unsigned Level = ThreadLevel;
+         Level < P.Strides.size() && Thread; ++Level) {
+      const LoopStride &S = P.Strides[Level];
+      uint64_t Iteration = S.TripCount ? Thread % S.TripCount : Thread;
+      Thread = S.TripCount ? Thread / S.TripCount : 0;
+      if (!Iteration)
+        continue;
+      if (!S.ConstantBytes)
+        Known = false;
+      else
+        Offset += int64_t(Iteration) * *S.ConstantBytes;
+    }
+    // Past the last iteration of the outermost loop
+    if (Thread)
+      break;
+    if (Known)
+      R.Offsets.push_back(Offset);
+    else
+      ++R.UnknownLanes;
+  }
+  return R;
+}
+
+WarpTransactionStats simulate(const WarpRequest &R, uint64_t AccessSize) {
+  WarpTransactionStats Stats;
+  Stats.Requests = 1;
+
+  SmallVector<int64_t, 32> Starts(R.Offsets.begin(), R.Offsets.end());
+  llvm::sort(Starts);
+  Starts.erase(std::unique(Starts.begin(), Starts.end()), Starts.end());
+
+  // Lanes of a broadcast or of overlapping accesses share their bytes
+  int64_t End = INT64_MIN;
+  for (int64_t Start : Starts) {
+    int64_t AccessEnd = Start + int64_t(AccessSize);
+    Stats.RequestedBytes += AccessEnd - std::max(Start, End);
+    End = AccessEnd;
+  }
+  Stats.RequestedBytes += R.UnknownLanes * AccessSize;
+
+  for (unsigned Size = 0; Size < NumWarpSegmentSizes; ++Size) {
+    int64_t SegmentSize = WarpSegmentSizes[Size];
+    SmallVector<int64_t, 64> Segments;
+    for (int64_t Start : Starts)
+      for (int64_t Seg = getSegment(Start, SegmentSize),
+                   Last = getSegment(Start + int64_t(AccessSize) - 1,
+                                     SegmentSize);
+           Seg <= Last; ++Seg)
+        Segments.push_back(Seg);
+    llvm::sort(Segments);
+    Stats.Transactions[Size] =
+        std::unique(Segments.begin(), Segments.end()) - Segments.begin();
+    Stats.Transactions[Size] +=
+        R.UnknownLanes * divideCeil(AccessSize, WarpSegmentSizes[Size]);
+  }
+  return Stats;
+}
+
+} // end anonymous namespace
+
+double WarpTransactionStats::getTransactionsPerRequest(unsigned Size) const {
+  return Requests ? double(Transactions[Size]) / Requests : 0.0;
+}
+
+double WarpTransactionStats::getEfficiency(unsigned Size) const {
+  uint64_t Transferred = Transactions[Size] * WarpSegmentSizes[Size];
+  return Transferred ? double(RequestedBytes) / Transferred : 0.0;
+}
+
+WarpTransactionStats &
+WarpTransactionStats::operator+=(const WarpTransactionStats &Other) {
+  Requests += Other.Requests;
+  RequestedBytes += Other.RequestedBytes;
+  for (unsigned Size = 0; Size < NumWarpSegmentSizes; ++Size)
+    Transactions[Size] += Other.Transactions[Size];
+  return *this;
+}
+
+bool WarpTransactionInfo::invalidate(
+    Function &F, const PreservedAnalyses &PA,
+    FunctionAnalysisManager::Invalidator &Inv) {
+  // The result refers to instructions and loops through the access
+  // patterns, so it goes with them.
+  auto PAC = PA.getChecker<WarpTransactionAnalysis>();
+  return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>()) ||
+         Inv.invalidate<MemoryAccessPatternAnalysis>(F, PA);
+}
+
+static void printStats(raw_ostream &OS, const WarpTransactionStats &Stats) {
+  OS << "transactions per request";
+  for (unsigned Size = 0; Size < NumWarpSegmentSizes; ++Size)
+    OS << (Size ? " / " : " ")
+       << format("%.2f", Stats.getTransactionsPerRequest(Size));
+  OS << ", efficiency";
+  for (unsigned Size = 0; Size < NumWarpSegmentSizes; ++Size)
+    OS << (Size ? " / " : " ")
+       << format("%.0f%%", 100.0 * Stats.getEfficiency(Size));
+  OS << "\n";
+}
+
+void WarpTransactionInfo::print(raw_ostream &OS) const {
+  OS << "segments of";
+  for (unsigned Size = 0; Size < NumWarpSegmentSizes; ++Size)
+    OS << (Size ? " / " : " ") << WarpSegmentSizes[Size];
+  OS << " bytes\n";
+  for (const WarpAccess &A : Accesses) {
+    OS << *A.I << "\n    thread loop " << A.ThreadLoop->getHeader()->getName()
+       << ", lane stride ";
+    if (A.LaneStride)
+      OS << *A.LaneStride << " bytes";
+    else
+      OS << "unknown";
+    OS << ", " << A.Stats.Requests << " requests\n    ";
+    printStats(OS, A.Stats);
+  }
+  OS << "total: " << Total.Requests << " requests, ";
+  printStats(OS, Total);
+}
+
+WarpTransactionInfo
+WarpTransactionAnalysis::run(Function &F, FunctionAnalysisManager &AM) {
+  const auto &MAP = AM.getResult<MemoryAccessPatternAnalysis>(F);
+  unsigned WarpSize = std::max(1u, unsigned(WarpSizeOpt));
+
+  WarpTransactionInfo Info;
+  for (const AccessPattern &P : MAP.patterns()) {
+    // Stack memory is private to a thread, so it does not reach the
+    // global memory the warps share
+    if (!P.InnermostLoop ||
+        isa<AllocaInst>(getUnderlyingObject(getLoadStorePointerOperand(P.I))))
+      continue;
+
+    WarpAccess A;
+    A.I = P.I;
+    if (!P.IsAffine) {
+      // Every lane may go anywhere
+      A.ThreadLoop = P.InnermostLoop;
+      for (unsigned Warp = 0; Warp < WarpCountOpt; ++Warp) {
+        WarpRequest R;
+        R.UnknownLanes = WarpSize;
+        A.Stats += simulate(R, P.AccessSize);
+      }
+    } else {
+      unsigned ThreadLevel =
+          std::min<unsigned>(ThreadLoopOpt, P.Strides.size() - 1);
+      A.ThreadLoop = P.Strides[ThreadLevel].L;
+      A.LaneStride = P.Strides[ThreadLevel].ConstantBytes;
+      for (unsigned Warp = 0; Warp < WarpCountOpt; ++Warp) {
+        WarpRequest R = buildRequest(P, ThreadLevel, Warp, WarpSize);
+        if (R.empty())
+          break;
+        A.Stats += simulate(R, P.AccessSize);
+      }
+    }
+    Info.Total += A.Stats;
+    Info.Accesses.push_back(std::move(A));
+  }
+  return Info;
+}
+
+PreservedAnalyses WarpTransactionPrinterPass::run(Function &F,
+                                                  FunctionAnalysisManager &AM) {
+  OS << "Warp transactions for function '" << F.getName() << "':\n";
+  AM.getResult<WarpTransactionAnalysis>(F).print(OS);
+  return PreservedAnalyses::all();
+}
+
+} // namespace mlcompileropt
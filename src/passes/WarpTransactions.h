@@ -0,0 +1,131 @@
+//===- WarpTransactions.h - Warp Memory Transaction Model ------------===//
+//
+// This file defines an analysis that scores the memory coalescing of a
+// function as a GPU would see it, without running it on one. One loop of
+// every loop nest, the innermost by default, is taken to run in SIMT
+// fashion: consecutive iterations go to consecutive lanes of 32-wide
+// warps, wrapping into the next iteration of the enclosing loop when the
+// loop runs fewer iterations than a warp has lanes. Every load and store
+// of the nest then becomes one request per warp, and the analysis counts
+// the aligned 32, 64 and 128 byte segments the lanes of the request
+// touch, which is the number of memory transactions the request costs at
+// that granularity.
+//
+// Addresses come from MemoryAccessPatternInfo. Allocations are assumed to
+// be aligned to the largest segment, so only constant offsets from the
+// base pointer affect the alignment of a request. Accesses whose stride
+// along the thread loop is not a constant count as one transaction per
+// lane.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_PASSES_WARP_TRANSACTIONS_H
+#define MLCOMPILEROPT_PASSES_WARP_TRANSACTIONS_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/IR/PassManager.h"
+
+#include <vector>
+
+namespace llvm {
+class Instruction;
+class Loop;
+class raw_ostream;
+} // namespace llvm
+
+namespace mlcompileropt {
+
+// Segment sizes the analysis counts transactions for, in bytes
+constexpr unsigned WarpSegmentSizes[] = {32, 64, 128};
+constexpr unsigned NumWarpSegmentSizes = 3;
+
+// Transactions of one or more warp requests.
+struct WarpTransactionStats {
+  // Warp requests simulated
+  uint64_t Requests = 0;
+
+  // Distinct bytes the active lanes asked for
+  uint64_t RequestedBytes = 0;
+
+  // Segments touched, per entry of WarpSegmentSizes
+  uint64_t Transactions[NumWarpSegmentSizes] = {};
+
+  // Transactions per request at WarpSegmentSizes[Size]
+  double getTransactionsPerRequest(unsigned Size) const;
+
+  // Requested bytes over transferred bytes at WarpSegmentSizes[Size],
+  // between 0 and 1
+  double getEfficiency(unsigned Size) const;
+
+  WarpTransactionStats &operator+=(const WarpTransactionStats &Other);
+};
+
+// Simulated requests of one load or store.
+struct WarpAccess {
+  const llvm::Instruction *I = nullptr;
+
+  // Loop whose iterations were mapped to lanes
+  const llvm::Loop *ThreadLoop = nullptr;
+
+  // Byte stride between neighboring lanes, when it is a constant
+  llvm::Optional<int64_t> LaneStride;
+
+  WarpTransactionStats Stats;
+};
+
+// Result of WarpTransactionAnalysis.
+class WarpTransactionInfo {
+public:
+  // Simulated accesses in program order; accesses outside of loops and
+  // accesses to stack memory are not included
+  llvm::ArrayRef<WarpAccess> accesses() const { return Accesses; }
+
+  // Sum over all accesses, each weighted equally
+  const WarpTransactionStats &getTotal() const { return Total; }
+
+  bool invalidate(llvm::Function &F, const llvm::PreservedAnalyses &PA,
+                  llvm::FunctionAnalysisManager::Invalidator &Inv);
+
+  void print(llvm::raw_ostream &OS) const;
+
+private:
+  friend class WarpTransactionAnalysis;
+
+  std::vector<WarpAccess> Accesses;
+  WarpTransactionStats Total;
+};
+
+// Computes a WarpTransactionInfo for a function. The thread loop, the
+// warp size and the number of warps simulated per access are set with
+// -warp-thread-loop, -warp-size and -warp-count.
+class WarpTransactionAnalysis
+    : public llvm::AnalysisInfoMixin<WarpTransactionAnalysis> {
+  friend llvm::AnalysisInfoMixin<WarpTransactionAnalysis>;
+  static llvm::AnalysisKey Key;
+
+public:
+  using Result = WarpTransactionInfo;
+
+  Result run(llvm::Function &F, llvm::FunctionAnalysisManager &AM);
+};
+
+// Prints the WarpTransactionInfo of every function, available as
+// "print<warp-transactions>" in textual pipelines
+class WarpTransactionPrinterPass
+    : public llvm::PassInfoMixin<WarpTransactionPrinterPass> {
+public:
+  explicit WarpTransactionPrinterPass(llvm::raw_ostream &OS) : OS(OS) {}
+
+  llvm::PreservedAnalyses run(llvm::Function &F,
+                              llvm::FunctionAnalysisManager &AM);
+
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+};
+
+} // namespace mlcompileropt
+
+#endif // MLCOMPILEROPT_PASSES_WARP_TRANSACTIONS_H
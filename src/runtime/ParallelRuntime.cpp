@@ -0,0 +1,276 @@
+//===- ParallelRuntime.cpp - Parallel Loop Runtime ------------------===//
+//
+// Implementation of the thread pool behind __ml_parallel_for. One loop
+// runs at a time: the caller fills the worker queues, publishes the loop
+// and waits until every chunk has run and every worker has let go of it.
+// Queues are short deques behind a mutex each; chunks are coarse enough
+// that the locks are not contended.
+//
+//===----------------------------------------------------------------===//
+
+#include "runtime/ParallelRuntime.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Average number of chunks per worker of the dynamic schedule
+const int64_t DynamicChunksPerThread = 8;
+
+// Set while a thread runs chunks, so that nested loops run serially
+thread_local bool InParallelLoop = false;
+
+struct Range {
+  int64_t Begin;
+  int64_t End;
+};
+
+// Chunks of one worker. The owner takes them from the front, thieves from
+// the back.
+class WorkQueue {
+public:
+  void push(Range R) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Chunks.push_back(R);
+  }
+
+  bool pop(Range &R) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (Chunks.empty())
+      return false;
+    R = Chunks.front();
+    Chunks.pop_front();
+    return true;
+  }
+
+  bool steal(Range &R) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (Chunks.empty())
+      return false;
+    R = Chunks.back();
+    Chunks.pop_back();
+    return true;
+  }
+
+private:
+  std::mutex Lock;
+  std::deque<Range> Chunks;
+};
+
+struct Loop {
+  ml_parallel_body Body;
+  void *Ctx;
+  bool Steal;
+};
+
+class ThreadPool {
+public:
+  // Starts NumThreads - 1 workers; the caller of parallelFor is worker 0
+  explicit ThreadPool(unsigned NumThreads);
+  ~ThreadPool();
+
+  unsigned getNumThreads() const { return Queues.size(); }
+
+  void parallelFor(int64_t Begin, int64_t End, ml_parallel_body Body,
+                   void *Ctx, int32_t Schedule, int64_t Chunk);
+
+private:
+  void distribute(int64_t Begin, int64_t End, int32_t Schedule,
+                  int64_t Chunk);
+  void runChunks(unsigned Id, const Loop &L);
+  void workerMain(unsigned Id);
+
+  std::vector<std::unique_ptr<WorkQueue>> Queues;
+  std::vector<std::thread> Workers;
+
+  // Chunks that have not finished running
+  std::atomic<int64_t> Pending{0};
+
+  // Guards the fields below
+  std::mutex Lock;
+  std::condition_variable LoopStarted;
+  std::condition_variable WorkerIdle;
+  const Loop *Current = nullptr;
+  uint64_t Generation = 0;
+  unsigned Busy = 0;
+  bool ShuttingDown = false;
+};
+
+ThreadPool::ThreadPool(unsigned NumThreads) {
+  for (unsigned I = 0; I < NumThreads; ++I)
+    Queues.push_back(std::make_unique<WorkQueue>());
+  for (unsigned I = 1; I < NumThreads; ++I)
+    Workers.emplace_back([this, I] { workerMain(I); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    ShuttingDown = true;
+  }
+  LoopStarted.notify_all();
+  for (std::thread &T : Workers)
+    T.join();
+}
+
+void ThreadPool::distribute(int64_t Begin, int64_t End, int32_t Schedule,
+                            int64_t Chunk) {
+  int64_t Count = End - Begin;
+  int64_t NumThreads = Queues.size();
+  auto Push = [&](int64_t Queue, int64_t ChunkBegin, int64_t ChunkEnd) {
+    Queues[Queue]->push({ChunkBegin, ChunkEnd});
+    ++Pending;
+  };
+
+  // One contiguous block per worker
+  if (Schedule == ML_SCHEDULE_STATIC && Chunk <= 0) {
+    for (int64_t T = 0; T < NumThreads; ++T) {
+      int64_t BlockBegin = Begin + Count * T / NumThreads;
+      int64_t BlockEnd = Begin + Count * (T + 1) / NumThreads;
+      if (BlockBegin != BlockEnd)
+        Push(T, BlockBegin, BlockEnd);
+    }
+    return;
+  }
+
+  if (Chunk <= 0)
+    Chunk = std::max<int64_t>(1, Count / (NumThreads * DynamicChunksPerThread));
+  int64_t NumChunks = (Count + Chunk - 1) / Chunk;
+  for (int64_t C = 0; C < NumChunks; ++C) {
+    // Static chunks are dealt round-robin; dynamic ones in contiguous
+    // groups, so that workers start on neighbouring iterations
+    int64_t Queue = Schedule == ML_SCHEDULE_STATIC
+                        ? C % NumThreads
+                        : C * NumThreads / NumChunks;
+    Push(Queue, Begin + C * Chunk, std::min(End, Begin + (C + 1) * Chunk));
+  }
+}
+
+void ThreadPool::runChunks(unsigned Id, const Loop &L) {
+  InParallelLoop = true;
+  unsigned NumThreads = Queues.size();
+  Range R;
+  for (;;) {
+    bool Found = Queues[Id]->pop(R);
+    for (unsigned I = 1; !Found && L.Steal && I < NumThreads; ++I)
+      Found = Queues[(Id + I) % NumThreads]->steal(R);
+    if (!Found)
+      break;
+    L.Body(R.Begin, R.End, L.Ctx);
+    --Pending;
+  }
+  InParallelLoop = false;
+}
+
+void ThreadPool::workerMain(unsigned Id) {
+  uint64_t Seen = 0;
+  for (;;) {
+    const Loop *L;
+    {
+      std::unique_lock<std::mutex> Guard(Lock);
+      LoopStarted.wait(Guard, [&] {
+        return ShuttingDown || (Current && Generation != Seen);
+      });
+      if (ShuttingDown)
+        return;
+      Seen = Generation;
+      L = Current;
+      ++Busy;
+    }
+    runChunks(Id, *L);
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      --Busy;
+    }
+    WorkerIdle.notify_all();
+  }
+}
+
+void ThreadPool::parallelFor(int64_t Begin, int64_t End, ml_parallel_body Body,
+                             void *Ctx, int32_t Schedule, int64_t Chunk) {
+  Loop L{Body, Ctx, Schedule == ML_SCHEDULE_DYNAMIC};
+  distribute(Begin, End, Schedule, Chunk);
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Current = &L;
+    ++Generation;
+  }
+  LoopStarted.notify_all();
+
+  runChunks(0, L);
+
+  // Workers that have not woken up yet see no loop and keep sleeping
+  std::unique_lock<std::mutex> Guard(Lock);
+  WorkerIdle.wait(Guard, [&] { return Pending == 0 && Busy == 0; });
+  Current = nullptr;
+}
+
+unsigned getDefaultNumThreads() {
+  if (const char *Env = std::getenv("ML_NUM_THREADS")) {
+    int N = std::atoi(Env);
+    if (N > 0)
+      return N;
+  }
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// The pool is created on first use and replaced when it is resized. The
+// lock is held for the whole of a parallel loop.
+std::mutex PoolLock;
+std::unique_ptr<ThreadPool> Pool;
+unsigned RequestedThreads = 0;
+
+ThreadPool &getPool() {
+  if (!Pool)
+    Pool = std::make_unique<ThreadPool>(RequestedThreads ? RequestedThreads
+                                                         : getDefaultNumThreads());
+  return *Pool;
+}
+
+} // end anonymous namespace
+
+extern "C" {
+
+void __ml_parallel_for(int64_t Begin, int64_t End, ml_parallel_body Body,
+                       void *Ctx, int32_t Schedule, int64_t Chunk) {
+  if (Begin >= End)
+    return;
+  if (InParallelLoop) {
+    Body(Begin, End, Ctx);
+    return;
+  }
+
+  std::lock_guard<std::mutex> Guard(PoolLock);
+  ThreadPool &P = getPool();
+  if (P.getNumThreads() == 1) {
+    InParallelLoop = true;
+    Body(Begin, End, Ctx);
+    InParallelLoop = false;
+    return;
+  }
+  P.parallelFor(Begin, End, Body, Ctx, Schedule, Chunk);
+}
+
+void __ml_set_num_threads(int32_t NumThreads) {
+  std::lock_guard<std::mutex> Guard(PoolLock);
+  unsigned N = NumThreads > 0 ? NumThreads : 0;
+  if (N == RequestedThreads)
+    return;
+  RequestedThreads = N;
+  Pool.reset();
+}
+
+int32_t __ml_get_num_threads(void) {
+  std::lock_guard<std::mutex> Guard(PoolLock);
+  return getPool().getNumThreads();
+}
+
+} // extern "C"
@@ -0,0 +1,58 @@
+//===- ParallelRuntime.h - Parallel Loop Runtime --------------------===//
+//
+// This file declares the C interface of ml_runtime, the thread pool that
+// runs the loops the loop parallelization pass outlines. A parallelized
+// loop becomes one call
+//
+//   __ml_parallel_for(0, TripCount, Body, Ctx, Schedule, Chunk);
+//
+// which returns once Body(Begin, End, Ctx) has run for chunks of
+// iterations covering [0, TripCount) exactly once. The calling thread
+// takes part in the work. Every worker owns a queue of chunks:
+//
+//   - ML_SCHEDULE_STATIC gives each worker one contiguous block of
+//     iterations, or chunks of Chunk iterations round-robin, and workers
+//     only run their own chunks.
+//   - ML_SCHEDULE_DYNAMIC cuts the range into chunks of Chunk iterations
+//     (by default an eighth of a worker's share), deals them out in
+//     contiguous groups, and lets idle workers steal from the back of
+//     other queues.
+//
+// Loops started from inside a parallel loop run serially on the calling
+// thread. The pool has ML_NUM_THREADS threads, or one per hardware
+// thread, until __ml_set_num_threads changes it.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_RUNTIME_PARALLEL_RUNTIME_H
+#define MLCOMPILEROPT_RUNTIME_PARALLEL_RUNTIME_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Schedules of __ml_parallel_for
+enum { ML_SCHEDULE_STATIC = 0, ML_SCHEDULE_DYNAMIC = 1 };
+
+// Runs the iterations [Begin, End) of an outlined loop
+typedef void (*ml_parallel_body)(int64_t Begin, int64_t End, void *Ctx);
+
+// Runs Body over [Begin, End) on the thread pool. Chunk is the number of
+// iterations per chunk, or 0 for the default of the schedule.
+void __ml_parallel_for(int64_t Begin, int64_t End, ml_parallel_body Body,
+                       void *Ctx, int32_t Schedule, int64_t Chunk);
+
+// Resizes the thread pool, counting the calling thread; 0 restores the
+// default
+void __ml_set_num_threads(int32_t NumThreads);
+
+// Number of threads parallel loops run on
+int32_t __ml_get_num_threads(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // MLCOMPILEROPT_RUNTIME_PARALLEL_RUNTIME_H
@@ -0,0 +1,126 @@
+//===- KernelTestUtils.h - Shared Helpers for the Pass Tests --------===//
+//
+// Helpers for the pass tests: parsing test IR, running a function pass
+// with the analyses of the pipelines, and checking a transformation by
+// running the kernel before and after it through the JIT and comparing the
+// buffers. Tests need the passes library, the jit library if they run
+// kernels, and ml_runtime if the kernels have parallel loops.
+//
+//===----------------------------------------------------------------===//
+
+#ifndef MLCOMPILEROPT_TESTS_KERNEL_TEST_UTILS_H
+#define MLCOMPILEROPT_TESTS_KERNEL_TEST_UTILS_H
+
+#include <gtest/gtest.h>
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "jit/JITKernel.h"
+#include "jit/KernelBuffers.h"
+#include "jit/KernelSpec.h"
+#include "passes/MemoryCoalescing.h"
+
+#include <memory>
+#include <string>
+
+namespace kernel_test {
+
+// Parses the textual IR of a test, printing the error if it is malformed
+inline std::unique_ptr<llvm::Module> parse(llvm::StringRef IR,
+                                           llvm::LLVMContext &Context) {
+  llvm::SMDiagnostic Err;
+  std::unique_ptr<llvm::Module> M = llvm::parseAssemblyString(IR, Err, Context);
+  if (!M)
+    Err.print("test", llvm::errs());
+  return M;
+}
+
+// The analysis managers of the pipelines, with the memory access pattern
+// analyses the custom passes query
+struct TestAnalysisManagers {
+  llvm::LoopAnalysisManager LAM;
+  llvm::FunctionAnalysisManager FAM;
+  llvm::CGSCCAnalysisManager CGAM;
+  llvm::ModuleAnalysisManager MAM;
+  llvm::PassBuilder PB;
+
+  TestAnalysisManagers() {
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    mlcompileropt::registerMemoryCoalescingAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+  }
+};
+
+// Runs the function pass Pass on F
+template <typename PassT> void runFunctionPass(llvm::Function &F, PassT Pass) {
+  TestAnalysisManagers AM;
+  Pass.run(F, AM.FAM);
+}
+
+// Runs the module pass Pass on M
+template <typename PassT> void runModulePass(llvm::Module &M, PassT Pass) {
+  TestAnalysisManagers AM;
+  Pass.run(M, AM.MAM);
+}
+
+// Runs the kernel named in Spec, e.g. "matmul:A=64,B=64,C=64", from M on
+// fresh buffers and returns the buffers
+inline llvm::Expected<mlcompileropt::KernelBuffers>
+runKernel(std::unique_ptr<llvm::Module> M,
+          std::unique_ptr<llvm::LLVMContext> Context, llvm::StringRef Spec) {
+  auto ParsedSpec = mlcompileropt::parseKernelSpec(Spec);
+  if (!ParsedSpec)
+    return ParsedSpec.takeError();
+  std::string Name = Spec.split(':').first.str();
+  auto Buffers =
+      mlcompileropt::KernelBuffers::create(*M->getFunction(Name), *ParsedSpec);
+  if (!Buffers)
+    return Buffers.takeError();
+  auto Kernel = mlcompileropt::JITKernel::compile(std::move(M), std::move(Context),
+                                                  Name);
+  if (!Kernel)
+    return Kernel.takeError();
+  (*Kernel)->run(Buffers->getArgumentArray(), 1);
+  return std::move(*Buffers);
+}
+
+// Builds the module twice, applies Transform to the second copy and
+// expects the kernel of Spec to leave the same buffers in both, within
+// RelTol and AbsTol.
+inline void expectSameResults(
+    llvm::function_ref<std::unique_ptr<llvm::Module>(llvm::LLVMContext &)> Build,
+    llvm::function_ref<void(llvm::Module &)> Transform, llvm::StringRef Spec,
+    double RelTol = 0.0, double AbsTol = 0.0) {
+  auto ReferenceContext = std::make_unique<llvm::LLVMContext>();
+  std::unique_ptr<llvm::Module> Reference = Build(*ReferenceContext);
+  ASSERT_TRUE(Reference != nullptr);
+
+  auto TransformedContext = std::make_unique<llvm::LLVMContext>();
+  std::unique_ptr<llvm::Module> Transformed = Build(*TransformedContext);
+  ASSERT_TRUE(Transformed != nullptr);
+  Transform(*Transformed);
+
+  auto Expected = runKernel(std::move(Reference), std::move(ReferenceContext), Spec);
+  ASSERT_TRUE(!!Expected) << llvm::toString(Expected.takeError());
+  auto Actual = runKernel(std::move(Transformed), std::move(TransformedContext), Spec);
+  ASSERT_TRUE(!!Actual) << llvm::toString(Actual.takeError());
+  EXPECT_EQ(Actual->compare(*Expected, RelTol, AbsTol), "") << Spec.str();
+}
+
+} // namespace kernel_test
+
+#endif // MLCOMPILEROPT_TESTS_KERNEL_TEST_UTILS_H
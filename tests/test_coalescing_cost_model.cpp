@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "driver/TargetMachineCache.h"
+#include "passes/CoalescingCostModel.h"
+#include "passes/MemoryCoalescing.h"
+
+// Path to test files, provided by the build system
+#ifndef ML_TEST_FILES_DIR
+#define ML_TEST_FILES_DIR "test_files/"
+#endif
+const std::string TEST_FILES_DIR = ML_TEST_FILES_DIR;
+
+// Test fixture that answers cost queries for the target of the module
+class CoalescingCostModelTest : public ::testing::Test {
+protected:
+  bool loadIRFile(const std::string &Filename) {
+    llvm::SMDiagnostic Err;
+    M = llvm::parseIRFile(Filename, Err, Context);
+    if (!M) {
+      Err.print("test", llvm::errs());
+      return false;
+    }
+    PB = std::make_unique<llvm::PassBuilder>(
+        Targets.getTargetMachine(M->getTargetTriple()));
+    PB->registerModuleAnalyses(MAM);
+    PB->registerCGSCCAnalyses(CGAM);
+    PB->registerFunctionAnalyses(FAM);
+    mlcompileropt::registerMemoryCoalescingAnalyses(FAM);
+    PB->registerLoopAnalyses(LAM);
+    PB->crossRegisterProxies(LAM, FAM, CGAM, MAM);
+    return true;
+  }
+
+  mlcompileropt::CoalescingCostModel getCostModel(llvm::Function &F) {
+    return mlcompileropt::CoalescingCostModel(
+        FAM.getResult<llvm::TargetIRAnalysis>(F), M->getDataLayout());
+  }
+
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M;
+  mlcompileropt::TargetMachineCache Targets;
+  std::unique_ptr<llvm::PassBuilder> PB;
+  llvm::LoopAnalysisManager LAM;
+  llvm::FunctionAnalysisManager FAM;
+  llvm::CGSCCAnalysisManager CGAM;
+  llvm::ModuleAnalysisManager MAM;
+};
+
+// Test that the model takes its parameters from the module's target
+TEST_F(CoalescingCostModelTest, TargetParameters) {
+  ASSERT_TRUE(loadIRFile(TEST_FILES_DIR + "strided_access.ll"));
+  llvm::Function *F = M->getFunction("adjacent_access");
+  ASSERT_NE(F, nullptr);
+
+  // x86-64 without -target-cpu has SSE2 registers and 64-byte lines
+  mlcompileropt::CoalescingCostModel CM = getCostModel(*F);
+  EXPECT_EQ(CM.getCacheLineSize(), 64u);
+  EXPECT_EQ(CM.getVectorWidth(), 128u);
+  EXPECT_EQ(CM.getMaxMergeFactor(llvm::Type::getFloatTy(Context)), 4u);
+  EXPECT_EQ(CM.getMaxMergeFactor(llvm::Type::getDoubleTy(Context)), 2u);
+
+  // Without a target nothing is known to be vectorizable
+  llvm::TargetTransformInfo Generic(M->getDataLayout());
+  mlcompileropt::CoalescingCostModel GenericCM(Generic, M->getDataLayout());
+  EXPECT_EQ(GenericCM.getMaxMergeFactor(llvm::Type::getFloatTy(Context)), 1u);
+}
+
+// Test the cost of interchanging a column walk into a row walk
+TEST_F(CoalescingCostModelTest, InterchangeCost) {
+  ASSERT_TRUE(loadIRFile(TEST_FILES_DIR + "strided_access.ll"));
+  llvm::Function *F = M->getFunction("column_walk");
+  ASSERT_NE(F, nullptr);
+
+  auto &LI = FAM.getResult<llvm::LoopAnalysis>(*F);
+  auto &MAP = FAM.getResult<mlcompileropt::MemoryAccessPatternAnalysis>(*F);
+  ASSERT_EQ(LI.getTopLevelLoops().size(), 1u);
+  llvm::Loop *Outer = LI.getTopLevelLoops().front();
+  ASSERT_EQ(Outer->getSubLoops().size(), 1u);
+  llvm::Loop *Inner = Outer->getSubLoops().front();
+
+  mlcompileropt::CoalescingCostModel CM = getCostModel(*F);
+  mlcompileropt::TransformCost Cost = CM.getInterchangeCost(Inner, Outer, MAP);
+
+  // Rows are 256 bytes apart, so the load and the store each touch a new
+  // line every iteration; walking a row, 16 floats share a line and are
+  // loaded and stored four at a time
+  EXPECT_DOUBLE_EQ(Cost.Before.CacheLines, 2.0);
+  EXPECT_DOUBLE_EQ(Cost.After.CacheLines, 2.0 / 16);
+  EXPECT_DOUBLE_EQ(Cost.Before.MemoryOps, 2.0);
+  EXPECT_DOUBLE_EQ(Cost.After.MemoryOps, 2.0 / 4);
+  EXPECT_LT(Cost.After.Instructions, Cost.Before.Instructions);
+  EXPECT_TRUE(Cost.isProfitable());
+
+  // Interchanging back is not
+  mlcompileropt::TransformCost Back = {Cost.After, Cost.Before};
+  EXPECT_FALSE(Back.isProfitable());
+}
+
+// Test that merges are accepted or rejected by their cost on the target
+TEST_F(CoalescingCostModelTest, MergeCost) {
+  ASSERT_TRUE(loadIRFile(TEST_FILES_DIR + "strided_access.ll"));
+  llvm::Function *F = M->getFunction("adjacent_access");
+  ASSERT_NE(F, nullptr);
+  mlcompileropt::CoalescingCostModel CM = getCostModel(*F);
+
+  // Four float loads become one load and three shuffles
+  mlcompileropt::TransformCost Floats = CM.getMergeCost(
+      llvm::Type::getFloatTy(Context), 4, llvm::Align(16), 0, /*IsLoad=*/true);
+  EXPECT_DOUBLE_EQ(Floats.Before.MemoryOps, 4.0);
+  EXPECT_DOUBLE_EQ(Floats.After.MemoryOps, 1.0);
+  EXPECT_EQ(Floats.Before.CacheLines, Floats.After.CacheLines);
+  EXPECT_TRUE(Floats.isProfitable());
+
+  // Without SSE4.1, every byte of the vector has to be extracted separately
+  mlcompileropt::TransformCost Bytes = CM.getMergeCost(
+      llvm::Type::getInt8Ty(Context), 16, llvm::Align(16), 0, /*IsLoad=*/true);
+  EXPECT_GT(Bytes.After.Instructions, Bytes.Before.Instructions);
+  EXPECT_FALSE(Bytes.isProfitable());
+}
+
+// Main function for the test
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
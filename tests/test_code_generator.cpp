@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "driver/CodeGenerator.h"
+
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+// Path to test files, provided by the build system
+#ifndef ML_TEST_FILES_DIR
+#define ML_TEST_FILES_DIR "test_files/"
+#endif
+const std::string TEST_FILES_DIR = ML_TEST_FILES_DIR;
+
+class CodeGeneratorTest : public ::testing::Test {
+protected:
+  std::unique_ptr<llvm::Module> loadIRFile(const std::string &Filename) {
+    llvm::SMDiagnostic Err;
+    auto M = llvm::parseIRFile(Filename, Err, Context);
+    if (!M)
+      Err.print("test", llvm::errs());
+    return M;
+  }
+
+  // Compiles M to NumPartitions buffers
+  std::vector<llvm::SmallString<0>>
+  emit(llvm::Module &M, unsigned NumPartitions,
+       mlcompileropt::OutputFormat Format, unsigned Jobs = 0,
+       mlcompileropt::CodeGenStats *Stats = nullptr) {
+    std::vector<llvm::SmallString<0>> Buffers(NumPartitions);
+    std::vector<std::unique_ptr<llvm::raw_svector_ostream>> Streams;
+    std::vector<llvm::raw_pwrite_stream *> Outputs;
+    for (llvm::SmallString<0> &Buffer : Buffers) {
+      Streams.push_back(std::make_unique<llvm::raw_svector_ostream>(Buffer));
+      Outputs.push_back(Streams.back().get());
+    }
+    mlcompileropt::CodeGenOptions Opts;
+    Opts.Format = Format;
+    Opts.Jobs = Jobs;
+    if (llvm::Error E = mlcompileropt::emitNativeCode(M, Outputs, Opts, Stats))
+      ADD_FAILURE() << llvm::toString(std::move(E));
+    return Buffers;
+  }
+
+  // Counts the definitions of every function symbol in the objects
+  std::map<std::string, unsigned>
+  getDefinedFunctions(const std::vector<llvm::SmallString<0>> &Objects) {
+    std::map<std::string, unsigned> Defined;
+    for (const llvm::SmallString<0> &Object : Objects) {
+      auto ObjOrErr = llvm::object::ObjectFile::createObjectFile(
+          llvm::MemoryBufferRef(Object.str(), "object"));
+      if (!ObjOrErr) {
+        ADD_FAILURE() << llvm::toString(ObjOrErr.takeError());
+        continue;
+      }
+      for (const llvm::object::SymbolRef &Sym : (*ObjOrErr)->symbols()) {
+        auto TypeOrErr = Sym.getType();
+        auto FlagsOrErr = Sym.getFlags();
+        auto NameOrErr = Sym.getName();
+        if (!TypeOrErr || !FlagsOrErr || !NameOrErr) {
+          ADD_FAILURE() << "unreadable symbol";
+          llvm::consumeError(TypeOrErr.takeError());
+          llvm::consumeError(FlagsOrErr.takeError());
+          llvm::consumeError(NameOrErr.takeError());
+          continue;
+        }
+        if (*TypeOrErr == llvm::object::SymbolRef::ST_Function &&
+            !(*FlagsOrErr & llvm::object::SymbolRef::SF_Undefined))
+          ++Defined[NameOrErr->str()];
+      }
+    }
+    return Defined;
+  }
+
+  llvm::LLVMContext Context;
+};
+
+// The serial object defines every function of the module
+TEST_F(CodeGeneratorTest, EmitsObject) {
+  auto M = loadIRFile(TEST_FILES_DIR + "strided_access.ll");
+  ASSERT_TRUE(M != nullptr);
+  mlcompileropt::CodeGenStats Stats;
+  auto Objects = emit(*M, 1, mlcompileropt::OutputFormat::Object, 0, &Stats);
+  EXPECT_EQ(Stats.NumPartitions, 1u);
+
+  std::map<std::string, unsigned> Defined = getDefinedFunctions(Objects);
+  for (llvm::Function &F : *M) {
+    if (!F.isDeclaration()) {
+      EXPECT_EQ(Defined[F.getName().str()], 1u) << F.getName().str();
+    }
+  }
+}
+
+// Every function is defined in exactly one partition, whatever the number
+// of threads
+TEST_F(CodeGeneratorTest, PartitionsDefineEveryFunctionOnce) {
+  auto M = loadIRFile(TEST_FILES_DIR + "strided_access.ll");
+  ASSERT_TRUE(M != nullptr);
+  unsigned NumDefined = 0;
+  for (llvm::Function &F : *M)
+    if (!F.isDeclaration())
+      ++NumDefined;
+  std::map<std::string, unsigned> Serial =
+      getDefinedFunctions(emit(*M, 1, mlcompileropt::OutputFormat::Object));
+  ASSERT_EQ(Serial.size(), NumDefined);
+
+  for (unsigned Jobs : {1u, 3u}) {
+    mlcompileropt::CodeGenStats Stats;
+    auto Objects = emit(*M, 3, mlcompileropt::OutputFormat::Object, Jobs, &Stats);
+    EXPECT_EQ(Stats.NumPartitions, 3u);
+    for (const llvm::SmallString<0> &Object : Objects)
+      EXPECT_FALSE(Object.empty());
+    EXPECT_EQ(getDefinedFunctions(Objects), Serial);
+  }
+}
+
+// Pipes cannot seek, so every partition written to one is buffered
+// until the files are kept
+TEST_F(CodeGeneratorTest, PartitionsToPipes) {
+  auto M = loadIRFile(TEST_FILES_DIR + "strided_access.ll");
+  ASSERT_TRUE(M != nullptr);
+  std::map<std::string, unsigned> Serial =
+      getDefinedFunctions(emit(*M, 1, mlcompileropt::OutputFormat::Object));
+
+  llvm::SmallString<128> Dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("codegen-pipes", Dir));
+  std::string Filename = (Dir + "/out.o").str();
+  const unsigned NumPartitions = 3;
+
+  // Opening a pipe for writing waits for a reader
+  std::vector<llvm::SmallString<0>> Objects(NumPartitions);
+  std::vector<std::thread> Readers;
+  for (unsigned I = 0; I < NumPartitions; ++I) {
+    std::string Pipe = mlcompileropt::getPartitionFilename(Filename, I);
+    ASSERT_EQ(::mkfifo(Pipe.c_str(), 0600), 0);
+    Readers.emplace_back([Pipe, &Object = Objects[I]] {
+      std::ifstream In(Pipe, std::ios::binary);
+      std::string Data((std::istreambuf_iterator<char>(In)),
+                       std::istreambuf_iterator<char>());
+      Object = Data;
+    });
+  }
+
+  {
+    auto Outputs = mlcompileropt::PartitionOutputFiles::open(
+        Filename, NumPartitions, mlcompileropt::OutputFormat::Object);
+    ASSERT_TRUE(!!Outputs) << llvm::toString(Outputs.takeError());
+    mlcompileropt::CodeGenOptions Opts;
+    if (llvm::Error E =
+            mlcompileropt::emitNativeCode(*M, (*Outputs)->getStreams(), Opts))
+      ADD_FAILURE() << llvm::toString(std::move(E));
+    (*Outputs)->keep();
+  }
+  for (std::thread &Reader : Readers)
+    Reader.join();
+
+  for (const llvm::SmallString<0> &Object : Objects)
+    EXPECT_FALSE(Object.empty());
+  EXPECT_EQ(getDefinedFunctions(Objects), Serial);
+  llvm::sys::fs::remove_directories(Dir);
+}
+
+// Modules without a triple are compiled for the host
+TEST_F(CodeGeneratorTest, AssemblyForHostWithoutTriple) {
+  auto M = loadIRFile(TEST_FILES_DIR + "strided_access.ll");
+  ASSERT_TRUE(M != nullptr);
+  M->setTargetTriple("");
+  auto Assembly = emit(*M, 1, mlcompileropt::OutputFormat::Assembly);
+  EXPECT_EQ(M->getTargetTriple(), llvm::sys::getDefaultTargetTriple());
+  EXPECT_TRUE(Assembly[0].str().contains("column_walk:"));
+}
+
+TEST_F(CodeGeneratorTest, PartitionFilenames) {
+  EXPECT_EQ(mlcompileropt::getPartitionFilename("out.o", 0), "out.o");
+  EXPECT_EQ(mlcompileropt::getPartitionFilename("out.o", 2), "out.2.o");
+  EXPECT_EQ(mlcompileropt::getPartitionFilename("dir/kernels.s", 1),
+            "dir/kernels.1.s");
+  EXPECT_EQ(mlcompileropt::getPartitionFilename("out", 1), "out.1");
+}
+
+// Main function for the test
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include "llvm/Support/raw_ostream.h"
+
+#include "driver/SampleStats.h"
+#include "driver/ServerProtocol.h"
+
+using mlcompileropt::ServerRequest;
+
+TEST(ServerProtocolTest, ReadsRequests) {
+  std::istringstream IS("optimize k1 bc 5\nBC\xc0\xde!\n"
+                        "stats s1\n"
+                        "optimize k2 ll 0\n");
+  ServerRequest Req;
+
+  auto ReadOrErr = mlcompileropt::readServerRequest(IS, Req);
+  ASSERT_TRUE(!!ReadOrErr && *ReadOrErr);
+  EXPECT_EQ(Req.Command, ServerRequest::Optimize);
+  EXPECT_EQ(Req.Id, "k1");
+  EXPECT_TRUE(Req.EmitBitcode);
+  EXPECT_EQ(Req.Payload, std::string("BC\xc0\xde!"));
+
+  // The payload is followed by a newline that separates the frames
+  ReadOrErr = mlcompileropt::readServerRequest(IS, Req);
+  ASSERT_TRUE(!!ReadOrErr && *ReadOrErr);
+  EXPECT_EQ(Req.Command, ServerRequest::Stats);
+  EXPECT_EQ(Req.Id, "s1");
+
+  ReadOrErr = mlcompileropt::readServerRequest(IS, Req);
+  ASSERT_TRUE(!!ReadOrErr && *ReadOrErr);
+  EXPECT_EQ(Req.Id, "k2");
+  EXPECT_FALSE(Req.EmitBitcode);
+  EXPECT_TRUE(Req.Payload.empty());
+
+  ReadOrErr = mlcompileropt::readServerRequest(IS, Req);
+  ASSERT_TRUE(!!ReadOrErr);
+  EXPECT_FALSE(*ReadOrErr);
+}
+
+TEST(ServerProtocolTest, RejectsMalformedRequests) {
+  for (const char *Input : {"compile k1 ll 3\nabc", "optimize k1 ll\n",
+                            "optimize k1 s 3\nabc", "optimize k1 ll x\n",
+                            "optimize k1 ll 10\nabc"}) {
+    std::istringstream IS(Input);
+    ServerRequest Req;
+    auto ReadOrErr = mlcompileropt::readServerRequest(IS, Req);
+    EXPECT_FALSE(!!ReadOrErr) << Input;
+    llvm::consumeError(ReadOrErr.takeError());
+  }
+}
+
+// A size over the limit is rejected before the payload is allocated, even
+// if the stream holds that many bytes
+TEST(ServerProtocolTest, RejectsOversizedPayloads) {
+  std::istringstream IS("optimize k1 ll 4\nabcd");
+  ServerRequest Req;
+  auto ReadOrErr = mlcompileropt::readServerRequest(IS, Req, 3);
+  ASSERT_FALSE(!!ReadOrErr);
+  EXPECT_NE(llvm::toString(ReadOrErr.takeError()).find("exceeds the limit"),
+            std::string::npos);
+  EXPECT_EQ(Req.Payload.capacity(), std::string().capacity());
+
+  std::istringstream Huge("optimize k2 bc 17179869184\n");
+  ReadOrErr = mlcompileropt::readServerRequest(Huge, Req);
+  ASSERT_FALSE(!!ReadOrErr);
+  llvm::consumeError(ReadOrErr.takeError());
+  EXPECT_EQ(Req.Payload.capacity(), std::string().capacity());
+
+  std::istringstream Exact("optimize k3 ll 3\nabc");
+  ReadOrErr = mlcompileropt::readServerRequest(Exact, Req, 3);
+  ASSERT_TRUE(!!ReadOrErr && *ReadOrErr);
+  EXPECT_EQ(Req.Payload, "abc");
+}
+
+TEST(ServerProtocolTest, WritesResponses) {
+  std::string Str;
+  llvm::raw_string_ostream OS(Str);
+  mlcompileropt::writeServerResponse(OS, "k1", true, "abc");
+  mlcompileropt::writeServerResponse(OS, "k2", false, "oops\n");
+  EXPECT_EQ(OS.str(), "k1 ok 3\nabck2 error 5\noops\n");
+}
+
+TEST(SampleStatsTest, Summary) {
+  std::vector<double> Samples;
+  for (int I = 100; I >= 1; --I)
+    Samples.push_back(I);
+
+  mlcompileropt::SampleSummary S = mlcompileropt::summarizeSamples(Samples);
+  EXPECT_EQ(S.Count, 100u);
+  EXPECT_DOUBLE_EQ(S.Min, 1.0);
+  EXPECT_DOUBLE_EQ(S.Max, 100.0);
+  EXPECT_DOUBLE_EQ(S.Mean, 50.5);
+  EXPECT_DOUBLE_EQ(S.Median, 50.5);
+  EXPECT_DOUBLE_EQ(S.P95, 95.0);
+  EXPECT_DOUBLE_EQ(S.P99, 99.0);
+  EXPECT_NEAR(S.StdDev, 29.0115, 1e-4);
+
+  EXPECT_EQ(mlcompileropt::summarizeSamples({}).Count, 0u);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
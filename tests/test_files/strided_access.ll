@@ -81,4 +81,125 @@ outer.end:
 
 exit:
   ret void
-} 
\ No newline at end of file
+} 
+; Function walking the columns of two 64x64 row-major matrices in the
+; inner loop. Interchanging the loops makes both accesses unit stride.
+define void @column_walk(float* noalias %src, float* noalias %dst) {
+entry:
+  br label %col.loop
+
+col.loop:
+  %j = phi i32 [ 0, %entry ], [ %j.next, %col.latch ]
+  br label %row.loop
+
+row.loop:
+  %k = phi i32 [ 0, %col.loop ], [ %k.next, %row.loop ]
+  %row = mul nsw i32 %k, 64
+  %idx = add nsw i32 %row, %j
+  %gep.src = getelementptr inbounds float, float* %src, i32 %idx
+  %val = load float, float* %gep.src, align 4
+  %scaled = fmul float %val, 2.0
+  %gep.dst = getelementptr inbounds float, float* %dst, i32 %idx
+  store float %scaled, float* %gep.dst, align 4
+  %k.next = add nsw i32 %k, 1
+  %k.cond = icmp slt i32 %k.next, 64
+  br i1 %k.cond, label %row.loop, label %col.latch
+
+col.latch:
+  %j.next = add nsw i32 %j, 1
+  %j.cond = icmp slt i32 %j.next, 64
+  br i1 %j.cond, label %col.loop, label %exit
+
+exit:
+  ret void
+}
+
+; Same column walk, but each iteration reads the element the previous
+; column wrote one row below. The anti-dependence has direction (<, >),
+; so the loops must not be interchanged.
+define void @column_walk_dependent(float* %a) {
+entry:
+  br label %col.loop
+
+col.loop:
+  %j = phi i32 [ 1, %entry ], [ %j.next, %col.latch ]
+  br label %row.loop
+
+row.loop:
+  %k = phi i32 [ 0, %col.loop ], [ %k.next, %row.loop ]
+  %row = mul nsw i32 %k, 64
+  %idx = add nsw i32 %row, %j
+  %gep.in = getelementptr inbounds float, float* %a, i32 %idx
+  %val = load float, float* %gep.in, align 4
+  %k1 = add nsw i32 %k, 1
+  %row.out = mul nsw i32 %k1, 64
+  %j1 = add nsw i32 %j, -1
+  %idx.out = add nsw i32 %row.out, %j1
+  %gep.out = getelementptr inbounds float, float* %a, i32 %idx.out
+  store float %val, float* %gep.out, align 4
+  %k.next = add nsw i32 %k, 1
+  %k.cond = icmp slt i32 %k.next, 63
+  br i1 %k.cond, label %row.loop, label %col.latch
+
+col.latch:
+  %j.next = add nsw i32 %j, 1
+  %j.cond = icmp slt i32 %j.next, 64
+  br i1 %j.cond, label %col.loop, label %exit
+
+exit:
+  ret void
+}
+
+; The column walk of column_walk over a batch of 4x16 matrices, four
+; loops deep
+define void @column_walk_batched(float* noalias %src, float* noalias %dst) {
+entry:
+  br label %batch.loop
+
+batch.loop:
+  %b = phi i32 [ 0, %entry ], [ %b.next, %batch.latch ]
+  br label %mat.loop
+
+mat.loop:
+  %m = phi i32 [ 0, %batch.loop ], [ %m.next, %mat.latch ]
+  br label %col.loop
+
+col.loop:
+  %j = phi i32 [ 0, %mat.loop ], [ %j.next, %col.latch ]
+  br label %row.loop
+
+row.loop:
+  %k = phi i32 [ 0, %col.loop ], [ %k.next, %row.loop ]
+  %batch = mul nsw i32 %b, 65536
+  %mat = mul nsw i32 %m, 4096
+  %base = add nsw i32 %batch, %mat
+  %row = mul nsw i32 %k, 64
+  %col = add nsw i32 %base, %j
+  %idx = add nsw i32 %row, %col
+  %gep.src = getelementptr inbounds float, float* %src, i32 %idx
+  %val = load float, float* %gep.src, align 4
+  %scaled = fmul float %val, 2.0
+  %gep.dst = getelementptr inbounds float, float* %dst, i32 %idx
+  store float %scaled, float* %gep.dst, align 4
+  %k.next = add nsw i32 %k, 1
+  %k.cond = icmp slt i32 %k.next, 64
+  br i1 %k.cond, label %row.loop, label %col.latch
+
+col.latch:
+  %j.next = add nsw i32 %j, 1
+  %j.cond = icmp slt i32 %j.next, 64
+  br i1 %j.cond, label %col.loop, label %mat.latch
+
+mat.latch:
+  %m.next = add nsw i32 %m, 1
+  %m.cond = icmp slt i32 %m.next, 16
+  br i1 %m.cond, label %mat.loop, label %batch.latch
+
+batch.latch:
+  %b.next = add nsw i32 %b, 1
+  %b.cond = icmp slt i32 %b.next, 4
+  br i1 %b.cond, label %batch.loop, label %exit
+
+exit:
+  ret void
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/SourceMgr.h"
+
+#include "jit/KernelBuffers.h"
+#include "jit/KernelSpec.h"
+
+#include <cstring>
+
+// y[i] = a * x[i] + y[i] for i < n
+static const char *SaxpyIR = R"(
+define void @saxpy(float* %x, float* %y, float %a, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %px = getelementptr inbounds float, float* %x, i64 %i
+  %py = getelementptr inbounds float, float* %y, i64 %i
+  %vx = load float, float* %px
+  %vy = load float, float* %py
+  %mul = fmul float %a, %vx
+  %add = fadd float %mul, %vy
+  store float %add, float* %py
+  %i.next = add nuw i64 %i, 1
+  %done = icmp eq i64 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+)";
+
+static std::unique_ptr<llvm::Module> parse(llvm::LLVMContext &Context) {
+  llvm::SMDiagnostic Err;
+  return llvm::parseAssemblyString(SaxpyIR, Err, Context);
+}
+
+TEST(JITKernelTest, ParseSpec) {
+  auto Spec = mlcompileropt::parseKernelSpec("saxpy:x=16,y=16xf32,a=2.0,n=16,flops=32");
+  ASSERT_TRUE(bool(Spec));
+  EXPECT_EQ(Spec->Function, "saxpy");
+  ASSERT_EQ(Spec->Args.size(), 4u);
+  EXPECT_EQ(Spec->getArg("y")->Value, "16xf32");
+  EXPECT_EQ(*Spec->Flops, 32u);
+  EXPECT_FALSE(Spec->Bytes.hasValue());
+
+  EXPECT_FALSE(bool(mlcompileropt::parseKernelSpec(":x=1")));
+  llvm::consumeError(mlcompileropt::parseKernelSpec(":x=1").takeError());
+  auto Duplicate = mlcompileropt::parseKernelSpec("saxpy:x=1,x=2");
+  EXPECT_FALSE(bool(Duplicate));
+  llvm::consumeError(Duplicate.takeError());
+}
+
+// Buffers are sized from the spec, typed from the signature and restored
+// by reset()
+TEST(JITKernelTest, Buffers) {
+  auto Spec = mlcompileropt::parseKernelSpec("saxpy:x=16,y=16,a=2.5,n=16");
+  ASSERT_TRUE(bool(Spec));
+  llvm::LLVMContext Context;
+  auto M = parse(Context);
+  ASSERT_TRUE(M != nullptr);
+  auto Buffers = mlcompileropt::KernelBuffers::create(*M->getFunction("saxpy"), *Spec);
+  ASSERT_TRUE(bool(Buffers));
+  EXPECT_EQ(Buffers->getTotalBytes(), 128u);
+
+  const auto &Args = Buffers->getBuffers();
+  ASSERT_EQ(Args.size(), 4u);
+  EXPECT_EQ(Args[0].Kind, mlcompileropt::KernelBuffers::ElementKind::F32);
+  EXPECT_FALSE(Args[2].IsPointer);
+  float A;
+  std::memcpy(&A, Buffers->getArgumentArray()[2], sizeof(A));
+  EXPECT_EQ(A, 2.5f);
+  int64_t N;
+  std::memcpy(&N, Buffers->getArgumentArray()[3], sizeof(N));
+  EXPECT_EQ(N, 16);
+
+  // A copy starts out equal and reports the first changed element
+  mlcompileropt::KernelBuffers Copy = Buffers->clone();
+  EXPECT_EQ(Copy.compare(*Buffers, 0.0, 0.0), "");
+  float *Y = static_cast<float *>(Copy.getArgumentArray()[1]);
+  Y[3] += 1.0f;
+  EXPECT_EQ(Copy.compare(*Buffers, 0.0, 0.0).substr(0, 5), "y[3] ");
+  EXPECT_EQ(Copy.compare(*Buffers, 0.0, 2.0), "");
+  Copy.reset();
+  EXPECT_EQ(Copy.compare(*Buffers, 0.0, 0.0), "");
+}
+
+TEST(JITKernelTest, MissingArgument) {
+  auto Spec = mlcompileropt::parseKernelSpec("saxpy:x=16,y=16,a=2.0");
+  ASSERT_TRUE(bool(Spec));
+  llvm::LLVMContext Context;
+  auto M = parse(Context);
+  auto Buffers = mlcompileropt::KernelBuffers::create(*M->getFunction("saxpy"), *Spec);
+  ASSERT_FALSE(bool(Buffers));
+  EXPECT_NE(llvm::toString(Buffers.takeError()).find("'n'"), std::string::npos);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "kernelgen/KernelGenerator.h"
+
+// Depth of the deepest loop of F
+static unsigned getMaxLoopDepth(llvm::Function &F) {
+  llvm::DominatorTree DT(F);
+  llvm::LoopInfo LI(DT);
+  unsigned Depth = 0;
+  for (llvm::BasicBlock &BB : F)
+    Depth = std::max(Depth, LI.getLoopDepth(&BB));
+  return Depth;
+}
+
+// Test that every kind generates a valid nest of its natural depth
+TEST(KernelGeneratorTest, AllKinds) {
+  llvm::LLVMContext Context;
+  mlcompileropt::KernelGeneratorOptions Opts;
+  Opts.Kinds = {mlcompileropt::KernelKind::Matmul,
+                mlcompileropt::KernelKind::BatchedMatmul,
+                mlcompileropt::KernelKind::Conv2DNCHW,
+                mlcompileropt::KernelKind::Conv2DNHWC,
+                mlcompileropt::KernelKind::DepthwiseConv,
+                mlcompileropt::KernelKind::Elementwise,
+                mlcompileropt::KernelKind::ColumnWalk,
+                mlcompileropt::KernelKind::TransposeAdd,
+                mlcompileropt::KernelKind::Transpose,
+                mlcompileropt::KernelKind::ColumnAdd};
+  Opts.NumKernels = 20;
+  auto ModuleOrErr = mlcompileropt::generateKernelModule(Context, Opts);
+  ASSERT_TRUE(!!ModuleOrErr) << llvm::toString(ModuleOrErr.takeError());
+  llvm::Module &M = **ModuleOrErr;
+  EXPECT_FALSE(llvm::verifyModule(M, &llvm::errs()));
+  EXPECT_EQ(M.size(), 20u);
+
+  for (unsigned I = 0; I < Opts.NumKernels; ++I) {
+    mlcompileropt::KernelKind Kind = Opts.Kinds[I % Opts.Kinds.size()];
+    std::string Name = mlcompileropt::getKernelKindName(Kind).str();
+    std::replace(Name.begin(), Name.end(), '-', '_');
+    llvm::Function *F = M.getFunction(Name + "_" + std::to_string(I));
+    ASSERT_NE(F, nullptr) << Name;
+    EXPECT_EQ(getMaxLoopDepth(*F), mlcompileropt::getNaturalLoopDepth(Kind)) << Name;
+    EXPECT_EQ(mlcompileropt::parseKernelKind(mlcompileropt::getKernelKindName(Kind)), Kind);
+  }
+}
+
+// Test that extra depth adds batch loops and the innermost loop is unrolled
+TEST(KernelGeneratorTest, DepthAndUnroll) {
+  llvm::LLVMContext Context;
+  mlcompileropt::KernelGeneratorOptions Opts;
+  Opts.LoopDepth = 5;
+  Opts.Unroll = 4;
+  auto ModuleOrErr = mlcompileropt::generateKernelModule(Context, Opts);
+  ASSERT_TRUE(!!ModuleOrErr) << llvm::toString(ModuleOrErr.takeError());
+  llvm::Function *F = (*ModuleOrErr)->getFunction("matmul_0");
+  ASSERT_NE(F, nullptr);
+  EXPECT_FALSE(llvm::verifyFunction(*F, &llvm::errs()));
+  EXPECT_EQ(getMaxLoopDepth(*F), 5u);
+
+  unsigned NumMuls = 0;
+  for (llvm::BasicBlock &BB : *F)
+    for (llvm::Instruction &I : BB)
+      NumMuls += I.getOpcode() == llvm::Instruction::FMul;
+  EXPECT_EQ(NumMuls, 4u);
+}
+
+// Test that impossible shapes are rejected
+TEST(KernelGeneratorTest, InvalidOptions) {
+  llvm::LLVMContext Context;
+  mlcompileropt::KernelGeneratorOptions Opts;
+  Opts.Unroll = 3;
+  EXPECT_FALSE(!!mlcompileropt::generateKernelModule(Context, Opts));
+
+  Opts.Unroll = 1;
+  Opts.LoopDepth = 2;
+  auto ModuleOrErr = mlcompileropt::generateKernelModule(Context, Opts);
+  ASSERT_FALSE(!!ModuleOrErr);
+  EXPECT_EQ(llvm::toString(ModuleOrErr.takeError()),
+            "matmul needs a loop depth of at least 3");
+}
+
+// Main function for the test
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,294 @@
+#include <gtest/gtest.h>
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "passes/LoopFusion.h"
+
+#include "KernelTestUtils.h"
+
+namespace {
+
+using kernel_test::parse;
+
+// A 16x16 matmul into O, followed by a bias-add nest and a ReLU nest over
+// O; all three fuse into one nest
+const char *const MatmulBiasReluIR = R"IR(
+define void @matmul_bias_relu(float* noalias %A, float* noalias %B,
+                              float* noalias %bias, float* noalias %O) {
+entry:
+  br label %mm.i
+
+mm.i:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %mm.i.latch ]
+  br label %mm.j
+
+mm.j:
+  %j = phi i64 [ 0, %mm.i ], [ %j.next, %mm.j.latch ]
+  %row = mul nuw nsw i64 %i, 16
+  %o.idx = add nuw nsw i64 %row, %j
+  %o.ptr = getelementptr inbounds float, float* %O, i64 %o.idx
+  store float 0.0, float* %o.ptr, align 4
+  br label %mm.k
+
+mm.k:
+  %k = phi i64 [ 0, %mm.j ], [ %k.next, %mm.k ]
+  %a.idx = add nuw nsw i64 %row, %k
+  %a.ptr = getelementptr inbounds float, float* %A, i64 %a.idx
+  %a = load float, float* %a.ptr, align 4
+  %b.row = mul nuw nsw i64 %k, 16
+  %b.idx = add nuw nsw i64 %b.row, %j
+  %b.ptr = getelementptr inbounds float, float* %B, i64 %b.idx
+  %b = load float, float* %b.ptr, align 4
+  %prod = fmul float %a, %b
+  %acc = load float, float* %o.ptr, align 4
+  %sum = fadd float %acc, %prod
+  store float %sum, float* %o.ptr, align 4
+  %k.next = add nuw nsw i64 %k, 1
+  %k.cond = icmp ult i64 %k.next, 16
+  br i1 %k.cond, label %mm.k, label %mm.j.latch
+
+mm.j.latch:
+  %j.next = add nuw nsw i64 %j, 1
+  %j.cond = icmp ult i64 %j.next, 16
+  br i1 %j.cond, label %mm.j, label %mm.i.latch
+
+mm.i.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %i.cond = icmp ult i64 %i.next, 16
+  br i1 %i.cond, label %mm.i, label %bias.ph
+
+bias.ph:
+  br label %bias.i
+
+bias.i:
+  %bi = phi i64 [ 0, %bias.ph ], [ %bi.next, %bias.i.latch ]
+  br label %bias.j
+
+bias.j:
+  %bj = phi i64 [ 0, %bias.i ], [ %bj.next, %bias.j ]
+  %b.brow = mul nuw nsw i64 %bi, 16
+  %b.oidx = add nuw nsw i64 %b.brow, %bj
+  %b.optr = getelementptr inbounds float, float* %O, i64 %b.oidx
+  %b.o = load float, float* %b.optr, align 4
+  %b.bptr = getelementptr inbounds float, float* %bias, i64 %bj
+  %b.b = load float, float* %b.bptr, align 4
+  %b.sum = fadd float %b.o, %b.b
+  store float %b.sum, float* %b.optr, align 4
+  %bj.next = add nuw nsw i64 %bj, 1
+  %bj.cond = icmp ult i64 %bj.next, 16
+  br i1 %bj.cond, label %bias.j, label %bias.i.latch
+
+bias.i.latch:
+  %bi.next = add nuw nsw i64 %bi, 1
+  %bi.cond = icmp ult i64 %bi.next, 16
+  br i1 %bi.cond, label %bias.i, label %relu.ph
+
+relu.ph:
+  br label %relu.i
+
+relu.i:
+  %ri = phi i64 [ 0, %relu.ph ], [ %ri.next, %relu.i.latch ]
+  br label %relu.j
+
+relu.j:
+  %rj = phi i64 [ 0, %relu.i ], [ %rj.next, %relu.j ]
+  %r.row = mul nuw nsw i64 %ri, 16
+  %r.idx = add nuw nsw i64 %r.row, %rj
+  %r.ptr = getelementptr inbounds float, float* %O, i64 %r.idx
+  %r.v = load float, float* %r.ptr, align 4
+  %r.pos = fcmp ogt float %r.v, 0.0
+  %r.max = select i1 %r.pos, float %r.v, float 0.0
+  store float %r.max, float* %r.ptr, align 4
+  %rj.next = add nuw nsw i64 %rj, 1
+  %rj.cond = icmp ult i64 %rj.next, 16
+  br i1 %rj.cond, label %relu.j, label %relu.i.latch
+
+relu.i.latch:
+  %ri.next = add nuw nsw i64 %ri, 1
+  %ri.cond = icmp ult i64 %ri.next, 16
+  br i1 %ri.cond, label %relu.i, label %exit
+
+exit:
+  ret void
+}
+)IR";
+
+// The second loop reads A[i+1] before the fused loop would write it
+const char *const ShiftedIR = R"IR(
+define void @shifted(float* noalias %A, float* noalias %B) {
+entry:
+  br label %first
+
+first:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %first ]
+  %f = uitofp i64 %i to float
+  %a.ptr = getelementptr inbounds float, float* %A, i64 %i
+  store float %f, float* %a.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %i.cond = icmp ult i64 %i.next, 63
+  br i1 %i.cond, label %first, label %between
+
+between:
+  br label %second
+
+second:
+  %j = phi i64 [ 0, %between ], [ %j.next, %second ]
+  %j.succ = add nuw nsw i64 %j, 1
+  %src = getelementptr inbounds float, float* %A, i64 %j.succ
+  %v = load float, float* %src, align 4
+  %dst = getelementptr inbounds float, float* %B, i64 %j
+  store float %v, float* %dst, align 4
+  %j.next = add nuw nsw i64 %j, 1
+  %j.cond = icmp ult i64 %j.next, 63
+  br i1 %j.cond, label %second, label %exit
+
+exit:
+  ret void
+}
+)IR";
+
+// Three independent statements reading seven arrays and three scalars
+const char *const WideIR = R"IR(
+define void @wide(float* noalias %A, float* noalias %B, float* noalias %C,
+                  float* noalias %D, float* noalias %X, float* noalias %Y,
+                  float* noalias %Z, float %s1, float %s2, float %s3) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %a.ptr = getelementptr inbounds float, float* %A, i64 %i
+  %a = load float, float* %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, float* %B, i64 %i
+  %b = load float, float* %b.ptr, align 4
+  %as = fmul float %a, %s1
+  %x = fadd float %as, %b
+  %x.ptr = getelementptr inbounds float, float* %X, i64 %i
+  store float %x, float* %x.ptr, align 4
+  %c.ptr = getelementptr inbounds float, float* %C, i64 %i
+  %c = load float, float* %c.ptr, align 4
+  %y = fmul float %c, %s2
+  %y.ptr = getelementptr inbounds float, float* %Y, i64 %i
+  store float %y, float* %y.ptr, align 4
+  %d.ptr = getelementptr inbounds float, float* %D, i64 %i
+  %d = load float, float* %d.ptr, align 4
+  %z = fadd float %d, %s3
+  %z.ptr = getelementptr inbounds float, float* %Z, i64 %i
+  store float %z, float* %z.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %i.cond = icmp ult i64 %i.next, 64
+  br i1 %i.cond, label %loop, label %exit
+
+exit:
+  ret void
+}
+)IR";
+
+void runLoopFusion(llvm::Function &F, mlcompileropt::LoopFusionMode Mode,
+                   unsigned MaxPressure) {
+  kernel_test::runFunctionPass(F,
+                               mlcompileropt::LoopFusionPass(Mode, MaxPressure));
+}
+
+// Number of loops, and the depth of the deepest one
+std::pair<unsigned, unsigned> getLoopShape(llvm::Function &F) {
+  llvm::DominatorTree DT(F);
+  llvm::LoopInfo LI(DT);
+  unsigned Depth = 0;
+  for (llvm::BasicBlock &BB : F)
+    Depth = std::max(Depth, LI.getLoopDepth(&BB));
+  return {unsigned(LI.getLoopsInPreorder().size()), Depth};
+}
+
+// Runs the kernel of IR before and after the pass and expects the same
+// buffers
+void expectSameResults(const char *IR, llvm::StringRef Spec,
+                       mlcompileropt::LoopFusionMode Mode,
+                       unsigned MaxPressure) {
+  kernel_test::expectSameResults(
+      [&](llvm::LLVMContext &Context) { return parse(IR, Context); },
+      [&](llvm::Module &M) {
+        runLoopFusion(*M.getFunction(Spec.split(':').first), Mode, MaxPressure);
+      },
+      Spec);
+}
+
+const char *const MatmulBiasReluSpec =
+    "matmul_bias_relu:A=256,B=256,bias=16,O=256";
+const char *const WideSpec =
+    "wide:A=64,B=64,C=64,D=64,X=64,Y=64,Z=64,s1=0.5,s2=2,s3=-1";
+
+} // end anonymous namespace
+
+TEST(LoopFusionTest, ModeNames) {
+  EXPECT_EQ(mlcompileropt::getLoopFusionModeName(
+                mlcompileropt::LoopFusionMode::Fission),
+            "fission");
+  // Off unless selected
+  EXPECT_EQ(mlcompileropt::getSelectedLoopFusionMode(),
+            mlcompileropt::LoopFusionMode::None);
+}
+
+// The three nests fuse level by level into one nest of depth 3
+TEST(LoopFusionTest, FuseMatmulBiasRelu) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(MatmulBiasReluIR, Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("matmul_bias_relu");
+  ASSERT_EQ(getLoopShape(F), std::make_pair(7u, 3u));
+
+  runLoopFusion(F, mlcompileropt::LoopFusionMode::Fuse, 16);
+  ASSERT_FALSE(llvm::verifyFunction(F, &llvm::errs()));
+  EXPECT_EQ(getLoopShape(F), std::make_pair(3u, 3u));
+
+  // Fission alone leaves the nests as they are
+  std::unique_ptr<llvm::Module> Unfused = parse(MatmulBiasReluIR, Context);
+  ASSERT_TRUE(Unfused != nullptr);
+  llvm::Function &G = *Unfused->getFunction("matmul_bias_relu");
+  runLoopFusion(G, mlcompileropt::LoopFusionMode::Fission, 16);
+  EXPECT_EQ(getLoopShape(G), std::make_pair(7u, 3u));
+}
+
+TEST(LoopFusionTest, KeepsDependence) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(ShiftedIR, Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("shifted");
+  runLoopFusion(F, mlcompileropt::LoopFusionMode::Both, 16);
+  EXPECT_EQ(getLoopShape(F), std::make_pair(2u, 1u));
+}
+
+// With room for 6 registers, fission splits the loop until every part fits
+TEST(LoopFusionTest, SplitWideLoop) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(WideIR, Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("wide");
+  runLoopFusion(F, mlcompileropt::LoopFusionMode::Both, 6);
+  ASSERT_FALSE(llvm::verifyFunction(F, &llvm::errs()));
+  EXPECT_EQ(getLoopShape(F), std::make_pair(3u, 1u));
+
+  // With enough registers, the loop stays as it is
+  std::unique_ptr<llvm::Module> Narrow = parse(WideIR, Context);
+  ASSERT_TRUE(Narrow != nullptr);
+  llvm::Function &G = *Narrow->getFunction("wide");
+  runLoopFusion(G, mlcompileropt::LoopFusionMode::Both, 16);
+  EXPECT_EQ(getLoopShape(G), std::make_pair(1u, 1u));
+}
+
+TEST(LoopFusionTest, SameResults) {
+  expectSameResults(MatmulBiasReluIR, MatmulBiasReluSpec,
+                    mlcompileropt::LoopFusionMode::Fuse, 16);
+  expectSameResults(WideIR, WideSpec, mlcompileropt::LoopFusionMode::Fission, 6);
+}
+
+// Main function for the test
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,373 @@
+#include <gtest/gtest.h>
+
+#include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "passes/LoopParallelization.h"
+#include "passes/MemoryCoalescing.h"
+#include "passes/TuningConfig.h"
+#include "runtime/ParallelRuntime.h"
+
+#include "KernelTestUtils.h"
+
+namespace {
+
+using kernel_test::parse;
+
+// C = A * B for 24x24 matrices; every row of C is independent
+const char *const MatmulIR = R"IR(
+define void @matmul(float* noalias %A, float* noalias %B, float* noalias %C) {
+entry:
+  br label %i.loop
+
+i.loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %j.exit ]
+  %row = mul nuw nsw i64 %i, 24
+  br label %j.loop
+
+j.loop:
+  %j = phi i64 [ 0, %i.loop ], [ %j.next, %k.exit ]
+  %c.idx = add nuw nsw i64 %row, %j
+  %c.ptr = getelementptr inbounds float, float* %C, i64 %c.idx
+  store float 0.0, float* %c.ptr, align 4
+  br label %k.loop
+
+k.loop:
+  %k = phi i64 [ 0, %j.loop ], [ %k.next, %k.loop ]
+  %a.idx = add nuw nsw i64 %row, %k
+  %a.ptr = getelementptr inbounds float, float* %A, i64 %a.idx
+  %a = load float, float* %a.ptr, align 4
+  %b.row = mul nuw nsw i64 %k, 24
+  %b.idx = add nuw nsw i64 %b.row, %j
+  %b.ptr = getelementptr inbounds float, float* %B, i64 %b.idx
+  %b = load float, float* %b.ptr, align 4
+  %prod = fmul float %a, %b
+  %acc = load float, float* %c.ptr, align 4
+  %sum = fadd float %acc, %prod
+  store float %sum, float* %c.ptr, align 4
+  %k.next = add nuw nsw i64 %k, 1
+  %k.cond = icmp ult i64 %k.next, 24
+  br i1 %k.cond, label %k.loop, label %k.exit
+
+k.exit:
+  %j.next = add nuw nsw i64 %j, 1
+  %j.cond = icmp ult i64 %j.next, 24
+  br i1 %j.cond, label %j.loop, label %j.exit
+
+j.exit:
+  %i.next = add nuw nsw i64 %i, 1
+  %i.cond = icmp ult i64 %i.next, 24
+  br i1 %i.cond, label %i.loop, label %exit
+
+exit:
+  ret void
+}
+)IR";
+
+// Y[p] = X[p] * s over n elements, walking pointers with a stride of 3
+// elements, followed by a prefix sum whose iterations depend on each other
+const char *const StridedThenScanIR = R"IR(
+define void @strided_scan(float* noalias %X, float* noalias %Y, float %s,
+                          i32 %n) {
+entry:
+  %any = icmp sgt i32 %n, 0
+  br i1 %any, label %scale.ph, label %exit
+
+scale.ph:
+  br label %scale
+
+scale:
+  %x = phi float* [ %X, %scale.ph ], [ %x.next, %scale ]
+  %y = phi float* [ %Y, %scale.ph ], [ %y.next, %scale ]
+  %t = phi i32 [ 0, %scale.ph ], [ %t.next, %scale ]
+  %v = load float, float* %x, align 4
+  %w = fmul float %v, %s
+  store float %w, float* %y, align 4
+  %x.next = getelementptr inbounds float, float* %x, i64 3
+  %y.next = getelementptr inbounds float, float* %y, i64 3
+  %t.next = add nuw nsw i32 %t, 1
+  %t.cond = icmp slt i32 %t.next, %n
+  br i1 %t.cond, label %scale, label %scan.ph
+
+scan.ph:
+  br label %scan
+
+scan:
+  %i = phi i64 [ 1, %scan.ph ], [ %i.next, %scan ]
+  %prev.idx = add nsw i64 %i, -1
+  %prev.ptr = getelementptr inbounds float, float* %Y, i64 %prev.idx
+  %prev = load float, float* %prev.ptr, align 4
+  %cur.ptr = getelementptr inbounds float, float* %Y, i64 %i
+  %cur = load float, float* %cur.ptr, align 4
+  %acc = fadd float %prev, %cur
+  store float %acc, float* %cur.ptr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %i.cond = icmp ult i64 %i.next, 48
+  br i1 %i.cond, label %scan, label %exit
+
+exit:
+  ret void
+}
+)IR";
+
+// The sum of X is needed after the loop
+const char *const ReductionIR = R"IR(
+define void @reduce(float* noalias %X, float* noalias %Out) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi float [ 0.0, %entry ], [ %sum, %loop ]
+  %x.ptr = getelementptr inbounds float, float* %X, i64 %i
+  %x = load float, float* %x.ptr, align 4
+  %sum = fadd float %acc, %x
+  %i.next = add nuw nsw i64 %i, 1
+  %i.cond = icmp ult i64 %i.next, 64
+  br i1 %i.cond, label %loop, label %exit
+
+exit:
+  store float %sum, float* %Out, align 4
+  ret void
+}
+)IR";
+
+// Out[m][n] = In[m][n] * 2 for 80x80 matrices, walking the columns in the
+// inner loop
+const char *const ColumnWalkIR = R"IR(
+define void @column_walk(float* noalias %In, float* noalias %Out) {
+entry:
+  br label %n.loop
+
+n.loop:
+  %n = phi i64 [ 0, %entry ], [ %n.next, %m.exit ]
+  br label %m.loop
+
+m.loop:
+  %m = phi i64 [ 0, %n.loop ], [ %m.next, %m.loop ]
+  %in.rows = bitcast float* %In to [80 x float]*
+  %in.ptr = getelementptr inbounds [80 x float], [80 x float]* %in.rows, i64 %m, i64 %n
+  %v = load float, float* %in.ptr, align 4
+  %out.rows = bitcast float* %Out to [80 x float]*
+  %out.ptr = getelementptr inbounds [80 x float], [80 x float]* %out.rows, i64 %m, i64 %n
+  %w = fmul float %v, 2.0
+  store float %w, float* %out.ptr, align 4
+  %m.next = add nuw nsw i64 %m, 1
+  %m.cond = icmp ult i64 %m.next, 80
+  br i1 %m.cond, label %m.loop, label %m.exit
+
+m.exit:
+  %n.next = add nuw nsw i64 %n, 1
+  %n.cond = icmp ult i64 %n.next, 80
+  br i1 %n.cond, label %n.loop, label %exit
+
+exit:
+  ret void
+}
+)IR";
+
+void runLoopParallelize(llvm::Module &M, mlcompileropt::ParallelSchedule Schedule,
+                        unsigned Chunk = 0) {
+  kernel_test::runModulePass(
+      M, mlcompileropt::LoopParallelizePass(Schedule, Chunk));
+}
+
+// Collects the names of the remarks emitted by the passes
+struct RemarkCollector : public llvm::DiagnosticHandler {
+  bool isAnalysisRemarkEnabled(llvm::StringRef) const override { return true; }
+  bool isMissedOptRemarkEnabled(llvm::StringRef) const override { return true; }
+  bool isPassedOptRemarkEnabled(llvm::StringRef) const override { return true; }
+  bool isAnyRemarkEnabled() const override { return true; }
+
+  bool handleDiagnostics(const llvm::DiagnosticInfo &DI) override {
+    if (auto *R = llvm::dyn_cast<llvm::DiagnosticInfoOptimizationBase>(&DI))
+      Names.push_back((R->getFunction().getName() + ":" + R->getRemarkName()).str());
+    return true;
+  }
+
+  std::vector<std::string> Names;
+};
+
+// Runs the memory coalescing pass on every function of M, after the
+// instcombine that precedes it in the default pipelines
+void runMemoryCoalescing(llvm::Module &M) {
+  llvm::LoopAnalysisManager LAM;
+  llvm::FunctionAnalysisManager FAM;
+  llvm::CGSCCAnalysisManager CGAM;
+  llvm::ModuleAnalysisManager MAM;
+  llvm::PassBuilder PB;
+  mlcompileropt::registerMemoryCoalescingPass(
+      PB, mlcompileropt::CoalescingExtensionPoint::None);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  llvm::ModulePassManager MPM;
+  llvm::cantFail(
+      PB.parsePassPipeline(MPM, "function(instcombine,memory-coalescing)"));
+  MPM.run(M, MAM);
+}
+
+// Calls of the runtime in F, with their schedule and chunk arguments
+std::vector<std::pair<int64_t, int64_t>> getParallelLoops(llvm::Function &F) {
+  std::vector<std::pair<int64_t, int64_t>> Loops;
+  for (llvm::BasicBlock &BB : F)
+    for (llvm::Instruction &I : BB)
+      if (auto *Call = llvm::dyn_cast<llvm::CallInst>(&I))
+        if (Call->getCalledFunction() &&
+            Call->getCalledFunction()->getName() == "__ml_parallel_for")
+          Loops.push_back(
+              {llvm::cast<llvm::ConstantInt>(Call->getArgOperand(4))->getSExtValue(),
+               llvm::cast<llvm::ConstantInt>(Call->getArgOperand(5))->getSExtValue()});
+  return Loops;
+}
+
+// Runs the kernel of IR before and after the pass, the latter with Threads
+// threads for its parallel loops, and expects the same buffers
+void expectSameResults(const char *IR, llvm::StringRef Spec,
+                       mlcompileropt::ParallelSchedule Schedule, unsigned Chunk,
+                       int32_t Threads) {
+  __ml_set_num_threads(Threads);
+  kernel_test::expectSameResults(
+      [&](llvm::LLVMContext &Context) { return parse(IR, Context); },
+      [&](llvm::Module &M) {
+        runLoopParallelize(M, Schedule, Chunk);
+        EXPECT_FALSE(getParallelLoops(*M.getFunction(Spec.split(':').first))
+                         .empty());
+      },
+      Spec);
+  __ml_set_num_threads(0);
+}
+
+const char *const MatmulSpec = "matmul:A=576,B=576,C=576";
+const char *const StridedScanSpec = "strided_scan:X=150,Y=150,s=1.5,n=50";
+const char *const ColumnWalkSpec = "column_walk:In=6400,Out=6400";
+
+} // end anonymous namespace
+
+// The row loop becomes a call of the runtime; the outlined functions are
+// marked so that they are not parallelized again
+TEST(LoopParallelizationTest, ParallelizeMatmul) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(MatmulIR, Context);
+  ASSERT_TRUE(M != nullptr);
+  runLoopParallelize(*M, mlcompileropt::ParallelSchedule::Dynamic, 2);
+  ASSERT_FALSE(llvm::verifyModule(*M, &llvm::errs()));
+
+  llvm::Function &F = *M->getFunction("matmul");
+  using Loops = std::vector<std::pair<int64_t, int64_t>>;
+  EXPECT_EQ(getParallelLoops(F), Loops({{ML_SCHEDULE_DYNAMIC, 2}}));
+  llvm::Function *Body = M->getFunction("matmul.parallel.body");
+  ASSERT_TRUE(Body != nullptr);
+  EXPECT_TRUE(Body->hasFnAttribute(mlcompileropt::ParallelBodyAttributeName));
+  EXPECT_TRUE(Body->hasParamAttribute(2, llvm::Attribute::NoAlias));
+  ASSERT_TRUE(M->getFunction("matmul.parallel") != nullptr);
+
+  // Running the pass again finds nothing left to do
+  runLoopParallelize(*M, mlcompileropt::ParallelSchedule::Static);
+  EXPECT_EQ(getParallelLoops(F).size(), 1u);
+  EXPECT_EQ(M->getFunction("matmul.parallel.body.parallel.body"), nullptr);
+}
+
+// The pointer loop is parallelized, the prefix sum is not
+TEST(LoopParallelizationTest, KeepsCarriedDependence) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(StridedThenScanIR, Context);
+  ASSERT_TRUE(M != nullptr);
+  runLoopParallelize(*M, mlcompileropt::ParallelSchedule::Static);
+  ASSERT_FALSE(llvm::verifyModule(*M, &llvm::errs()));
+  llvm::Function &F = *M->getFunction("strided_scan");
+  EXPECT_EQ(getParallelLoops(F).size(), 1u);
+  EXPECT_TRUE(llvm::any_of(F, [](llvm::BasicBlock &BB) {
+    return BB.getName() == "scan";
+  }));
+}
+
+TEST(LoopParallelizationTest, KeepsReduction) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(ReductionIR, Context);
+  ASSERT_TRUE(M != nullptr);
+  runLoopParallelize(*M, mlcompileropt::ParallelSchedule::Static);
+  EXPECT_TRUE(getParallelLoops(*M->getFunction("reduce")).empty());
+  EXPECT_EQ(M->getFunction("reduce.parallel"), nullptr);
+}
+
+// The chunk loop of the outlined column walk can still be interchanged
+// with the row loop, so each thread walks its columns with unit stride
+TEST(LoopParallelizationTest, OutlinedColumnWalkIsInterchanged) {
+  llvm::LLVMContext Context;
+  auto Handler = std::make_unique<RemarkCollector>();
+  RemarkCollector *Remarks = Handler.get();
+  Context.setDiagnosticHandler(std::move(Handler));
+  std::unique_ptr<llvm::Module> M = parse(ColumnWalkIR, Context);
+  ASSERT_TRUE(M != nullptr);
+  runLoopParallelize(*M, mlcompileropt::ParallelSchedule::Static);
+  ASSERT_EQ(getParallelLoops(*M->getFunction("column_walk")).size(), 1u);
+
+  runMemoryCoalescing(*M);
+  ASSERT_FALSE(llvm::verifyModule(*M, &llvm::errs()));
+  std::vector<std::string> Expected = {
+      "column_walk:Parallelized",
+      "column_walk.parallel.body:StridedAccess",
+      "column_walk.parallel.body:Interchanged",
+  };
+  EXPECT_EQ(Remarks->Names, Expected);
+}
+
+// A tuning parameter selects the schedule of a function
+TEST(LoopParallelizationTest, TuningSelectsSchedule) {
+  auto Config = mlcompileropt::TuningConfig::parse("parallel=dynamic");
+  ASSERT_TRUE(!!Config);
+  EXPECT_EQ(Config->toString(), "parallel=dynamic");
+
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(MatmulIR, Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("matmul");
+  runLoopParallelize(*M, mlcompileropt::ParallelSchedule::None);
+  EXPECT_TRUE(getParallelLoops(F).empty());
+
+  Config->attachTo(F);
+  runLoopParallelize(*M, mlcompileropt::ParallelSchedule::None);
+  using Loops = std::vector<std::pair<int64_t, int64_t>>;
+  EXPECT_EQ(getParallelLoops(F), Loops({{ML_SCHEDULE_DYNAMIC, 0}}));
+
+  // parallel=none keeps the loops of a function serial
+  std::unique_ptr<llvm::Module> Serial = parse(MatmulIR, Context);
+  ASSERT_TRUE(Serial != nullptr);
+  llvm::Function &G = *Serial->getFunction("matmul");
+  ASSERT_FALSE(G.getFnAttribute(mlcompileropt::TuningAttributeName).isValid());
+  auto None = mlcompileropt::TuningConfig::parse("parallel=none");
+  ASSERT_TRUE(!!None);
+  None->attachTo(G);
+  runLoopParallelize(*Serial, mlcompileropt::ParallelSchedule::Static);
+  EXPECT_TRUE(getParallelLoops(G).empty());
+}
+
+TEST(LoopParallelizationTest, SameResults) {
+  for (int32_t Threads : {1, 4}) {
+    expectSameResults(MatmulIR, MatmulSpec, mlcompileropt::ParallelSchedule::Static,
+                      0, Threads);
+    expectSameResults(MatmulIR, MatmulSpec, mlcompileropt::ParallelSchedule::Dynamic,
+                      0, Threads);
+    expectSameResults(StridedThenScanIR, StridedScanSpec,
+                      mlcompileropt::ParallelSchedule::Dynamic, 3, Threads);
+    expectSameResults(ColumnWalkIR, ColumnWalkSpec,
+                      mlcompileropt::ParallelSchedule::Dynamic, 3, Threads);
+  }
+}
+
+// Main function for the test
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,220 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "kernelgen/KernelGenerator.h"
+#include "passes/LoopTiling.h"
+#include "passes/MemoryAccessPattern.h"
+#include "passes/MemoryCoalescing.h"
+#include "passes/TuningConfig.h"
+
+#include "KernelTestUtils.h"
+
+namespace {
+
+// A[i][j] = A[i-1][j+1] + 1: the dependence runs forwards in i and
+// backwards in j, so the nest must not be tiled
+const char *const SkewedIR = R"IR(
+define void @skewed(float* noalias %A) {
+entry:
+  br label %i.loop
+
+i.loop:
+  %i = phi i64 [ 1, %entry ], [ %i.next, %j.exit ]
+  br label %j.loop
+
+j.loop:
+  %j = phi i64 [ 0, %i.loop ], [ %j.next, %j.loop ]
+  %i.prev = add nsw i64 %i, -1
+  %j.succ = add nsw i64 %j, 1
+  %row.prev = mul nsw i64 %i.prev, 128
+  %src.idx = add nsw i64 %row.prev, %j.succ
+  %src = getelementptr inbounds float, float* %A, i64 %src.idx
+  %v = load float, float* %src, align 4
+  %w = fadd float %v, 1.0
+  %row = mul nsw i64 %i, 128
+  %dst.idx = add nsw i64 %row, %j
+  %dst = getelementptr inbounds float, float* %A, i64 %dst.idx
+  store float %w, float* %dst, align 4
+  %j.next = add nsw i64 %j, 1
+  %j.cond = icmp slt i64 %j.next, 127
+  br i1 %j.cond, label %j.loop, label %j.exit
+
+j.exit:
+  %i.next = add nsw i64 %i, 1
+  %i.cond = icmp slt i64 %i.next, 128
+  br i1 %i.cond, label %i.loop, label %exit
+
+exit:
+  ret void
+}
+)IR";
+
+std::unique_ptr<llvm::Module> generateMatmul(llvm::LLVMContext &Context,
+                                             unsigned Size) {
+  mlcompileropt::KernelGeneratorOptions Opts;
+  Opts.M = Opts.N = Opts.K = Size;
+  auto ModuleOrErr = mlcompileropt::generateKernelModule(Context, Opts);
+  if (!ModuleOrErr) {
+    llvm::errs() << llvm::toString(ModuleOrErr.takeError()) << "\n";
+    return nullptr;
+  }
+  return std::move(*ModuleOrErr);
+}
+
+// Runs the tiling pass on F with the given tuning configuration; with
+// TileAll false, as in the default pipelines
+void runLoopTiling(llvm::Function &F, llvm::StringRef Config,
+                   bool TileAll = true) {
+  auto ConfigOrErr = mlcompileropt::TuningConfig::parse(Config);
+  ASSERT_TRUE(!!ConfigOrErr) << llvm::toString(ConfigOrErr.takeError());
+  ConfigOrErr->attachTo(F);
+
+  kernel_test::runFunctionPass(F, mlcompileropt::LoopTilingPass(TileAll));
+}
+
+unsigned getMaxLoopDepth(llvm::Function &F) {
+  llvm::DominatorTree DT(F);
+  llvm::LoopInfo LI(DT);
+  unsigned Depth = 0;
+  for (llvm::BasicBlock &BB : F)
+    Depth = std::max(Depth, LI.getLoopDepth(&BB));
+  return Depth;
+}
+
+unsigned countSelects(llvm::Function &F) {
+  unsigned NumSelects = 0;
+  for (llvm::BasicBlock &BB : F)
+    for (llvm::Instruction &I : BB)
+      NumSelects += llvm::isa<llvm::SelectInst>(I);
+  return NumSelects;
+}
+
+} // end anonymous namespace
+
+// The footprint counts every distinct array tile once
+TEST(LoopTilingTest, Footprint) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = generateMatmul(Context, 64);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("matmul_0");
+
+  kernel_test::TestAnalysisManagers AM;
+  auto &LI = AM.FAM.getResult<llvm::LoopAnalysis>(F);
+  auto &MAP = AM.FAM.getResult<mlcompileropt::MemoryAccessPatternAnalysis>(F);
+
+  llvm::SmallVector<mlcompileropt::LoopControl, 4> Band;
+  mlcompileropt::getPerfectLoopBand(*LI.getLoopsInPreorder().rbegin(), Band);
+  ASSERT_EQ(Band.size(), 3u);
+
+  // A is 8x4, B is 4x2 and C is 8x2 floats
+  unsigned Extents[] = {8, 2, 4};
+  EXPECT_EQ(mlcompileropt::estimateTileFootprint(Band, Extents, MAP),
+            4u * (8 * 4 + 4 * 2 + 8 * 2));
+}
+
+// Single-level tiling adds a tile loop per band loop and checks for
+// partial tiles only where the tile size does not divide the trip count
+TEST(LoopTilingTest, TileMatmul) {
+  for (unsigned Size : {64u, 70u}) {
+    llvm::LLVMContext Context;
+    std::unique_ptr<llvm::Module> M = generateMatmul(Context, Size);
+    ASSERT_TRUE(M != nullptr);
+    llvm::Function &F = *M->getFunction("matmul_0");
+
+    runLoopTiling(F, "tile=16");
+    ASSERT_FALSE(llvm::verifyFunction(F, &llvm::errs()));
+    EXPECT_EQ(getMaxLoopDepth(F), 6u) << Size;
+    EXPECT_EQ(countSelects(F), Size % 16 ? 3u : 0u) << Size;
+  }
+}
+
+// Two-level tiling nests the L1 tiles in the L2 tiles, and a tile size of
+// 1 disables tiling
+TEST(LoopTilingTest, TwoLevels) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = generateMatmul(Context, 100);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("matmul_0");
+  runLoopTiling(F, "tile=8,tile-l2=32");
+  ASSERT_FALSE(llvm::verifyFunction(F, &llvm::errs()));
+  EXPECT_EQ(getMaxLoopDepth(F), 9u);
+
+  std::unique_ptr<llvm::Module> Untiled = generateMatmul(Context, 100);
+  ASSERT_TRUE(Untiled != nullptr);
+  llvm::Function &G = *Untiled->getFunction("matmul_0");
+  runLoopTiling(G, "tile=1");
+  EXPECT_EQ(getMaxLoopDepth(G), 3u);
+}
+
+// Without a tile size the sizes follow from the cache: a small matmul fits
+// and stays as it is, a large one is tiled
+TEST(LoopTilingTest, AutomaticSizes) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> Small = generateMatmul(Context, 16);
+  ASSERT_TRUE(Small != nullptr);
+  runLoopTiling(*Small->getFunction("matmul_0"), "default");
+  EXPECT_EQ(getMaxLoopDepth(*Small->getFunction("matmul_0")), 3u);
+
+  std::unique_ptr<llvm::Module> Large = generateMatmul(Context, 512);
+  ASSERT_TRUE(Large != nullptr);
+  llvm::Function &F = *Large->getFunction("matmul_0");
+  runLoopTiling(F, "default");
+  ASSERT_FALSE(llvm::verifyFunction(F, &llvm::errs()));
+  EXPECT_GE(getMaxLoopDepth(F), 6u);
+}
+
+// In the default pipelines, only functions with a tile size are tiled
+TEST(LoopTilingTest, TuningSelectsFunctions) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = generateMatmul(Context, 512);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("matmul_0");
+  runLoopTiling(F, "default", /*TileAll=*/false);
+  EXPECT_EQ(getMaxLoopDepth(F), 3u);
+
+  runLoopTiling(F, "tile=16", /*TileAll=*/false);
+  ASSERT_FALSE(llvm::verifyFunction(F, &llvm::errs()));
+  EXPECT_GE(getMaxLoopDepth(F), 6u);
+}
+
+TEST(LoopTilingTest, KeepsBackwardDependence) {
+  llvm::LLVMContext Context;
+  llvm::SMDiagnostic Err;
+  std::unique_ptr<llvm::Module> M = llvm::parseAssemblyString(SkewedIR, Err, Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("skewed");
+  runLoopTiling(F, "tile=16");
+  EXPECT_EQ(getMaxLoopDepth(F), 2u);
+}
+
+// The tiled kernel computes exactly what the original does; tiling keeps
+// the order of the additions into each element of C
+TEST(LoopTilingTest, SameResults) {
+  const unsigned Size = 37;
+  std::string Elements = std::to_string(Size * Size);
+  kernel_test::expectSameResults(
+      [&](llvm::LLVMContext &Context) { return generateMatmul(Context, Size); },
+      [](llvm::Module &M) {
+        llvm::Function &F = *M.getFunction("matmul_0");
+        runLoopTiling(F, "tile=4,tile-l2=16");
+        EXPECT_EQ(getMaxLoopDepth(F), 9u);
+      },
+      "matmul_0:A=" + Elements + ",B=" + Elements + ",C=" + Elements);
+}
+
+// Main function for the test
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,324 @@
+#include <gtest/gtest.h>
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+
+#include "passes/MemoryAccessPattern.h"
+#include "passes/MemoryCoalescing.h"
+
+// Test fixture for the access pattern analysis
+class MemoryAccessPatternTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    Context = std::make_unique<llvm::LLVMContext>();
+
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    mlcompileropt::registerMemoryCoalescingAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+  }
+
+  void TearDown() override {
+    // Cached results refer to the module, so drop them first
+    FAM.clear();
+  }
+
+  // Helper to parse IR string into a module
+  bool parseIR(const std::string &IR) {
+    llvm::SMDiagnostic Err;
+    M = llvm::parseIR(llvm::MemoryBufferRef(IR, "testIR"), Err, *Context);
+    if (!M) {
+      Err.print("test", llvm::errs());
+      return false;
+    }
+    return true;
+  }
+
+  const mlcompileropt::MemoryAccessPatternInfo &analyze(llvm::Function &F) {
+    return FAM.getResult<mlcompileropt::MemoryAccessPatternAnalysis>(F);
+  }
+
+  // Returns the first load (or store) in F that reads from (writes to) the
+  // pointer named PtrName
+  llvm::Instruction *findAccess(llvm::Function &F, llvm::StringRef PtrName) {
+    for (auto &BB : F)
+      for (auto &I : BB)
+        if (auto *Ptr = llvm::getLoadStorePointerOperand(&I))
+          if (Ptr->getName() == PtrName)
+            return &I;
+    return nullptr;
+  }
+
+  std::unique_ptr<llvm::LLVMContext> Context;
+  std::unique_ptr<llvm::Module> M;
+
+  llvm::PassBuilder PB;
+  llvm::LoopAnalysisManager LAM;
+  llvm::FunctionAnalysisManager FAM;
+  llvm::CGSCCAnalysisManager CGAM;
+  llvm::ModuleAnalysisManager MAM;
+};
+
+// The original mul-by-constant pattern
+TEST_F(MemoryAccessPatternTest, MulIndex) {
+  const char *IR = R"(
+    define void @f(float* %input, float* %output, i32 %n) {
+    entry:
+      br label %loop
+
+    loop:
+      %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+      %idx = mul i32 %i, 4
+      %gep.in = getelementptr float, float* %input, i32 %idx
+      %val = load float, float* %gep.in, align 4
+      %gep.out = getelementptr float, float* %output, i32 %i
+      store float %val, float* %gep.out, align 4
+      %i.next = add i32 %i, 1
+      %cond = icmp slt i32 %i.next, %n
+      br i1 %cond, label %loop, label %exit
+
+    exit:
+      ret void
+    }
+  )";
+  ASSERT_TRUE(parseIR(IR));
+  llvm::Function *F = M->getFunction("f");
+  const auto &MAP = analyze(*F);
+
+  const auto *Load = MAP.getPattern(findAccess(*F, "gep.in"));
+  ASSERT_NE(Load, nullptr);
+  ASSERT_TRUE(Load->IsAffine);
+  EXPECT_TRUE(Load->isLoad());
+  EXPECT_EQ(Load->AccessSize, 4u);
+  EXPECT_EQ(Load->getInnermostStride().getValueOr(0), 16);
+  EXPECT_TRUE(Load->isStrided());
+
+  const auto *Store = MAP.getPattern(findAccess(*F, "gep.out"));
+  ASSERT_NE(Store, nullptr);
+  EXPECT_TRUE(Store->isUnitStride());
+  EXPECT_FALSE(Store->isStrided());
+}
+
+// Shifted, sign-extended and zero-extended indices
+TEST_F(MemoryAccessPatternTest, ShlAndExtendedIndices) {
+  const char *IR = R"(
+    define void @f(float* %a, float* %b, float* %c, i64 %n) {
+    entry:
+      br label %loop
+
+    loop:
+      %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+      %shl = shl i32 %i, 3
+      %shl.ext = sext i32 %shl to i64
+      %gep.a = getelementptr float, float* %a, i64 %shl.ext
+      %va = load float, float* %gep.a, align 4
+      %mul = mul nuw i32 %i, 2
+      %mul.ext = zext i32 %mul to i64
+      %gep.b = getelementptr float, float* %b, i64 %mul.ext
+      %vb = load float, float* %gep.b, align 4
+      %i.ext = sext i32 %i to i64
+      %gep.c = getelementptr float, float* %c, i64 %i.ext
+      %sum = fadd float %va, %vb
+      store float %sum, float* %gep.c, align 4
+      %i.next = add i32 %i, 1
+      %i.next.ext = sext i32 %i.next to i64
+      %cond = icmp slt i64 %i.next.ext, %n
+      br i1 %cond, label %loop, label %exit
+
+    exit:
+      ret void
+    }
+  )";
+  ASSERT_TRUE(parseIR(IR));
+  llvm::Function *F = M->getFunction("f");
+  const auto &MAP = analyze(*F);
+
+  const auto *A = MAP.getPattern(findAccess(*F, "gep.a"));
+  ASSERT_NE(A, nullptr);
+  EXPECT_EQ(A->getInnermostStride().getValueOr(0), 32);
+
+  const auto *B = MAP.getPattern(findAccess(*F, "gep.b"));
+  ASSERT_NE(B, nullptr);
+  EXPECT_EQ(B->getInnermostStride().getValueOr(0), 8);
+
+  const auto *C = MAP.getPattern(findAccess(*F, "gep.c"));
+  ASSERT_NE(C, nullptr);
+  EXPECT_TRUE(C->isUnitStride());
+}
+
+// Multi-index GEP into rows of a [16 x float] array: walking a column
+TEST_F(MemoryAccessPatternTest, MultiIndexColumnWalk) {
+  const char *IR = R"(
+    define void @f([16 x float]* %m, float* %out) {
+    entry:
+      br label %outer
+
+    outer:
+      %j = phi i64 [ 0, %entry ], [ %j.next, %outer.latch ]
+      br label %inner
+
+    inner:
+      %i = phi i64 [ 0, %outer ], [ %i.next, %inner ]
+      %gep.m = getelementptr [16 x float], [16 x float]* %m, i64 %i, i64 %j
+      %v = load float, float* %gep.m, align 4
+      %gep.out = getelementptr float, float* %out, i64 %j
+      store float %v, float* %gep.out, align 4
+      %i.next = add nuw nsw i64 %i, 1
+      %i.cond = icmp ult i64 %i.next, 8
+      br i1 %i.cond, label %inner, label %outer.latch
+
+    outer.latch:
+      %j.next = add nuw nsw i64 %j, 1
+      %j.cond = icmp ult i64 %j.next, 16
+      br i1 %j.cond, label %outer, label %exit
+
+    exit:
+      ret void
+    }
+  )";
+  ASSERT_TRUE(parseIR(IR));
+  llvm::Function *F = M->getFunction("f");
+  const auto &MAP = analyze(*F);
+
+  const auto *P = MAP.getPattern(findAccess(*F, "gep.m"));
+  ASSERT_NE(P, nullptr);
+  ASSERT_TRUE(P->IsAffine);
+  ASSERT_EQ(P->Strides.size(), 2u);
+
+  // Innermost loop walks rows, the outer loop walks columns
+  EXPECT_EQ(P->Strides[0].ConstantBytes.getValueOr(0), 64);
+  EXPECT_EQ(P->Strides[0].TripCount, 8u);
+  EXPECT_EQ(P->Strides[1].ConstantBytes.getValueOr(0), 4);
+  EXPECT_EQ(P->Strides[1].TripCount, 16u);
+  EXPECT_TRUE(P->isStrided());
+
+  // The store is invariant in the inner loop
+  const auto *Out = MAP.getPattern(findAccess(*F, "gep.out"));
+  ASSERT_NE(Out, nullptr);
+  EXPECT_EQ(Out->getInnermostStride().getValueOr(-1), 0);
+  EXPECT_FALSE(Out->isStrided());
+}
+
+// Symbolic outer stride, as in a row-major walk with a runtime width
+TEST_F(MemoryAccessPatternTest, SymbolicOuterStride) {
+  const char *IR = R"(
+    define void @f(float* %input, i32 %width, i32 %height) {
+    entry:
+      br label %outer.loop
+
+    outer.loop:
+      %i = phi i32 [ 0, %entry ], [ %i.next, %outer.end ]
+      br label %inner.loop
+
+    inner.loop:
+      %j = phi i32 [ 0, %outer.loop ], [ %j.next, %inner.loop ]
+      %row_offset = mul i32 %i, %width
+      %col_offset = mul i32 %j, 2
+      %idx = add i32 %row_offset, %col_offset
+      %gep.in = getelementptr float, float* %input, i32 %idx
+      %val = load float, float* %gep.in, align 4
+      %j.next = add i32 %j, 1
+      %j.cond = icmp slt i32 %j.next, %width
+      br i1 %j.cond, label %inner.loop, label %outer.end
+
+    outer.end:
+      %i.next = add i32 %i, 1
+      %i.cond = icmp slt i32 %i.next, %height
+      br i1 %i.cond, label %outer.loop, label %exit
+
+    exit:
+      ret void
+    }
+  )";
+  ASSERT_TRUE(parseIR(IR));
+  llvm::Function *F = M->getFunction("f");
+  const auto &MAP = analyze(*F);
+
+  const auto *P = MAP.getPattern(findAccess(*F, "gep.in"));
+  ASSERT_NE(P, nullptr);
+  ASSERT_TRUE(P->IsAffine);
+  ASSERT_EQ(P->Strides.size(), 2u);
+  EXPECT_EQ(P->Strides[0].ConstantBytes.getValueOr(0), 8);
+  EXPECT_FALSE(P->Strides[1].ConstantBytes.hasValue());
+  EXPECT_EQ(P->Strides[0].TripCount, 0u);
+}
+
+// Indirect addresses are not affine
+TEST_F(MemoryAccessPatternTest, IndirectAccessIsNotAffine) {
+  const char *IR = R"(
+    define void @f(float* %a, i32* %idx, i64 %n) {
+    entry:
+      br label %loop
+
+    loop:
+      %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+      %gep.idx = getelementptr i32, i32* %idx, i64 %i
+      %k = load i32, i32* %gep.idx, align 4
+      %gep.a = getelementptr float, float* %a, i32 %k
+      %v = load float, float* %gep.a, align 4
+      %i.next = add nuw nsw i64 %i, 1
+      %cond = icmp ult i64 %i.next, %n
+      br i1 %cond, label %loop, label %exit
+
+    exit:
+      ret void
+    }
+  )";
+  ASSERT_TRUE(parseIR(IR));
+  llvm::Function *F = M->getFunction("f");
+  const auto &MAP = analyze(*F);
+
+  const auto *P = MAP.getPattern(findAccess(*F, "gep.a"));
+  ASSERT_NE(P, nullptr);
+  EXPECT_FALSE(P->IsAffine);
+  EXPECT_FALSE(P->isStrided());
+  EXPECT_TRUE(MAP.getPattern(findAccess(*F, "gep.idx"))->isUnitStride());
+}
+
+// The result is cached by the analysis manager and reused by the pass
+TEST_F(MemoryAccessPatternTest, ResultIsCached) {
+  const char *IR = R"(
+    define void @f(float* %a, i64 %n) {
+    entry:
+      br label %loop
+
+    loop:
+      %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+      %idx = shl i64 %i, 1
+      %gep.a = getelementptr float, float* %a, i64 %idx
+      %v = load float, float* %gep.a, align 4
+      %i.next = add nuw nsw i64 %i, 1
+      %cond = icmp ult i64 %i.next, %n
+      br i1 %cond, label %loop, label %exit
+
+    exit:
+      ret void
+    }
+  )";
+  ASSERT_TRUE(parseIR(IR));
+  llvm::Function *F = M->getFunction("f");
+
+  const auto *First = &analyze(*F);
+  EXPECT_EQ(First, &analyze(*F));
+
+  mlcompileropt::MemoryCoalescingPass MemCoalesce;
+  MemCoalesce.run(*F, FAM);
+  EXPECT_EQ(First,
+            FAM.getCachedResult<mlcompileropt::MemoryAccessPatternAnalysis>(*F));
+}
+
+// Main function for the test
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -8,10 +8,13 @@
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Verifier.h"
 #include "llvm/Analysis/LoopAnalysisManager.h"
 #include "llvm/Analysis/CGSCCPassManager.h"
 #include "llvm/Passes/PassBuilder.h"
 
+#include "driver/TargetMachineCache.h"
 #include "passes/MemoryCoalescing.h"
 
 // Test fixture for memory coalescing tests
@@ -34,7 +37,10 @@ protected:
       return false;
     }
     
+    // Costs are those of x86-64, the target of the kernels in data/
     M = std::move(ParsedModule);
+    if (M->getTargetTriple().empty())
+      M->setTargetTriple("x86_64-unknown-linux-gnu");
     return true;
   }
 
@@ -46,11 +52,12 @@ protected:
     llvm::CGSCCAnalysisManager CGAM;
     llvm::ModuleAnalysisManager MAM;
     
-    // Register analyses
-    llvm::PassBuilder PB;
+    // Register analyses; cost queries are answered for the module's target
+    llvm::PassBuilder PB(Targets.getTargetMachine(F.getParent()->getTargetTriple()));
     PB.registerModuleAnalyses(MAM);
     PB.registerCGSCCAnalyses(CGAM);
     PB.registerFunctionAnalyses(FAM);
+    mlcompileropt::registerMemoryCoalescingAnalyses(FAM);
     PB.registerLoopAnalyses(LAM);
     PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
     
@@ -59,8 +66,19 @@ protected:
     MemCoalesce.run(F, FAM);
   }
 
+  // Helper to collect the loads of a function in program order
+  std::vector<llvm::LoadInst *> collectLoads(llvm::Function &F) {
+    std::vector<llvm::LoadInst *> Loads;
+    for (auto &BB : F)
+      for (auto &I : BB)
+        if (auto *LI = llvm::dyn_cast<llvm::LoadInst>(&I))
+          Loads.push_back(LI);
+    return Loads;
+  }
+
   std::unique_ptr<llvm::LLVMContext> Context;
   std::unique_ptr<llvm::Module> M;
+  mlcompileropt::TargetMachineCache Targets;
 };
 
 // Test basic functionality of the memory coalescing pass
@@ -102,7 +120,7 @@ TEST_F(MemoryCoalescingTest, BasicCoalescing) {
   SUCCEED();
 }
 
-// Test that the pass correctly identifies adjacent memory accesses
+// Test that the pass merges adjacent loads into a vector load
 TEST_F(MemoryCoalescingTest, AdjacentMemoryAccesses) {
   // Simple IR with adjacent memory accesses
   const char *IR = R"(
@@ -127,9 +145,122 @@ TEST_F(MemoryCoalescingTest, AdjacentMemoryAccesses) {
   
   // Run the memory coalescing pass
   runMemoryCoalescingPass(*F);
+  EXPECT_FALSE(llvm::verifyFunction(*F, &llvm::errs()));
   
-  // Again, for the simplified implementation, we just ensure the test runs
-  SUCCEED();
+  // The two scalar loads become one <2 x float> load
+  auto Loads = collectLoads(*F);
+  ASSERT_EQ(Loads.size(), 1u);
+  auto *VecTy = llvm::dyn_cast<llvm::FixedVectorType>(Loads[0]->getType());
+  ASSERT_NE(VecTy, nullptr);
+  EXPECT_EQ(VecTy->getNumElements(), 2u);
+}
+
+// Accesses need not be next to each other in instruction order
+TEST_F(MemoryCoalescingTest, InterleavedAccessesAreMerged) {
+  const char *IR = R"(
+    define float @interleaved(float* %a, float* %b) {
+    entry:
+      %a2.ptr = getelementptr float, float* %a, i64 2
+      %a2 = load float, float* %a2.ptr, align 4
+      %b0 = load float, float* %b, align 4
+      %a0 = load float, float* %a, align 16
+      %m0 = fmul float %a0, %b0
+      %a3.ptr = getelementptr float, float* %a, i64 3
+      %a3 = load float, float* %a3.ptr, align 4
+      %a1.ptr = getelementptr float, float* %a, i64 1
+      %a1 = load float, float* %a1.ptr, align 4
+      %s0 = fadd float %m0, %a1
+      %s1 = fadd float %a2, %a3
+      %r = fadd float %s0, %s1
+      ret float %r
+    }
+  )";
+  ASSERT_TRUE(parseIR(IR));
+  llvm::Function *F = M->getFunction("interleaved");
+  runMemoryCoalescingPass(*F);
+  EXPECT_FALSE(llvm::verifyFunction(*F, &llvm::errs()));
+  
+  // a[0..3] become one <4 x float> load placed before its first use, b[0]
+  // stays scalar
+  auto Loads = collectLoads(*F);
+  ASSERT_EQ(Loads.size(), 2u);
+  auto *VecTy = llvm::dyn_cast<llvm::FixedVectorType>(Loads[0]->getType());
+  ASSERT_NE(VecTy, nullptr);
+  EXPECT_EQ(VecTy->getNumElements(), 4u);
+  EXPECT_EQ(Loads[0]->getAlign().value(), 16u);
+  EXPECT_TRUE(Loads[1]->getType()->isFloatTy());
+}
+
+// A store that may alias one of the loads keeps them apart
+TEST_F(MemoryCoalescingTest, AliasingStoreBlocksMerge) {
+  const char *IR = R"(
+    define float @blocked(float* %a, float* %c) {
+    entry:
+      %a0 = load float, float* %a, align 4
+      store float 0.0, float* %c, align 4
+      %a1.ptr = getelementptr float, float* %a, i64 1
+      %a1 = load float, float* %a1.ptr, align 4
+      %r = fadd float %a0, %a1
+      ret float %r
+    }
+
+    define float @not_blocked(float* noalias %a, float* noalias %c) {
+    entry:
+      %a0 = load float, float* %a, align 4
+      store float 0.0, float* %c, align 4
+      %a1.ptr = getelementptr float, float* %a, i64 1
+      %a1 = load float, float* %a1.ptr, align 4
+      %r = fadd float %a0, %a1
+      ret float %r
+    }
+  )";
+  ASSERT_TRUE(parseIR(IR));
+  
+  llvm::Function *Blocked = M->getFunction("blocked");
+  runMemoryCoalescingPass(*Blocked);
+  EXPECT_EQ(collectLoads(*Blocked).size(), 2u);
+  
+  llvm::Function *NotBlocked = M->getFunction("not_blocked");
+  runMemoryCoalescingPass(*NotBlocked);
+  EXPECT_FALSE(llvm::verifyFunction(*NotBlocked, &llvm::errs()));
+  EXPECT_EQ(collectLoads(*NotBlocked).size(), 1u);
+}
+
+// Contiguous stores become one vector store, long runs are split into
+// chunks of the maximum vector width
+TEST_F(MemoryCoalescingTest, StoreRunsAreMerged) {
+  const char *IR = R"(
+    define void @stores(float* %out, float %x) {
+    entry:
+      %p0 = getelementptr inbounds float, float* %out, i64 0
+      store float %x, float* %p0, align 4
+      %p1 = getelementptr inbounds float, float* %out, i64 1
+      store float %x, float* %p1, align 4
+      %p2 = getelementptr inbounds float, float* %out, i64 2
+      store float %x, float* %p2, align 4
+      %p3 = getelementptr inbounds float, float* %out, i64 3
+      store float %x, float* %p3, align 4
+      %p4 = getelementptr inbounds float, float* %out, i64 4
+      store float %x, float* %p4, align 4
+      %p5 = getelementptr inbounds float, float* %out, i64 5
+      store float %x, float* %p5, align 4
+      ret void
+    }
+  )";
+  ASSERT_TRUE(parseIR(IR));
+  llvm::Function *F = M->getFunction("stores");
+  runMemoryCoalescingPass(*F);
+  EXPECT_FALSE(llvm::verifyFunction(*F, &llvm::errs()));
+  
+  std::vector<unsigned> Widths;
+  for (auto &BB : *F)
+    for (auto &I : BB)
+      if (auto *SI = llvm::dyn_cast<llvm::StoreInst>(&I)) {
+        auto *VecTy = llvm::dyn_cast<llvm::FixedVectorType>(
+            SI->getValueOperand()->getType());
+        Widths.push_back(VecTy ? VecTy->getNumElements() : 1);
+      }
+  EXPECT_EQ(Widths, (std::vector<unsigned>{4, 2}));
 }
 
 // Main function for the test
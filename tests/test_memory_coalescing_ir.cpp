@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/IRBuilder.h"
@@ -9,14 +11,26 @@
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/Verifier.h"
 #include "llvm/Analysis/LoopAnalysisManager.h"
 #include "llvm/Analysis/CGSCCPassManager.h"
 #include "llvm/Passes/PassBuilder.h"
 
+#include "driver/TargetMachineCache.h"
+#include "passes/CoalescingCostModel.h"
+#include "passes/InterchangeAdvisor.h"
+#include "passes/InterchangeModel.h"
+#include "passes/MemoryAccessPattern.h"
 #include "passes/MemoryCoalescing.h"
+#include "passes/TuningConfig.h"
 
-// Path to test files
-const std::string TEST_FILES_DIR = "/Users/adityaswaroop/Desktop/ml-compiler-opt-framework/tests/test_files/";
+// Path to test files, provided by the build system
+#ifndef ML_TEST_FILES_DIR
+#define ML_TEST_FILES_DIR "test_files/"
+#endif
+const std::string TEST_FILES_DIR = ML_TEST_FILES_DIR;
 
 // Test fixture for memory coalescing tests
 class MemoryCoalescingIRTest : public ::testing::Test {
@@ -40,28 +54,43 @@ protected:
   }
 
   // Helper to run the memory coalescing pass on a function
-  void runMemoryCoalescingPass(llvm::Function &F) {
+  llvm::PreservedAnalyses runMemoryCoalescingPass(llvm::Function &F) {
     // Create analysis managers
     llvm::LoopAnalysisManager LAM;
     llvm::FunctionAnalysisManager FAM;
     llvm::CGSCCAnalysisManager CGAM;
     llvm::ModuleAnalysisManager MAM;
     
-    // Register analyses
-    llvm::PassBuilder PB;
+    // Register analyses; cost queries are answered for the module's target
+    llvm::PassBuilder PB(Targets.getTargetMachine(F.getParent()->getTargetTriple()));
     PB.registerModuleAnalyses(MAM);
     PB.registerCGSCCAnalyses(CGAM);
     PB.registerFunctionAnalyses(FAM);
+    mlcompileropt::registerMemoryCoalescingAnalyses(FAM);
     PB.registerLoopAnalyses(LAM);
     PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
     
     // Run our pass
     mlcompileropt::MemoryCoalescingPass MemCoalesce;
-    MemCoalesce.run(F, FAM);
+    return MemCoalesce.run(F, FAM);
+  }
+
+  // Helpers to look up values by name
+  llvm::Instruction *findInstruction(llvm::Function &F, llvm::StringRef Name) {
+    for (auto &BB : F)
+      for (auto &I : BB)
+        if (I.getName() == Name)
+          return &I;
+    return nullptr;
+  }
+  
+  llvm::PHINode *findPhi(llvm::Function &F, llvm::StringRef Name) {
+    return llvm::dyn_cast_or_null<llvm::PHINode>(findInstruction(F, Name));
   }
 
   std::unique_ptr<llvm::LLVMContext> Context;
   std::unique_ptr<llvm::Module> M;
+  mlcompileropt::TargetMachineCache Targets;
 };
 
 // Test the Memory Coalescing pass on strided access pattern
@@ -104,11 +133,20 @@ TEST_F(MemoryCoalescingIRTest, AdjacentMemoryAccesses) {
   // Run the memory coalescing pass
   runMemoryCoalescingPass(*F);
   
-  // Similar to above, we just verify basic function integrity
+  // Verify basic function integrity
   ASSERT_FALSE(F->empty());
+  ASSERT_FALSE(llvm::verifyFunction(*F, &llvm::errs()));
   
-  // In a full implementation, we would check if adjacent loads were merged
-  // For example, we might count load instructions and check if there are fewer loads
+  // The four adjacent float loads are merged into a single <4 x float> load
+  std::vector<llvm::LoadInst *> Loads;
+  for (auto &BB : *F)
+    for (auto &I : BB)
+      if (auto *LI = llvm::dyn_cast<llvm::LoadInst>(&I))
+        Loads.push_back(LI);
+  ASSERT_EQ(Loads.size(), 1u);
+  auto *VecTy = llvm::dyn_cast<llvm::FixedVectorType>(Loads[0]->getType());
+  ASSERT_NE(VecTy, nullptr);
+  EXPECT_EQ(VecTy->getNumElements(), 4u);
 }
 
 // Test the Memory Coalescing pass on nested loops with strided access
@@ -132,6 +170,349 @@ TEST_F(MemoryCoalescingIRTest, NestedLoopStridedAccess) {
   // - Memory access patterns in the transformed code
 }
 
+// Test that a column walk is interchanged into a row walk
+TEST_F(MemoryCoalescingIRTest, ColumnWalkIsInterchanged) {
+  std::string FilePath = TEST_FILES_DIR + "strided_access.ll";
+  ASSERT_TRUE(loadIRFile(FilePath));
+  
+  llvm::Function *F = M->getFunction("column_walk");
+  ASSERT_NE(F, nullptr);
+  
+  runMemoryCoalescingPass(*F);
+  ASSERT_FALSE(llvm::verifyFunction(*F, &llvm::errs()));
+  
+  // The column index is now driven by the inner loop's induction variable
+  // and the row index by the outer one
+  auto *Inner = findPhi(*F, "k");
+  auto *Outer = findPhi(*F, "j");
+  ASSERT_NE(Inner, nullptr);
+  ASSERT_NE(Outer, nullptr);
+  auto *Idx = findInstruction(*F, "idx");
+  auto *Row = findInstruction(*F, "row");
+  ASSERT_NE(Idx, nullptr);
+  ASSERT_NE(Row, nullptr);
+  EXPECT_EQ(Idx->getOperand(1), Inner);
+  EXPECT_EQ(Row->getOperand(0), Outer);
+}
+
+// Test that the innermost loop of a deeper nest is interchanged with the
+// enclosing loop that walks its accesses with unit stride
+TEST_F(MemoryCoalescingIRTest, DeepColumnWalkIsInterchanged) {
+  std::string FilePath = TEST_FILES_DIR + "strided_access.ll";
+  ASSERT_TRUE(loadIRFile(FilePath));
+  
+  llvm::Function *F = M->getFunction("column_walk_batched");
+  ASSERT_NE(F, nullptr);
+  
+  runMemoryCoalescingPass(*F);
+  ASSERT_FALSE(llvm::verifyFunction(*F, &llvm::errs()));
+  
+  // j and k trade places; the batch and matrix loops stay outermost
+  auto *Col = findInstruction(*F, "col");
+  auto *Row = findInstruction(*F, "row");
+  ASSERT_NE(Col, nullptr);
+  ASSERT_NE(Row, nullptr);
+  EXPECT_EQ(Col->getOperand(1), findPhi(*F, "k"));
+  EXPECT_EQ(Row->getOperand(0), findPhi(*F, "j"));
+  EXPECT_EQ(findInstruction(*F, "batch")->getOperand(0), findPhi(*F, "b"));
+  EXPECT_EQ(findInstruction(*F, "mat")->getOperand(0), findPhi(*F, "m"));
+}
+
+// Test that the pass reports a change only when it rewrites the IR, and
+// keeps the analyses its rewrites leave valid
+TEST_F(MemoryCoalescingIRTest, PreservedAnalyses) {
+  using mlcompileropt::MemoryAccessPatternAnalysis;
+  std::string FilePath = TEST_FILES_DIR + "strided_access.ll";
+  ASSERT_TRUE(loadIRFile(FilePath));
+  
+  // Nothing to interchange or merge
+  llvm::PreservedAnalyses PA = runMemoryCoalescingPass(*M->getFunction("strided_access"));
+  EXPECT_TRUE(PA.areAllPreserved());
+  
+  // An interchange rewrites loop controls only
+  llvm::Function *Walk = M->getFunction("column_walk");
+  PA = runMemoryCoalescingPass(*Walk);
+  EXPECT_TRUE(PA.allAnalysesInSetPreserved<llvm::CFGAnalyses>());
+  EXPECT_TRUE(PA.getChecker<llvm::ScalarEvolutionAnalysis>().preserved());
+  EXPECT_FALSE(PA.getChecker<MemoryAccessPatternAnalysis>().preserved());
+  
+  // The interchanged nest is left as it is
+  EXPECT_TRUE(runMemoryCoalescingPass(*Walk).areAllPreserved());
+  
+  // Merging replaces the loaded values
+  PA = runMemoryCoalescingPass(*M->getFunction("adjacent_access"));
+  EXPECT_TRUE(PA.allAnalysesInSetPreserved<llvm::CFGAnalyses>());
+  EXPECT_FALSE(PA.getChecker<llvm::ScalarEvolutionAnalysis>().preserved());
+  EXPECT_FALSE(PA.getChecker<MemoryAccessPatternAnalysis>().preserved());
+  
+  // Tuning hints change loop metadata once
+  llvm::Function *Hinted = M->getFunction("nested_loop_strided");
+  auto Config = mlcompileropt::TuningConfig::parse("unroll=4");
+  ASSERT_TRUE(!!Config) << llvm::toString(Config.takeError());
+  Config->attachTo(*Hinted);
+  PA = runMemoryCoalescingPass(*Hinted);
+  EXPECT_FALSE(PA.areAllPreserved());
+  EXPECT_TRUE(PA.getChecker<MemoryAccessPatternAnalysis>().preserved());
+  EXPECT_TRUE(runMemoryCoalescingPass(*Hinted).areAllPreserved());
+}
+
+// Test that the loop info the pass preserves across an interchange still
+// matches the function
+TEST_F(MemoryCoalescingIRTest, InterchangeKeepsLoopInfoValid) {
+  std::string FilePath = TEST_FILES_DIR + "strided_access.ll";
+  ASSERT_TRUE(loadIRFile(FilePath));
+  
+  llvm::LoopAnalysisManager LAM;
+  llvm::FunctionAnalysisManager FAM;
+  llvm::CGSCCAnalysisManager CGAM;
+  llvm::ModuleAnalysisManager MAM;
+  llvm::PassBuilder PB(Targets.getTargetMachine(M->getTargetTriple()));
+  mlcompileropt::registerMemoryCoalescingPass(
+      PB, mlcompileropt::CoalescingExtensionPoint::None);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+  
+  llvm::ModulePassManager MPM;
+  ASSERT_FALSE(llvm::errorToBool(PB.parsePassPipeline(
+      MPM, "function(require<loops>,memory-coalescing,verify<loops>,verify)")));
+  MPM.run(*M, MAM);
+  
+  for (const char *Name : {"column_walk", "column_walk_batched"}) {
+    llvm::Function *F = M->getFunction(Name);
+    ASSERT_NE(F, nullptr);
+    EXPECT_EQ(findInstruction(*F, "row")->getOperand(0), findPhi(*F, "j"))
+        << Name;
+  
+    // The cached loop info survived the pass and describes the same nest
+    // as one computed from scratch
+    llvm::LoopInfo *Cached = FAM.getCachedResult<llvm::LoopAnalysis>(*F);
+    ASSERT_NE(Cached, nullptr) << Name;
+    llvm::DominatorTree DT(*F);
+    llvm::LoopInfo Fresh(DT);
+    std::string CachedLoops, FreshLoops;
+    llvm::raw_string_ostream CachedOS(CachedLoops), FreshOS(FreshLoops);
+    Cached->print(CachedOS);
+    Fresh.print(FreshOS);
+    EXPECT_EQ(CachedOS.str(), FreshOS.str()) << Name;
+  }
+}
+
+// Test that a nest whose dependences forbid interchange is left alone
+TEST_F(MemoryCoalescingIRTest, DependentColumnWalkIsNotInterchanged) {
+  std::string FilePath = TEST_FILES_DIR + "strided_access.ll";
+  ASSERT_TRUE(loadIRFile(FilePath));
+  
+  llvm::Function *F = M->getFunction("column_walk_dependent");
+  ASSERT_NE(F, nullptr);
+  
+  runMemoryCoalescingPass(*F);
+  ASSERT_FALSE(llvm::verifyFunction(*F, &llvm::errs()));
+  
+  auto *Idx = findInstruction(*F, "idx");
+  ASSERT_NE(Idx, nullptr);
+  EXPECT_EQ(Idx->getOperand(1), findPhi(*F, "j"));
+}
+
+// Test that the interchange advisor decides, and that the training log
+// records the features of every candidate
+TEST_F(MemoryCoalescingIRTest, InterchangeAdvisorAndTrainingLog) {
+  using mlcompileropt::InterchangeAdvisorKind;
+  using mlcompileropt::LoopFeature;
+  std::string FilePath = TEST_FILES_DIR + "strided_access.ll";
+  ASSERT_TRUE(loadIRFile(FilePath));
+  
+  llvm::Function *F = M->getFunction("column_walk");
+  ASSERT_NE(F, nullptr);
+  
+  // The never advisor keeps the column walk
+  mlcompileropt::InterchangeTrainingLog Log;
+  mlcompileropt::setInterchangeTrainingLog(&Log);
+  mlcompileropt::setSelectedInterchangeAdvisor(InterchangeAdvisorKind::Never);
+  runMemoryCoalescingPass(*F);
+  mlcompileropt::setSelectedInterchangeAdvisor(InterchangeAdvisorKind::Heuristic);
+  mlcompileropt::setInterchangeTrainingLog(nullptr);
+  EXPECT_EQ(findInstruction(*F, "idx")->getOperand(1), findPhi(*F, "j"));
+  
+  std::vector<mlcompileropt::InterchangeRecord> Records = Log.takeRecords();
+  ASSERT_EQ(Records.size(), 1u);
+  const mlcompileropt::InterchangeRecord &R = Records[0];
+  EXPECT_EQ(R.Function, "column_walk");
+  EXPECT_EQ(R.Loop, "row.loop");
+  EXPECT_EQ(R.OuterLoop, "col.loop");
+  EXPECT_FALSE(R.Decision);
+  EXPECT_FALSE(R.Applied);
+  EXPECT_TRUE(R.Profitable);
+  EXPECT_EQ(R.Features[LoopFeature::BandDepth], 2.0f);
+  EXPECT_EQ(R.Features[LoopFeature::InnerTripCount], 64.0f);
+  EXPECT_EQ(R.Features[LoopFeature::NumLoads], 1.0f);
+  EXPECT_EQ(R.Features[LoopFeature::NumStores], 1.0f);
+  EXPECT_EQ(R.Features[LoopFeature::UnitStrideBefore], 0.0f);
+  EXPECT_EQ(R.Features[LoopFeature::UnitStrideAfter], 2.0f);
+  EXPECT_LT(R.Features[LoopFeature::CacheLinesAfter],
+            R.Features[LoopFeature::CacheLinesBefore]);
+  
+  // The model advisor follows the embedded tree, whatever the cost model
+  // says
+  ASSERT_TRUE(mlcompileropt::hasInterchangeModel());
+  mlcompileropt::TransformCost Cost;
+  Cost.Before.CacheLines = 0.5;
+  Cost.After.CacheLines = 2.0;
+  EXPECT_EQ(mlcompileropt::adviseInterchange(InterchangeAdvisorKind::Model,
+                                             R.Features, Cost),
+            mlcompileropt::evaluateInterchangeModel(R.Features));
+  
+  // Training log lines hold the names, every feature, the heuristic
+  // decision and the speedup
+  std::string Line;
+  llvm::raw_string_ostream OS(Line);
+  mlcompileropt::InterchangeTrainingLog::writeRecord(OS, R, 1.5);
+  OS.flush();
+  EXPECT_EQ(Line.rfind("column_walk,row.loop,col.loop,", 0), 0u);
+  EXPECT_EQ(std::count(Line.begin(), Line.end(), ','),
+            4 + static_cast<long>(mlcompileropt::NumLoopFeatures));
+  EXPECT_NE(Line.find(",1,1.5000\n"), std::string::npos);
+}
+
+// Test that a tree is walked from the root to the leaf its thresholds
+// select
+TEST_F(MemoryCoalescingIRTest, InterchangeTreeEvaluation) {
+  using mlcompileropt::LoopFeature;
+  // num_strided <= 1.5 ? interchange
+  //                    : (unit_stride_after <= 0.5 ? keep : interchange)
+  const mlcompileropt::interchange_model::Node Nodes[] = {
+      {static_cast<int>(LoopFeature::NumStrided), 1.5f, 1, 2, true},
+      {-1, 0.0f, 0, 0, true},
+      {static_cast<int>(LoopFeature::UnitStrideAfter), 0.5f, 3, 4, false},
+      {-1, 0.0f, 0, 0, false},
+      {-1, 0.0f, 0, 0, true},
+  };
+  
+  mlcompileropt::InterchangeFeatures Features;
+  Features[LoopFeature::NumStrided] = 1.0f;
+  EXPECT_TRUE(mlcompileropt::evaluateInterchangeTree(Nodes, Features));
+  
+  Features[LoopFeature::NumStrided] = 3.0f;
+  Features[LoopFeature::UnitStrideAfter] = 0.0f;
+  EXPECT_FALSE(mlcompileropt::evaluateInterchangeTree(Nodes, Features));
+  
+  // Values equal to the threshold take the true branch
+  Features[LoopFeature::UnitStrideAfter] = 0.5f;
+  EXPECT_FALSE(mlcompileropt::evaluateInterchangeTree(Nodes, Features));
+  Features[LoopFeature::UnitStrideAfter] = 2.0f;
+  EXPECT_TRUE(mlcompileropt::evaluateInterchangeTree(Nodes, Features));
+}
+
+// Collects the names of the remarks emitted by the memory coalescing pass
+struct RemarkCollector : public llvm::DiagnosticHandler {
+  bool isAnalysisRemarkEnabled(llvm::StringRef Pass) const override {
+    return Pass == "memory-coalescing";
+  }
+  bool isMissedOptRemarkEnabled(llvm::StringRef Pass) const override {
+    return Pass == "memory-coalescing";
+  }
+  bool isPassedOptRemarkEnabled(llvm::StringRef Pass) const override {
+    return Pass == "memory-coalescing";
+  }
+  bool isAnyRemarkEnabled() const override { return true; }
+
+  bool handleDiagnostics(const llvm::DiagnosticInfo &DI) override {
+    if (auto *R = llvm::dyn_cast<llvm::DiagnosticInfoOptimizationBase>(&DI))
+      Names.push_back((R->getFunction().getName() + ":" + R->getRemarkName()).str());
+    return true;
+  }
+
+  std::vector<std::string> Names;
+};
+
+// Test that every finding and decision of the pass is reported once
+TEST_F(MemoryCoalescingIRTest, OptimizationRemarks) {
+  auto Handler = std::make_unique<RemarkCollector>();
+  RemarkCollector *Remarks = Handler.get();
+  Context->setDiagnosticHandler(std::move(Handler));
+  
+  std::string FilePath = TEST_FILES_DIR + "strided_access.ll";
+  ASSERT_TRUE(loadIRFile(FilePath));
+  for (llvm::Function &F : *M)
+    if (!F.isDeclaration())
+      runMemoryCoalescingPass(F);
+  
+  std::vector<std::string> Expected = {
+      "strided_access:StridedAccess",
+      "strided_access:NotPerfectNest",
+      "adjacent_access:MergedAccesses",
+      "nested_loop_strided:StridedAccess",
+      "nested_loop_strided:NoUnitStrideLoop",
+      "column_walk:StridedAccess",
+      "column_walk:Interchanged",
+      "column_walk_dependent:StridedAccess",
+      "column_walk_dependent:InterchangeIllegal",
+      "column_walk_batched:StridedAccess",
+      "column_walk_batched:Interchanged",
+  };
+  EXPECT_EQ(Remarks->Names, Expected);
+}
+
+// Test that the pass can be named in a textual pipeline and is added to
+// the default pipelines at the selected extension point
+TEST_F(MemoryCoalescingIRTest, PassBuilderRegistration) {
+  std::string FilePath = TEST_FILES_DIR + "strided_access.ll";
+  ASSERT_TRUE(loadIRFile(FilePath));
+  
+  llvm::LoopAnalysisManager LAM;
+  llvm::FunctionAnalysisManager FAM;
+  llvm::CGSCCAnalysisManager CGAM;
+  llvm::ModuleAnalysisManager MAM;
+  llvm::PassInstrumentationCallbacks PIC;
+  llvm::PassBuilder PB(Targets.getTargetMachine(M->getTargetTriple()),
+                       llvm::PipelineTuningOptions(), llvm::None, &PIC);
+  mlcompileropt::registerMemoryCoalescingPass(
+      PB, mlcompileropt::CoalescingExtensionPoint::VectorizerStart);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+  
+  llvm::ModulePassManager MPM;
+  ASSERT_FALSE(llvm::errorToBool(PB.parsePassPipeline(
+      MPM, "function(require<memory-access-pattern>,memory-coalescing)")));
+  MPM.run(*M, MAM);
+  llvm::Function *F = M->getFunction("adjacent_access");
+  ASSERT_NE(F, nullptr);
+  unsigned NumLoads = 0;
+  for (auto &BB : *F)
+    for (auto &I : BB)
+      NumLoads += llvm::isa<llvm::LoadInst>(I);
+  EXPECT_EQ(NumLoads, 1u);
+  
+  std::string Pipeline;
+  llvm::raw_string_ostream OS(Pipeline);
+  PB.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3)
+      .printPipeline(OS, [&](llvm::StringRef ClassName) {
+        llvm::StringRef PassName = PIC.getPassNameForClassName(ClassName);
+        return PassName.empty() ? ClassName : PassName;
+      });
+  OS.flush();
+  // Passes without a registered pipeline name print their class name
+  auto Find = [&](llvm::StringRef Name, llvm::StringRef ClassName) {
+    size_t Pos = Pipeline.find(Name.str());
+    return Pos != std::string::npos ? Pos : Pipeline.find(ClassName.str());
+  };
+  size_t Pos = Pipeline.find("memory-coalescing");
+  ASSERT_NE(Pos, std::string::npos);
+  size_t IndVars = Find("indvars", "IndVarSimplifyPass");
+  ASSERT_NE(IndVars, std::string::npos);
+  EXPECT_GT(Pos, IndVars);
+  EXPECT_LT(Pos, Find("loop-vectorize", "LoopVectorizePass"));
+  
+  EXPECT_EQ(mlcompileropt::parseExtensionPoint("vectorizer-start"),
+            mlcompileropt::CoalescingExtensionPoint::VectorizerStart);
+  EXPECT_FALSE(mlcompileropt::parseExtensionPoint("loop-start").hasValue());
+}
+
 // Main function for the test
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+#include "driver/ModuleCache.h"
+
+class ModuleCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("module-cache", Dir));
+  }
+
+  void TearDown() override { llvm::sys::fs::remove_directories(Dir); }
+
+  bool hasEntry(llvm::StringRef Key) {
+    llvm::SmallString<128> Path(Dir);
+    llvm::sys::path::append(Path, "llvmcache-" + Key);
+    return llvm::sys::fs::exists(Path);
+  }
+
+  llvm::SmallString<128> Dir;
+};
+
+TEST_F(ModuleCacheTest, KeyCoversInputAndConfig) {
+  mlcompileropt::ModuleCache Serial(Dir, "serial", llvm::CachePruningPolicy());
+  mlcompileropt::ModuleCache Tuned(Dir, "serial -memory-coalescing-max-merge-width=64",
+                                   llvm::CachePruningPolicy());
+
+  std::string Key = Serial.getKey("input");
+  EXPECT_EQ(Key.size(), 64u);
+  EXPECT_EQ(Key, Serial.getKey("input"));
+  EXPECT_NE(Key, Serial.getKey("input2"));
+  EXPECT_NE(Key, Tuned.getKey("input"));
+}
+
+TEST_F(ModuleCacheTest, MissThenHit) {
+  mlcompileropt::ModuleCache Cache(Dir, "serial", llvm::CachePruningPolicy());
+  ASSERT_FALSE(!!Cache.initialize());
+
+  std::string Key = Cache.getKey("input");
+  EXPECT_TRUE(Cache.lookup(Key) == nullptr);
+  ASSERT_FALSE(!!Cache.insert(Key, "optimized"));
+
+  std::unique_ptr<llvm::MemoryBuffer> Hit = Cache.lookup(Key);
+  ASSERT_TRUE(Hit != nullptr);
+  EXPECT_EQ(Hit->getBuffer(), "optimized");
+  EXPECT_EQ(Cache.getNumHits(), 1u);
+  EXPECT_EQ(Cache.getNumMisses(), 1u);
+}
+
+// The least recently used entry goes first when the size limit is exceeded
+TEST_F(ModuleCacheTest, EvictsLeastRecentlyUsed) {
+  auto PolicyOrErr = llvm::parseCachePruningPolicy(
+      "prune_interval=0s:cache_size_bytes=2500");
+  ASSERT_TRUE(!!PolicyOrErr);
+  mlcompileropt::ModuleCache Cache(Dir, "serial", *PolicyOrErr);
+  ASSERT_FALSE(!!Cache.initialize());
+
+  std::string Data(1000, 'x');
+  std::string A = Cache.getKey("a"), B = Cache.getKey("b"),
+              C = Cache.getKey("c");
+
+  ASSERT_FALSE(!!Cache.insert(A, Data));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  ASSERT_FALSE(!!Cache.insert(B, Data));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  ASSERT_TRUE(Cache.lookup(A) != nullptr);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  ASSERT_FALSE(!!Cache.insert(C, Data));
+
+  EXPECT_TRUE(hasEntry(A));
+  EXPECT_FALSE(hasEntry(B));
+  EXPECT_TRUE(hasEntry(C));
+}
+
+// Temporary files left by an interrupted insert are removed once stale;
+// those of inserts that may still be running are kept
+TEST_F(ModuleCacheTest, RemovesStaleTempFiles) {
+  mlcompileropt::ModuleCache Cache(Dir, "serial", llvm::CachePruningPolicy());
+  ASSERT_FALSE(!!Cache.initialize());
+
+  auto CreateTempFile = [&](llvm::StringRef Name, std::chrono::hours Age) {
+    llvm::SmallString<128> Path(Dir);
+    llvm::sys::path::append(Path, Name);
+    int FD;
+    EXPECT_FALSE(llvm::sys::fs::openFileForWrite(Path, FD));
+    auto Time = std::chrono::system_clock::now() - Age;
+    EXPECT_FALSE(llvm::sys::fs::setLastAccessAndModificationTime(
+        FD, llvm::sys::toTimePoint(std::chrono::system_clock::to_time_t(Time))));
+    llvm::sys::fs::closeFile(FD);
+    return std::string(Path);
+  };
+  std::string Stale = CreateTempFile("tmp-stale-abcdef", std::chrono::hours(2));
+  std::string Fresh = CreateTempFile("tmp-fresh-abcdef", std::chrono::hours(0));
+
+  ASSERT_FALSE(!!Cache.insert(Cache.getKey("input"), "optimized"));
+  EXPECT_FALSE(llvm::sys::fs::exists(Stale));
+  EXPECT_TRUE(llvm::sys::fs::exists(Fresh));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
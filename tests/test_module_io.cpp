@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "driver/ModuleIO.h"
+
+// Path to test files, provided by the build system
+#ifndef ML_TEST_FILES_DIR
+#define ML_TEST_FILES_DIR "test_files/"
+#endif
+const std::string TEST_FILES_DIR = ML_TEST_FILES_DIR;
+
+static std::string printModule(const llvm::Module &M) {
+  std::string Str;
+  llvm::raw_string_ostream OS(Str);
+  M.print(OS, nullptr);
+  return OS.str();
+}
+
+// A module written as bitcode loads back unchanged, through the mapped
+// bitcode path
+TEST(ModuleIOTest, BitcodeRoundTrip) {
+  llvm::LLVMContext Context;
+  llvm::SMDiagnostic Err;
+  auto M = mlcompileropt::loadModule(TEST_FILES_DIR + "strided_access.ll",
+                                     Context, Err);
+  ASSERT_TRUE(M != nullptr);
+
+  llvm::SmallString<128> Path;
+  int FD;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("module-io", "bc", FD, Path));
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    mlcompileropt::writeModule(*M, OS, mlcompileropt::OutputFormat::Bitcode);
+  }
+
+  auto Loaded = mlcompileropt::loadModule(Path, Context, Err);
+  llvm::sys::fs::remove(Path);
+  ASSERT_TRUE(Loaded != nullptr);
+
+  // Only the module identifier differs
+  Loaded->setModuleIdentifier(M->getModuleIdentifier());
+  EXPECT_EQ(printModule(*M), printModule(*Loaded));
+}
+
+TEST(ModuleIOTest, MissingFile) {
+  llvm::LLVMContext Context;
+  llvm::SMDiagnostic Err;
+  auto M = mlcompileropt::loadModule(TEST_FILES_DIR + "does_not_exist.ll",
+                                     Context, Err);
+  EXPECT_TRUE(M == nullptr);
+  EXPECT_EQ(Err.getKind(), llvm::SourceMgr::DK_Error);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
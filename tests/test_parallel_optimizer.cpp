@@ -0,0 +1,229 @@
+#include <gtest/gtest.h>
+
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include "driver/OptimizationPipeline.h"
+#include "driver/ParallelOptimizer.h"
+
+#include <set>
+#include <string>
+#include <utility>
+
+// Path to test files, provided by the build system
+#ifndef ML_TEST_FILES_DIR
+#define ML_TEST_FILES_DIR "test_files/"
+#endif
+const std::string TEST_FILES_DIR = ML_TEST_FILES_DIR;
+
+class ParallelOptimizerTest : public ::testing::Test {
+protected:
+  std::unique_ptr<llvm::Module> loadIRFile(const std::string &Filename) {
+    llvm::SMDiagnostic Err;
+    auto M = llvm::parseIRFile(Filename, Err, Context);
+    if (!M)
+      Err.print("test", llvm::errs());
+    return M;
+  }
+
+  std::unique_ptr<llvm::Module> parseIR(const char *IR) {
+    llvm::SMDiagnostic Err;
+    auto M = llvm::parseAssemblyString(IR, Err, Context);
+    if (!M)
+      Err.print("test", llvm::errs());
+    return M;
+  }
+
+  // Optimizes M with the given number of threads and returns the printed
+  // result, or an empty string on failure.
+  std::string optimize(llvm::Module &M, unsigned Jobs) {
+    mlcompileropt::ParallelOptimizerOptions Opts;
+    Opts.Jobs = Jobs;
+    mlcompileropt::ParallelOptimizerStats Stats;
+    auto OptimizedOrErr = mlcompileropt::optimizeModuleInParallel(M, Opts, &Stats);
+    if (!OptimizedOrErr) {
+      ADD_FAILURE() << llvm::toString(OptimizedOrErr.takeError());
+      return "";
+    }
+    EXPECT_FALSE(llvm::verifyModule(**OptimizedOrErr, &llvm::errs()));
+
+    std::string Str;
+    llvm::raw_string_ostream OS(Str);
+    (*OptimizedOrErr)->print(OS, nullptr);
+    return OS.str();
+  }
+
+  llvm::LLVMContext Context;
+};
+
+// The output must not depend on the number of threads
+TEST_F(ParallelOptimizerTest, OutputIsIndependentOfJobs) {
+  auto M = loadIRFile(TEST_FILES_DIR + "strided_access.ll");
+  ASSERT_TRUE(M != nullptr);
+
+  std::string Serial = optimize(*M, 1);
+  ASSERT_FALSE(Serial.empty());
+  EXPECT_EQ(Serial, optimize(*M, 2));
+  EXPECT_EQ(Serial, optimize(*M, 4));
+}
+
+// Every function keeps its definition, and the partitions are optimized
+// by the same pipeline as the serial driver
+TEST_F(ParallelOptimizerTest, MatchesSerialPipelinePerFunction) {
+  auto M = loadIRFile(TEST_FILES_DIR + "strided_access.ll");
+  ASSERT_TRUE(M != nullptr);
+
+  mlcompileropt::ParallelOptimizerOptions Opts;
+  Opts.Jobs = 4;
+  auto OptimizedOrErr = mlcompileropt::optimizeModuleInParallel(*M, Opts);
+  ASSERT_TRUE(!!OptimizedOrErr) << llvm::toString(OptimizedOrErr.takeError());
+  llvm::Module &Parallel = **OptimizedOrErr;
+
+  // The functions do not call each other, so splitting loses nothing
+  std::unique_ptr<llvm::Module> Serial = llvm::CloneModule(*M);
+  mlcompileropt::OptimizationPipeline Pipeline;
+  Pipeline.run(*Serial);
+
+  for (llvm::Function &F : *M) {
+    if (F.isDeclaration())
+      continue;
+    llvm::Function *P = Parallel.getFunction(F.getName());
+    llvm::Function *S = Serial->getFunction(F.getName());
+    ASSERT_TRUE(P && S) << F.getName().str();
+    EXPECT_FALSE(P->isDeclaration()) << F.getName().str();
+
+    // Attribute group numbers are module specific, so compare the
+    // attributes and the instructions separately
+    EXPECT_EQ(S->getAttributes(), P->getAttributes()) << F.getName().str();
+    std::string PStr, SStr;
+    llvm::raw_string_ostream POS(PStr), SOS(SStr);
+    for (llvm::BasicBlock &BB : *P)
+      BB.print(POS);
+    for (llvm::BasicBlock &BB : *S)
+      BB.print(SOS);
+    EXPECT_EQ(SOS.str(), POS.str()) << F.getName().str();
+  }
+}
+
+// Discardable definitions whose only users are in another partition must
+// survive the optimization of their own partition
+TEST_F(ParallelOptimizerTest, KeepsDiscardableDefinitions) {
+  auto M = parseIR(R"IR(
+    @llvm.compiler.used = appending global [1 x i8*] [i8* bitcast (i32 ()* @pinned to i8*)], section "llvm.metadata"
+
+    define linkonce_odr i32 @helper(i32 %x) noinline {
+      %y = mul i32 %x, 3
+      ret i32 %y
+    }
+
+    define i32 @pinned() {
+      ret i32 7
+    }
+
+    define i32 @caller(i32 %x) {
+      %r = call i32 @helper(i32 %x)
+      ret i32 %r
+    }
+  )IR");
+  ASSERT_TRUE(M != nullptr);
+
+  mlcompileropt::ParallelOptimizerOptions Opts;
+  Opts.Jobs = 2;
+  mlcompileropt::ParallelOptimizerStats Stats;
+  auto OptimizedOrErr = mlcompileropt::optimizeModuleInParallel(*M, Opts, &Stats);
+  ASSERT_TRUE(!!OptimizedOrErr) << llvm::toString(OptimizedOrErr.takeError());
+  llvm::Module &Optimized = **OptimizedOrErr;
+  EXPECT_EQ(Stats.NumPartitions, 3u);
+  EXPECT_FALSE(llvm::verifyModule(Optimized, &llvm::errs()));
+
+  llvm::Function *Helper = Optimized.getFunction("helper");
+  ASSERT_TRUE(Helper != nullptr);
+  EXPECT_FALSE(Helper->isDeclaration());
+
+  // Only the original entries remain in llvm.compiler.used
+  llvm::SmallVector<llvm::GlobalValue *, 4> Used;
+  llvm::collectUsedGlobalVariables(Optimized, Used, /*CompilerUsed=*/true);
+  ASSERT_EQ(Used.size(), 1u);
+  EXPECT_EQ(Used[0]->getName(), "pinned");
+}
+
+// Pinned definitions and declarations that nothing uses are dropped after
+// linking, as the serial pipeline drops them, so both have the same globals
+TEST_F(ParallelOptimizerTest, SameGlobalsAsSerial) {
+  auto M = parseIR(R"IR(
+    @table = linkonce_odr constant [2 x i32] [i32 1, i32 2]
+    @unused_table = linkonce_odr constant [2 x i32] [i32 3, i32 4]
+
+    define linkonce_odr i32 @helper(i32 %x) noinline {
+      %p = getelementptr [2 x i32], [2 x i32]* @table, i32 0, i32 %x
+      %y = load i32, i32* %p
+      ret i32 %y
+    }
+
+    define linkonce_odr i32 @unused(i32 %x) noinline {
+      %p = getelementptr [2 x i32], [2 x i32]* @unused_table, i32 0, i32 %x
+      %y = load i32, i32* %p
+      ret i32 %y
+    }
+
+    define available_externally i32 @external(i32 %x) {
+      ret i32 %x
+    }
+
+    define i32 @caller(i32 %x) {
+      %r = call i32 @helper(i32 %x)
+      ret i32 %r
+    }
+  )IR");
+  ASSERT_TRUE(M != nullptr);
+
+  mlcompileropt::ParallelOptimizerOptions Opts;
+  Opts.Jobs = 2;
+  auto OptimizedOrErr = mlcompileropt::optimizeModuleInParallel(*M, Opts);
+  ASSERT_TRUE(!!OptimizedOrErr) << llvm::toString(OptimizedOrErr.takeError());
+  llvm::Module &Parallel = **OptimizedOrErr;
+  EXPECT_FALSE(llvm::verifyModule(Parallel, &llvm::errs()));
+
+  std::unique_ptr<llvm::Module> Serial = llvm::CloneModule(*M);
+  mlcompileropt::OptimizationPipeline Pipeline;
+  Pipeline.run(*Serial);
+
+  auto getGlobals = [](llvm::Module &Module) {
+    std::set<std::pair<std::string, bool>> Globals;
+    for (llvm::GlobalValue &GV : Module.global_values())
+      Globals.insert({GV.getName().str(), GV.isDeclaration()});
+    return Globals;
+  };
+  EXPECT_EQ(getGlobals(*Serial), getGlobals(Parallel));
+  EXPECT_EQ(Parallel.getFunction("unused"), nullptr);
+  EXPECT_EQ(Parallel.getNamedGlobal("unused_table"), nullptr);
+  EXPECT_EQ(Parallel.getFunction("external"), nullptr);
+  EXPECT_NE(Parallel.getNamedGlobal("table"), nullptr);
+}
+
+// An invalid pipeline is reported once, as an error of the whole module
+// rather than of a partition
+TEST_F(ParallelOptimizerTest, RejectsInvalidPipeline) {
+  auto M = loadIRFile(TEST_FILES_DIR + "strided_access.ll");
+  ASSERT_TRUE(M != nullptr);
+
+  mlcompileropt::ParallelOptimizerOptions Opts;
+  Opts.Jobs = 4;
+  Opts.PassPipeline = "function(no-such-pass)";
+  auto OptimizedOrErr = mlcompileropt::optimizeModuleInParallel(*M, Opts);
+  ASSERT_FALSE(!!OptimizedOrErr);
+  std::string Message = llvm::toString(OptimizedOrErr.takeError());
+  EXPECT_NE(Message.find("no-such-pass"), std::string::npos) << Message;
+  EXPECT_EQ(Message.find("partition"), std::string::npos) << Message;
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+
+#include "runtime/ParallelRuntime.h"
+
+#include <atomic>
+#include <vector>
+
+namespace {
+
+// Counts how often every iteration of [Begin, Begin + Counts.size()) ran
+struct Coverage {
+  int64_t Begin;
+  std::vector<std::atomic<int>> Counts;
+  std::atomic<int> Calls{0};
+
+  Coverage(int64_t Begin, size_t Size) : Begin(Begin), Counts(Size) {}
+
+  bool coveredOnce() const {
+    for (const std::atomic<int> &C : Counts)
+      if (C != 1)
+        return false;
+    return true;
+  }
+};
+
+void countIterations(int64_t Begin, int64_t End, void *Ctx) {
+  auto *Cov = static_cast<Coverage *>(Ctx);
+  ++Cov->Calls;
+  for (int64_t I = Begin; I < End; ++I)
+    ++Cov->Counts[I - Cov->Begin];
+}
+
+// Every chunk runs a parallel loop over the rows of its iterations
+struct Nested {
+  int64_t Columns;
+  Coverage Cov;
+};
+
+void countRow(int64_t Begin, int64_t End, void *Ctx) {
+  auto *N = static_cast<Nested *>(Ctx);
+  for (int64_t Row = Begin; Row < End; ++Row) {
+    __ml_parallel_for(Row * N->Columns, (Row + 1) * N->Columns,
+                      [](int64_t B, int64_t E, void *C) {
+                        auto *Outer = static_cast<Nested *>(C);
+                        for (int64_t I = B; I < E; ++I)
+                          ++Outer->Cov.Counts[I];
+                      },
+                      N, ML_SCHEDULE_DYNAMIC, 0);
+  }
+}
+
+} // end anonymous namespace
+
+TEST(ParallelRuntimeTest, CoversEveryIterationOnce) {
+  for (int32_t Threads : {1, 2, 3, 4}) {
+    __ml_set_num_threads(Threads);
+    EXPECT_EQ(__ml_get_num_threads(), Threads);
+    for (int32_t Schedule : {ML_SCHEDULE_STATIC, ML_SCHEDULE_DYNAMIC}) {
+      for (int64_t Chunk : {0, 1, 7, 1000}) {
+        Coverage Cov(-5, 1000);
+        __ml_parallel_for(-5, 995, countIterations, &Cov, Schedule, Chunk);
+        EXPECT_TRUE(Cov.coveredOnce()) << Threads << " threads, schedule "
+                                       << Schedule << ", chunk " << Chunk;
+      }
+    }
+  }
+  __ml_set_num_threads(0);
+}
+
+TEST(ParallelRuntimeTest, Chunks) {
+  __ml_set_num_threads(4);
+  // Static without a chunk size: one block per thread
+  Coverage Blocks(0, 100);
+  __ml_parallel_for(0, 100, countIterations, &Blocks, ML_SCHEDULE_STATIC, 0);
+  EXPECT_EQ(Blocks.Calls, 4);
+
+  // Fewer iterations than threads: no empty blocks
+  Coverage Small(0, 3);
+  __ml_parallel_for(0, 3, countIterations, &Small, ML_SCHEDULE_STATIC, 0);
+  EXPECT_EQ(Small.Calls, 3);
+
+  Coverage Chunked(0, 100);
+  __ml_parallel_for(0, 100, countIterations, &Chunked, ML_SCHEDULE_DYNAMIC, 10);
+  EXPECT_EQ(Chunked.Calls, 10);
+  EXPECT_TRUE(Chunked.coveredOnce());
+
+  // Dynamic without a chunk size: eight chunks per thread
+  Coverage Default(0, 320);
+  __ml_parallel_for(0, 320, countIterations, &Default, ML_SCHEDULE_DYNAMIC, 0);
+  EXPECT_EQ(Default.Calls, 32);
+  __ml_set_num_threads(0);
+}
+
+TEST(ParallelRuntimeTest, EmptyRange) {
+  Coverage Cov(0, 0);
+  __ml_parallel_for(10, 10, countIterations, &Cov, ML_SCHEDULE_DYNAMIC, 0);
+  __ml_parallel_for(10, 0, countIterations, &Cov, ML_SCHEDULE_STATIC, 0);
+  EXPECT_EQ(Cov.Calls, 0);
+}
+
+// Loops started from a parallel loop run on the calling thread
+TEST(ParallelRuntimeTest, NestedLoops) {
+  __ml_set_num_threads(3);
+  Nested N{16, Coverage(0, 16 * 16)};
+  __ml_parallel_for(0, 16, countRow, &N, ML_SCHEDULE_DYNAMIC, 1);
+  EXPECT_TRUE(N.Cov.coveredOnce());
+  __ml_set_num_threads(0);
+}
+
+TEST(ParallelRuntimeTest, DefaultThreads) {
+  __ml_set_num_threads(0);
+  EXPECT_GE(__ml_get_num_threads(), 1);
+}
+
+// Main function for the test
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "driver/OptimizationPipeline.h"
+#include "driver/PassProfiler.h"
+
+// Path to test files, provided by the build system
+#ifndef ML_TEST_FILES_DIR
+#define ML_TEST_FILES_DIR "test_files/"
+#endif
+const std::string TEST_FILES_DIR = ML_TEST_FILES_DIR;
+
+class PassProfilerTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    llvm::SMDiagnostic Err;
+    M = llvm::parseIRFile(TEST_FILES_DIR + "strided_access.ll", Err, Context);
+    ASSERT_TRUE(M != nullptr);
+
+    mlcompileropt::OptimizationPipeline Pipeline(/*UseCustomPasses=*/true,
+                                                 &Profiler);
+    Pipeline.run(*M);
+  }
+
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M;
+  mlcompileropt::PassProfiler Profiler{"test"};
+};
+
+// The custom pass is timed along with the O3 passes and the analyses
+TEST_F(PassProfilerTest, Report) {
+  ASSERT_FALSE(Profiler.empty());
+  std::string Report;
+  llvm::raw_string_ostream OS(Report);
+  Profiler.printReport(OS);
+  OS.flush();
+
+  EXPECT_NE(Report.find("(test)"), std::string::npos);
+  EXPECT_NE(Report.find("MemoryCoalescingPass"), std::string::npos);
+  EXPECT_NE(Report.find("InstCombinePass"), std::string::npos);
+  EXPECT_NE(Report.find("DominatorTreeAnalysis"), std::string::npos);
+}
+
+// Pass times are looked up by pass name; analyses are not passes
+TEST_F(PassProfilerTest, PassTimes) {
+  llvm::StringMap<double> Times = Profiler.getPassTimes();
+  auto It = Times.find(mlcompileropt::MemoryCoalescingPass::name());
+  ASSERT_NE(It, Times.end());
+  EXPECT_GT(It->second, 0.0);
+  EXPECT_EQ(Times.count("DominatorTreeAnalysis"), 0u);
+}
+
+// Self times leave out the analyses and nested passes a pass runs
+TEST_F(PassProfilerTest, PassSelfTimes) {
+  llvm::StringMap<double> Times = Profiler.getPassTimes();
+  llvm::StringMap<double> SelfTimes = Profiler.getPassSelfTimes();
+  llvm::StringRef Name = mlcompileropt::MemoryCoalescingPass::name();
+  ASSERT_EQ(SelfTimes.count(Name), 1u);
+  EXPECT_GT(SelfTimes.lookup(Name), 0.0);
+  EXPECT_LE(SelfTimes.lookup(Name), Times.lookup(Name));
+  EXPECT_EQ(SelfTimes.count("DominatorTreeAnalysis"), 0u);
+}
+
+// Every function of the module gets a named row in the trace
+TEST_F(PassProfilerTest, ChromeTrace) {
+  llvm::SmallString<128> Path;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("trace", "json", Path));
+  ASSERT_FALSE(bool(mlcompileropt::writeChromeTrace(Path, {&Profiler})));
+  auto Buffer = llvm::MemoryBuffer::getFile(Path);
+  llvm::sys::fs::remove(Path);
+  ASSERT_TRUE(bool(Buffer));
+
+  auto Trace = llvm::json::parse((*Buffer)->getBuffer());
+  ASSERT_TRUE(bool(Trace));
+  const llvm::json::Array *Events =
+      Trace->getAsObject()->getArray("traceEvents");
+  ASSERT_TRUE(Events != nullptr);
+
+  unsigned NumFunctionRows = 0, NumCompleteEvents = 0;
+  for (const llvm::json::Value &V : *Events) {
+    const llvm::json::Object *E = V.getAsObject();
+    if (E->getString("ph") == llvm::StringRef("X")) {
+      ++NumCompleteEvents;
+      EXPECT_GE(*E->getNumber("dur"), 0.0);
+    } else if (E->getString("name") == llvm::StringRef("thread_name") &&
+               E->getObject("args")->getString("name")->startswith("function ")) {
+      ++NumFunctionRows;
+    }
+  }
+  EXPECT_GT(NumCompleteEvents, 0u);
+
+  unsigned NumDefined = 0;
+  for (const llvm::Function &F : *M)
+    NumDefined += !F.isDeclaration();
+  EXPECT_GE(NumFunctionRows, NumDefined);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,207 @@
+#include <gtest/gtest.h>
+
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "passes/ReductionVectorization.h"
+#include "passes/TuningConfig.h"
+
+#include "KernelTestUtils.h"
+
+namespace {
+
+// Reductions as LICM leaves them: the accumulator is a phi, the sum is
+// stored after the loop
+const char *const ReductionsIR = R"IR(
+define void @dot(float* noalias %A, float* noalias %B, float* noalias %Out,
+                 i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %k = phi i64 [ 0, %entry ], [ %k.next, %loop ]
+  %acc = phi float [ 0.0, %entry ], [ %sum, %loop ]
+  %a.ptr = getelementptr inbounds float, float* %A, i64 %k
+  %a = load float, float* %a.ptr, align 4
+  %b.ptr = getelementptr inbounds float, float* %B, i64 %k
+  %b = load float, float* %b.ptr, align 4
+  %prod = fmul float %a, %b
+  %sum = fadd float %acc, %prod
+  %k.next = add nuw nsw i64 %k, 1
+  %cond = icmp ult i64 %k.next, %n
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  %sum.lcssa = phi float [ %sum, %loop ]
+  store float %sum.lcssa, float* %Out, align 4
+  ret void
+}
+
+; Row 0 of A times column 3 of B, an 8-column matrix, added to Out[0],
+; and the sum of row 0 of A
+define void @row_times_column(float* noalias %A, float* noalias %B,
+                              float* noalias %Out) {
+entry:
+  %init = load float, float* %Out, align 4
+  br label %loop
+
+loop:
+  %k = phi i64 [ 0, %entry ], [ %k.next, %loop ]
+  %acc = phi float [ %init, %entry ], [ %sum, %loop ]
+  %total = phi float [ 0.0, %entry ], [ %total.next, %loop ]
+  %a.ptr = getelementptr inbounds float, float* %A, i64 %k
+  %a = load float, float* %a.ptr, align 4
+  %b.row = mul nuw nsw i64 %k, 8
+  %b.idx = add nuw nsw i64 %b.row, 3
+  %b.ptr = getelementptr inbounds float, float* %B, i64 %b.idx
+  %b = load float, float* %b.ptr, align 4
+  %sum = call float @llvm.fmuladd.f32(float %a, float %b, float %acc)
+  %total.next = fadd float %a, %total
+  %k.next = add nuw nsw i64 %k, 1
+  %cond = icmp ult i64 %k.next, 40
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  %sum.lcssa = phi float [ %sum, %loop ]
+  %total.lcssa = phi float [ %total.next, %loop ]
+  store float %sum.lcssa, float* %Out, align 4
+  %out.1 = getelementptr inbounds float, float* %Out, i64 1
+  store float %total.lcssa, float* %out.1, align 4
+  ret void
+}
+
+; Stores a running sum, so the order of the additions is visible
+define void @prefix_sum(float* noalias %A, float* noalias %Out) {
+entry:
+  br label %loop
+
+loop:
+  %k = phi i64 [ 0, %entry ], [ %k.next, %loop ]
+  %acc = phi float [ 0.0, %entry ], [ %sum, %loop ]
+  %a.ptr = getelementptr inbounds float, float* %A, i64 %k
+  %a = load float, float* %a.ptr, align 4
+  %sum = fadd float %acc, %a
+  %out.ptr = getelementptr inbounds float, float* %Out, i64 %k
+  store float %sum, float* %out.ptr, align 4
+  %k.next = add nuw nsw i64 %k, 1
+  %cond = icmp ult i64 %k.next, 64
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  ret void
+}
+
+declare float @llvm.fmuladd.f32(float, float, float)
+)IR";
+
+std::unique_ptr<llvm::Module> parse(llvm::LLVMContext &Context) {
+  return kernel_test::parse(ReductionsIR, Context);
+}
+
+// Runs the pass with Width lanes; Reassociate lets it reorder sums that
+// do not carry the reassoc flag, as all of those in ReductionsIR
+void runReductionVectorize(llvm::Function &F, unsigned Width,
+                           bool Reassociate = true) {
+  kernel_test::runFunctionPass(
+      F, mlcompileropt::ReductionVectorizePass(Width, Reassociate));
+}
+
+// Number of calls to intrinsic ID with vector arguments
+unsigned countVectorIntrinsics(llvm::Function &F, llvm::Intrinsic::ID ID) {
+  unsigned Count = 0;
+  for (llvm::BasicBlock &BB : F)
+    for (llvm::Instruction &I : BB)
+      if (auto *II = llvm::dyn_cast<llvm::IntrinsicInst>(&I))
+        Count += II->getIntrinsicID() == ID &&
+                 llvm::any_of(II->args(), [](llvm::Value *Arg) {
+                   return Arg->getType()->isVectorTy();
+                 });
+  return Count;
+}
+
+} // end anonymous namespace
+
+// Both operands of the dot product are contiguous: the loop gets a
+// vector copy with fmuladd partial sums and one reduction after it
+TEST(ReductionVectorizationTest, DotProduct) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("dot");
+  runReductionVectorize(F, 4);
+  ASSERT_FALSE(llvm::verifyFunction(F, &llvm::errs()));
+  EXPECT_EQ(countVectorIntrinsics(F, llvm::Intrinsic::fmuladd), 1u);
+  EXPECT_EQ(countVectorIntrinsics(F, llvm::Intrinsic::vector_reduce_fadd), 1u);
+}
+
+// Two reductions in one loop, one of them over a strided column
+TEST(ReductionVectorizationTest, StridedOperand) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("row_times_column");
+  runReductionVectorize(F, 8);
+  ASSERT_FALSE(llvm::verifyFunction(F, &llvm::errs()));
+  EXPECT_EQ(countVectorIntrinsics(F, llvm::Intrinsic::fmuladd), 1u);
+  EXPECT_EQ(countVectorIntrinsics(F, llvm::Intrinsic::vector_reduce_fadd), 2u);
+}
+
+// Loops that store, and a tuning configuration with a vector width of 1,
+// keep their reductions scalar
+TEST(ReductionVectorizationTest, KeepsScalar) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("prefix_sum");
+  runReductionVectorize(F, 4);
+  EXPECT_EQ(countVectorIntrinsics(F, llvm::Intrinsic::vector_reduce_fadd), 0u);
+
+  llvm::Function &G = *M->getFunction("dot");
+  auto Config = mlcompileropt::TuningConfig::parse("vectorize-width=1");
+  ASSERT_TRUE(!!Config) << llvm::toString(Config.takeError());
+  Config->attachTo(G);
+  runReductionVectorize(G, 0);
+  EXPECT_EQ(countVectorIntrinsics(G, llvm::Intrinsic::vector_reduce_fadd), 0u);
+}
+
+// Without being asked to reassociate, the pass keeps plain fadd sums in
+// order and only vectorizes the ones with the reassoc flag
+TEST(ReductionVectorizationTest, KeepsStrictSumsByDefault) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("dot");
+  runReductionVectorize(F, 4, /*Reassociate=*/false);
+  EXPECT_EQ(countVectorIntrinsics(F, llvm::Intrinsic::vector_reduce_fadd), 0u);
+
+  for (llvm::BasicBlock &BB : F)
+    for (llvm::Instruction &I : BB)
+      if (I.getName() == "sum")
+        I.setHasAllowReassoc(true);
+  runReductionVectorize(F, 4, /*Reassociate=*/false);
+  ASSERT_FALSE(llvm::verifyFunction(F, &llvm::errs()));
+  EXPECT_EQ(countVectorIntrinsics(F, llvm::Intrinsic::vector_reduce_fadd), 1u);
+}
+
+// The sums only differ by rounding, with and without a remainder loop
+TEST(ReductionVectorizationTest, SameResults) {
+  for (llvm::StringRef Spec : {"dot:A=64,B=64,Out=1,n=64", "dot:A=64,B=64,Out=1,n=37",
+                               "dot:A=64,B=64,Out=1,n=3",
+                               "row_times_column:A=40,B=320,Out=2"}) {
+    kernel_test::expectSameResults(
+        [](llvm::LLVMContext &Context) { return parse(Context); },
+        [&](llvm::Module &M) {
+          runReductionVectorize(*M.getFunction(Spec.split(':').first), 4);
+        },
+        Spec, 1e-5, 1e-5);
+  }
+}
+
+// Main function for the test
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
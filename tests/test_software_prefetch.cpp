@@ -0,0 +1,225 @@
+#include <gtest/gtest.h>
+
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "passes/SoftwarePrefetch.h"
+#include "passes/TuningConfig.h"
+
+#include "KernelTestUtils.h"
+
+namespace {
+
+// Loops over a 1024-column float matrix
+const char *const WalksIR = R"IR(
+; Sums of every column, with a runtime row count
+define void @column_sums(float* noalias %A, float* noalias %Out, i64 %n) {
+entry:
+  br label %j.loop
+
+j.loop:
+  %j = phi i64 [ 0, %entry ], [ %j.next, %i.exit ]
+  br label %i.loop
+
+i.loop:
+  %i = phi i64 [ 0, %j.loop ], [ %i.next, %i.loop ]
+  %acc = phi float [ 0.0, %j.loop ], [ %sum, %i.loop ]
+  %row = mul nuw nsw i64 %i, 1024
+  %idx = add nuw nsw i64 %row, %j
+  %ptr = getelementptr inbounds float, float* %A, i64 %idx
+  %a = load float, float* %ptr, align 4
+  %sum = fadd float %acc, %a
+  %i.next = add nuw nsw i64 %i, 1
+  %i.cond = icmp ult i64 %i.next, %n
+  br i1 %i.cond, label %i.loop, label %i.exit
+
+i.exit:
+  %out.ptr = getelementptr inbounds float, float* %Out, i64 %j
+  store float %sum, float* %out.ptr, align 4
+  %j.next = add nuw nsw i64 %j, 1
+  %j.cond = icmp ult i64 %j.next, 1024
+  br i1 %j.cond, label %j.loop, label %exit
+
+exit:
+  ret void
+}
+
+; Columns j and j + 1 of A share a cache line, column 0 of B does not
+define void @column_pairs(float* noalias %A, float* noalias %B,
+                          float* noalias %Out, i64 %j, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi float [ 0.0, %entry ], [ %sum.2, %loop ]
+  %row = mul nuw nsw i64 %i, 1024
+  %idx = add nuw nsw i64 %row, %j
+  %a.ptr = getelementptr inbounds float, float* %A, i64 %idx
+  %a = load float, float* %a.ptr, align 4
+  %idx.1 = add nuw nsw i64 %idx, 1
+  %a.1.ptr = getelementptr inbounds float, float* %A, i64 %idx.1
+  %a.1 = load float, float* %a.1.ptr, align 4
+  %b.ptr = getelementptr inbounds float, float* %B, i64 %row
+  %b = load float, float* %b.ptr, align 4
+  %sum = fadd float %acc, %a
+  %sum.1 = fadd float %sum, %a.1
+  %sum.2 = fadd float %sum.1, %b
+  %i.next = add nuw nsw i64 %i, 1
+  %cond = icmp ult i64 %i.next, %n
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  store float %sum.2, float* %Out, align 4
+  ret void
+}
+
+; A row walk, a column walk over 16 rows that fits in the cache, and a
+; column of stores
+define void @no_prefetch(float* noalias %A, float* noalias %Out, i64 %n) {
+entry:
+  br label %row.loop
+
+row.loop:
+  %k = phi i64 [ 0, %entry ], [ %k.next, %row.loop ]
+  %acc = phi float [ 0.0, %entry ], [ %sum, %row.loop ]
+  %a.ptr = getelementptr inbounds float, float* %A, i64 %k
+  %a = load float, float* %a.ptr, align 4
+  %sum = fadd float %acc, %a
+  %k.next = add nuw nsw i64 %k, 1
+  %k.cond = icmp ult i64 %k.next, %n
+  br i1 %k.cond, label %row.loop, label %small.loop
+
+small.loop:
+  %i = phi i64 [ 0, %row.loop ], [ %i.next, %small.loop ]
+  %small.acc = phi float [ %sum, %row.loop ], [ %small.sum, %small.loop ]
+  %row = mul nuw nsw i64 %i, 1024
+  %b.ptr = getelementptr inbounds float, float* %A, i64 %row
+  %b = load float, float* %b.ptr, align 4
+  %small.sum = fadd float %small.acc, %b
+  %i.next = add nuw nsw i64 %i, 1
+  %i.cond = icmp ult i64 %i.next, 16
+  br i1 %i.cond, label %small.loop, label %store.loop
+
+store.loop:
+  %s = phi i64 [ 0, %small.loop ], [ %s.next, %store.loop ]
+  %out.row = mul nuw nsw i64 %s, 1024
+  %out.ptr = getelementptr inbounds float, float* %Out, i64 %out.row
+  store float %small.sum, float* %out.ptr, align 4
+  %s.next = add nuw nsw i64 %s, 1
+  %s.cond = icmp ult i64 %s.next, %n
+  br i1 %s.cond, label %store.loop, label %exit
+
+exit:
+  ret void
+}
+)IR";
+
+std::unique_ptr<llvm::Module> parse(llvm::LLVMContext &Context) {
+  return kernel_test::parse(WalksIR, Context);
+}
+
+// Runs the pass on F; with PrefetchAll false, as in the default pipelines
+void runSoftwarePrefetch(llvm::Function &F, bool PrefetchAll = true) {
+  kernel_test::runFunctionPass(F, mlcompileropt::SoftwarePrefetchPass(PrefetchAll));
+}
+
+// Byte offsets of the prefetched addresses from the accessed ones
+std::vector<int64_t> getPrefetchOffsets(llvm::Function &F) {
+  std::vector<int64_t> Offsets;
+  for (llvm::BasicBlock &BB : F)
+    for (llvm::Instruction &I : BB)
+      if (auto *II = llvm::dyn_cast<llvm::IntrinsicInst>(&I))
+        if (II->getIntrinsicID() == llvm::Intrinsic::prefetch) {
+          auto *GEP = llvm::cast<llvm::GEPOperator>(II->getArgOperand(0));
+          Offsets.push_back(
+              llvm::cast<llvm::ConstantInt>(GEP->getOperand(1))->getSExtValue());
+        }
+  return Offsets;
+}
+
+} // end anonymous namespace
+
+// Each column walk is prefetched a whole number of rows ahead
+TEST(SoftwarePrefetchTest, ColumnWalk) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("column_sums");
+  runSoftwarePrefetch(F);
+  ASSERT_FALSE(llvm::verifyFunction(F, &llvm::errs()));
+  std::vector<int64_t> Offsets = getPrefetchOffsets(F);
+  ASSERT_EQ(Offsets.size(), 1u);
+  EXPECT_GT(Offsets[0], 0);
+  EXPECT_EQ(Offsets[0] % 4096, 0);
+}
+
+// Accesses within a cache line of each other share a prefetch
+TEST(SoftwarePrefetchTest, SharedCacheLine) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("column_pairs");
+  runSoftwarePrefetch(F);
+  ASSERT_FALSE(llvm::verifyFunction(F, &llvm::errs()));
+  EXPECT_EQ(getPrefetchOffsets(F).size(), 2u);
+}
+
+// The tuning parameter prefetch sets the distance in iterations, and 0
+// disables prefetching
+TEST(SoftwarePrefetchTest, TunedDistance) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("column_sums");
+  auto Config = mlcompileropt::TuningConfig::parse("prefetch=4");
+  ASSERT_TRUE(!!Config) << llvm::toString(Config.takeError());
+  Config->attachTo(F);
+  runSoftwarePrefetch(F);
+  EXPECT_EQ(getPrefetchOffsets(F), std::vector<int64_t>{4 * 4096});
+
+  llvm::Function &G = *M->getFunction("column_pairs");
+  auto Disabled = mlcompileropt::TuningConfig::parse("prefetch=0");
+  ASSERT_TRUE(!!Disabled) << llvm::toString(Disabled.takeError());
+  Disabled->attachTo(G);
+  runSoftwarePrefetch(G);
+  EXPECT_TRUE(getPrefetchOffsets(G).empty());
+}
+
+// In the default pipelines, only functions with a prefetch distance get
+// prefetches
+TEST(SoftwarePrefetchTest, TuningSelectsFunctions) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("column_sums");
+  runSoftwarePrefetch(F, /*PrefetchAll=*/false);
+  EXPECT_TRUE(getPrefetchOffsets(F).empty());
+
+  auto Config = mlcompileropt::TuningConfig::parse("prefetch=4");
+  ASSERT_TRUE(!!Config) << llvm::toString(Config.takeError());
+  Config->attachTo(F);
+  runSoftwarePrefetch(F, /*PrefetchAll=*/false);
+  EXPECT_EQ(getPrefetchOffsets(F), std::vector<int64_t>{4 * 4096});
+}
+
+// Unit strides, walks that fit in the cache and, without write
+// prefetching on the target, stores are not prefetched
+TEST(SoftwarePrefetchTest, NoPrefetch) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function &F = *M->getFunction("no_prefetch");
+  runSoftwarePrefetch(F);
+  EXPECT_TRUE(getPrefetchOffsets(F).empty());
+}
+
+// Main function for the test
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
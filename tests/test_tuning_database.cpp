@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+#include "driver/OptimizationPipeline.h"
+#include "driver/TuningDatabase.h"
+#include "passes/TuningConfig.h"
+
+#include "KernelTestUtils.h"
+
+namespace {
+
+using kernel_test::parse;
+
+const char *const KernelIR = R"IR(
+define void @scale(float* noalias %a, float* noalias %b) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %pa = getelementptr inbounds float, float* %a, i64 %i
+  %v = load float, float* %pa, align 4
+  %m = fmul float %v, 2.0
+  %pb = getelementptr inbounds float, float* %b, i64 %i
+  store float %m, float* %pb, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %c = icmp ult i64 %i.next, 1024
+  br i1 %c, label %loop, label %exit
+
+exit:
+  ret void
+}
+)IR";
+
+} // end anonymous namespace
+
+TEST(TuningConfigTest, ParseAndPrint) {
+  auto ConfigOrErr = mlcompileropt::TuningConfig::parse(
+      "unroll=4, interchange=never,vectorize-width=8");
+  ASSERT_TRUE(!!ConfigOrErr);
+  EXPECT_EQ(ConfigOrErr->UnrollCount, 4u);
+  EXPECT_EQ(ConfigOrErr->VectorizeWidth, 8u);
+  EXPECT_EQ(ConfigOrErr->toString(), "interchange=never,unroll=4,vectorize-width=8");
+
+  // A prefetch distance of 0 is set, not the default
+  auto NoPrefetch = mlcompileropt::TuningConfig::parse("prefetch=0");
+  ASSERT_TRUE(!!NoPrefetch);
+  EXPECT_FALSE(NoPrefetch->isDefault());
+  EXPECT_EQ(NoPrefetch->toString(), "prefetch=0");
+
+  auto Default = mlcompileropt::TuningConfig::parse("default");
+  ASSERT_TRUE(!!Default);
+  EXPECT_TRUE(Default->isDefault());
+  EXPECT_EQ(Default->toString(), "default");
+
+  for (const char *Bad : {"unroll=four", "tile=big", "unroll", "interchange=sometimes"}) {
+    auto BadOrErr = mlcompileropt::TuningConfig::parse(Bad);
+    EXPECT_FALSE(!!BadOrErr) << Bad;
+    llvm::consumeError(BadOrErr.takeError());
+  }
+}
+
+// Signatures ignore value names and the tuning attribute, but not the body
+TEST(TuningDatabaseTest, KernelSignature) {
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(KernelIR, Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function *F = M->getFunction("scale");
+  std::string Signature = mlcompileropt::getKernelSignature(*F);
+  EXPECT_EQ(Signature.rfind("scale#", 0), 0u);
+
+  std::string Renamed = KernelIR;
+  for (size_t Pos; (Pos = Renamed.find("%pa")) != std::string::npos;)
+    Renamed.replace(Pos, 3, "%addr");
+  std::unique_ptr<llvm::Module> R = parse(Renamed, Context);
+  ASSERT_TRUE(R != nullptr);
+  EXPECT_EQ(mlcompileropt::getKernelSignature(*R->getFunction("scale")), Signature);
+
+  mlcompileropt::TuningConfig Config;
+  Config.UnrollCount = 2;
+  Config.attachTo(*F);
+  EXPECT_EQ(mlcompileropt::getKernelSignature(*F), Signature);
+
+  std::string Changed = KernelIR;
+  Changed.replace(Changed.find("2.0"), 3, "3.0");
+  std::unique_ptr<llvm::Module> C = parse(Changed, Context);
+  ASSERT_TRUE(C != nullptr);
+  EXPECT_NE(mlcompileropt::getKernelSignature(*C->getFunction("scale")), Signature);
+}
+
+// Kernels that differ only in the row width of what they address get
+// different signatures, even when pointers do not carry the element type
+TEST(TuningDatabaseTest, KernelSignatureSeesRowWidth) {
+  const char *const RowIR = R"IR(
+define void @row(ptr noalias %a, ptr noalias %b, i64 %i) {
+entry:
+  %pa = getelementptr inbounds [64 x float], ptr %a, i64 %i, i64 1
+  %v = load float, ptr %pa, align 4
+  store float %v, ptr %b, align 4
+  ret void
+}
+)IR";
+  llvm::LLVMContext Context;
+#if LLVM_VERSION_MAJOR < 15
+  Context.enableOpaquePointers();
+#endif
+  std::unique_ptr<llvm::Module> M = parse(RowIR, Context);
+  ASSERT_TRUE(M != nullptr);
+  std::string Signature = mlcompileropt::getKernelSignature(*M->getFunction("row"));
+
+  std::string Wider = RowIR;
+  Wider.replace(Wider.find("64 x"), 2, "80");
+  std::unique_ptr<llvm::Module> W = parse(Wider, Context);
+  ASSERT_TRUE(W != nullptr);
+  EXPECT_NE(mlcompileropt::getKernelSignature(*W->getFunction("row")), Signature);
+
+  std::string Aligned = RowIR;
+  Aligned.replace(Aligned.rfind("align 4"), 7, "align 16");
+  std::unique_ptr<llvm::Module> A = parse(Aligned, Context);
+  ASSERT_TRUE(A != nullptr);
+  EXPECT_NE(mlcompileropt::getKernelSignature(*A->getFunction("row")), Signature);
+
+  std::string NotInBounds = RowIR;
+  NotInBounds.replace(NotInBounds.find("inbounds "), 9, "");
+  std::unique_ptr<llvm::Module> N = parse(NotInBounds, Context);
+  ASSERT_TRUE(N != nullptr);
+  EXPECT_NE(mlcompileropt::getKernelSignature(*N->getFunction("row")), Signature);
+}
+
+TEST(TuningDatabaseTest, SaveLoadAndApply) {
+  llvm::SmallString<128> Dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("tuning-db", Dir));
+  llvm::SmallString<128> Path(Dir);
+  llvm::sys::path::append(Path, "tuning.db");
+
+  // A missing file is an empty database
+  auto EmptyOrErr = mlcompileropt::TuningDatabase::load(Path);
+  ASSERT_TRUE(!!EmptyOrErr);
+  EXPECT_EQ(EmptyOrErr->size(), 0u);
+
+  llvm::LLVMContext Context;
+  std::unique_ptr<llvm::Module> M = parse(KernelIR, Context);
+  ASSERT_TRUE(M != nullptr);
+  llvm::Function *F = M->getFunction("scale");
+
+  mlcompileropt::TuningDatabase DB;
+  mlcompileropt::TuningDatabase::Entry E;
+  E.Config.UnrollCount = 4;
+  E.Config.VectorizeWidth = 1;
+  E.Time = 12.5;
+  DB.insert(mlcompileropt::getKernelSignature(*F), E);
+  ASSERT_FALSE(!!DB.save(Path));
+
+  auto LoadedOrErr = mlcompileropt::TuningDatabase::load(Path);
+  ASSERT_TRUE(!!LoadedOrErr);
+  EXPECT_EQ(LoadedOrErr->str(), DB.str());
+  EXPECT_EQ(LoadedOrErr->apply(*M), 1u);
+  llvm::Optional<mlcompileropt::TuningConfig> Attached =
+      mlcompileropt::TuningConfig::get(*F);
+  ASSERT_TRUE(Attached.hasValue());
+  EXPECT_EQ(Attached->toString(), "unroll=4,vectorize-width=1");
+
+  // The pipeline turns the configuration into loop hints: the loop stays
+  // scalar and is unrolled four times
+  mlcompileropt::OptimizationPipeline Pipeline;
+  Pipeline.run(*M);
+  unsigned NumLoads = 0;
+  for (llvm::BasicBlock &BB : *F)
+    for (llvm::Instruction &I : BB) {
+      EXPECT_FALSE(I.getType()->isVectorTy()) << "unexpected vector code";
+      NumLoads += llvm::isa<llvm::LoadInst>(I);
+    }
+  EXPECT_EQ(NumLoads, 4u);
+
+  llvm::sys::fs::remove_directories(Dir);
+}
+
+// Main function for the test
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,281 @@
+#include <gtest/gtest.h>
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Analysis/LoopAnalysisManager.h"
+#include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+
+#include "driver/TargetMachineCache.h"
+#include "passes/MemoryCoalescing.h"
+#include "passes/WarpTransactions.h"
+
+// Path to test files, provided by the build system
+#ifndef ML_TEST_FILES_DIR
+#define ML_TEST_FILES_DIR "test_files/"
+#endif
+const std::string TEST_FILES_DIR = ML_TEST_FILES_DIR;
+
+// Test fixture for the warp transaction model
+class WarpTransactionTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    Context = std::make_unique<llvm::LLVMContext>();
+  }
+
+  void TearDown() override {
+    // Cached results refer to the module, so drop them first
+    if (FAM)
+      FAM->clear();
+  }
+
+  bool parseIR(const std::string &IR) {
+    llvm::SMDiagnostic Err;
+    M = llvm::parseIR(llvm::MemoryBufferRef(IR, "testIR"), Err, *Context);
+    if (!M) {
+      Err.print("test", llvm::errs());
+      return false;
+    }
+    setUpAnalyses();
+    return true;
+  }
+
+  bool loadIRFile(const std::string &Filename) {
+    llvm::SMDiagnostic Err;
+    M = llvm::parseIRFile(Filename, Err, *Context);
+    if (!M) {
+      Err.print("test", llvm::errs());
+      return false;
+    }
+    setUpAnalyses();
+    return true;
+  }
+
+  // Registers the analyses; cost queries are answered for the module's
+  // target
+  void setUpAnalyses() {
+    PB = std::make_unique<llvm::PassBuilder>(
+        Targets.getTargetMachine(M->getTargetTriple()));
+    LAM = std::make_unique<llvm::LoopAnalysisManager>();
+    FAM = std::make_unique<llvm::FunctionAnalysisManager>();
+    CGAM = std::make_unique<llvm::CGSCCAnalysisManager>();
+    MAM = std::make_unique<llvm::ModuleAnalysisManager>();
+    PB->registerModuleAnalyses(*MAM);
+    PB->registerCGSCCAnalyses(*CGAM);
+    PB->registerFunctionAnalyses(*FAM);
+    mlcompileropt::registerMemoryCoalescingAnalyses(*FAM);
+    PB->registerLoopAnalyses(*LAM);
+    PB->crossRegisterProxies(*LAM, *FAM, *CGAM, *MAM);
+  }
+
+  const mlcompileropt::WarpTransactionInfo &analyze(llvm::Function &F) {
+    return FAM->getResult<mlcompileropt::WarpTransactionAnalysis>(F);
+  }
+
+  // Simulated requests of the first load (or store) through PtrName
+  const mlcompileropt::WarpAccess *findAccess(llvm::Function &F,
+                                              llvm::StringRef PtrName) {
+    for (const mlcompileropt::WarpAccess &A : analyze(F).accesses())
+      if (llvm::getLoadStorePointerOperand(A.I)->getName() == PtrName)
+        return &A;
+    return nullptr;
+  }
+
+  std::unique_ptr<llvm::LLVMContext> Context;
+  std::unique_ptr<llvm::Module> M;
+  mlcompileropt::TargetMachineCache Targets;
+
+  std::unique_ptr<llvm::PassBuilder> PB;
+  std::unique_ptr<llvm::LoopAnalysisManager> LAM;
+  std::unique_ptr<llvm::FunctionAnalysisManager> FAM;
+  std::unique_ptr<llvm::CGSCCAnalysisManager> CGAM;
+  std::unique_ptr<llvm::ModuleAnalysisManager> MAM;
+};
+
+// Indices of the 32, 64 and 128 byte segment sizes
+enum { Seg32, Seg64, Seg128 };
+
+// A warp of consecutive floats reads one aligned 128 byte line
+TEST_F(WarpTransactionTest, UnitStride) {
+  const char *IR = R"(
+    define void @f(float* %a, float* %b) {
+    entry:
+      br label %loop
+
+    loop:
+      %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+      %a.ptr = getelementptr inbounds float, float* %a, i64 %i
+      %v = load float, float* %a.ptr, align 4
+      %b.ptr = getelementptr inbounds float, float* %b, i64 %i
+      store float %v, float* %b.ptr, align 4
+      %i.next = add nuw nsw i64 %i, 1
+      %cond = icmp ult i64 %i.next, 1024
+      br i1 %cond, label %loop, label %exit
+
+    exit:
+      ret void
+    }
+  )";
+  ASSERT_TRUE(parseIR(IR));
+  llvm::Function &F = *M->getFunction("f");
+
+  const mlcompileropt::WarpAccess *Load = findAccess(F, "a.ptr");
+  ASSERT_NE(Load, nullptr);
+  EXPECT_EQ(Load->LaneStride, llvm::Optional<int64_t>(4));
+  EXPECT_EQ(Load->ThreadLoop->getHeader()->getName(), "loop");
+  EXPECT_EQ(Load->Stats.Requests, 4u);
+  EXPECT_DOUBLE_EQ(Load->Stats.getTransactionsPerRequest(Seg32), 4.0);
+  EXPECT_DOUBLE_EQ(Load->Stats.getTransactionsPerRequest(Seg64), 2.0);
+  EXPECT_DOUBLE_EQ(Load->Stats.getTransactionsPerRequest(Seg128), 1.0);
+  for (unsigned Size = 0; Size < mlcompileropt::NumWarpSegmentSizes; ++Size)
+    EXPECT_DOUBLE_EQ(Load->Stats.getEfficiency(Size), 1.0);
+
+  const mlcompileropt::WarpTransactionStats &Total = analyze(F).getTotal();
+  EXPECT_EQ(Total.Requests, 8u);
+  EXPECT_EQ(Total.RequestedBytes, 8u * 128);
+}
+
+// One element past the start of a line, a warp straddles two lines
+TEST_F(WarpTransactionTest, Misaligned) {
+  const char *IR = R"(
+    define void @f(float* %a) {
+    entry:
+      br label %loop
+
+    loop:
+      %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+      %idx = add nuw nsw i64 %i, 1
+      %a.ptr = getelementptr inbounds float, float* %a, i64 %idx
+      %v = load float, float* %a.ptr, align 4
+      %i.next = add nuw nsw i64 %i, 1
+      %cond = icmp ult i64 %i.next, 1024
+      br i1 %cond, label %loop, label %exit
+
+    exit:
+      ret void
+    }
+  )";
+  ASSERT_TRUE(parseIR(IR));
+  const mlcompileropt::WarpAccess *Load = findAccess(*M->getFunction("f"), "a.ptr");
+  ASSERT_NE(Load, nullptr);
+  EXPECT_DOUBLE_EQ(Load->Stats.getTransactionsPerRequest(Seg32), 5.0);
+  EXPECT_DOUBLE_EQ(Load->Stats.getTransactionsPerRequest(Seg64), 3.0);
+  EXPECT_DOUBLE_EQ(Load->Stats.getTransactionsPerRequest(Seg128), 2.0);
+  EXPECT_DOUBLE_EQ(Load->Stats.getEfficiency(Seg128), 0.5);
+}
+
+// A column walk touches one segment per lane; a loop invariant address is
+// a broadcast of one segment
+TEST_F(WarpTransactionTest, ColumnAndBroadcast) {
+  const char *IR = R"(
+    define void @f(float* %a, float* %s) {
+    entry:
+      br label %loop
+
+    loop:
+      %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+      %row = mul nuw nsw i64 %i, 1024
+      %a.ptr = getelementptr inbounds float, float* %a, i64 %row
+      %v = load float, float* %a.ptr, align 4
+      %s.ptr = getelementptr inbounds float, float* %s, i64 3
+      %w = load float, float* %s.ptr, align 4
+      %i.next = add nuw nsw i64 %i, 1
+      %cond = icmp ult i64 %i.next, 64
+      br i1 %cond, label %loop, label %exit
+
+    exit:
+      ret void
+    }
+  )";
+  ASSERT_TRUE(parseIR(IR));
+  llvm::Function &F = *M->getFunction("f");
+
+  const mlcompileropt::WarpAccess *Column = findAccess(F, "a.ptr");
+  ASSERT_NE(Column, nullptr);
+  EXPECT_EQ(Column->Stats.Requests, 2u);
+  EXPECT_DOUBLE_EQ(Column->Stats.getTransactionsPerRequest(Seg32), 32.0);
+  EXPECT_DOUBLE_EQ(Column->Stats.getTransactionsPerRequest(Seg128), 32.0);
+  EXPECT_DOUBLE_EQ(Column->Stats.getEfficiency(Seg32), 4.0 / 32);
+  EXPECT_DOUBLE_EQ(Column->Stats.getEfficiency(Seg128), 4.0 / 128);
+
+  const mlcompileropt::WarpAccess *Broadcast = findAccess(F, "s.ptr");
+  ASSERT_NE(Broadcast, nullptr);
+  EXPECT_EQ(Broadcast->LaneStride, llvm::Optional<int64_t>(0));
+  EXPECT_DOUBLE_EQ(Broadcast->Stats.getTransactionsPerRequest(Seg32), 1.0);
+  EXPECT_DOUBLE_EQ(Broadcast->Stats.getEfficiency(Seg32), 4.0 / 32);
+}
+
+// Lanes past the trip count of a short loop continue in the next iteration
+// of the loop around it; accesses to the stack are not simulated
+TEST_F(WarpTransactionTest, ShortLoopWraps) {
+  const char *IR = R"(
+    define void @f(float* %a) {
+    entry:
+      %tmp = alloca float, align 4
+      br label %outer
+
+    outer:
+      %i = phi i64 [ 0, %entry ], [ %i.next, %outer.latch ]
+      %row = mul nuw nsw i64 %i, 64
+      br label %inner
+
+    inner:
+      %j = phi i64 [ 0, %outer ], [ %j.next, %inner ]
+      %idx = add nuw nsw i64 %row, %j
+      %a.ptr = getelementptr inbounds float, float* %a, i64 %idx
+      %v = load float, float* %a.ptr, align 4
+      store float %v, float* %tmp, align 4
+      %j.next = add nuw nsw i64 %j, 1
+      %j.cond = icmp ult i64 %j.next, 8
+      br i1 %j.cond, label %inner, label %outer.latch
+
+    outer.latch:
+      %i.next = add nuw nsw i64 %i, 1
+      %i.cond = icmp ult i64 %i.next, 8
+      br i1 %i.cond, label %outer, label %exit
+
+    exit:
+      ret void
+    }
+  )";
+  ASSERT_TRUE(parseIR(IR));
+  llvm::Function &F = *M->getFunction("f");
+  ASSERT_EQ(analyze(F).accesses().size(), 1u);
+
+  // 8 rows of 8 floats: two full warps, each reading 32 bytes of 4 rows
+  const mlcompileropt::WarpAccess *Load = findAccess(F, "a.ptr");
+  ASSERT_NE(Load, nullptr);
+  EXPECT_EQ(Load->Stats.Requests, 2u);
+  EXPECT_DOUBLE_EQ(Load->Stats.getTransactionsPerRequest(Seg32), 4.0);
+  EXPECT_DOUBLE_EQ(Load->Stats.getTransactionsPerRequest(Seg128), 4.0);
+  EXPECT_DOUBLE_EQ(Load->Stats.getEfficiency(Seg32), 1.0);
+  EXPECT_DOUBLE_EQ(Load->Stats.getEfficiency(Seg128), 0.25);
+}
+
+// Interchanging the column walk turns one transaction per lane into one
+// line per warp
+TEST_F(WarpTransactionTest, CoalescingReducesTransactions) {
+  ASSERT_TRUE(loadIRFile(TEST_FILES_DIR + "strided_access.ll"));
+  llvm::Function &F = *M->getFunction("column_walk");
+
+  mlcompileropt::WarpTransactionStats Before = analyze(F).getTotal();
+  EXPECT_DOUBLE_EQ(Before.getTransactionsPerRequest(Seg128), 32.0);
+
+  mlcompileropt::MemoryCoalescingPass Pass;
+  FAM->invalidate(F, Pass.run(F, *FAM));
+
+  mlcompileropt::WarpTransactionStats After = analyze(F).getTotal();
+  EXPECT_EQ(After.Requests, Before.Requests);
+  EXPECT_DOUBLE_EQ(After.getTransactionsPerRequest(Seg128), 1.0);
+  EXPECT_DOUBLE_EQ(After.getEfficiency(Seg128), 1.0);
+}
+
+// Main function for the test
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}